@@ -22,6 +22,11 @@ struct nla_policy joolnl_instance_entry_policy[JNLAIE_COUNT] = {
 	},
 };
 
+struct nla_policy joolnl_stats_entry_policy[JNLASTE_COUNT] = {
+	[JNLASTE_INSTANCE] = { .type = NLA_NESTED },
+	[JNLASTE_STATS] = { .type = NLA_NESTED },
+};
+
 struct nla_policy joolnl_prefix6_policy[JNLAP_COUNT] = {
 	[JNLAP_ADDR] = JOOLNL_ADDR6_POLICY,
 	[JNLAP_LEN] = { .type = NLA_U8 },
@@ -57,6 +62,12 @@ struct nla_policy joolnl_pool4_entry_policy[JNLAP4_COUNT] = {
 	[JNLAP4_PORT_MAX] = { .type = NLA_U16 },
 };
 
+struct nla_policy joolnl_pool4_usage_policy[JNLAPU_COUNT] = {
+	[JNLAPU_ENTRY] = { .type = NLA_NESTED },
+	[JNLAPU_IN_USE] = { .type = NLA_U32 },
+	[JNLAPU_EXHAUSTIONS] = { .type = NLA_U32 },
+};
+
 struct nla_policy joolnl_bib_entry_policy[JNLAB_COUNT] = {
 	[JNLAB_SRC6] = { .type = NLA_NESTED },
 	[JNLAB_SRC4] = { .type = NLA_NESTED },
@@ -75,6 +86,30 @@ struct nla_policy joolnl_session_entry_policy[JNLASE_COUNT] = {
 	[JNLASE_EXPIRATION] = { .type = NLA_U32 },
 };
 
+struct nla_policy joolnl_query_policy[JNLAQ_COUNT] = {
+	[JNLAQ_SRC6] = { .type = NLA_NESTED },
+	[JNLAQ_SRC4] = { .type = NLA_NESTED },
+	[JNLAQ_SRC4_PORT_MIN] = { .type = NLA_U16 },
+	[JNLAQ_SRC4_PORT_MAX] = { .type = NLA_U16 },
+	[JNLAQ_DST4] = { .type = NLA_NESTED },
+	[JNLAQ_STATE] = { .type = NLA_U8 },
+	[JNLAQ_MIN_IDLE] = { .type = NLA_U32 },
+	[JNLAQ_MODE] = { .type = NLA_U8 },
+	[JNLAQ_TOP] = { .type = NLA_U32 },
+	[JNLAQ_SUBSCRIBER_LEN] = { .type = NLA_U8 },
+};
+
+struct nla_policy joolnl_query_result_policy[JNLAQR_COUNT] = {
+	[JNLAQR_MATCHES] = { .type = NLA_U32 },
+	[JNLAQR_SUBSCRIBERS] = { .type = NLA_U32 },
+	[JNLAQR_TOP] = { .type = NLA_NESTED },
+};
+
+struct nla_policy joolnl_query_top_policy[JNLAQT_COUNT] = {
+	[JNLAQT_SUBSCRIBER] = { .type = NLA_NESTED },
+	[JNLAQT_MATCHES] = { .type = NLA_U32 },
+};
+
 struct nla_policy siit_globals_policy[JNLAG_COUNT] = {
 	[JNLAG_ENABLED] = { .type = NLA_U8 },
 	[JNLAG_TRACE] = { .type = NLA_U8 },
@@ -83,6 +118,10 @@ struct nla_policy siit_globals_policy[JNLAG_COUNT] = {
 	[JNLAG_RESET_TOS] = { .type = NLA_U8 },
 	[JNLAG_TOS] = { .type = NLA_U8 },
 	[JNLAG_PLATEAUS] = { .type = NLA_NESTED },
+	[JNLAG_DIRECT_XMIT] = { .type = NLA_U8 },
+	[JNLAG_ICMP_ERROR_RATE] = { .type = NLA_U32 },
+	[JNLAG_LATENCY_HISTOGRAMS] = { .type = NLA_U8 },
+	[JNLAG_STATS_STREAM_INTERVAL] = { .type = NLA_U32 },
 	[JNLAG_COMPUTE_CSUM_ZERO] = { .type = NLA_U8 },
 	[JNLAG_HAIRPIN_MODE] = { .type = NLA_U8 },
 	[JNLAG_RANDOMIZE_ERROR_ADDR] = { .type = NLA_U8 },
@@ -98,6 +137,10 @@ struct nla_policy nat64_globals_policy[JNLAG_COUNT] = {
 	[JNLAG_RESET_TOS] = { .type = NLA_U8 },
 	[JNLAG_TOS] = { .type = NLA_U8 },
 	[JNLAG_PLATEAUS] = { .type = NLA_NESTED },
+	[JNLAG_DIRECT_XMIT] = { .type = NLA_U8 },
+	[JNLAG_ICMP_ERROR_RATE] = { .type = NLA_U32 },
+	[JNLAG_LATENCY_HISTOGRAMS] = { .type = NLA_U8 },
+	[JNLAG_STATS_STREAM_INTERVAL] = { .type = NLA_U32 },
 	[JNLAG_DROP_ICMP6_INFO] = { .type = NLA_U8 },
 	[JNLAG_SRC_ICMP6_BETTER] = { .type = NLA_U8 },
 	[JNLAG_F_ARGS] = { .type = NLA_U8 },
@@ -108,14 +151,18 @@ struct nla_policy nat64_globals_policy[JNLAG_COUNT] = {
 	[JNLAG_TTL_ICMP] = { .type = NLA_U32 },
 	[JNLAG_BIB_LOGGING] = { .type = NLA_U8 },
 	[JNLAG_SESSION_LOGGING] = { .type = NLA_U8 },
+	[JNLAG_LOGGING_STREAM] = { .type = NLA_U8 },
 	[JNLAG_DROP_BY_ADDR] = { .type = NLA_U8 },
 	[JNLAG_DROP_EXTERNAL_TCP] = { .type = NLA_U8 },
 	[JNLAG_MAX_STORED_PKTS] = { .type = NLA_U32 },
+	[JNLAG_TCP_OFFLOAD] = { .type = NLA_U8 },
 	[JNLAG_JOOLD_ENABLED] = { .type = NLA_U8 },
 	[JNLAG_JOOLD_FLUSH_ASAP] = { .type = NLA_U8 },
 	[JNLAG_JOOLD_FLUSH_DEADLINE] = { .type = NLA_U32 },
 	[JNLAG_JOOLD_CAPACITY] = { .type = NLA_U32 },
 	[JNLAG_JOOLD_MAX_PAYLOAD] = { .type = NLA_U32 },
+	[JNLAG_JOOLD_WINDOW] = { .type = NLA_U32 },
+	[JNLAG_JOOLD_ADVERTISE_RATE] = { .type = NLA_U32 },
 };
 
 int iname_validate(const char *iname, bool allow_null)
@@ -16,6 +16,8 @@
 
 #define JOOLNL_FAMILY "Jool"
 #define JOOLNL_MULTICAST_GRP_NAME "joold"
+#define JOOLNL_SLOG_GRP_NAME "session-log"
+#define JOOLNL_STATS_GRP_NAME "stats"
 
 enum joolnl_operation {
 	JNLOP_INSTANCE_FOREACH,
@@ -28,6 +30,8 @@ enum joolnl_operation {
 	JNLOP_ADDRESS_QUERY46,
 
 	JNLOP_STATS_FOREACH,
+	JNLOP_STATS_LATENCY,
+	JNLOP_STATS_DUMP,
 
 	JNLOP_GLOBAL_FOREACH,
 	JNLOP_GLOBAL_UPDATE,
@@ -46,12 +50,15 @@ enum joolnl_operation {
 	JNLOP_POOL4_ADD,
 	JNLOP_POOL4_RM,
 	JNLOP_POOL4_FLUSH,
+	JNLOP_POOL4_USAGE,
 
 	JNLOP_BIB_FOREACH,
 	JNLOP_BIB_ADD,
 	JNLOP_BIB_RM,
+	JNLOP_BIB_QUERY,
 
 	JNLOP_SESSION_FOREACH,
+	JNLOP_SESSION_QUERY,
 
 	JNLOP_FILE_HANDLE,
 
@@ -74,6 +81,18 @@ enum joolnl_attr_root {
 	JNLAR_PROTO,
 	JNLAR_ATOMIC_INIT,
 	JNLAR_ATOMIC_END,
+	JNLAR_SESSION_RECORDS,
+	JNLAR_JOOLD_SEQ,
+	JNLAR_SLOG_EVENTS,
+	JNLAR_QUERY,
+	JNLAR_QUERY_RESULT,
+	JNLAR_ATOMIC_DELTA,
+	JNLAR_ATOMIC_HOLD,
+	JNLAR_BL4_RM_ENTRIES,
+	JNLAR_EAMT_RM_ENTRIES,
+	JNLAR_POOL4_RM_ENTRIES,
+	JNLAR_STATS_DELTAS,
+	JNLAR_STATS_GAUGES,
 	JNLAR_COUNT,
 #define JNLAR_MAX (JNLAR_COUNT - 1)
 };
@@ -139,6 +158,18 @@ enum joolnl_attr_instance_entry {
 
 extern struct nla_policy joolnl_instance_entry_policy[JNLAIE_COUNT];
 
+/* One of the entries of a JNLOP_STATS_DUMP. */
+enum joolnl_attr_stats_entry {
+	/* Nested; see joolnl_attr_instance_entry. */
+	JNLASTE_INSTANCE = 1,
+	/* Nested; u64s whose types are enum jool_stat_id. */
+	JNLASTE_STATS,
+	JNLASTE_COUNT,
+#define JNLASTE_MAX (JNLASTE_COUNT - 1)
+};
+
+extern struct nla_policy joolnl_stats_entry_policy[JNLASTE_COUNT];
+
 enum joolnl_attr_instance_status {
 	JNLAIS_STATUS = 1,
 	JNLAIS_COUNT,
@@ -175,6 +206,18 @@ enum joolnl_attr_pool4 {
 
 extern struct nla_policy joolnl_pool4_entry_policy[JNLAP4_COUNT];
 
+/* See struct pool4_usage. */
+enum joolnl_attr_pool4_usage {
+	/* Nested; see joolnl_attr_pool4. */
+	JNLAPU_ENTRY = 1,
+	JNLAPU_IN_USE,
+	JNLAPU_EXHAUSTIONS,
+	JNLAPU_COUNT,
+#define JNLAPU_MAX (JNLAPU_COUNT - 1)
+};
+
+extern struct nla_policy joolnl_pool4_usage_policy[JNLAPU_COUNT];
+
 enum joolnl_attr_bib {
 	JNLAB_SRC6 = 1,
 	JNLAB_SRC4,
@@ -201,6 +244,45 @@ enum joolnl_attr_session {
 
 extern struct nla_policy joolnl_session_entry_policy[JNLASE_COUNT];
 
+/* See struct bib_query. */
+enum joolnl_attr_query {
+	JNLAQ_SRC6 = 1,
+	JNLAQ_SRC4,
+	JNLAQ_SRC4_PORT_MIN,
+	JNLAQ_SRC4_PORT_MAX,
+	JNLAQ_DST4,
+	JNLAQ_STATE,
+	JNLAQ_MIN_IDLE,
+	JNLAQ_MODE,
+	JNLAQ_TOP,
+	JNLAQ_SUBSCRIBER_LEN,
+	JNLAQ_COUNT,
+#define JNLAQ_MAX (JNLAQ_COUNT - 1)
+};
+
+extern struct nla_policy joolnl_query_policy[JNLAQ_COUNT];
+
+/* See struct bib_query_result. */
+enum joolnl_attr_query_result {
+	JNLAQR_MATCHES = 1,
+	JNLAQR_SUBSCRIBERS,
+	/* List (JNLAL_ENTRY) of joolnl_attr_query_top. */
+	JNLAQR_TOP,
+	JNLAQR_COUNT,
+#define JNLAQR_MAX (JNLAQR_COUNT - 1)
+};
+
+extern struct nla_policy joolnl_query_result_policy[JNLAQR_COUNT];
+
+enum joolnl_attr_query_top {
+	JNLAQT_SUBSCRIBER = 1,
+	JNLAQT_MATCHES,
+	JNLAQT_COUNT,
+#define JNLAQT_MAX (JNLAQT_COUNT - 1)
+};
+
+extern struct nla_policy joolnl_query_top_policy[JNLAQT_COUNT];
+
 enum joolnl_attr_address_query {
 	JNLAAQ_ADDR6 = 1,
 	JNLAAQ_ADDR4,
@@ -219,6 +301,10 @@ enum joolnl_attr_global {
 	JNLAG_RESET_TOS,
 	JNLAG_TOS,
 	JNLAG_PLATEAUS,
+	JNLAG_DIRECT_XMIT,
+	JNLAG_ICMP_ERROR_RATE,
+	JNLAG_LATENCY_HISTOGRAMS,
+	JNLAG_STATS_STREAM_INTERVAL,
 
 	/* SIIT */
 	JNLAG_COMPUTE_CSUM_ZERO,
@@ -240,7 +326,9 @@ enum joolnl_attr_global {
 	JNLAG_TTL_ICMP,
 	JNLAG_BIB_LOGGING,
 	JNLAG_SESSION_LOGGING,
+	JNLAG_LOGGING_STREAM,
 	JNLAG_MAX_STORED_PKTS,
+	JNLAG_TCP_OFFLOAD,
 
 	/* joold */
 	JNLAG_JOOLD_ENABLED,
@@ -248,6 +336,8 @@ enum joolnl_attr_global {
 	JNLAG_JOOLD_FLUSH_DEADLINE,
 	JNLAG_JOOLD_CAPACITY,
 	JNLAG_JOOLD_MAX_PAYLOAD,
+	JNLAG_JOOLD_WINDOW,
+	JNLAG_JOOLD_ADVERTISE_RATE,
 
 	/* Needs to be last */
 	JNLAG_COUNT,
@@ -355,6 +445,80 @@ struct pool4_update {
 	__u8 l4_proto;
 };
 
+/** How busy a pool4 entry is. (See `pool4 display --usage`.) */
+struct pool4_usage {
+	struct pool4_entry entry;
+	/**
+	 * Number of BIB entries whose IPv4 transport address belongs to
+	 * @entry's range. (Regardless of mark.)
+	 */
+	__u32 in_use;
+	/**
+	 * Port allocations that ran out of candidates in @entry's mark (and
+	 * protocol). Shared by all of the mark's entries.
+	 */
+	__u32 exhaustions;
+};
+
+enum bib_query_mode {
+	/** Return the matching entries themselves. (Normal foreach.) */
+	BQM_LIST,
+	/** Only count the matching entries. */
+	BQM_COUNT,
+	/** Count the matching entries, grouped by subscriber. */
+	BQM_TOP,
+};
+
+/**
+ * Filters (and aggregation) applied by the kernel module while it walks the
+ * BIB or session table, so userspace doesn't have to dump the whole thing to
+ * find a handful of entries.
+ *
+ * Every filter is optional. Entries need to match all of the ones that are
+ * set. @dst4, @state and @min_idle are ignored by BIB queries.
+ */
+struct bib_query {
+	/** The IPv6 node's address ("src6") must belong to this prefix. */
+	struct config_prefix6 src6;
+	/** The pool4 mask ("src4") must belong to this range. */
+	bool src4_set;
+	struct ipv4_range src4;
+	/** The IPv4 node's address ("dst4") must belong to this prefix. */
+	struct config_prefix4 dst4;
+	/** The TCP session must be in this state. */
+	bool state_set;
+	__u8 state; /* tcp_state */
+	/** The session must not have seen traffic for this many milliseconds. */
+	__u32 min_idle;
+
+	__u8 mode; /* enum bib_query_mode */
+	/** BQM_TOP: Number of subscribers to return. */
+	__u32 top;
+	/** BQM_TOP: Length of the src6 prefix that identifies a subscriber. */
+	__u8 subscriber_len;
+};
+
+/** Maximum bib_query.top. (It needs to fit in a single Netlink message.) */
+#define BIB_QUERY_MAX_TOP 64
+/** BQM_TOP gives up if it finds more than this many subscribers. */
+#define BIB_QUERY_MAX_SUBSCRIBERS 65536
+
+struct bib_query_top {
+	struct ipv6_prefix subscriber;
+	__u32 matches;
+};
+
+/** Response to a BQM_COUNT or BQM_TOP bib_query. */
+struct bib_query_result {
+	/** Number of entries that matched the filters. */
+	__u32 matches;
+	/** BQM_TOP: Number of distinct subscribers among the matches. */
+	__u32 subscribers;
+	/** BQM_TOP: The subscribers with the most matches, busiest first. */
+	unsigned int top_count;
+	struct bib_query_top top[BIB_QUERY_MAX_TOP];
+};
+
 enum address_translation_method {
 	AXM_RFC6052,
 	AXM_EAMT,
@@ -398,6 +562,11 @@ struct bib_config {
 
 	bool bib_logging;
 	bool session_logging;
+	/**
+	 * Send the two above to userspace (as binary Netlink multicasts)
+	 * instead of printk()ing them?
+	 */
+	bool logging_stream;
 
 	/** Use Address-Dependent Filtering? */
 	bool drop_by_addr;
@@ -405,10 +574,98 @@ struct bib_config {
 	bool drop_external_tcp;
 
 	__u32 max_stored_pkts;
+
+	/**
+	 * Let packets from established TCP connections skip Filtering and
+	 * Updating? (See db/bib/offload.h.)
+	 */
+	bool tcp_offload;
 };
 
 #define JOOLD_MAX_PAYLOAD 2048
 
+/*
+ * Compact joold wire format. (Payload of JNLAR_SESSION_RECORDS.)
+ *
+ * A joold_records_hdr, followed by @count joold_records. Each record is in
+ * turn followed by the session's IPv6 destination address if its
+ * JOOLD_RECORD_DST6 flag is set. Otherwise, the address is pool6 + dst4.
+ * Everything is in network byte order.
+ *
+ * The daemons forward this blob untouched, so the magic number also allows
+ * them to tell it apart from the old nested attributes
+ * (JNLAR_SESSION_ENTRIES): Read as the length of the first attribute, it is
+ * always larger than JOOLD_MAX_PAYLOAD.
+ */
+#define JOOLD_RECORDS_MAGIC 0x4a53 /* "JS" */
+#define JOOLD_RECORDS_VERSION 1
+
+struct joold_records_hdr {
+	__be16 magic;
+	__u8 version;
+	__u8 reserved1;
+	__be16 count;
+	__be16 reserved2;
+};
+
+/* joold_record.flags */
+#define JOOLD_RECORD_DST6 (1 << 0)
+
+struct joold_record {
+	struct in6_addr src6;
+	struct in_addr src4;
+	struct in_addr dst4;
+	__be16 src6_port;
+	__be16 dst6_port;
+	__be16 src4_port;
+	__be16 dst4_port;
+	__u8 proto;
+	__u8 state;
+	__u8 timer;
+	__u8 flags;
+	/**
+	 * Milliseconds the session has left, counted from the moment the
+	 * packet was built. (Nodes don't need synchronized clocks.)
+	 */
+	__be32 expiration;
+};
+
+/*
+ * Session log stream. (Payload of JNLAR_SLOG_EVENTS.)
+ *
+ * When logging-stream is enabled, the BIB and session logs are multicasted to
+ * the JOOLNL_SLOG_GRP_NAME group as arrays of these, instead of printk()ed.
+ * Consumers live in the same machine, so everything is in host byte order,
+ * except for the addresses.
+ *
+ * Batches are collected per CPU, so events are not guaranteed to arrive in
+ * chronological order. Sort by @time if you need to.
+ */
+enum slog_type {
+	/* A BIB entry (ie. a port) was allocated. Only src6 and src4 are set. */
+	SLOG_BIB_ADD = 1,
+	/* A BIB entry (ie. a port) was released. Only src6 and src4 are set. */
+	SLOG_BIB_RM,
+	SLOG_SESSION_ADD,
+	SLOG_SESSION_RM,
+};
+
+struct slog_event {
+	/** Nanoseconds since the epoch. */
+	__u64 time;
+	struct in6_addr src6;
+	struct in6_addr dst6;
+	struct in_addr src4;
+	struct in_addr dst4;
+	__u16 src6_port;
+	__u16 dst6_port;
+	__u16 src4_port;
+	__u16 dst4_port;
+	__u8 type; /* enum slog_type */
+	__u8 proto; /* l4_protocol */
+	__u8 reserved[6];
+};
+
 struct joold_config {
 	/** Is joold enabled on this Jool instance? */
 	bool enabled;
@@ -462,6 +719,22 @@ struct joold_config {
 	 * code. (I guess I'm missing something.)
 	 */
 	__u32 max_payload;
+
+	/**
+	 * Maximum number of packets that can be sent to joold without having
+	 * been ACKed yet.
+	 * Netlink is lossy, so we cannot just dump sessions on joold as fast
+	 * as they come. But waiting for an ACK after every packet ties sync
+	 * throughput to the round trip time.
+	 */
+	__u32 window;
+
+	/**
+	 * Maximum number of sessions per second an advertisement can send.
+	 * Keeps a full table dump from hogging the window that the live
+	 * updates also need. Zero means "only limited by @window."
+	 */
+	__u32 advertise_rate;
 };
 
 /**
@@ -510,6 +783,31 @@ struct jool_globals {
 	 */
 	struct mtu_plateaus plateaus;
 
+	/**
+	 * Send translated packets straight to the neighbour layer, instead of
+	 * dst_output()? (ie. skip LOCAL_OUT and POST_ROUTING.)
+	 */
+	bool direct_xmit;
+
+	/**
+	 * Maximum number of ICMP errors (per second) Jool will generate towards
+	 * a single source. (IPv6 sources are aggregated by /64.)
+	 * Zero means unlimited.
+	 */
+	__u32 icmp_error_rate;
+
+	/**
+	 * Measure how many CPU cycles each translation stage takes?
+	 * (See enum jool_stage.)
+	 */
+	bool latency_histograms;
+
+	/**
+	 * Milliseconds between stats deltas multicasted to the
+	 * JOOLNL_STATS_GRP_NAME group. Zero means don't stream them.
+	 */
+	__u32 stats_stream_interval;
+
 	union {
 		struct {
 			/**
@@ -43,6 +43,20 @@
 /** Default session lifetime for ICMP bindings, in seconds. */
 #define ICMP_DEFAULT (1 * 60)
 
+/**
+ * Seconds an established TCP session can be trusted by the offload table
+ * before its packets have to go through the session table again.
+ * (And therefore, maximum amount of time its update time can lag behind.)
+ */
+#define TCP_OFFLOAD_REFRESH (1)
+
+/**
+ * Seconds the fragment table remembers the tuple of a fragmented packet. (ie.
+ * how long we wait for its subsequent fragments.) RFC 6146 section 4 asks for
+ * at least two.
+ */
+#define FRAGMENT_TIMEOUT (2)
+
 /*
  * The timers will never sleep less than this amount of jiffies. This is because
  * I don't think we need to interrupt the kernel too much.
@@ -72,11 +86,17 @@
 #define DEFAULT_HANDLE_FIN_RCV_RST false
 #define DEFAULT_BIB_LOGGING false
 #define DEFAULT_SESSION_LOGGING false
+#define DEFAULT_LOGGING_STREAM false
+#define DEFAULT_TCP_OFFLOAD false
 
 #define DEFAULT_INSTANCE_ENABLED true
 #define DEFAULT_RESET_TRAFFIC_CLASS false
 #define DEFAULT_RESET_TOS false
 #define DEFAULT_NEW_TOS 0
+#define DEFAULT_DIRECT_XMIT false
+#define DEFAULT_ICMP_ERROR_RATE 0
+#define DEFAULT_LATENCY_HISTOGRAMS false
+#define DEFAULT_STATS_STREAM_INTERVAL 0
 #define DEFAULT_COMPUTE_UDP_CSUM0 false
 #define DEFAULT_EAM_HAIRPIN_MODE EHM_INTRINSIC
 #define DEFAULT_RANDOMIZE_RFC6791 true
@@ -88,10 +108,13 @@
 #define DEFAULT_JOOLD_CAPACITY 512
 /**
  * typical MTU minus max(20, 40) minus the UDP header. (1500 - 40 - 8)
- * There's a 16-bytes joold header and each session spans 64 bytes currently.
- * This means we can fit 22 sessions per packet. (Regardless of IPv4/IPv6)
+ * Minus the Netlink overhead and the 8-byte records header, each session
+ * spans 40 bytes (56 if pool6 can't infer its dst6), which means we can fit
+ * 35 sessions per packet. (Regardless of IPv4/IPv6)
  */
 #define DEFAULT_JOOLD_MAX_PAYLOAD 1452
+#define DEFAULT_JOOLD_WINDOW 8
+#define DEFAULT_JOOLD_ADVERTISE_RATE 10000
 
 /* -- IPv6 Pool -- */
 
@@ -808,6 +808,34 @@ static const struct joolnl_global_meta globals_metadata[] = {
 		.doc = "Set the list of plateaus for ICMPv4 Fragmentation Neededs with MTU unset.",
 		.offset = offsetof(struct jool_globals, plateaus),
 		.xt = XT_ANY,
+	}, {
+		.id = JNLAG_DIRECT_XMIT,
+		.name = "direct-xmit",
+		.type = &gt_bool,
+		.doc = "Send translated packets straight to the neighbour layer, skipping the LOCAL_OUT and POST_ROUTING hooks?",
+		.offset = offsetof(struct jool_globals, direct_xmit),
+		.xt = XT_ANY,
+	}, {
+		.id = JNLAG_ICMP_ERROR_RATE,
+		.name = "icmp-error-rate",
+		.type = &gt_uint32,
+		.doc = "Maximum number of ICMP errors Jool will send to a given source (or IPv6 /64) per second. Zero means unlimited.",
+		.offset = offsetof(struct jool_globals, icmp_error_rate),
+		.xt = XT_ANY,
+	}, {
+		.id = JNLAG_LATENCY_HISTOGRAMS,
+		.name = "latency-histograms",
+		.type = &gt_bool,
+		.doc = "Count the CPU cycles spent in each translation stage? (See 'stats latency'.)",
+		.offset = offsetof(struct jool_globals, latency_histograms),
+		.xt = XT_ANY,
+	}, {
+		.id = JNLAG_STATS_STREAM_INTERVAL,
+		.name = "stats-stream-interval",
+		.type = &gt_uint32,
+		.doc = "Milliseconds between the stats deltas multicasted to 'stats follow'. Zero disables the stream.",
+		.offset = offsetof(struct jool_globals, stats_stream_interval),
+		.xt = XT_ANY,
 	}, {
 		.id = JNLAG_COMPUTE_CSUM_ZERO,
 		.name = "amend-udp-checksum-zero",
@@ -953,6 +981,13 @@ static const struct joolnl_global_meta globals_metadata[] = {
 		.doc = "Log sessions as they are created and destroyed?",
 		.offset = offsetof(struct jool_globals, nat64.bib.session_logging),
 		.xt = XT_NAT64,
+	}, {
+		.id = JNLAG_LOGGING_STREAM,
+		.name = "logging-stream",
+		.type = &gt_bool,
+		.doc = "Send the BIB and session logs to 'jool session follow' instead of the kernel log?",
+		.offset = offsetof(struct jool_globals, nat64.bib.logging_stream),
+		.xt = XT_NAT64,
 	}, {
 		.id = JNLAG_MAX_STORED_PKTS,
 		.name = "maximum-simultaneous-opens",
@@ -960,6 +995,13 @@ static const struct joolnl_global_meta globals_metadata[] = {
 		.doc = "Set the maximum allowable 'simultaneous' Simultaneos Opens of TCP connections.",
 		.offset = offsetof(struct jool_globals, nat64.bib.max_stored_pkts),
 		.xt = XT_NAT64,
+	}, {
+		.id = JNLAG_TCP_OFFLOAD,
+		.name = "tcp-offload",
+		.type = &gt_bool,
+		.doc = "Let packets from established TCP connections skip the session table?",
+		.offset = offsetof(struct jool_globals, nat64.bib.tcp_offload),
+		.xt = XT_NAT64,
 	}, {
 		.id = JNLAG_JOOLD_ENABLED,
 		.name = "ss-enabled",
@@ -995,6 +1037,20 @@ static const struct joolnl_global_meta globals_metadata[] = {
 		.doc = "Maximum amount of bytes joold should send per packet.",
 		.offset = offsetof(struct jool_globals, nat64.joold.max_payload),
 		.xt = XT_NAT64,
+	}, {
+		.id = JNLAG_JOOLD_WINDOW,
+		.name = "ss-window",
+		.type = &gt_uint32,
+		.doc = "Maximum number of joold packets awaiting an ACK.",
+		.offset = offsetof(struct jool_globals, nat64.joold.window),
+		.xt = XT_NAT64,
+	}, {
+		.id = JNLAG_JOOLD_ADVERTISE_RATE,
+		.name = "ss-advertise-rate",
+		.type = &gt_uint32,
+		.doc = "Maximum sessions per second an advertisement can send. (0 = no limit)",
+		.offset = offsetof(struct jool_globals, nat64.joold.advertise_rate),
+		.xt = XT_NAT64,
 	},
 };
 
@@ -1,6 +1,12 @@
 #ifndef SRC_COMMON_STATS_H_
 #define SRC_COMMON_STATS_H_
 
+#ifdef __KERNEL__
+#include <linux/types.h>
+#else
+#include <stdbool.h>
+#endif
+
 /*
  * TODO (warning) Caller review needed.
  * Make sure there's a counter for every worthwhile event,
@@ -28,6 +34,7 @@ enum jool_stat_id {
 	JSTAT_L3HDR_OFFSET,
 	JSTAT_SKB_TRUNCATED,
 	JSTAT_FRAGMENTED_PING,
+	JSTAT_FRAG_NO_FIRST,
 	JSTAT_HDR6,
 	JSTAT_HDR4,
 
@@ -83,11 +90,42 @@ enum jool_stat_id {
 	JSTAT_FAILED_ROUTES,
 	JSTAT_PKT_TOO_BIG,
 	JSTAT_DST_OUTPUT,
+	JSTAT_NEIGH_XMIT,
+	JSTAT_NEIGH_XMIT_SENT,
+	JSTAT_NEIGH_XMIT_FALLBACK,
 
 	JSTAT_ICMP6ERR_SUCCESS,
 	JSTAT_ICMP6ERR_FAILURE,
+	JSTAT_ICMP6ERR_RATELIMITED,
 	JSTAT_ICMP4ERR_SUCCESS,
 	JSTAT_ICMP4ERR_FAILURE,
+	JSTAT_ICMP4ERR_RATELIMITED,
+
+	JSTAT_TCP_OFFLOADED,
+
+	JSTAT_JOOLD_IN_FLIGHT,
+	JSTAT_JOOLD_QUEUED,
+	JSTAT_JOOLD_DROPPED,
+	JSTAT_JOOLD_ADV_SENT,
+	JSTAT_JOOLD_ADV_TOTAL,
+
+	JSTAT_SLOG_DROPPED,
+
+	JSTAT_POOL4_EXHAUSTED,
+	/*
+	 * Histogram of the pool4 candidates tried by successful port
+	 * allocations. (See jstat_pool4_iterations().) Bucket i counts the
+	 * allocations that needed (4^(i-1), 4^i] tries; the last one also
+	 * swallows everything above.
+	 */
+	JSTAT_POOL4_ITER_1,
+	JSTAT_POOL4_ITER_4,
+	JSTAT_POOL4_ITER_16,
+	JSTAT_POOL4_ITER_64,
+	JSTAT_POOL4_ITER_256,
+	JSTAT_POOL4_ITER_1024,
+	JSTAT_POOL4_ITER_4096,
+	JSTAT_POOL4_ITER_MORE,
 
 	/* These 3 need to be last, and in this order. */
 	JSTAT_UNKNOWN, /* "WTF was that" errors only. */
@@ -96,4 +134,53 @@ enum jool_stat_id {
 #define JSTAT_MAX (JSTAT_COUNT - 1)
 };
 
+#define JSTAT_POOL4_ITER_BUCKETS \
+	(JSTAT_POOL4_ITER_MORE - JSTAT_POOL4_ITER_1 + 1)
+
+/**
+ * Is @stat a gauge? (ie. it goes up and down, so only its current value is
+ * meaningful.) Everything else is a monotonic counter.
+ */
+static inline bool jstat_is_gauge(enum jool_stat_id stat)
+{
+	switch (stat) {
+	case JSTAT_BIB_ENTRIES:
+	case JSTAT_SESSIONS:
+	case JSTAT_JOOLD_IN_FLIGHT:
+	case JSTAT_JOOLD_QUEUED:
+	case JSTAT_JOOLD_ADV_SENT:
+	case JSTAT_JOOLD_ADV_TOTAL:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/**
+ * Translation stages timed by the latency histograms.
+ * (See the latency-histograms global.)
+ *
+ * NOTE THAT ANY MODIFICATIONS MADE TO THIS STRUCTURE NEED TO BE CASCADED TO
+ * jstage_metadatas.
+ */
+enum jool_stage {
+	JSTAGE_IN_TUPLE,
+	JSTAGE_FILTERING,
+	JSTAGE_OUT_TUPLE,
+	JSTAGE_TRANSLATE,
+	JSTAGE_SEND,
+	JSTAGE_COUNT,
+};
+
+/*
+ * Buckets per histogram. Bucket 0 counts the runs that took zero cycles, and
+ * bucket i > 0 counts the ones that took [2^(i-1), 2^i) cycles. The last
+ * bucket also swallows everything above.
+ *
+ * On Netlink, stage s travels as a nested attribute of type s + 1, and bucket i
+ * as a u64 attribute of type i + 1 inside of it.
+ */
+#define JSTAGE_BUCKETS 32
+#define JSTAGE_PADDING (JSTAGE_BUCKETS + 1)
+
 #endif /* SRC_COMMON_STATS_H_ */
@@ -7,8 +7,8 @@
 #include "mod/common/nl/attribute.h"
 #include "mod/common/nl/global.h"
 #include "mod/common/nl/nl_common.h"
+#include "mod/common/db/blacklist4.h"
 #include "mod/common/db/eam.h"
-#include "mod/common/db/pool.h"
 #include "mod/common/joold.h"
 #include "mod/common/db/pool4/db.h"
 #include "mod/common/db/bib/db.h"
@@ -24,10 +24,26 @@
  * "configuration candidate") as Netlink messages arrive. The running
  * configuration is then only replaced when the candidate has been completed and
  * validated.
+ *
+ * A candidate can also be a "delta": Instead of starting empty, it starts as a
+ * shallow copy of the running instance, and its tables are only duplicated
+ * once the transaction actually modifies them. (Copy-on-write.) This way,
+ * changing one global or a handful of EAMs doesn't rebuild every table.
  */
 struct config_candidate {
 	struct xlator xlator;
 
+	/** Did this candidate start as a copy of the running instance? */
+	bool delta;
+	/**
+	 * Tables that belong to @xlator alone. (CLONED_* flags.)
+	 * The rest are still shared with the running instance, so they must not
+	 * be modified.
+	 */
+	unsigned int cloned;
+	/** Is this candidate waiting to be committed along with another one? */
+	bool held;
+
 	/** Last jiffy the user made an edit. */
 	unsigned long update_time;
 	/** Process ID of the client that is populating this candidate. */
@@ -36,6 +52,11 @@ struct config_candidate {
 	struct list_head list_hook;
 };
 
+#define CLONED_EAMT		(1 << 0)
+#define CLONED_BLACKLIST4	(1 << 1)
+#define CLONED_POOL4		(1 << 2)
+#define CLONED_ALL		(CLONED_EAMT | CLONED_BLACKLIST4 | CLONED_POOL4)
+
 /**
  * We'll purge candidates after they've been inactive for this long.
  * This is because otherwise we depend on userspace sending us a commit at some
@@ -43,6 +64,13 @@ struct config_candidate {
  */
 #define TIMEOUT msecs_to_jiffies(2000)
 
+/*
+ * Static BIB entries are added this many at a time. (See
+ * bib_add_static_batch().) Bounds the time the BIB spends locked, and the
+ * memory handle_bib() needs.
+ */
+#define BIB_BATCH_SIZE 64
+
 static LIST_HEAD(db);
 static DEFINE_MUTEX(lock);
 
@@ -133,8 +161,22 @@ static int get_candidate(char *iname, struct config_candidate **result)
 	return -ESRCH;
 }
 
+/* Drops whatever transaction the client left unfinished on @iname. */
+static void destroy_stale_candidate(struct net *ns, char *iname)
+{
+	struct config_candidate *candidate;
+	struct config_candidate *tmp;
+
+	list_for_each_entry_safe(candidate, tmp, &db, list_hook) {
+		if ((candidate->xlator.ns == ns)
+				&& (strcmp(candidate->xlator.iname, iname) == 0)
+				&& (candidate->pid == task_pid_nr(current)))
+			candidate_destroy(candidate);
+	}
+}
+
 static int handle_init(struct config_candidate **out, struct nlattr *attr,
-		char *iname, xlator_type xt)
+		char *iname, xlator_type xt, bool delta)
 {
 	struct config_candidate *candidate;
 	struct net *ns;
@@ -148,18 +190,33 @@ static int handle_init(struct config_candidate **out, struct nlattr *attr,
 		return PTR_ERR(ns);
 	}
 
+	destroy_stale_candidate(ns, iname);
+
 	candidate = wkmalloc(struct config_candidate, GFP_KERNEL);
 	if (!candidate) {
 		error = -ENOMEM;
 		goto end;
 	}
 
-	error = xlator_init(&candidate->xlator, ns, iname, nla_get_u8(attr) | xt,
-			NULL);
+	if (delta) {
+		error = xlator_find(ns, nla_get_u8(attr) | xt, iname,
+				&candidate->xlator);
+		if (error == -ESRCH)
+			log_err("Instance '%s' does not exist, so there's nothing to apply the changes to.",
+					iname);
+		candidate->delta = true;
+		candidate->cloned = 0;
+	} else {
+		error = xlator_init(&candidate->xlator, ns, iname,
+				nla_get_u8(attr) | xt, NULL);
+		candidate->delta = false;
+		candidate->cloned = CLONED_ALL;
+	}
 	if (error) {
 		wkfree(struct config_candidate, candidate);
 		goto end;
 	}
+	candidate->held = false;
 	candidate->update_time = jiffies;
 	candidate->pid = task_pid_nr(current);
 	list_add(&candidate->list_hook, &db);
@@ -170,6 +227,54 @@ end:	put_net(ns);
 	return error;
 }
 
+static int cow_eamt(struct config_candidate *candidate)
+{
+	struct eam_table *clone;
+
+	if (candidate->cloned & CLONED_EAMT)
+		return 0;
+
+	clone = eamt_clone(candidate->xlator.siit.eamt);
+	if (!clone)
+		return -ENOMEM;
+	eamt_put(candidate->xlator.siit.eamt);
+	candidate->xlator.siit.eamt = clone;
+	candidate->cloned |= CLONED_EAMT;
+	return 0;
+}
+
+static int cow_blacklist4(struct config_candidate *candidate)
+{
+	struct addr4_pool *clone;
+
+	if (candidate->cloned & CLONED_BLACKLIST4)
+		return 0;
+
+	clone = blacklist4_clone(candidate->xlator.siit.blacklist4);
+	if (!clone)
+		return -ENOMEM;
+	blacklist4_put(candidate->xlator.siit.blacklist4);
+	candidate->xlator.siit.blacklist4 = clone;
+	candidate->cloned |= CLONED_BLACKLIST4;
+	return 0;
+}
+
+static int cow_pool4(struct config_candidate *candidate)
+{
+	struct pool4 *clone;
+
+	if (candidate->cloned & CLONED_POOL4)
+		return 0;
+
+	clone = pool4db_clone(candidate->xlator.nat64.pool4);
+	if (!clone)
+		return -ENOMEM;
+	pool4db_put(candidate->xlator.nat64.pool4);
+	candidate->xlator.nat64.pool4 = clone;
+	candidate->cloned |= CLONED_POOL4;
+	return 0;
+}
+
 static int handle_global(struct config_candidate *new, struct nlattr *attr,
 		joolnlhdr_flags flags)
 {
@@ -194,6 +299,10 @@ static int handle_eamt(struct config_candidate *new, struct nlattr *root,
 		return -EINVAL;
 	}
 
+	error = cow_eamt(new);
+	if (error)
+		return error;
+
 	nla_for_each_nested(attr, root, rem) {
 		if (nla_type(attr) != JNLAL_ENTRY)
 			continue; /* ? */
@@ -208,6 +317,39 @@ static int handle_eamt(struct config_candidate *new, struct nlattr *root,
 	return 0;
 }
 
+static int handle_eamt_rm(struct config_candidate *new, struct nlattr *root)
+{
+	struct nlattr *attr;
+	struct eamt_entry entry;
+	int rem;
+	int error;
+
+	log_debug("Handling atomic EAMT removal attribute.");
+
+	if (xlator_is_nat64(&new->xlator)) {
+		log_err("Stateful NAT64 doesn't have an EAMT.");
+		return -EINVAL;
+	}
+
+	error = cow_eamt(new);
+	if (error)
+		return error;
+
+	nla_for_each_nested(attr, root, rem) {
+		if (nla_type(attr) != JNLAL_ENTRY)
+			continue; /* ? */
+		error = jnla_get_eam(attr, "EAMT entry", &entry);
+		if (error)
+			return error;
+		error = eamt_rm(new->xlator.siit.eamt, &entry.prefix6,
+				&entry.prefix4);
+		if (error)
+			return error;
+	}
+
+	return 0;
+}
+
 static int handle_blacklist4(struct config_candidate *new, struct nlattr *root,
 		bool force)
 {
@@ -223,6 +365,10 @@ static int handle_blacklist4(struct config_candidate *new, struct nlattr *root,
 		return -EINVAL;
 	}
 
+	error = cow_blacklist4(new);
+	if (error)
+		return error;
+
 	nla_for_each_nested(attr, root, rem) {
 		if (nla_type(attr) != JNLAL_ENTRY)
 			continue; /* ? */
@@ -237,6 +383,39 @@ static int handle_blacklist4(struct config_candidate *new, struct nlattr *root,
 	return 0;
 }
 
+static int handle_blacklist4_rm(struct config_candidate *new,
+		struct nlattr *root)
+{
+	struct nlattr *attr;
+	struct ipv4_prefix entry;
+	int rem;
+	int error;
+
+	log_debug("Handling atomic blacklist4 removal attribute.");
+
+	if (xlator_is_nat64(&new->xlator)) {
+		log_err("Stateful NAT64 doesn't have blacklist4.");
+		return -EINVAL;
+	}
+
+	error = cow_blacklist4(new);
+	if (error)
+		return error;
+
+	nla_for_each_nested(attr, root, rem) {
+		if (nla_type(attr) != JNLAL_ENTRY)
+			continue; /* ? */
+		error = jnla_get_prefix4(attr, "IPv4 blacklist entry", &entry);
+		if (error)
+			return error;
+		error = blacklist4_rm(new->xlator.siit.blacklist4, &entry);
+		if (error)
+			return error;
+	}
+
+	return 0;
+}
+
 static int handle_pool4(struct config_candidate *new, struct nlattr *root)
 {
 	struct nlattr *attr;
@@ -251,6 +430,10 @@ static int handle_pool4(struct config_candidate *new, struct nlattr *root)
 		return -EINVAL;
 	}
 
+	error = cow_pool4(new);
+	if (error)
+		return error;
+
 	nla_for_each_nested(attr, root, rem) {
 		if (nla_type(attr) != JNLAL_ENTRY)
 			continue; /* ? */
@@ -265,27 +448,35 @@ static int handle_pool4(struct config_candidate *new, struct nlattr *root)
 	return 0;
 }
 
-static int handle_bib(struct config_candidate *new, struct nlattr *root)
+/*
+ * Note: The BIB entries that were using the removed addresses are not touched.
+ * They will time out normally, as if the removal had been --quick.
+ */
+static int handle_pool4_rm(struct config_candidate *new, struct nlattr *root)
 {
 	struct nlattr *attr;
-	struct bib_entry entry;
+	struct pool4_entry entry;
 	int rem;
 	int error;
 
-	log_debug("Handling atomic BIB attribute.");
+	log_debug("Handling atomic pool4 removal attribute.");
 
 	if (xlator_is_siit(&new->xlator)) {
-		log_err("SIIT doesn't have BIBs.");
+		log_err("SIIT doesn't have pool4.");
 		return -EINVAL;
 	}
 
+	error = cow_pool4(new);
+	if (error)
+		return error;
+
 	nla_for_each_nested(attr, root, rem) {
 		if (nla_type(attr) != JNLAL_ENTRY)
 			continue; /* ? */
-		error = jnla_get_bib(attr, "BIB entry", &entry);
+		error = jnla_get_pool4(attr, "pool4 entry", &entry);
 		if (error)
 			return error;
-		error = bib_add_static(&new->xlator, &entry);
+		error = pool4db_rm_usr(new->xlator.nat64.pool4, &entry);
 		if (error)
 			return error;
 	}
@@ -293,27 +484,142 @@ static int handle_bib(struct config_candidate *new, struct nlattr *root)
 	return 0;
 }
 
-static int commit(struct config_candidate *candidate)
+static int handle_bib(struct config_candidate *new, struct nlattr *root)
 {
+	struct nlattr *attr;
+	struct bib_entry *entries;
+	unsigned int count;
+	int rem;
+	int error;
+
+	log_debug("Handling atomic BIB attribute.");
+
+	if (xlator_is_siit(&new->xlator)) {
+		log_err("SIIT doesn't have BIBs.");
+		return -EINVAL;
+	}
+	if (new->delta) {
+		/* The BIB is never cloned, so this would skip the commit. */
+		log_err("Incremental transactions cannot include BIB entries. Please use the bib mode instead.");
+		return -EINVAL;
+	}
+
+	entries = kmalloc_array(BIB_BATCH_SIZE, sizeof(*entries), GFP_KERNEL);
+	if (!entries)
+		return -ENOMEM;
+
+	count = 0;
+	nla_for_each_nested(attr, root, rem) {
+		if (nla_type(attr) != JNLAL_ENTRY)
+			continue; /* ? */
+		error = jnla_get_bib(attr, "BIB entry", &entries[count]);
+		if (error)
+			goto end;
+
+		if (++count == BIB_BATCH_SIZE) {
+			error = bib_add_static_batch(&new->xlator, entries,
+					count);
+			if (error)
+				goto end;
+			count = 0;
+		}
+	}
+
+	error = count ? bib_add_static_batch(&new->xlator, entries, count) : 0;
+	/* Fall through */
+
+end:
+	kfree(entries);
+	return error;
+}
+
+/*
+ * Moves @candidate, along with the candidates the same client held earlier, to
+ * @batch. Returns the number of candidates moved.
+ */
+static unsigned int detach_batch(struct config_candidate *candidate,
+		struct list_head *batch)
+{
+	struct config_candidate *cursor;
+	struct config_candidate *tmp;
+	unsigned int count = 1;
+
+	list_move_tail(&candidate->list_hook, batch);
+	list_for_each_entry_safe(cursor, tmp, &db, list_hook) {
+		if (cursor->held && (cursor->pid == candidate->pid)
+				&& (cursor->xlator.ns == candidate->xlator.ns)) {
+			list_move_tail(&cursor->list_hook, batch);
+			count++;
+		}
+	}
+
+	return count;
+}
+
+static void destroy_batch(struct list_head *batch)
+{
+	struct config_candidate *candidate;
+	struct config_candidate *tmp;
+
+	list_for_each_entry_safe(candidate, tmp, batch, list_hook)
+		candidate_destroy(candidate);
+}
+
+/*
+ * Commits every candidate in @batch (all of them or none of them), then
+ * destroys them.
+ */
+static int commit(struct list_head *batch, unsigned int count)
+{
+	struct config_candidate *candidate;
+	struct xlator **jools;
+	unsigned int i;
 	int error;
 
 	log_debug("Handling atomic END attribute.");
 
-	error = xlator_replace(&candidate->xlator);
+	jools = __wkmalloc("atomic config batch", count * sizeof(*jools),
+			GFP_KERNEL);
+	if (!jools) {
+		error = -ENOMEM;
+		goto end;
+	}
+
+	i = 0;
+	list_for_each_entry(candidate, batch, list_hook)
+		jools[i++] = &candidate->xlator;
+
+	error = xlator_replace_batch(jools, count);
+	__wkfree("atomic config batch", jools);
 	if (error) {
-		log_err("xlator_replace() failed. Errcode %d", error);
-		return error;
+		log_err("xlator_replace_batch() failed. Errcode %d", error);
+		goto end;
 	}
 
-	candidate_destroy(candidate);
 	log_debug("The atomic configuration transaction was a success.");
-	return 0;
+	/* Fall through */
+
+end:
+	destroy_batch(batch);
+	return error;
+}
+
+/* Keeps the client's held candidates from expiring while it's still busy. */
+static void touch_candidates(pid_t pid)
+{
+	struct config_candidate *candidate;
+
+	list_for_each_entry(candidate, &db, list_hook)
+		if (candidate->pid == pid)
+			candidate->update_time = jiffies;
 }
 
 int atomconfig_add(struct sk_buff *skb, struct genl_info *info)
 {
 	struct config_candidate *candidate = NULL;
 	struct joolnlhdr *jhdr;
+	LIST_HEAD(batch);
+	unsigned int count;
 	int error;
 
 	jhdr = get_jool_hdr(info);
@@ -326,7 +632,7 @@ int atomconfig_add(struct sk_buff *skb, struct genl_info *info)
 	mutex_lock(&lock);
 
 	error = info->attrs[JNLAR_ATOMIC_INIT]
-			? handle_init(&candidate, info->attrs[JNLAR_ATOMIC_INIT], jhdr->iname, jhdr->xt)
+			? handle_init(&candidate, info->attrs[JNLAR_ATOMIC_INIT], jhdr->iname, jhdr->xt, !!info->attrs[JNLAR_ATOMIC_DELTA])
 			: get_candidate(jhdr->iname, &candidate);
 	if (error)
 		goto end;
@@ -336,16 +642,31 @@ int atomconfig_add(struct sk_buff *skb, struct genl_info *info)
 		if (error)
 			goto revert;
 	}
+	if (info->attrs[JNLAR_BL4_RM_ENTRIES]) {
+		error = handle_blacklist4_rm(candidate, info->attrs[JNLAR_BL4_RM_ENTRIES]);
+		if (error)
+			goto revert;
+	}
 	if (info->attrs[JNLAR_BL4_ENTRIES]) {
 		error = handle_blacklist4(candidate, info->attrs[JNLAR_BL4_ENTRIES], jhdr->flags & JOOLNLHDR_FLAGS_FORCE);
 		if (error)
 			goto revert;
 	}
+	if (info->attrs[JNLAR_EAMT_RM_ENTRIES]) {
+		error = handle_eamt_rm(candidate, info->attrs[JNLAR_EAMT_RM_ENTRIES]);
+		if (error)
+			goto revert;
+	}
 	if (info->attrs[JNLAR_EAMT_ENTRIES]) {
 		error = handle_eamt(candidate, info->attrs[JNLAR_EAMT_ENTRIES], jhdr->flags & JOOLNLHDR_FLAGS_FORCE);
 		if (error)
 			goto revert;
 	}
+	if (info->attrs[JNLAR_POOL4_RM_ENTRIES]) {
+		error = handle_pool4_rm(candidate, info->attrs[JNLAR_POOL4_RM_ENTRIES]);
+		if (error)
+			goto revert;
+	}
 	if (info->attrs[JNLAR_POOL4_ENTRIES]) {
 		error = handle_pool4(candidate, info->attrs[JNLAR_POOL4_ENTRIES]);
 		if (error)
@@ -357,16 +678,22 @@ int atomconfig_add(struct sk_buff *skb, struct genl_info *info)
 			goto revert;
 	}
 	if (info->attrs[JNLAR_ATOMIC_END]) {
-		error = commit(candidate);
-		if (error)
-			goto revert;
+		if (!info->attrs[JNLAR_ATOMIC_HOLD]) {
+			count = detach_batch(candidate, &batch);
+			mutex_unlock(&lock);
+			/* (Don't hold up other transactions during the RCU sync.) */
+			return commit(&batch, count);
+		}
+		candidate->held = true;
 	}
 
-	candidate->update_time = jiffies;
+	touch_candidates(candidate->pid);
 	goto end;
 
 revert:
-	candidate_destroy(candidate);
+	/* The candidates held before this one are part of the same transaction. */
+	detach_batch(candidate, &batch);
+	destroy_batch(&batch);
 end:
 	mutex_unlock(&lock);
 	return error;
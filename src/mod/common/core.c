@@ -3,6 +3,7 @@
 #include "common/config.h"
 #include "mod/common/log.h"
 #include "mod/common/trace.h"
+#include "mod/common/tracepoint.h"
 #include "mod/common/translation_state.h"
 #include "mod/common/xlator.h"
 #include "mod/common/rfc7915/core.h"
@@ -25,32 +26,66 @@ static verdict validate_xlator(struct xlation *state)
 	return VERDICT_CONTINUE;
 }
 
+static verdict send_or_hairpin(struct xlation *state)
+{
+	verdict result;
+
+	if (state->jool.is_hairpin(state)) {
+		result = state->jool.handling_hairpinning(state);
+		kfree_skb(state->out.skb); /* Put this inside of hh()? */
+	} else {
+		result = sendpkt_send(state);
+		/* sendpkt_send() releases out's skb regardless of verdict. */
+	}
+
+	return result;
+}
+
+/*
+ * Runs @stage, feeds its duration to the latency histograms if the user wants
+ * them, and reports its verdict to the tracepoint if anyone is listening.
+ */
+static verdict run_stage(struct xlation *state, enum jool_stage id,
+		verdict (*stage)(struct xlation *))
+{
+	cycles_t start;
+	verdict result;
+
+	if (!state->jool.globals.latency_histograms) {
+		result = stage(state);
+	} else {
+		start = get_cycles();
+		result = stage(state);
+		jstat_latency(state->jool.stats, id, get_cycles() - start);
+	}
+
+	trace_jool_stage(state, id, result);
+	return result;
+}
+
 static verdict core_common(struct xlation *state)
 {
 	verdict result;
 
 	if (xlation_is_nat64(state)) {
-		result = determine_in_tuple(state);
+		result = run_stage(state, JSTAGE_IN_TUPLE, determine_in_tuple);
 		if (result != VERDICT_CONTINUE)
 			return result;
-		result = filtering_and_updating(state);
-		if (result != VERDICT_CONTINUE)
-			return result;
-		result = compute_out_tuple(state);
+		if (!filtering_offloaded(state)) {
+			result = run_stage(state, JSTAGE_FILTERING,
+					filtering_and_updating);
+			if (result != VERDICT_CONTINUE)
+				return result;
+		}
+		result = run_stage(state, JSTAGE_OUT_TUPLE, compute_out_tuple);
 		if (result != VERDICT_CONTINUE)
 			return result;
 	}
-	result = translating_the_packet(state);
+	result = run_stage(state, JSTAGE_TRANSLATE, translating_the_packet);
 	if (result != VERDICT_CONTINUE)
 		return result;
 
-	if (state->jool.is_hairpin(state)) {
-		result = state->jool.handling_hairpinning(state);
-		kfree_skb(state->out.skb); /* Put this inside of hh()? */
-	} else {
-		result = sendpkt_send(state);
-		/* sendpkt_send() releases out's skb regardless of verdict. */
-	}
+	result = run_stage(state, JSTAGE_SEND, send_or_hairpin);
 	if (result != VERDICT_CONTINUE)
 		return result;
 
@@ -75,6 +110,12 @@ static void send_icmp4_error(struct xlation *state, verdict result)
 		return;
 	if (result == VERDICT_UNTRANSLATABLE)
 		return; /* Linux will decide what to do. */
+	/* PMTUD needs every Fragmentation Needed, so they're never limited. */
+	if (state->result.icmp != ICMPERR_FRAG_NEEDED
+			&& !icmp64_allow(&state->jool, state->in.skb)) {
+		jstat_inc(state->jool.stats, JSTAT_ICMP4ERR_RATELIMITED);
+		return;
+	}
 
 	success = icmp64_send4(state->in.skb,
 			state->result.icmp,
@@ -128,6 +169,12 @@ static void send_icmp6_error(struct xlation *state, verdict result)
 		return;
 	if (result == VERDICT_UNTRANSLATABLE)
 		return; /* Linux will decide what to do. */
+	/* PMTUD needs every Packet Too Big, so they're never limited. */
+	if (state->result.icmp != ICMPERR_FRAG_NEEDED
+			&& !icmp64_allow(&state->jool, state->in.skb)) {
+		jstat_inc(state->jool.stats, JSTAT_ICMP6ERR_RATELIMITED);
+		return;
+	}
 
 	success = icmp64_send6(state->in.skb,
 			state->result.icmp,
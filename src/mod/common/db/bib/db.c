@@ -2,19 +2,30 @@
 
 #include <net/ip6_checksum.h>
 #include <linux/ktime.h>
+#include <linux/sort.h>
 
 #include "common/constants.h"
 #include "mod/common/icmp_wrapper.h"
 #include "mod/common/linux_version.h"
 #include "mod/common/log.h"
 #include "mod/common/route.h"
+#include "mod/common/session_log.h"
+#include "mod/common/tracepoint.h"
 #include "mod/common/wkmalloc.h"
 #include "mod/common/db/rbtree.h"
+#include "mod/common/db/bib/frag.h"
+#include "mod/common/db/bib/offload.h"
 #include "mod/common/db/bib/pkt_queue.h"
 
 #define XGLOBALS(xlator) (xlator->globals.nat64.bib)
 #define GLOBALS(state) (state->jool.globals.nat64.bib)
 
+/*
+ * Stored packets don't have an expiration list of their own, so the tables
+ * that hold them need to be cleaned at least this often.
+ */
+#define PKTQUEUE_CLEAN_PERIOD msecs_to_jiffies(2000)
+
 /*
  * TODO (performance) Maybe pack this?
  */
@@ -173,6 +184,11 @@ struct bib {
 	/** The session table for ICMP conversations. */
 	struct bib_table icmp;
 
+	/** Established TCP sessions packets can take shortcuts through. */
+	struct offload_table *offload;
+	/** Tuples of fragmented packets whose fragments are still arriving. */
+	struct frag_table *frags;
+
 	struct kref refs;
 };
 
@@ -344,6 +360,9 @@ void bib_teardown(void)
 	bib_cache = NULL;
 	kmem_cache_destroy(session_cache);
 	session_cache = NULL;
+
+	/* Wait for the offload table's pending frees. */
+	rcu_barrier();
 }
 
 static enum session_fate just_die(struct session_entry *session, void *arg)
@@ -404,10 +423,22 @@ struct bib *bib_alloc(void)
 	if (!db->tcp.pkt_queue)
 		goto pktqueue_alloc_fail;
 
+	db->offload = offload_alloc();
+	if (!db->offload)
+		goto offload_alloc_fail;
+
+	db->frags = frag_alloc();
+	if (!db->frags)
+		goto frag_alloc_fail;
+
 	kref_init(&db->refs);
 
 	return db;
 
+frag_alloc_fail:
+	offload_release(db->offload);
+offload_alloc_fail:
+	pktqueue_release(db->tcp.pkt_queue);
 pktqueue_alloc_fail:
 	wkfree(struct bib, db);
 db_alloc_fail:
@@ -462,6 +493,8 @@ static void bib_release(struct kref *refs)
 	rbtree_clear(&db->icmp.tree4, release_bib_entry, NULL);
 
 	pktqueue_release(db->tcp.pkt_queue);
+	offload_release(db->offload);
+	frag_release(db->frags);
 
 	wkfree(struct bib, db);
 }
@@ -471,7 +504,24 @@ void bib_put(struct bib *db)
 	kref_put(&db->refs, bib_release);
 }
 
-static void log_bib(struct xlator *jool, struct tabled_bib *bib, char *action)
+static void stream_bib(struct xlator *jool, struct tabled_bib *bib,
+		enum slog_type type)
+{
+	struct slog_event event;
+
+	memset(&event, 0, sizeof(event));
+	event.src6 = bib->src6.l3;
+	event.src4 = bib->src4.l3;
+	event.src6_port = bib->src6.l4;
+	event.src4_port = bib->src4.l4;
+	event.type = type;
+	event.proto = bib->proto;
+
+	slog_add(jool, &event);
+}
+
+static void log_bib(struct xlator *jool, struct tabled_bib *bib,
+		enum slog_type type, char *action)
 {
 #if LINUX_VERSION_AT_LEAST(4, 8, 0, 9999, 0)
 	time64_t tsec;
@@ -482,6 +532,10 @@ static void log_bib(struct xlator *jool, struct tabled_bib *bib, char *action)
 
 	if (!jool->globals.nat64.bib.bib_logging)
 		return;
+	if (jool->globals.nat64.bib.logging_stream) {
+		stream_bib(jool, bib, type);
+		return;
+	}
 
 #if LINUX_VERSION_AT_LEAST(4, 8, 0, 9999, 0)
 	tsec = ktime_get_real_seconds();
@@ -501,12 +555,33 @@ static void log_bib(struct xlator *jool, struct tabled_bib *bib, char *action)
 
 static void log_new_bib(struct xlator *jool, struct tabled_bib *bib)
 {
-	return log_bib(jool, bib, "Mapped");
+	return log_bib(jool, bib, SLOG_BIB_ADD, "Mapped");
+}
+
+static void stream_session(struct xlator *jool,
+		struct tabled_session *session,
+		enum slog_type type)
+{
+	struct slog_event event;
+
+	memset(&event, 0, sizeof(event));
+	event.src6 = session->bib->src6.l3;
+	event.dst6 = session->dst6.l3;
+	event.src4 = session->bib->src4.l3;
+	event.dst4 = session->dst4.l3;
+	event.src6_port = session->bib->src6.l4;
+	event.dst6_port = session->dst6.l4;
+	event.src4_port = session->bib->src4.l4;
+	event.dst4_port = session->dst4.l4;
+	event.type = type;
+	event.proto = session->bib->proto;
+
+	slog_add(jool, &event);
 }
 
 static void log_session(struct xlator *jool,
 		struct tabled_session *session,
-		char *action)
+		enum slog_type type, char *action)
 {
 #if LINUX_VERSION_AT_LEAST(4, 8, 0, 9999, 0)
 	time64_t tsec;
@@ -517,6 +592,10 @@ static void log_session(struct xlator *jool,
 
 	if (!jool->globals.nat64.bib.session_logging)
 		return;
+	if (jool->globals.nat64.bib.logging_stream) {
+		stream_session(jool, session, type);
+		return;
+	}
 
 #if LINUX_VERSION_AT_LEAST(4, 8, 0, 9999, 0)
 	tsec = ktime_get_real_seconds();
@@ -538,7 +617,11 @@ static void log_session(struct xlator *jool,
 
 static void log_new_session(struct xlator *jool, struct tabled_session *session)
 {
-	return log_session(jool, session, "Added session");
+	trace_jool_session_create(jool->iname,
+			&session->bib->src6, &session->dst6,
+			&session->bib->src4, &session->dst4,
+			session->bib->proto, session->state);
+	return log_session(jool, session, SLOG_SESSION_ADD, "Added session");
 }
 
 /**
@@ -605,14 +688,16 @@ static void rm(struct xlator *jool,
 
 	rb_erase(&session->tree_hook, &bib->sessions);
 	list_del(&session->list_hook);
-	log_session(jool, session, "Forgot session");
+	if (bib->proto == L4PROTO_TCP)
+		offload_rm(jool->nat64.bib->offload, &bib->src6, &session->dst6);
+	log_session(jool, session, SLOG_SESSION_RM, "Forgot session");
 	free_session(session);
 	jstat_dec(jool->stats, JSTAT_SESSIONS);
 
 	if (!bib->is_static && RB_EMPTY_ROOT(&bib->sessions)) {
 		rb_erase(&bib->hook6, &table->tree6);
 		rb_erase(&bib->hook4, &table->tree4);
-		log_bib(jool, bib, "Forgot");
+		log_bib(jool, bib, SLOG_BIB_RM, "Forgot");
 		free_bib(bib);
 		jstat_dec(jool->stats, JSTAT_BIB_ENTRIES);
 	}
@@ -703,6 +788,8 @@ static bool decide_fate(struct xlator *jool,
 
 	case FATE_PROBE:
 		/* TODO ICMP errors aren't supposed to drop down to TRANS. */
+		trace_jool_session_probe(jool->iname, &tmp.src6, &tmp.dst6,
+				&tmp.src4, &tmp.dst4, tmp.proto, tmp.state);
 		handle_probe(table, probes, session, &tmp);
 		/* Fall through. */
 	case FATE_TIMER_TRANS:
@@ -710,6 +797,8 @@ static bool decide_fate(struct xlator *jool,
 		break;
 
 	case FATE_RM:
+		trace_jool_session_expire(jool->iname, &tmp.src6, &tmp.dst6,
+				&tmp.src4, &tmp.dst4, tmp.proto, tmp.state);
 		rm(jool, table, probes, session, &tmp);
 		break;
 
@@ -1287,6 +1376,7 @@ static int find_available_mask(struct bib_table *table,
 		struct tree_slot *slot)
 {
 	struct tabled_bib *collision = NULL;
+	unsigned int attempts = 0;
 	bool consecutive;
 	int error;
 
@@ -1309,11 +1399,15 @@ static int find_available_mask(struct bib_table *table,
 		collision = consecutive
 				? try_next(table, collision, bib, slot)
 				: find_bibtree4_slot(table, bib, slot);
+		if (collision)
+			attempts++;
 
 	} while (collision);
 
 end:
 	mask_domain_commit(masks);
+	trace_jool_pool4_alloc(&bib->src6, &bib->src4, bib->proto, attempts,
+			error);
 	return error;
 }
 
@@ -1557,6 +1651,9 @@ static int find_bib_session6(struct xlator *jool,
 			return error;
 		}
 
+		jstat_pool4_iterations(jool->stats,
+				mask_domain_get_iterations(masks));
+
 		if (new->bib->proto == L4PROTO_ICMP)
 			new->session->dst4.l4 = new->bib->src4.l4;
 
@@ -1746,7 +1843,13 @@ verdict bib_add_tcp6(struct xlation *state,
 	table = &state->jool.nat64.bib->tcp;
 	spin_lock_bh(&table->lock);
 
-	if (find_bib_session6(&state->jool, table, masks, &new, &old, &slots, &bdl)) {
+	switch (find_bib_session6(&state->jool, table, masks, &new, &old, &slots, &bdl)) {
+	case 0:
+		break;
+	case -ENOENT:
+		result = drop(state, JSTAT_POOL4_EXHAUSTED);
+		goto end;
+	default:
 		result = drop(state, JSTAT_UNKNOWN);
 		goto end;
 	}
@@ -1945,6 +2048,53 @@ int bib_find(struct bib *db, struct tuple *tuple, struct bib_session *result)
 	return 0;
 }
 
+/**
+ * Like bib_find(), except it only looks in the offload table, and therefore
+ * also fills in @result's session.
+ */
+int bib_offload_find(struct bib *db, struct tuple *tuple,
+		struct bib_session *result)
+{
+	return offload_find(db->offload, tuple, result);
+}
+
+void bib_offload_add(struct bib *db, struct session_entry *session)
+{
+	int error;
+
+	error = offload_add(db->offload, session);
+	if (error)
+		log_debug("Could not offload the session; errcode %d.", error);
+}
+
+void bib_offload_rm(struct bib *db, struct session_entry *session)
+{
+	offload_rm(db->offload, &session->src6, &session->dst6);
+}
+
+/**
+ * Finds the tuple of the first fragment of @pkt's packet. (@pkt is a
+ * subsequent fragment.)
+ */
+int bib_frag_find(struct bib *db, struct packet *pkt, struct tuple *result)
+{
+	return frag_find(db->frags, pkt, result);
+}
+
+/**
+ * Remembers @pkt's tuple, so its subsequent fragments can be translated later.
+ * (@pkt is a first fragment.)
+ */
+void bib_frag_add(struct bib *db, struct packet *pkt)
+{
+	int error;
+
+	error = frag_add(db->frags, pkt);
+	if (error)
+		log_debug("Could not remember the fragment's tuple; errcode %d.",
+				error);
+}
+
 int bib_add_session(struct xlator *jool,
 		struct session_entry *session,
 		struct collision_cb *cb)
@@ -1982,6 +2132,11 @@ int bib_add_session(struct xlator *jool,
 end:
 	spin_unlock_bh(&table->lock);
 
+	/* The peer knows better; don't let packets skip its update. */
+	if (session->proto == L4PROTO_TCP)
+		offload_rm(jool->nat64.bib->offload, &session->src6,
+				&session->dst6);
+
 	if (new.bib)
 		free_bib(new.bib);
 	if (new.session)
@@ -1991,6 +2146,174 @@ end:
 	return error;
 }
 
+/*
+ * Maximum number of sessions bib_add_sessions() adds per lock acquisition.
+ * (Also the size of an on-stack array, so don't go overboard.)
+ */
+#define BIB_ADD_BATCH 32
+
+struct sync_collision {
+	struct session_entry *new;
+	bool updated;
+};
+
+static enum session_fate sync_collision_cb(struct session_entry *old,
+		void *arg)
+{
+	struct sync_collision *collision = arg;
+	struct session_entry *new = collision->new;
+
+	if (session_equals(old, new)) { /* It's the same session; update it. */
+		old->state = new->state;
+		old->timer_type = new->timer_type;
+		old->update_time = new->update_time;
+		collision->updated = true;
+		return FATE_TIMER_SLOW;
+	}
+
+	log_debug("Incoming %s session entry %pI6c#%u|%pI6c#%u|%pI4#%u|%pI4#%u collides with DB entry %pI6c#%u|%pI6c#%u|%pI4#%u|%pI4#%u.",
+			l4proto_to_string(new->proto),
+			&new->src6.l3, new->src6.l4,
+			&new->dst6.l3, new->dst6.l4,
+			&new->src4.l3, new->src4.l4,
+			&new->dst4.l3, new->dst4.l4,
+			&old->src6.l3, old->src6.l4,
+			&old->dst6.l3, old->dst6.l4,
+			&old->src4.l3, old->src4.l4,
+			&old->dst4.l3, old->dst4.l4);
+	collision->updated = false;
+	return FATE_PRESERVE;
+}
+
+/*
+ * Groups the sessions by table, and sorts them by BIB entry within each table,
+ * so consecutive insertions walk similar tree paths.
+ */
+static int compare_sync_sessions(const void *a, const void *b)
+{
+	struct session_entry const *s1 = a;
+	struct session_entry const *s2 = b;
+	int gap;
+
+	gap = s1->proto - s2->proto;
+	if (gap)
+		return gap;
+	gap = taddr6_compare(&s1->src6, &s2->src6);
+	if (gap)
+		return gap;
+	return taddr6_compare(&s1->dst6, &s2->dst6);
+}
+
+/* All of @sessions are assumed to belong to @table. */
+static void add_session_batch(struct xlator *jool, struct bib_table *table,
+		struct session_entry *sessions, unsigned int count,
+		struct bib_add_summary *summary)
+{
+	struct bib_session_tuple new[BIB_ADD_BATCH];
+	struct bib_session_tuple old;
+	struct slot_group slots;
+	struct bib_delete_list bdl = { NULL };
+	struct sync_collision collision;
+	struct collision_cb cb;
+	unsigned int i;
+	int error;
+
+	/* Allocate before locking; there's no point in holding it for this. */
+	for (i = 0; i < count; i++) {
+		if (create_bib_session(&sessions[i], &new[i])) {
+			new[i].bib = NULL;
+			new[i].session = NULL;
+		}
+	}
+
+	cb.cb = sync_collision_cb;
+	cb.arg = &collision;
+
+	spin_lock_bh(&table->lock);
+
+	for (i = 0; i < count; i++) {
+		if (!new[i].session) {
+			summary->failed++;
+			continue;
+		}
+
+		error = find_bib_session6(jool, table, NULL, &new[i], &old,
+				&slots, &bdl);
+		if (error) {
+			summary->failed++;
+			continue;
+		}
+
+		if (old.session) {
+			collision.new = &sessions[i];
+			/* There's no packet; ignore the verdict. */
+			decide_fate(jool, &cb, table, old.session, NULL);
+			if (collision.updated)
+				summary->updated++;
+			else
+				summary->collisions++;
+			continue;
+		}
+
+		error = commit_add(jool, table, &old, &new[i], &slots,
+				sessions[i].timer_type);
+		if (error)
+			summary->failed++;
+		else
+			summary->added++;
+	}
+
+	spin_unlock_bh(&table->lock);
+
+	for (i = 0; i < count; i++) {
+		/* The peer knows better; don't let packets skip its update. */
+		if (sessions[i].proto == L4PROTO_TCP)
+			offload_rm(jool->nat64.bib->offload, &sessions[i].src6,
+					&sessions[i].dst6);
+		if (new[i].bib)
+			free_bib(new[i].bib);
+		if (new[i].session)
+			free_session(new[i].session);
+	}
+	commit_delete_list(&bdl);
+}
+
+/**
+ * Adds a bunch of sessions (which normally come from a peer NAT64) to the
+ * database.
+ *
+ * Unlike bib_add_session(), this takes each table's lock once per batch of
+ * sessions, instead of once per session. Sessions that already exist are
+ * refreshed; sessions that collide with different sessions are left alone.
+ *
+ * @sessions will be reordered. The results are accumulated in @summary, which
+ * the caller is expected to have initialized.
+ */
+void bib_add_sessions(struct xlator *jool, struct session_entry *sessions,
+		unsigned int count, struct bib_add_summary *summary)
+{
+	struct bib_table *table;
+	unsigned int first, last;
+
+	sort(sessions, count, sizeof(*sessions), compare_sync_sessions, NULL);
+
+	for (first = 0; first < count; first = last) {
+		table = get_table(jool->nat64.bib, sessions[first].proto);
+		for (last = first + 1; last < count; last++) {
+			if (sessions[last].proto != sessions[first].proto)
+				break;
+			if (last - first == BIB_ADD_BATCH)
+				break;
+		}
+
+		if (table)
+			add_session_batch(jool, table, &sessions[first],
+					last - first, summary);
+		else
+			summary->failed += last - first;
+	}
+}
+
 static void __clean(struct xlator *jool,
 		struct expire_timer *expirer,
 		struct bib_table *table,
@@ -2016,10 +2339,31 @@ static void __clean(struct xlator *jool,
 	}
 }
 
-static void clean_table(struct xlator *jool, struct bib_table *table)
+/*
+ * Returns the number of jiffies until @expirer's oldest session expires, or
+ * MAX_JIFFY_OFFSET if it has no sessions.
+ * Assumes the table's lock is held.
+ */
+static unsigned long time_to_expire(struct xlator *jool,
+		struct expire_timer *expirer)
+{
+	struct tabled_session *session;
+	unsigned long expiration;
+
+	if (list_empty(&expirer->sessions))
+		return MAX_JIFFY_OFFSET;
+
+	session = list_first_entry(&expirer->sessions, struct tabled_session,
+			list_hook);
+	expiration = session->update_time + get_timeout(jool, expirer);
+	return time_before(jiffies, expiration) ? (expiration - jiffies) : 0;
+}
+
+static unsigned long clean_table(struct xlator *jool, struct bib_table *table)
 {
 	LIST_HEAD(probes);
 	LIST_HEAD(icmps);
+	unsigned long next;
 
 	spin_lock_bh(&table->lock);
 	__clean(jool, &table->est_timer, table, &probes);
@@ -2029,21 +2373,38 @@ static void clean_table(struct xlator *jool, struct bib_table *table)
 		table->pkt_count -= pktqueue_prepare_clean(table->pkt_queue,
 				&icmps);
 	}
+
+	next = time_to_expire(jool, &table->est_timer);
+	next = min(next, time_to_expire(jool, &table->trans_timer));
+	next = min(next, time_to_expire(jool, &table->syn4_timer));
+	if (table->pkt_count)
+		next = min(next, PKTQUEUE_CLEAN_PERIOD);
 	spin_unlock_bh(&table->lock);
 
 	post_fate(jool->ns, &probes);
 	pktqueue_clean(&icmps);
+	return next;
 }
 
 /**
  * Forgets or downgrades (from EST to TRANS) old sessions.
+ *
+ * Returns the number of jiffies until the BIB will need to be cleaned again, or
+ * MAX_JIFFY_OFFSET if it's empty. (New sessions might shorten this, of course.)
  */
-void bib_clean(struct xlator *jool)
+unsigned long bib_clean(struct xlator *jool)
 {
 	struct bib *db = jool->nat64.bib;
-	clean_table(jool, &db->udp);
-	clean_table(jool, &db->tcp);
-	clean_table(jool, &db->icmp);
+	unsigned long next;
+
+	next = clean_table(jool, &db->udp);
+	next = min(next, clean_table(jool, &db->tcp));
+	next = min(next, clean_table(jool, &db->icmp));
+	offload_clean(db->offload);
+	if (frag_clean(db->frags))
+		next = min(next, msecs_to_jiffies(1000 * FRAGMENT_TIMEOUT));
+
+	return next;
 }
 
 static struct rb_node *find_starting_point(struct bib_table *table,
@@ -2076,30 +2437,67 @@ static struct rb_node *find_starting_point(struct bib_table *table,
 	return (compare_src4(bib, offset) < 0) ? rb_next(parent) : parent;
 }
 
+/*
+ * The foreaches copy the entries in chunks of this size, and only hold the
+ * table's lock while copying. The callbacks (which are usually slow, because
+ * they serialize) run unlocked, so dumping a huge table doesn't starve the
+ * packet path.
+ */
+#define FOREACH_CHUNK 64
+
+/*
+ * Iterates over @proto's BIB entries, starting from the one that follows
+ * @offset (or from the beginning, if @offset is NULL).
+ *
+ * Stops as soon as @cb returns nonzero, and returns that.
+ * Must be called in process context. The table is not locked during @cb, so
+ * this is not an atomic snapshot; entries added or removed concurrently might
+ * or might not be seen.
+ */
 int bib_foreach(struct bib *db, l4_protocol proto,
 		bib_foreach_entry_cb cb, void *cb_arg,
 		const struct ipv4_transport_addr *offset)
 {
 	struct bib_table *table;
 	struct rb_node *node;
-	struct tabled_bib *tabled;
-	struct bib_entry bib;
+	struct bib_entry *chunk;
+	struct ipv4_transport_addr cursor;
+	unsigned int count, i;
 	int error = 0;
 
 	table = get_table(db, proto);
 	if (!table)
 		return -EINVAL;
 
-	spin_lock_bh(&table->lock);
+	chunk = __wkmalloc("bib foreach chunk",
+			FOREACH_CHUNK * sizeof(struct bib_entry), GFP_KERNEL);
+	if (!chunk)
+		return -ENOMEM;
 
-	node = find_starting_point(table, offset, false);
-	for (; node && !error; node = rb_next(node)) {
-		tabled = bib4_entry(node);
-		tbtobe(tabled, &bib);
-		error = cb(&bib, cb_arg);
-	}
+	do {
+		spin_lock_bh(&table->lock);
+		node = find_starting_point(table, offset, false);
+		for (count = 0; node && count < FOREACH_CHUNK; count++) {
+			tbtobe(bib4_entry(node), &chunk[count]);
+			node = rb_next(node);
+		}
+		spin_unlock_bh(&table->lock);
 
-	spin_unlock_bh(&table->lock);
+		for (i = 0; i < count; i++) {
+			error = cb(&chunk[i], cb_arg);
+			if (error)
+				goto end;
+		}
+
+		if (count) {
+			cursor = chunk[count - 1].addr4;
+			offset = &cursor;
+		}
+		cond_resched();
+	} while (node);
+
+end:
+	__wkfree("bib foreach chunk", chunk);
 	return error;
 }
 
@@ -2180,19 +2578,21 @@ static void find_session_offset(struct bib_table *table,
 				node; \
 				node = node2session(rb_next(&node->tree_hook)))
 
-int bib_foreach_session(struct xlator *jool, l4_protocol proto,
-		session_foreach_entry_cb cb, void *cb_arg,
-		struct session_foreach_offset *offset)
+/*
+ * Copies up to FOREACH_CHUNK sessions to @chunk, starting from @offset.
+ * Returns the number of sessions copied. Sets @more if there are sessions
+ * left after them.
+ */
+static unsigned int copy_session_chunk(struct xlator *jool,
+		struct bib_table *table,
+		struct session_foreach_offset *offset,
+		struct session_entry *chunk,
+		bool *more)
 {
-	struct bib_table *table;
 	struct bib_session_tuple pos;
-	struct session_entry tmp;
-	int error = 0;
-
-	table = get_table(jool->nat64.bib, proto);
-	if (!table)
-		return -EINVAL;
+	unsigned int count = 0;
 
+	*more = false;
 	spin_lock_bh(&table->lock);
 
 	if (offset) {
@@ -2207,15 +2607,66 @@ int bib_foreach_session(struct xlator *jool, l4_protocol proto,
 
 	foreach_bib(table, pos.bib) {
 goto_bib:	foreach_session(&pos.bib->sessions, pos.session) {
-goto_session:		tstose(jool, pos.session, &tmp);
-			error = cb(&tmp, cb_arg);
-			if (error)
+goto_session:		if (count == FOREACH_CHUNK) {
+				*more = true;
 				goto end;
+			}
+			tstose(jool, pos.session, &chunk[count++]);
 		}
 	}
 
 end:
 	spin_unlock_bh(&table->lock);
+	return count;
+}
+
+/*
+ * Iterates over @proto's sessions, starting from @offset (or from the
+ * beginning, if @offset is NULL).
+ *
+ * Same rules as bib_foreach(): Stops as soon as @cb returns nonzero, process
+ * context only, and @cb runs unlocked.
+ */
+int bib_foreach_session(struct xlator *jool, l4_protocol proto,
+		session_foreach_entry_cb cb, void *cb_arg,
+		struct session_foreach_offset *offset)
+{
+	struct bib_table *table;
+	struct session_entry *chunk;
+	struct session_foreach_offset cursor;
+	unsigned int count, i;
+	bool more;
+	int error = 0;
+
+	table = get_table(jool->nat64.bib, proto);
+	if (!table)
+		return -EINVAL;
+
+	chunk = __wkmalloc("session foreach chunk",
+			FOREACH_CHUNK * sizeof(struct session_entry), GFP_KERNEL);
+	if (!chunk)
+		return -ENOMEM;
+
+	do {
+		count = copy_session_chunk(jool, table, offset, chunk, &more);
+
+		for (i = 0; i < count; i++) {
+			error = cb(&chunk[i], cb_arg);
+			if (error)
+				goto end;
+		}
+
+		if (count) {
+			cursor.offset.src = chunk[count - 1].src4;
+			cursor.offset.dst = chunk[count - 1].dst4;
+			cursor.include_offset = false;
+			offset = &cursor;
+		}
+		cond_resched();
+	} while (more);
+
+end:
+	__wkfree("session foreach chunk", chunk);
 	return error;
 }
 
@@ -2262,6 +2713,46 @@ int bib_find4(struct bib *db, l4_protocol proto,
 	return bib ? 0 : -ESRCH;
 }
 
+/*
+ * Returns the number of @proto BIB entries whose IPv4 transport address
+ * belongs to @range. (ie. how many of @range's transport addresses are in use.)
+ *
+ * The table is only locked while counting one address, so the walk never
+ * exceeds 65536 entries per lock.
+ */
+int bib_count_range(struct bib *db, l4_protocol proto,
+		struct ipv4_range const *range, __u32 *result)
+{
+	struct bib_table *table;
+	struct rb_node *node;
+	struct tabled_bib *bib;
+	struct ipv4_transport_addr first;
+	u64 tmp;
+
+	table = get_table(db, proto);
+	if (!table)
+		return -EINVAL;
+
+	*result = 0;
+	first.l4 = range->ports.min;
+	foreach_addr4(first.l3, tmp, &range->prefix) {
+		spin_lock_bh(&table->lock);
+		node = find_starting_point(table, &first, true);
+		for (; node; node = rb_next(node)) {
+			bib = bib4_entry(node);
+			if (bib->src4.l3.s_addr != first.l3.s_addr)
+				break;
+			if (bib->src4.l4 > range->ports.max)
+				break;
+			(*result)++;
+		}
+		spin_unlock_bh(&table->lock);
+		cond_resched();
+	}
+
+	return 0;
+}
+
 static void bib2tabled(struct bib_entry *bib, struct tabled_bib *tabled)
 {
 	tabled->src6 = bib->addr6;
@@ -2271,34 +2762,26 @@ static void bib2tabled(struct bib_entry *bib, struct tabled_bib *tabled)
 	tabled->sessions = RB_ROOT;
 }
 
-static int __bib_add_static(struct xlator *jool, struct bib_entry *new,
-		struct bib_entry *old)
+/*
+ * Requires @table's lock.
+ *
+ * Returns 0 if @bib was added (in which case @table now owns it), 1 if an
+ * identical dynamic entry was upgraded to static instead, and -EEXIST (with
+ * the culprit in @old) if @bib collides with some other entry.
+ */
+static int add_static_locked(struct xlator *jool, struct bib_table *table,
+		struct tabled_bib *bib, struct bib_entry *old)
 {
-	struct bib_table *table;
-	struct tabled_bib *bib;
 	struct tabled_bib *collision;
 	struct tree_slot slot6;
 	struct tree_slot slot4;
 
-	log_debug("Adding static BIB entry (%pI6c#%u, %pI4#%u).",
-			&new->addr6.l3, new->addr6.l4,
-			&new->addr4.l3, new->addr4.l4);
-
-	table = get_table(jool->nat64.bib, new->l4_proto);
-	if (!table)
-		return -EINVAL;
-
-	bib = alloc_bib(GFP_ATOMIC);
-	if (!bib)
-		return -ENOMEM;
-	bib2tabled(new, bib);
-
-	spin_lock_bh(&table->lock);
-
 	collision = find_bibtree6_slot(table, bib, &slot6);
 	if (collision) {
-		if (taddr4_equals(&bib->src4, &collision->src4))
-			goto upgrade;
+		if (taddr4_equals(&bib->src4, &collision->src4)) {
+			collision->is_static = true;
+			return 1;
+		}
 		goto eexist;
 	}
 
@@ -2316,32 +2799,19 @@ static int __bib_add_static(struct xlator *jool, struct bib_entry *new,
 	 * That's bound to be a lot of messy code though, and the v4 client is
 	 * going to retry anyway, so let's just forget the packets instead.
 	 */
-	if (new->l4_proto == L4PROTO_TCP)
-		pktqueue_rm(jool->nat64.bib->tcp.pkt_queue, &new->addr4);
-
-	spin_unlock_bh(&table->lock);
-	return 0;
+	if (bib->proto == L4PROTO_TCP)
+		pktqueue_rm(jool->nat64.bib->tcp.pkt_queue, &bib->src4);
 
-upgrade:
-	collision->is_static = true;
-	spin_unlock_bh(&table->lock);
-	free_bib(bib);
 	return 0;
 
 eexist:
 	tbtobe(collision, old);
-	spin_unlock_bh(&table->lock);
-	free_bib(bib);
 	return -EEXIST;
 }
 
-/* Noisy version. */
-int bib_add_static(struct xlator *jool, struct bib_entry *new)
+static void log_static_error(struct bib_entry *new, struct bib_entry *old,
+		int error)
 {
-	struct bib_entry old;
-	int error;
-
-	error = __bib_add_static(jool, new, &old);
 	switch (error) {
 	case 0:
 		break;
@@ -2349,17 +2819,126 @@ int bib_add_static(struct xlator *jool, struct bib_entry *new)
 		log_err("Entry %pI4#%u|%pI6c#%u collides with %pI4#%u|%pI6c#%u.",
 				&new->addr4.l3, new->addr4.l4,
 				&new->addr6.l3, new->addr6.l4,
-				&old.addr4.l3, old.addr4.l4,
-				&old.addr6.l3, old.addr6.l4);
+				&old->addr4.l3, old->addr4.l4,
+				&old->addr6.l3, old->addr6.l4);
 		break;
 	default:
 		log_err("Unknown error code: %d", error);
 		break;
 	}
+}
+
+static int __bib_add_static(struct xlator *jool, struct bib_entry *new,
+		struct bib_entry *old)
+{
+	struct bib_table *table;
+	struct tabled_bib *bib;
+	int error;
+
+	log_debug("Adding static BIB entry (%pI6c#%u, %pI4#%u).",
+			&new->addr6.l3, new->addr6.l4,
+			&new->addr4.l3, new->addr4.l4);
+
+	table = get_table(jool->nat64.bib, new->l4_proto);
+	if (!table)
+		return -EINVAL;
+
+	bib = alloc_bib(GFP_ATOMIC);
+	if (!bib)
+		return -ENOMEM;
+	bib2tabled(new, bib);
+
+	spin_lock_bh(&table->lock);
+	error = add_static_locked(jool, table, bib, old);
+	spin_unlock_bh(&table->lock);
+
+	if (error) {
+		free_bib(bib);
+		if (error > 0)
+			error = 0;
+	}
 
 	return error;
 }
 
+/* Noisy version. */
+int bib_add_static(struct xlator *jool, struct bib_entry *new)
+{
+	struct bib_entry old;
+	int error;
+
+	error = __bib_add_static(jool, new, &old);
+	log_static_error(new, &old, error);
+	return error;
+}
+
+/**
+ * Same as calling bib_add_static() on each of the @count @entries, except
+ * faster: The memory is reserved beforehand (while sleeping is still allowed),
+ * and each table is locked once per run of consecutive entries of its
+ * protocol, rather than once per entry.
+ *
+ * Stops at the first failure. The entries added before it are not reverted.
+ * Can sleep.
+ */
+int bib_add_static_batch(struct xlator *jool, struct bib_entry *entries,
+		unsigned int count)
+{
+	struct tabled_bib **bibs;
+	struct bib_table *table;
+	struct bib_entry old;
+	l4_protocol proto;
+	unsigned int i, j;
+	int error;
+
+	bibs = kmalloc_array(count, sizeof(*bibs), GFP_KERNEL);
+	if (!bibs)
+		return -ENOMEM;
+
+	for (i = 0; i < count; i++) {
+		bibs[i] = alloc_bib(GFP_KERNEL);
+		if (!bibs[i]) {
+			error = -ENOMEM;
+			goto end;
+		}
+		bib2tabled(&entries[i], bibs[i]);
+	}
+
+	error = 0;
+	for (j = 0; j < count && !error;) {
+		proto = entries[j].l4_proto;
+		table = get_table(jool->nat64.bib, proto);
+		if (!table) {
+			error = -EINVAL;
+			break;
+		}
+
+		spin_lock_bh(&table->lock);
+		for (; j < count && entries[j].l4_proto == proto; j++) {
+			error = add_static_locked(jool, table, bibs[j], &old);
+			if (error < 0)
+				break;
+			if (error > 0) {
+				free_bib(bibs[j]);
+				error = 0;
+			}
+			bibs[j] = NULL; /* The table owns it now. */
+		}
+		spin_unlock_bh(&table->lock);
+
+		if (error)
+			log_static_error(&entries[j], &old, error);
+	}
+
+end:
+	/* Release whatever was not added. */
+	while (i-- > 0)
+		if (bibs[i])
+			free_bib(bibs[i]);
+	kfree(bibs);
+	return error;
+}
+
 int bib_rm(struct xlator *jool, struct bib_entry *entry)
 {
 	struct bib_table *table;
@@ -2383,8 +2962,11 @@ int bib_rm(struct xlator *jool, struct bib_entry *entry)
 
 	spin_unlock_bh(&table->lock);
 
-	if (!error)
+	if (!error) {
 		release_bib_entry(&bib->hook4, NULL);
+		if (entry->l4_proto == L4PROTO_TCP)
+			offload_flush(jool->nat64.bib->offload);
+	}
 
 	return error;
 }
@@ -2424,6 +3006,8 @@ void bib_rm_range(struct xlator *jool, l4_protocol proto,
 	spin_unlock_bh(&table->lock);
 
 	commit_delete_list(&delete_list);
+	if (proto == L4PROTO_TCP)
+		offload_flush(jool->nat64.bib->offload);
 }
 
 static void flush_table(struct xlator *jool, struct bib_table *table)
@@ -2451,6 +3035,8 @@ void bib_flush(struct xlator *jool)
 	flush_table(jool, &db->tcp);
 	flush_table(jool, &db->udp);
 	flush_table(jool, &db->icmp);
+	offload_flush(db->offload);
+	frag_flush(db->frags);
 }
 
 static void print_tabs(int tabs)
@@ -96,9 +96,30 @@ verdict bib_add_tcp4(struct xlation *xstate,
 
 int bib_find(struct bib *db, struct tuple *tuple,
 		struct bib_session *result);
+int bib_offload_find(struct bib *db, struct tuple *tuple,
+		struct bib_session *result);
+void bib_offload_add(struct bib *db, struct session_entry *session);
+void bib_offload_rm(struct bib *db, struct session_entry *session);
+int bib_frag_find(struct bib *db, struct packet *pkt, struct tuple *result);
+void bib_frag_add(struct bib *db, struct packet *pkt);
 int bib_add_session(struct xlator *jool, struct session_entry *new,
 		struct collision_cb *cb);
-void bib_clean(struct xlator *jool);
+
+/** Outcome of one or more bib_add_sessions(). */
+struct bib_add_summary {
+	/** The session was new, and has been added. */
+	unsigned int added;
+	/** The session already existed, and has been refreshed. */
+	unsigned int updated;
+	/** The session clashed with a different session, and was ignored. */
+	unsigned int collisions;
+	/** The session could not be added for some other reason. */
+	unsigned int failed;
+};
+
+void bib_add_sessions(struct xlator *jool, struct session_entry *sessions,
+		unsigned int count, struct bib_add_summary *summary);
+unsigned long bib_clean(struct xlator *jool);
 
 /* These are used by userspace request handling. */
 
@@ -122,7 +143,11 @@ int bib_find6(struct bib *db, l4_protocol proto,
 int bib_find4(struct bib *db, l4_protocol proto,
 		struct ipv4_transport_addr *addr,
 		struct bib_entry *result);
+int bib_count_range(struct bib *db, l4_protocol proto,
+		struct ipv4_range const *range, __u32 *result);
 int bib_add_static(struct xlator *jool, struct bib_entry *new);
+int bib_add_static_batch(struct xlator *jool, struct bib_entry *entries,
+		unsigned int count);
 int bib_rm(struct xlator *jool, struct bib_entry *entry);
 void bib_rm_range(struct xlator *jool, l4_protocol proto,
 		struct ipv4_range *range);
@@ -0,0 +1,245 @@
+#include "mod/common/db/bib/frag.h"
+
+#include <linux/hash.h>
+#include <linux/jhash.h>
+#include <linux/random.h>
+
+#include "common/constants.h"
+#include "mod/common/log.h"
+#include "mod/common/wkmalloc.h"
+
+#define FRAG_HASH_BITS 8
+#define FRAG_HASH_SIZE (1 << FRAG_HASH_BITS)
+/*
+ * Entries only last FRAGMENT_TIMEOUT seconds, so this only needs to account for
+ * the packets that are being fragmented at any given moment. Once it's full,
+ * the subsequent fragments of new packets are dropped until room frees up.
+ */
+#define FRAG_MAX_ENTRIES (8 * FRAG_HASH_SIZE)
+
+/*
+ * Everything that identifies the fragments of a single packet.
+ * Hashed and compared as a whole, so make sure it has no uninitialized padding.
+ */
+struct frag_key {
+	union {
+		struct in6_addr v6;
+		struct in_addr v4;
+	} src, dst;
+	/* IPv4 packets only use the lower 16 bits. */
+	__u32 id;
+	/* (l3_proto << 8) | l4_proto */
+	__u32 protos;
+};
+
+struct frag_entry {
+	struct frag_key key;
+	/** Tuple of the first fragment. */
+	struct tuple tuple;
+	/** Jiffy at which we stop waiting for more fragments. */
+	unsigned long expires;
+	struct hlist_node hook;
+};
+
+struct frag_table {
+	struct hlist_head table[FRAG_HASH_SIZE];
+	u32 seed;
+	unsigned int count;
+	spinlock_t lock;
+};
+
+struct frag_table *frag_alloc(void)
+{
+	struct frag_table *table;
+	unsigned int i;
+
+	table = wkmalloc(struct frag_table, GFP_KERNEL);
+	if (!table)
+		return NULL;
+
+	for (i = 0; i < FRAG_HASH_SIZE; i++)
+		INIT_HLIST_HEAD(&table->table[i]);
+	get_random_bytes(&table->seed, sizeof(table->seed));
+	table->count = 0;
+	spin_lock_init(&table->lock);
+
+	return table;
+}
+
+void frag_release(struct frag_table *table)
+{
+	frag_flush(table);
+	wkfree(struct frag_table, table);
+}
+
+static void init_key(struct packet *pkt, struct frag_key *key)
+{
+	struct ipv6hdr *hdr6;
+	struct iphdr *hdr4;
+
+	memset(key, 0, sizeof(*key));
+
+	switch (pkt_l3_proto(pkt)) {
+	case L3PROTO_IPV6:
+		hdr6 = pkt_ip6_hdr(pkt);
+		key->src.v6 = hdr6->saddr;
+		key->dst.v6 = hdr6->daddr;
+		key->id = be32_to_cpu(pkt_frag_hdr(pkt)->identification);
+		break;
+	case L3PROTO_IPV4:
+		hdr4 = pkt_ip4_hdr(pkt);
+		key->src.v4.s_addr = hdr4->saddr;
+		key->dst.v4.s_addr = hdr4->daddr;
+		key->id = be16_to_cpu(hdr4->id);
+		break;
+	}
+
+	key->protos = (pkt_l3_proto(pkt) << 8) | pkt_l4_proto(pkt);
+}
+
+static struct hlist_head *get_bucket(struct frag_table *table,
+		struct frag_key *key)
+{
+	u32 hash;
+	hash = jhash2((u32 *)key, sizeof(*key) / sizeof(u32), table->seed);
+	return &table->table[hash_32(hash, FRAG_HASH_BITS)];
+}
+
+static bool is_expired(struct frag_entry *entry)
+{
+	return !time_before(jiffies, entry->expires);
+}
+
+/* Assumes the lock is held. */
+static struct frag_entry *__find(struct hlist_head *bucket,
+		struct frag_key *key)
+{
+	struct frag_entry *entry;
+
+	hlist_for_each_entry(entry, bucket, hook)
+		if (memcmp(&entry->key, key, sizeof(*key)) == 0)
+			return entry;
+
+	return NULL;
+}
+
+/* Assumes the lock is held. */
+static void __rm(struct frag_table *table, struct frag_entry *entry)
+{
+	hlist_del(&entry->hook);
+	table->count--;
+	wkfree(struct frag_entry, entry);
+}
+
+/**
+ * Copies to @result the tuple of @pkt's first fragment.
+ *
+ * @pkt is assumed to be a subsequent fragment. Returns -ESRCH if its first
+ * fragment hasn't been seen (or was seen too long ago).
+ */
+int frag_find(struct frag_table *table, struct packet *pkt,
+		struct tuple *result)
+{
+	struct frag_key key;
+	struct frag_entry *entry;
+	int error = -ESRCH;
+
+	init_key(pkt, &key);
+
+	spin_lock_bh(&table->lock);
+	entry = __find(get_bucket(table, &key), &key);
+	if (entry && !is_expired(entry)) {
+		*result = entry->tuple;
+		error = 0;
+	}
+	spin_unlock_bh(&table->lock);
+
+	return error;
+}
+
+/**
+ * Remembers @pkt's tuple so its subsequent fragments can find it.
+ *
+ * @pkt is assumed to be the first fragment of a fragmented packet, and its
+ * tuple is expected to be already computed.
+ */
+int frag_add(struct frag_table *table, struct packet *pkt)
+{
+	struct frag_key key;
+	struct hlist_head *bucket;
+	struct frag_entry *entry;
+	unsigned long expires;
+	int error = 0;
+
+	init_key(pkt, &key);
+	expires = jiffies + msecs_to_jiffies(1000 * FRAGMENT_TIMEOUT);
+
+	spin_lock_bh(&table->lock);
+
+	bucket = get_bucket(table, &key);
+	entry = __find(bucket, &key);
+	if (entry) {
+		/* Probably a retransmission, or an ID that wrapped around. */
+		entry->tuple = pkt->tuple;
+		entry->expires = expires;
+		goto end;
+	}
+
+	if (table->count >= FRAG_MAX_ENTRIES) {
+		error = -ENOSPC;
+		goto end;
+	}
+
+	entry = wkmalloc(struct frag_entry, GFP_ATOMIC);
+	if (!entry) {
+		error = -ENOMEM;
+		goto end;
+	}
+
+	entry->key = key;
+	entry->tuple = pkt->tuple;
+	entry->expires = expires;
+	hlist_add_head(&entry->hook, bucket);
+	table->count++;
+	/* Fall through. */
+
+end:
+	spin_unlock_bh(&table->lock);
+	return error;
+}
+
+/* Returns whether the table still has entries afterwards. */
+static bool __flush(struct frag_table *table, bool expired_only)
+{
+	struct frag_entry *entry;
+	struct hlist_node *tmp;
+	unsigned int i;
+	bool remaining;
+
+	spin_lock_bh(&table->lock);
+
+	for (i = 0; i < FRAG_HASH_SIZE && table->count; i++) {
+		hlist_for_each_entry_safe(entry, tmp, &table->table[i], hook) {
+			if (!expired_only || is_expired(entry))
+				__rm(table, entry);
+		}
+	}
+	remaining = table->count != 0;
+
+	spin_unlock_bh(&table->lock);
+	return remaining;
+}
+
+/**
+ * Forgets the packets whose fragments we are no longer waiting for.
+ * Returns whether there are still fragments being waited for.
+ */
+bool frag_clean(struct frag_table *table)
+{
+	return __flush(table, true);
+}
+
+void frag_flush(struct frag_table *table)
+{
+	__flush(table, false);
+}
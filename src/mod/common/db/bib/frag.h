@@ -0,0 +1,32 @@
+#ifndef SRC_MOD_NAT64_BIB_FRAG_H_
+#define SRC_MOD_NAT64_BIB_FRAG_H_
+
+/**
+ * @file
+ * Remembers the tuples of the first fragments of fragmented packets, so the
+ * subsequent fragments (which do not carry layer-4 headers, and therefore
+ * ports or ICMP identifiers) can be translated as well.
+ *
+ * This is what allows NAT64 Jool to translate fragments as they come, instead
+ * of depending on nf_defrag_ipv4 and nf_defrag_ipv6 to reassemble every
+ * fragmented packet first. (See the module's "defrag" parameter.)
+ *
+ * Fragments are keyed by their addresses, protocol and fragment
+ * identification. A subsequent fragment that arrives before its first fragment
+ * cannot be matched, so it is dropped.
+ */
+
+#include "mod/common/packet.h"
+
+struct frag_table;
+
+struct frag_table *frag_alloc(void);
+void frag_release(struct frag_table *table);
+
+int frag_find(struct frag_table *table, struct packet *pkt,
+		struct tuple *result);
+int frag_add(struct frag_table *table, struct packet *pkt);
+bool frag_clean(struct frag_table *table);
+void frag_flush(struct frag_table *table);
+
+#endif /* SRC_MOD_NAT64_BIB_FRAG_H_ */
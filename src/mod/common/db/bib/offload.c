@@ -0,0 +1,303 @@
+#include "mod/common/db/bib/offload.h"
+
+#include <linux/hash.h>
+#include <linux/jhash.h>
+#include <linux/random.h>
+#include <linux/rculist.h>
+
+#include "common/constants.h"
+#include "mod/common/address.h"
+#include "mod/common/log.h"
+#include "mod/common/wkmalloc.h"
+
+#define OFFLOAD_HASH_BITS 10
+#define OFFLOAD_HASH_SIZE (1 << OFFLOAD_HASH_BITS)
+/*
+ * Only connections that moved data during the last TCP_OFFLOAD_REFRESH seconds
+ * are supposed to be here, so this doesn't need to be large. If it fills up,
+ * the remaining connections just keep using the slow path.
+ */
+#define OFFLOAD_MAX_ENTRIES (4 * OFFLOAD_HASH_SIZE)
+
+struct offload_entry {
+	/** Copy of the established session this entry stands for. */
+	struct session_entry session;
+	/** Jiffy at which this entry stops being trustworthy. */
+	unsigned long expires;
+
+	/** Indexes the entry by src6 and dst6. (IPv6 packets.) */
+	struct hlist_node hook6;
+	/** Indexes the entry by dst4 and src4. (IPv4 packets.) */
+	struct hlist_node hook4;
+	struct rcu_head rcu;
+};
+
+struct offload_table {
+	struct hlist_head table6[OFFLOAD_HASH_SIZE];
+	struct hlist_head table4[OFFLOAD_HASH_SIZE];
+	/* So peers cannot predict (and therefore flood) our buckets. */
+	u32 seed;
+	unsigned int count;
+	/** Serializes writers. Readers only need RCU. */
+	spinlock_t lock;
+};
+
+struct offload_table *offload_alloc(void)
+{
+	struct offload_table *table;
+	unsigned int i;
+
+	table = wkmalloc(struct offload_table, GFP_KERNEL);
+	if (!table)
+		return NULL;
+
+	for (i = 0; i < OFFLOAD_HASH_SIZE; i++) {
+		INIT_HLIST_HEAD(&table->table6[i]);
+		INIT_HLIST_HEAD(&table->table4[i]);
+	}
+	get_random_bytes(&table->seed, sizeof(table->seed));
+	table->count = 0;
+	spin_lock_init(&table->lock);
+
+	return table;
+}
+
+/**
+ * Assumes nobody else has access to @table anymore, which means this is the
+ * only function that is allowed to bypass RCU.
+ */
+void offload_release(struct offload_table *table)
+{
+	struct offload_entry *entry;
+	struct hlist_node *tmp;
+	unsigned int i;
+
+	for (i = 0; i < OFFLOAD_HASH_SIZE; i++) {
+		hlist_for_each_entry_safe(entry, tmp, &table->table6[i], hook6)
+			wkfree(struct offload_entry, entry);
+	}
+
+	wkfree(struct offload_table, table);
+}
+
+static u32 hash6(struct offload_table *table,
+		struct ipv6_transport_addr const *src,
+		struct ipv6_transport_addr const *dst)
+{
+	u32 hash;
+
+	hash = jhash2((u32 const *)src->l3.s6_addr32, 4, table->seed);
+	hash = jhash2((u32 const *)dst->l3.s6_addr32, 4, hash);
+	return hash_32(hash ^ ((src->l4 << 16) | dst->l4), OFFLOAD_HASH_BITS);
+}
+
+static u32 hash4(struct offload_table *table,
+		struct ipv4_transport_addr const *src,
+		struct ipv4_transport_addr const *dst)
+{
+	return hash_32(jhash_3words((__force u32)src->l3.s_addr,
+			(__force u32)dst->l3.s_addr,
+			(src->l4 << 16) | dst->l4,
+			table->seed), OFFLOAD_HASH_BITS);
+}
+
+static bool match6(struct offload_entry *entry,
+		struct ipv6_transport_addr const *src,
+		struct ipv6_transport_addr const *dst)
+{
+	return taddr6_equals(&entry->session.src6, src)
+			&& taddr6_equals(&entry->session.dst6, dst);
+}
+
+/* Remember: In the 4->6 direction, the packet's source is the session's dst4 */
+static bool match4(struct offload_entry *entry,
+		struct ipv4_transport_addr const *src,
+		struct ipv4_transport_addr const *dst)
+{
+	return taddr4_equals(&entry->session.dst4, src)
+			&& taddr4_equals(&entry->session.src4, dst);
+}
+
+static int copy_entry(struct offload_entry *entry, struct bib_session *result)
+{
+	if (!time_before(jiffies, READ_ONCE(entry->expires)))
+		return -ESRCH;
+
+	result->bib_set = true;
+	result->session_set = true;
+	result->session = entry->session;
+	return 0;
+}
+
+/**
+ * Finds the (still trustworthy) session entry that corresponds to @tuple, and
+ * copies it to @result.
+ *
+ * Returns -ESRCH if there is no such session. This does not mean the session
+ * does not exist; it just means you have to ask the BIB.
+ */
+int offload_find(struct offload_table *table, struct tuple *tuple,
+		struct bib_session *result)
+{
+	struct offload_entry *entry;
+	struct ipv6_transport_addr *src6, *dst6;
+	struct ipv4_transport_addr *src4, *dst4;
+	int error = -ESRCH;
+
+	rcu_read_lock();
+
+	switch (tuple->l3_proto) {
+	case L3PROTO_IPV6:
+		src6 = &tuple->src.addr6;
+		dst6 = &tuple->dst.addr6;
+		hlist_for_each_entry_rcu(entry,
+				&table->table6[hash6(table, src6, dst6)],
+				hook6) {
+			if (match6(entry, src6, dst6)) {
+				error = copy_entry(entry, result);
+				break;
+			}
+		}
+		break;
+
+	case L3PROTO_IPV4:
+		src4 = &tuple->src.addr4;
+		dst4 = &tuple->dst.addr4;
+		hlist_for_each_entry_rcu(entry,
+				&table->table4[hash4(table, src4, dst4)],
+				hook4) {
+			if (match4(entry, src4, dst4)) {
+				error = copy_entry(entry, result);
+				break;
+			}
+		}
+		break;
+	}
+
+	rcu_read_unlock();
+	return error;
+}
+
+static struct offload_entry *__find6(struct offload_table *table,
+		struct ipv6_transport_addr *src6,
+		struct ipv6_transport_addr *dst6)
+{
+	struct offload_entry *entry;
+
+	hlist_for_each_entry(entry, &table->table6[hash6(table, src6, dst6)],
+			hook6) {
+		if (match6(entry, src6, dst6))
+			return entry;
+	}
+
+	return NULL;
+}
+
+static void free_entry_rcu(struct rcu_head *rcu)
+{
+	struct offload_entry *entry;
+	entry = container_of(rcu, struct offload_entry, rcu);
+	wkfree(struct offload_entry, entry);
+}
+
+/* Assumes the lock is held. */
+static void __rm(struct offload_table *table, struct offload_entry *entry)
+{
+	hlist_del_rcu(&entry->hook6);
+	hlist_del_rcu(&entry->hook4);
+	table->count--;
+	call_rcu(&entry->rcu, free_entry_rcu);
+}
+
+/**
+ * Adds @session to the table, or renews its lifetime if it is already there.
+ *
+ * @session is expected to be an ESTABLISHED TCP session, fresh out of the BIB.
+ */
+int offload_add(struct offload_table *table, struct session_entry *session)
+{
+	struct offload_entry *entry;
+	unsigned long expires;
+	int error = 0;
+
+	expires = jiffies + msecs_to_jiffies(1000 * TCP_OFFLOAD_REFRESH);
+
+	spin_lock_bh(&table->lock);
+
+	entry = __find6(table, &session->src6, &session->dst6);
+	if (entry) {
+		WRITE_ONCE(entry->expires, expires);
+		goto end;
+	}
+
+	if (table->count >= OFFLOAD_MAX_ENTRIES) {
+		error = -ENOSPC;
+		goto end;
+	}
+
+	entry = wkmalloc(struct offload_entry, GFP_ATOMIC);
+	if (!entry) {
+		error = -ENOMEM;
+		goto end;
+	}
+
+	entry->session = *session;
+	entry->expires = expires;
+	hlist_add_head_rcu(&entry->hook6, &table->table6[hash6(table,
+			&session->src6, &session->dst6)]);
+	hlist_add_head_rcu(&entry->hook4, &table->table4[hash4(table,
+			&session->dst4, &session->src4)]);
+	table->count++;
+	/* Fall through. */
+
+end:
+	spin_unlock_bh(&table->lock);
+	return error;
+}
+
+/**
+ * Removes the session whose IPv6 identifiers are @src6 and @dst6, if it is
+ * cached.
+ */
+void offload_rm(struct offload_table *table, struct ipv6_transport_addr *src6,
+		struct ipv6_transport_addr *dst6)
+{
+	struct offload_entry *entry;
+
+	spin_lock_bh(&table->lock);
+	entry = __find6(table, src6, dst6);
+	if (entry)
+		__rm(table, entry);
+	spin_unlock_bh(&table->lock);
+}
+
+static void __flush(struct offload_table *table, bool expired_only)
+{
+	struct offload_entry *entry;
+	struct hlist_node *tmp;
+	unsigned int i;
+
+	spin_lock_bh(&table->lock);
+
+	for (i = 0; i < OFFLOAD_HASH_SIZE && table->count; i++) {
+		hlist_for_each_entry_safe(entry, tmp, &table->table6[i], hook6) {
+			if (!expired_only || !time_before(jiffies, entry->expires))
+				__rm(table, entry);
+		}
+	}
+
+	spin_unlock_bh(&table->lock);
+}
+
+/**
+ * Forgets the entries that are no longer trustworthy.
+ */
+void offload_clean(struct offload_table *table)
+{
+	__flush(table, true);
+}
+
+void offload_flush(struct offload_table *table)
+{
+	__flush(table, false);
+}
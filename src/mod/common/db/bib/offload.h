@@ -0,0 +1,44 @@
+#ifndef SRC_MOD_NAT64_BIB_OFFLOAD_H_
+#define SRC_MOD_NAT64_BIB_OFFLOAD_H_
+
+/**
+ * @file
+ * A small cache of established TCP sessions, indexed by the tuples of the
+ * packets that belong to them.
+ *
+ * The session table is a spinlocked pair of red-black trees, and every packet
+ * that hits it also has to run the TCP state machine and shuffle the session's
+ * expiration list. That's a lot of work (and a lot of lock contention) for
+ * packets that do nothing but move data through an already ESTABLISHED
+ * connection.
+ *
+ * So once a connection is established, Filtering and Updating drops a copy of
+ * its session here. Packets that match it (and that don't carry SYN, FIN or
+ * RST, which always need the state machine) are then allowed to skip Filtering
+ * and Updating altogether. Lookups are RCU; only writers lock.
+ *
+ * Offloaded packets do not refresh the session's timer, so entries are only
+ * trusted for TCP_OFFLOAD_REFRESH seconds. Once that's over, the next packet
+ * of the connection takes the slow path again, which updates the real session
+ * and renews the offload entry. The session's update time therefore lags
+ * behind by at most that much, which is negligible next to the established
+ * timeout.
+ */
+
+#include "mod/common/types.h"
+#include "mod/common/db/bib/entry.h"
+
+struct offload_table;
+
+struct offload_table *offload_alloc(void);
+void offload_release(struct offload_table *table);
+
+int offload_find(struct offload_table *table, struct tuple *tuple,
+		struct bib_session *result);
+int offload_add(struct offload_table *table, struct session_entry *session);
+void offload_rm(struct offload_table *table, struct ipv6_transport_addr *src6,
+		struct ipv6_transport_addr *dst6);
+void offload_clean(struct offload_table *table);
+void offload_flush(struct offload_table *table);
+
+#endif /* SRC_MOD_NAT64_BIB_OFFLOAD_H_ */
@@ -0,0 +1,263 @@
+#include "mod/common/db/bib/query.h"
+
+#include <linux/jiffies.h>
+#include "mod/common/address.h"
+#include "mod/common/log.h"
+#include "mod/common/wkmalloc.h"
+#include "mod/common/db/rbtree.h"
+
+struct bibq_subscriber {
+	/* src6, already masked to the query's subscriber_len. */
+	struct in6_addr prefix;
+	__u32 matches;
+	struct rb_node hook;
+};
+
+int bibq_validate(struct bib_query const *query)
+{
+	int error;
+
+	if (query->src6.set) {
+		error = prefix6_validate(&query->src6.prefix);
+		if (error)
+			return error;
+	}
+	if (query->src4_set) {
+		error = prefix4_validate(&query->src4.prefix);
+		if (error)
+			return error;
+		if (query->src4.ports.min > query->src4.ports.max) {
+			log_err("The source port range is inverted (%u-%u).",
+					query->src4.ports.min,
+					query->src4.ports.max);
+			return -EINVAL;
+		}
+	}
+	if (query->dst4.set) {
+		error = prefix4_validate(&query->dst4.prefix);
+		if (error)
+			return error;
+	}
+
+	switch (query->mode) {
+	case BQM_LIST:
+	case BQM_COUNT:
+		return 0;
+	case BQM_TOP:
+		if (query->top < 1 || query->top > BIB_QUERY_MAX_TOP) {
+			log_err("The number of top subscribers must be between 1 and %u.",
+					BIB_QUERY_MAX_TOP);
+			return -EINVAL;
+		}
+		if (query->subscriber_len > 128) {
+			log_err("Subscriber prefix length (%u) is too long for IPv6.",
+					query->subscriber_len);
+			return -EINVAL;
+		}
+		return 0;
+	}
+
+	log_err("Unknown query mode: %u", query->mode);
+	return -EINVAL;
+}
+
+static bool match_src6(struct bib_query const *query,
+		struct ipv6_transport_addr const *src6)
+{
+	return !query->src6.set
+			|| prefix6_contains(&query->src6.prefix, &src6->l3);
+}
+
+static bool match_src4(struct bib_query const *query,
+		struct ipv4_transport_addr const *src4)
+{
+	return !query->src4_set
+			|| (prefix4_contains(&query->src4.prefix, &src4->l3)
+			&& port_range_contains(&query->src4.ports, src4->l4));
+}
+
+bool bibq_match_bib(struct bib_query const *query, struct bib_entry const *bib)
+{
+	return match_src6(query, &bib->addr6) && match_src4(query, &bib->addr4);
+}
+
+bool bibq_match_session(struct bib_query const *query,
+		struct session_entry const *session)
+{
+	if (!match_src6(query, &session->src6))
+		return false;
+	if (!match_src4(query, &session->src4))
+		return false;
+	if (query->dst4.set
+			&& !prefix4_contains(&query->dst4.prefix, &session->dst4.l3))
+		return false;
+	if (query->state_set && session->state != query->state)
+		return false;
+	if (query->min_idle && time_before(jiffies, session->update_time
+			+ msecs_to_jiffies(query->min_idle)))
+		return false;
+
+	return true;
+}
+
+void bibq_summary_init(struct bib_summary *summary,
+		struct bib_query const *query)
+{
+	summary->query = query;
+	summary->matches = 0;
+	summary->subscribers = RB_ROOT;
+	summary->subscriber_count = 0;
+}
+
+static int compare_subscriber(struct bibq_subscriber const *subscriber,
+		struct in6_addr const *prefix)
+{
+	return ipv6_addr_cmp(&subscriber->prefix, prefix);
+}
+
+/* Counts a match. @src6 is the IPv6 node's address. */
+int bibq_summary_add(struct bib_summary *summary, struct in6_addr const *src6)
+{
+	struct bibq_subscriber *subscriber;
+	struct in6_addr prefix;
+	struct rb_node **node, *parent;
+
+	summary->matches++;
+	if (summary->query->mode != BQM_TOP)
+		return 0;
+
+	ipv6_addr_prefix(&prefix, src6, summary->query->subscriber_len);
+	rbtree_find_node(&prefix, &summary->subscribers, compare_subscriber,
+			struct bibq_subscriber, hook, parent, node);
+	if (*node) {
+		subscriber = rb_entry(*node, struct bibq_subscriber, hook);
+		subscriber->matches++;
+		return 0;
+	}
+
+	if (summary->subscriber_count >= BIB_QUERY_MAX_SUBSCRIBERS) {
+		log_err("The query matched more than %u subscribers. Please narrow down the filters, or shorten the subscriber prefix length.",
+				BIB_QUERY_MAX_SUBSCRIBERS);
+		return -E2BIG;
+	}
+
+	subscriber = wkmalloc(struct bibq_subscriber, GFP_KERNEL);
+	if (!subscriber)
+		return -ENOMEM;
+	subscriber->prefix = prefix;
+	subscriber->matches = 1;
+	rb_link_node(&subscriber->hook, parent, node);
+	rb_insert_color(&subscriber->hook, &summary->subscribers);
+	summary->subscriber_count++;
+	return 0;
+}
+
+/* Inserts @subscriber in @result's top list, if it's busy enough. */
+static void rank_subscriber(struct bib_query_result *result, unsigned int top,
+		struct bibq_subscriber const *subscriber)
+{
+	unsigned int i;
+
+	if (result->top_count == top) {
+		if (result->top[top - 1].matches >= subscriber->matches)
+			return;
+		result->top_count--;
+	}
+
+	/* Keep it sorted, busiest first. Ties go to the smaller prefix. */
+	for (i = result->top_count; i > 0; i--) {
+		if (result->top[i - 1].matches >= subscriber->matches)
+			break;
+		result->top[i] = result->top[i - 1];
+	}
+
+	result->top[i].subscriber.addr = subscriber->prefix;
+	result->top[i].matches = subscriber->matches;
+	result->top_count++;
+}
+
+void bibq_summary_result(struct bib_summary *summary,
+		struct bib_query_result *result)
+{
+	struct rb_node *node;
+	unsigned int i;
+
+	memset(result, 0, sizeof(*result));
+	result->matches = summary->matches;
+	if (summary->query->mode != BQM_TOP)
+		return;
+
+	result->subscribers = summary->subscriber_count;
+	for (node = rb_first(&summary->subscribers); node; node = rb_next(node)) {
+		rank_subscriber(result, summary->query->top,
+				rb_entry(node, struct bibq_subscriber, hook));
+	}
+	for (i = 0; i < result->top_count; i++)
+		result->top[i].subscriber.len = summary->query->subscriber_len;
+}
+
+static void destroy_subscriber(struct rb_node *node, void *arg)
+{
+	wkfree(struct bibq_subscriber,
+			rb_entry(node, struct bibq_subscriber, hook));
+}
+
+void bibq_summary_clean(struct bib_summary *summary)
+{
+	rbtree_clear(&summary->subscribers, destroy_subscriber, NULL);
+}
+
+static int summarize_bib_entry(struct bib_entry const *entry, void *arg)
+{
+	struct bib_summary *summary = arg;
+
+	if (!bibq_match_bib(summary->query, entry))
+		return 0;
+	return bibq_summary_add(summary, &entry->addr6.l3);
+}
+
+/**
+ * Runs BQM_COUNT or BQM_TOP @query on @db's @proto table.
+ * @query must have already been validated.
+ */
+int bibq_query_bib(struct bib *db, l4_protocol proto,
+		struct bib_query const *query, struct bib_query_result *result)
+{
+	struct bib_summary summary;
+	int error;
+
+	bibq_summary_init(&summary, query);
+	error = bib_foreach(db, proto, summarize_bib_entry, &summary, NULL);
+	if (!error)
+		bibq_summary_result(&summary, result);
+	bibq_summary_clean(&summary);
+
+	return error;
+}
+
+static int summarize_session_entry(struct session_entry const *entry,
+		void *arg)
+{
+	struct bib_summary *summary = arg;
+
+	if (!bibq_match_session(summary->query, entry))
+		return 0;
+	return bibq_summary_add(summary, &entry->src6.l3);
+}
+
+/* Session version of bibq_query_bib(). */
+int bibq_query_sessions(struct xlator *jool, l4_protocol proto,
+		struct bib_query const *query, struct bib_query_result *result)
+{
+	struct bib_summary summary;
+	int error;
+
+	bibq_summary_init(&summary, query);
+	error = bib_foreach_session(jool, proto, summarize_session_entry,
+			&summary, NULL);
+	if (!error)
+		bibq_summary_result(&summary, result);
+	bibq_summary_clean(&summary);
+
+	return error;
+}
@@ -0,0 +1,47 @@
+#ifndef SRC_MOD_COMMON_DB_BIB_QUERY_H_
+#define SRC_MOD_COMMON_DB_BIB_QUERY_H_
+
+/**
+ * @file
+ * Server-side evaluation of struct bib_query. (BIB/session filters and
+ * aggregation.)
+ *
+ * The matchers are meant to be called from bib_foreach() and
+ * bib_foreach_session() callbacks, which run in process context and without the
+ * table lock.
+ */
+
+#include <linux/rbtree.h>
+#include "common/config.h"
+#include "mod/common/db/bib/db.h"
+#include "mod/common/db/bib/entry.h"
+
+int bibq_validate(struct bib_query const *query);
+
+bool bibq_match_bib(struct bib_query const *query,
+		struct bib_entry const *bib);
+bool bibq_match_session(struct bib_query const *query,
+		struct session_entry const *session);
+
+/** Accumulator of BQM_COUNT and BQM_TOP queries. */
+struct bib_summary {
+	struct bib_query const *query;
+	__u32 matches;
+	/* Tree of struct bibq_subscriber, sorted by prefix. (BQM_TOP only) */
+	struct rb_root subscribers;
+	__u32 subscriber_count;
+};
+
+void bibq_summary_init(struct bib_summary *summary,
+		struct bib_query const *query);
+int bibq_summary_add(struct bib_summary *summary, struct in6_addr const *src6);
+void bibq_summary_result(struct bib_summary *summary,
+		struct bib_query_result *result);
+void bibq_summary_clean(struct bib_summary *summary);
+
+int bibq_query_bib(struct bib *db, l4_protocol proto,
+		struct bib_query const *query, struct bib_query_result *result);
+int bibq_query_sessions(struct xlator *jool, l4_protocol proto,
+		struct bib_query const *query, struct bib_query_result *result);
+
+#endif /* SRC_MOD_COMMON_DB_BIB_QUERY_H_ */
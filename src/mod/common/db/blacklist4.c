@@ -16,6 +16,11 @@ struct addr4_pool *blacklist4_alloc(void)
 	return pool_alloc();
 }
 
+struct addr4_pool *blacklist4_clone(struct addr4_pool *pool)
+{
+	return pool_clone(pool);
+}
+
 void blacklist4_get(struct addr4_pool *pool)
 {
 	pool_get(pool);
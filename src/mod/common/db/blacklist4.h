@@ -10,6 +10,7 @@
 #include "mod/common/db/pool.h"
 
 struct addr4_pool *blacklist4_alloc(void);
+struct addr4_pool *blacklist4_clone(struct addr4_pool *pool);
 void blacklist4_get(struct addr4_pool *pool);
 void blacklist4_put(struct addr4_pool *pool);
 
@@ -473,6 +473,51 @@ struct eam_table *eamt_alloc(void)
 	return result;
 }
 
+static int clone_cb(void const *eam, void *arg)
+{
+	struct eam_table *clone = arg;
+	struct eamt_entry *entry = (struct eamt_entry *)eam;
+	int error;
+
+	/* The entries were already validated when they reached the original. */
+	error = eamt_add6(clone, entry);
+	if (error)
+		return error;
+	error = eamt_add4(clone, entry);
+	if (error) {
+		__revert_add6(clone, &entry->prefix6);
+		return error;
+	}
+
+	clone->count++;
+	return 0;
+}
+
+/**
+ * Returns a private copy of @eamt, so it can be modified without affecting the
+ * instance that is currently using @eamt.
+ */
+struct eam_table *eamt_clone(struct eam_table *eamt)
+{
+	struct eam_table *clone;
+	int error;
+
+	clone = eamt_alloc();
+	if (!clone)
+		return NULL;
+
+	mutex_lock(&lock);
+	error = rtrie_foreach(&eamt->trie4, clone_cb, clone, NULL);
+	mutex_unlock(&lock);
+
+	if (error) {
+		eamt_put(clone);
+		return NULL;
+	}
+
+	return clone;
+}
+
 void eamt_get(struct eam_table *eamt)
 {
 	kref_get(&eamt->refcount);
@@ -10,6 +10,7 @@
 struct eam_table;
 
 struct eam_table *eamt_alloc(void);
+struct eam_table *eamt_clone(struct eam_table *eamt);
 void eamt_get(struct eam_table *eamt);
 void eamt_put(struct eam_table *eamt);
 
@@ -74,6 +74,10 @@ int globals_init(struct jool_globals *config, xlator_type type,
 	config->new_tos = DEFAULT_NEW_TOS;
 	memcpy(config->plateaus.values, &PLATEAUS, sizeof(PLATEAUS));
 	config->plateaus.count = ARRAY_SIZE(PLATEAUS);
+	config->direct_xmit = DEFAULT_DIRECT_XMIT;
+	config->icmp_error_rate = DEFAULT_ICMP_ERROR_RATE;
+	config->latency_histograms = DEFAULT_LATENCY_HISTOGRAMS;
+	config->stats_stream_interval = DEFAULT_STATS_STREAM_INTERVAL;
 
 	switch (type) {
 	case XT_SIIT:
@@ -96,15 +100,19 @@ int globals_init(struct jool_globals *config, xlator_type type,
 		config->nat64.bib.ttl.icmp = 1000 * ICMP_DEFAULT;
 		config->nat64.bib.bib_logging = DEFAULT_BIB_LOGGING;
 		config->nat64.bib.session_logging = DEFAULT_SESSION_LOGGING;
+		config->nat64.bib.logging_stream = DEFAULT_LOGGING_STREAM;
 		config->nat64.bib.drop_by_addr = DEFAULT_ADDR_DEPENDENT_FILTERING;
 		config->nat64.bib.drop_external_tcp = DEFAULT_DROP_EXTERNAL_CONNECTIONS;
 		config->nat64.bib.max_stored_pkts = DEFAULT_MAX_STORED_PKTS;
+		config->nat64.bib.tcp_offload = DEFAULT_TCP_OFFLOAD;
 
 		config->nat64.joold.enabled = DEFAULT_JOOLD_ENABLED;
 		config->nat64.joold.flush_asap = DEFAULT_JOOLD_FLUSH_ASAP;
 		config->nat64.joold.flush_deadline = 1000 * DEFAULT_JOOLD_DEADLINE;
 		config->nat64.joold.capacity = DEFAULT_JOOLD_CAPACITY;
 		config->nat64.joold.max_payload = DEFAULT_JOOLD_MAX_PAYLOAD;
+		config->nat64.joold.window = DEFAULT_JOOLD_WINDOW;
+		config->nat64.joold.advertise_rate = DEFAULT_JOOLD_ADVERTISE_RATE;
 		break;
 
 	default:
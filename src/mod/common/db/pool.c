@@ -81,6 +81,43 @@ struct addr4_pool *pool_alloc(void)
 	return result;
 }
 
+/**
+ * Returns a private copy of @pool, so it can be modified without affecting the
+ * instance that is currently using @pool.
+ */
+RCUTAG_USR
+struct addr4_pool *pool_clone(struct addr4_pool *pool)
+{
+	struct addr4_pool *clone;
+	struct list_head *src;
+	struct list_head *dst;
+	struct pool_entry *entry;
+	struct pool_entry *copy;
+
+	clone = pool_alloc();
+	if (!clone)
+		return NULL;
+
+	/* @clone isn't published yet, so its list needs no RCU. */
+	dst = rcu_dereference_raw(clone->list);
+
+	mutex_lock(&lock);
+	src = rcu_dereference_protected(pool->list, lockdep_is_held(&lock));
+	list_for_each_entry(entry, src, list_hook) {
+		copy = wkmalloc(struct pool_entry, GFP_KERNEL);
+		if (!copy) {
+			mutex_unlock(&lock);
+			pool_put(clone);
+			return NULL;
+		}
+		copy->prefix = entry->prefix;
+		list_add_tail(&copy->list_hook, dst);
+	}
+	mutex_unlock(&lock);
+
+	return clone;
+}
+
 void pool_get(struct addr4_pool *pool)
 {
 	kref_get(&pool->refcounter);
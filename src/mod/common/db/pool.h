@@ -13,6 +13,7 @@ struct addr4_pool;
 /* Do-not-use-when-you-can't-sleep-functions */
 
 struct addr4_pool *pool_alloc(void);
+struct addr4_pool *pool_clone(struct addr4_pool *pool);
 void pool_get(struct addr4_pool *pool);
 void pool_put(struct addr4_pool *pool);
 
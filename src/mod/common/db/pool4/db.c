@@ -66,6 +66,13 @@ struct pool4_table {
 	 */
 	enum iteration_flags max_iterations_flags;
 
+	/**
+	 * Port allocations that ran out of candidates while iterating on
+	 * mask_domains inferred from this table. (See mask_domain_report().)
+	 * Only relevant in mark-based tables.
+	 */
+	__u32 exhaustions;
+
 	/*
 	 * An array of struct ipv4_range hangs off here.
 	 * (The array length is @sample_count.)
@@ -98,11 +105,14 @@ struct pool4 {
 
 struct mask_domain {
 	__u32 pool_mark;
+	l4_protocol proto;
 
 	unsigned int taddr_count;
 	unsigned int taddr_counter;
 	/* ITERATIONS_INFINITE is represented by this being zero. */
 	unsigned int max_iterations;
+	/* Did mask_domain_next() run out of candidates? */
+	bool exhausted;
 
 	unsigned int range_count;
 	struct ipv4_range *current_range;
@@ -253,6 +263,7 @@ static struct pool4_table *create_table(struct ipv4_range *range)
 	table->sample_count = 1;
 	table->max_iterations_allowed = 0;
 	table->max_iterations_flags = ITERATIONS_AUTO;
+	table->exhaustions = 0;
 
 	entry = first_table_entry(table);
 	*entry = *range;
@@ -280,6 +291,71 @@ struct pool4 *pool4db_alloc(void)
 	return result;
 }
 
+/* Assumes @src is locked, and @dst is empty and private. */
+static int clone_tree(struct rb_root *dst, struct rb_root *src)
+{
+	struct rb_node *node;
+	struct rb_node *parent = NULL;
+	struct rb_node **link = &dst->rb_node;
+	struct pool4_table *table;
+	struct pool4_table *copy;
+	size_t size;
+
+	for (node = rb_first(src); node; node = rb_next(node)) {
+		table = rb_entry(node, struct pool4_table, tree_hook);
+		size = sizeof(struct pool4_table)
+				+ table->sample_count * sizeof(struct ipv4_range);
+
+		copy = __wkmalloc("pool4table", size, GFP_ATOMIC);
+		if (!copy)
+			return -ENOMEM;
+		memcpy(copy, table, size);
+
+		/* @src is sorted, so every copy is the new rightmost node. */
+		rb_link_node(&copy->tree_hook, parent, link);
+		rb_insert_color(&copy->tree_hook, dst);
+		parent = &copy->tree_hook;
+		link = &parent->rb_right;
+	}
+
+	return 0;
+}
+
+/**
+ * Returns a private copy of @pool, so it can be modified without affecting the
+ * instance that is currently using @pool.
+ */
+struct pool4 *pool4db_clone(struct pool4 *pool)
+{
+	struct pool4 *clone;
+	int error;
+
+	clone = pool4db_alloc();
+	if (!clone)
+		return NULL;
+
+	spin_lock_bh(&pool->lock);
+	error = clone_tree(&clone->tree_mark.tcp, &pool->tree_mark.tcp);
+	if (!error)
+		error = clone_tree(&clone->tree_mark.udp, &pool->tree_mark.udp);
+	if (!error)
+		error = clone_tree(&clone->tree_mark.icmp, &pool->tree_mark.icmp);
+	if (!error)
+		error = clone_tree(&clone->tree_addr.tcp, &pool->tree_addr.tcp);
+	if (!error)
+		error = clone_tree(&clone->tree_addr.udp, &pool->tree_addr.udp);
+	if (!error)
+		error = clone_tree(&clone->tree_addr.icmp, &pool->tree_addr.icmp);
+	spin_unlock_bh(&pool->lock);
+
+	if (error) {
+		pool4db_put(clone);
+		return NULL;
+	}
+
+	return clone;
+}
+
 void pool4db_get(struct pool4 *pool)
 {
 	kref_get(&pool->refcounter);
@@ -1011,6 +1087,25 @@ eagain:
 	return -EAGAIN;
 }
 
+/**
+ * Returns the number of port allocations that ran out of candidates in
+ * @proto's @mark table. (Zero if the table doesn't exist.)
+ */
+__u32 pool4db_get_exhaustions(struct pool4 *pool, l4_protocol proto,
+		__u32 mark)
+{
+	struct pool4_table *table;
+	__u32 result = 0;
+
+	spin_lock_bh(&pool->lock);
+	table = find_by_mark(get_tree(&pool->tree_mark, proto), mark);
+	if (table)
+		result = table->exhaustions;
+	spin_unlock_bh(&pool->lock);
+
+	return result;
+}
+
 static void print_tree(struct rb_root *tree, bool mark)
 {
 	struct rb_node *node = rb_first(tree);
@@ -1060,7 +1155,7 @@ void pool4db_print(struct pool4 *pool)
 }
 
 static struct mask_domain *find_empty(struct route4_args *args,
-		unsigned int offset)
+		l4_protocol proto, unsigned int offset)
 {
 	struct mask_domain *masks;
 	struct ipv4_range *range;
@@ -1078,9 +1173,11 @@ static struct mask_domain *find_empty(struct route4_args *args,
 	}
 
 	masks->pool_mark = 0;
+	masks->proto = proto;
 	masks->taddr_count = port_range_count(&range->ports);
 	masks->taddr_counter = 0;
 	masks->max_iterations = 0;
+	masks->exhausted = false;
 	masks->range_count = 1;
 	masks->current_range = range;
 	masks->current_port = range->ports.min + offset % masks->taddr_count;
@@ -1105,7 +1202,7 @@ struct mask_domain *mask_domain_find(struct pool4 *pool, struct tuple *tuple6,
 
 	if (is_empty(pool)) {
 		spin_unlock_bh(&pool->lock);
-		return find_empty(route_args, offset);
+		return find_empty(route_args, tuple6->l4_proto, offset);
 	}
 
 	table = find_by_mark(get_tree(&pool->tree_mark, tuple6->l4_proto),
@@ -1128,7 +1225,9 @@ struct mask_domain *mask_domain_find(struct pool4 *pool, struct tuple *tuple6,
 	spin_unlock_bh(&pool->lock);
 
 	masks->pool_mark = route_args->mark;
+	masks->proto = tuple6->l4_proto;
 	masks->taddr_counter = 0;
+	masks->exhausted = false;
 	masks->dynamic = false;
 	offset %= masks->taddr_count;
 
@@ -1161,10 +1260,10 @@ int mask_domain_next(struct mask_domain *masks,
 {
 	masks->taddr_counter++;
 	if (masks->taddr_counter > masks->taddr_count)
-		return -ENOENT;
+		goto exhausted;
 	if (masks->max_iterations)
 		if (masks->taddr_counter > masks->max_iterations)
-			return -ENOENT;
+			goto exhausted;
 
 	masks->current_port++;
 	if (masks->current_port > masks->current_range->ports.max) {
@@ -1180,6 +1279,10 @@ int mask_domain_next(struct mask_domain *masks,
 	addr->l3 = masks->current_range->prefix.addr;
 	addr->l4 = masks->current_port;
 	return 0;
+
+exhausted:
+	masks->exhausted = true;
+	return -ENOENT;
 }
 
 /*
@@ -1213,6 +1316,36 @@ bool mask_domain_matches(struct mask_domain *masks,
 	return false;
 }
 
+/**
+ * If @masks ran out of candidates, blames its pool4 table. (So the user can
+ * tell which mark is running out of ports.)
+ *
+ * Needs to be called outside of the BIB's lock, since it takes pool4's.
+ */
+void mask_domain_report(struct pool4 *pool, struct mask_domain *masks)
+{
+	struct pool4_table *table;
+
+	if (!masks->exhausted || masks->dynamic)
+		return;
+
+	spin_lock_bh(&pool->lock);
+	table = find_by_mark(get_tree(&pool->tree_mark, masks->proto),
+			masks->pool_mark);
+	if (table)
+		table->exhaustions++;
+	spin_unlock_bh(&pool->lock);
+}
+
+/**
+ * Returns the number of transport addresses mask_domain_next() has handed out
+ * so far. (ie. how many candidates the port allocation tried.)
+ */
+unsigned int mask_domain_get_iterations(struct mask_domain *masks)
+{
+	return masks->taddr_counter;
+}
+
 bool mask_domain_is_dynamic(struct mask_domain *masks)
 {
 	return masks->dynamic;
@@ -19,6 +19,7 @@ struct pool4;
  */
 
 struct pool4 *pool4db_alloc(void);
+struct pool4 *pool4db_clone(struct pool4 *pool);
 void pool4db_get(struct pool4 *pool);
 void pool4db_put(struct pool4 *pool);
 
@@ -40,6 +41,8 @@ typedef int (*pool4db_foreach_entry_cb)(struct pool4_entry const *, void *);
 int pool4db_foreach_sample(struct pool4 *pool, l4_protocol proto,
 		pool4db_foreach_entry_cb cb, void *arg,
 		struct pool4_entry *offset);
+__u32 pool4db_get_exhaustions(struct pool4 *pool, l4_protocol proto,
+		__u32 mark);
 
 struct mask_domain;
 
@@ -50,6 +53,8 @@ int mask_domain_next(struct mask_domain *masks,
 		struct ipv4_transport_addr *addr,
 		bool *consecutive);
 void mask_domain_commit(struct mask_domain *masks);
+void mask_domain_report(struct pool4 *pool, struct mask_domain *masks);
+unsigned int mask_domain_get_iterations(struct mask_domain *masks);
 bool mask_domain_matches(struct mask_domain *masks,
 		struct ipv4_transport_addr *addr);
 bool mask_domain_is_dynamic(struct mask_domain *masks);
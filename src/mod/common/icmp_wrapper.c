@@ -1,12 +1,37 @@
 #include "mod/common/icmp_wrapper.h"
 
+#include <linux/hash.h>
 #include <linux/icmpv6.h>
+#include <linux/jhash.h>
+#include <linux/math64.h>
+#include <linux/net.h>
 #include <linux/version.h>
 #include <net/icmp.h>
 #include "common/types.h"
 #include "mod/common/log.h"
 #include "mod/common/route.h"
 
+/*
+ * Rate limiting buckets. Sources are hashed into them, so sources that collide
+ * share their allowance. That's fine; this is meant to keep a scan from eating
+ * the CPU, not to be exact.
+ *
+ * The instance is part of the key, so a source flooding one instance doesn't
+ * drain its buckets in the others. (Unless it collides, same as above.)
+ *
+ * Each bucket packs a token bucket in a single atomic so it can be updated
+ * without locks: the upper 32 bits are the (truncated) jiffy of the last
+ * update, and the lower 32 bits are the available credit, in thousandths of
+ * an error.
+ */
+#define RL_HASH_BITS 10
+#define RL_COST 1000U
+/* So RL_COST times the rate (ie. the maximum credit) fits in 32 bits. */
+#define RL_MAX_RATE 1000000U
+
+static atomic64_t buckets[1 << RL_HASH_BITS];
+static u32 rl_seed;
+
 static char *icmp_error_to_string(icmp_error_code error)
 {
 	switch (error) {
@@ -130,6 +155,81 @@ bool icmp64_send6(struct sk_buff *skb, icmp_error_code error, __u32 info)
 	return true;
 }
 
+static atomic64_t *get_bucket(struct xlator const *jool, struct sk_buff *skb)
+{
+	u32 seed;
+	u32 hash;
+
+	net_get_random_once(&rl_seed, sizeof(rl_seed));
+	/* (Namespace and name, so the buckets survive atomic configuration.) */
+	seed = jhash(jool->iname, strlen(jool->iname),
+			rl_seed ^ hash_ptr(jool->ns, 32));
+
+	switch (ntohs(skb->protocol)) {
+	case ETH_P_IP:
+		hash = jhash_1word((__force u32)ip_hdr(skb)->saddr, seed);
+		break;
+	case ETH_P_IPV6:
+		/* The owner of a /64 can trivially rotate the rest. */
+		hash = jhash2((__force u32 *)ipv6_hdr(skb)->saddr.s6_addr32, 2,
+				seed);
+		break;
+	default:
+		return NULL;
+	}
+
+	return &buckets[hash_32(hash, RL_HASH_BITS)];
+}
+
+/**
+ * Spends one token from the bucket that corresponds to @skb's source, in @jool.
+ * (@skb being a packet @jool wants to answer with an ICMP error.) Buckets
+ * refill at icmp-error-rate tokens per second, and hold at most icmp-error-rate
+ * tokens.
+ *
+ * Returns false if the source has run out of tokens, which means the error
+ * should not be sent. A zero icmp-error-rate disables the limit.
+ *
+ * Meant to be called before any of the icmp64_send*() functions, since those
+ * are rather expensive.
+ */
+bool icmp64_allow(struct xlator const *jool, struct sk_buff *skb)
+{
+	atomic64_t *bucket;
+	unsigned int rate;
+	u64 old, new;
+	u32 now, elapsed, credit, max_credit;
+
+	rate = jool->globals.icmp_error_rate;
+	if (!rate || unlikely(!skb))
+		return true;
+	bucket = get_bucket(jool, skb);
+	if (!bucket)
+		return true;
+
+	rate = min(rate, RL_MAX_RATE);
+	max_credit = rate * RL_COST;
+	now = (u32)jiffies;
+
+	do {
+		old = atomic64_read(bucket);
+
+		/* A full second refills the bucket anyway. */
+		elapsed = min_t(u32, now - (u32)(old >> 32), HZ);
+		credit = (u32)old + (u32)div_u64((u64)elapsed * max_credit, HZ);
+		if (credit > max_credit)
+			credit = max_credit;
+
+		/* Not updating the bucket is fine; nothing was spent. */
+		if (credit < RL_COST)
+			return false;
+
+		new = ((u64)now << 32) | (credit - RL_COST);
+	} while (atomic64_cmpxchg(bucket, old, new) != old);
+
+	return true;
+}
+
 bool icmp64_send(struct sk_buff *skb, icmp_error_code error, __u32 info)
 {
 	if (unlikely(!skb))
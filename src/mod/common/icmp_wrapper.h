@@ -19,6 +19,7 @@
  */
 
 #include "mod/common/packet.h"
+#include "mod/common/xlator.h"
 
 typedef enum icmp_errcode {
 	ICMPERR_NONE,
@@ -39,6 +40,11 @@ bool icmp64_send6(struct sk_buff *skb, icmp_error_code error, __u32 info);
 bool icmp64_send4(struct sk_buff *skb, icmp_error_code error, __u32 info);
 bool icmp64_send(struct sk_buff *skb, icmp_error_code error, __u32 info);
 
+/**
+ * Per-instance, per-source rate limit for the errors above.
+ */
+bool icmp64_allow(struct xlator const *jool, struct sk_buff *skb);
+
 /**
  * Return the numbers of icmp error that was sent, also reset the static counter
  * This is only used in Unit Testing.
@@ -1,10 +1,18 @@
 #include "mod/common/joold.h"
 
+#include <linux/hash.h>
 #include <linux/inet.h>
+#include <linux/jhash.h>
+#include <linux/percpu.h>
+#include <linux/random.h>
+#include <linux/workqueue.h>
 #include <net/genetlink.h>
 
 #include "common/constants.h"
+#include "mod/common/address.h"
 #include "mod/common/log.h"
+#include "mod/common/rfc6052.h"
+#include "mod/common/tracepoint.h"
 #include "mod/common/wkmalloc.h"
 #include "mod/common/xlator.h"
 #include "mod/common/nl/attribute.h"
@@ -14,6 +22,19 @@
 
 #define GLOBALS(xlator) (xlator->globals.nat64.joold)
 
+/* Sessions each CPU can stage before it has to hand them over to the queue. */
+#define JOOLD_STAGE_SIZE 32
+#define JOOLD_HASH_BITS 8
+#define JOOLD_HASH_SIZE (1 << JOOLD_HASH_BITS)
+/* Time between advertisement rounds, if no ACK triggers one earlier. */
+#define JOOLD_ADVERTISE_PERIOD msecs_to_jiffies(100)
+
+/* Session tables an advertisement walks, in order. */
+static const l4_protocol advertise_protos[] = {
+	L4PROTO_TCP, L4PROTO_UDP, L4PROTO_ICMP,
+};
+#define ADVERTISE_PROTO_COUNT ARRAY_SIZE(advertise_protos)
+
 /*
  * Remember to include in the user documentation:
  *
@@ -21,29 +42,99 @@
  * - Apparently, users do not actually need to keep clocks in sync.
  */
 
+/**
+ * The sessions a single CPU updated since the last time they were handed over
+ * to the queue.
+ *
+ * joold_add() is called on every translated packet, so it cannot afford to
+ * fight the other CPUs over the queue's lock. Instead, it only touches the
+ * current CPU's stage, and the queue only hears about the sessions in bulk.
+ * The lock is only contended while somebody is draining every CPU (ACKs and
+ * the timer), which is rare.
+ */
+struct joold_stage {
+	struct session_entry sessions[JOOLD_STAGE_SIZE];
+	unsigned int count;
+	spinlock_t lock;
+};
+
+/**
+ * A dump of the entire session table, trickling to joold in the background.
+ *
+ * It does not go through the queue; a worker sends it whenever the live
+ * updates leave room in the window, and never faster than ss-advertise-rate.
+ * The cursor lives as long as the queue does, so an advertisement that was
+ * interrupted (joold went away, ss-enabled was turned off, the instance was
+ * replaced) resumes where it left off the next time the user asks for one.
+ */
+struct joold_advertiser {
+	/**
+	 * Next round. Owned by the instance that owns the queue, which cancels
+	 * it (joold_stop()) before it drops its reference.
+	 */
+	struct delayed_work work;
+	/** The instance the queue belongs to. */
+	char iname[INAME_MAX_SIZE];
+	xlator_flags flags;
+	/**
+	 * true: The advertisement is in progress.
+	 * false: It's either done or paused. (See @proto.)
+	 */
+	bool active;
+	/** true: The owner is gone; @work must not be scheduled anymore. */
+	bool stopped;
+
+	/*
+	 * The fields below are only touched by the worker, or while @active
+	 * is false.
+	 */
+
+	/**
+	 * Index (in advertise_protos) of the table being dumped.
+	 * ADVERTISE_PROTO_COUNT means there's nothing to resume.
+	 */
+	unsigned int proto;
+	/** Last session sent from that table. Valid if @offset_set. */
+	struct session_foreach_offset offset;
+	bool offset_set;
+
+	/** Sessions we can send before we exceed ss-advertise-rate. */
+	unsigned int tokens;
+	/** Jiffy at which @tokens was last replenished. */
+	unsigned long last_refill;
+
+	/** Sessions sent so far. (JSTAT_JOOLD_ADV_SENT.) */
+	unsigned int sent;
+	/** Size of the table when the advertisement started. */
+	unsigned int total;
+};
+
 struct joold_queue {
-	/* The packet we're accumulating the sessions in. */
-	struct sk_buff *skb;
-	void *msg_head;
-	struct nlattr *root;
-	bool skb_full;
+	/** Per-CPU buffers where joold_add() drops the sessions first. */
+	struct joold_stage __percpu *stages;
 
-	/** Additional sessions we've queued but don't fit in @skb yet. */
+	/** Sessions waiting to be sent to userspace. */
 	struct list_head sessions;
+	/**
+	 * Indexes the nodes from @sessions, so a session that gets updated
+	 * several times before the next flush is only sent once.
+	 */
+	struct hlist_head index[JOOLD_HASH_SIZE];
+	u32 seed;
 	/** Number of nodes in @sessions. */
 	unsigned int count;
-	/** Number of advertisement nodes in @sessions. */
-	unsigned int advertisement_count;
 
+	/** Sequence number of the next packet we'll send to joold. */
+	u32 next_seq;
 	/**
-	 * Can we send a packet?
+	 * Number of packets we've sent whose ACK hasn't arrived yet.
 	 * We need to wait for ACKs because the kernel can't handle too many
-	 * Netlink messages at once.
+	 * Netlink messages at once. (See ss-window.)
 	 */
-	bool ack_received;
+	unsigned int in_flight;
 	/**
 	 * Jiffy at which the last batch of sessions was sent.
-	 * If the ACK was lost for some reason, this should get us back on
+	 * If ACKs were lost for some reason, this should get us back on
 	 * track.
 	 */
 	unsigned long last_flush_time;
@@ -51,151 +142,423 @@ struct joold_queue {
 	/** Namespace where the sessions will be multicasted. */
 	struct net *ns;
 
+	struct joold_advertiser advertiser;
+
+	/**
+	 * Protects everything above, except @stages and the worker-only
+	 * fields of @advertiser. Nests inside stages.
+	 */
 	spinlock_t lock;
 	struct kref refs;
 };
 
 /**
- * A session or group of sessions that need to be transmitted to other Jool
- * instances in the near future.
+ * A session that needs to be transmitted to other Jool instances in the near
+ * future. These are added whenever a translating packet updates a session.
  */
 struct joold_node {
-	/**
-	 * true - @group below is valid.
-	 * false - @single below is valid.
-	 */
-	bool is_group;
-	union {
-		/**
-		 * If @single is valid, this node represents a lone session.
-		 * These are added whenever a translating packet updates a
-		 * session.
-		 */
-		struct session_entry single;
-		/**
-		 * If @group is valid, the user issued an --advertise.
-		 * The whole database needs to be transmitted.
-		 * Unfortunately, a typical table won't fit in a single
-		 * packet so this node might stick for several iterations and
-		 * keep track of what is yet to be sent.
-		 */
-		struct {
-			/** IPv4 ID of the session sent in the last packet. */
-			struct taddr4_tuple offset;
-			/**
-			 * true - @offset above is valid.
-			 * false - @no sessions from this node have been sent.
-			 */
-			bool offset_set;
-			/** Protocol table this group belongs to. */
-			l4_protocol proto;
-		} group;
-	};
+	struct session_entry session;
 
 	/** List hook to joold_queue.sessions.  */
 	struct list_head nextprev;
-};
-
-struct write_status {
-	bool is_full;
-	unsigned int entries_written;
-};
-
-struct joold_advertise_struct {
-	struct sk_buff *skb;
-	struct joold_node *node;
-	struct write_status *status;
+	/** Hook to joold_queue.index. */
+	struct hlist_node hook;
 };
 
 static struct kmem_cache *node_cache;
+/* Runs the advertisers. */
+static struct workqueue_struct *joold_wq;
+
+static void advertise_round(struct work_struct *work);
 
 static int joold_setup(void)
 {
 	node_cache = kmem_cache_create("jool_joold_nodes",
 			sizeof(struct joold_node), 0, 0, NULL);
-	return node_cache ? 0 : -EINVAL;
+	if (!node_cache)
+		return -EINVAL;
+
+	joold_wq = alloc_workqueue("jool_joold", 0, 0);
+	if (!joold_wq) {
+		kmem_cache_destroy(node_cache);
+		node_cache = NULL;
+		return -ENOMEM;
+	}
+
+	return 0;
 }
 
 void joold_teardown(void)
 {
+	if (joold_wq) {
+		/* The instances are gone, so joold_stop() idled every round. */
+		destroy_workqueue(joold_wq);
+		joold_wq = NULL;
+	}
+
 	if (node_cache) {
 		kmem_cache_destroy(node_cache);
 		node_cache = NULL;
 	}
 }
 
-static int allocate_joold_skb(struct xlator *jool)
+/* Number of sessions that usually fit in a single joold packet. */
+static unsigned int sessions_per_packet(struct xlator *jool)
+{
+	size_t overhead;
+	size_t payload;
+
+	overhead = jnl_family()->hdrsize
+			+ nla_total_size(sizeof(struct joold_records_hdr));
+	payload = GLOBALS(jool).max_payload;
+	return (payload > overhead)
+			? ((payload - overhead) / sizeof(struct joold_record))
+			: 0;
+}
+
+/* Can the peers infer @session's dst6 from its dst4? */
+static bool is_dst6_implied(struct xlator *jool,
+		struct session_entry const *session)
 {
-	struct joold_queue *queue = jool->nat64.joold;
+	struct in6_addr implied;
 
-	queue->skb = genlmsg_new(GLOBALS(jool).max_payload, GFP_ATOMIC);
-	if (!queue->skb)
-		return -ENOMEM;
+	return !__rfc6052_4to6(&jool->globals.pool6.prefix, &session->dst4.l3,
+			&implied) && addr6_equals(&implied, &session->dst6.l3);
+}
 
-	queue->msg_head = genlmsg_put(queue->skb, 0, 0, jnl_family(), 0, 0);
-	if (!queue->msg_head) {
-		pr_err("genlmsg_put() returned NULL.\n");
-		goto kill_packet;
+/* Bytes @session will span once written by put_record(). */
+static size_t record_size(struct xlator *jool,
+		struct session_entry const *session)
+{
+	return sizeof(struct joold_record) + (is_dst6_implied(jool, session)
+			? 0 : sizeof(struct in6_addr));
+}
+
+/*
+ * Writes @session on @buffer, in compact wire format.
+ * @buffer is assumed to have record_size() bytes of room.
+ * Returns the number of bytes written.
+ */
+static size_t put_record(struct xlator *jool, void *buffer,
+		struct session_entry const *session)
+{
+	struct joold_record *record = buffer;
+
+	record->src6 = session->src6.l3;
+	record->src4 = session->src4.l3;
+	record->dst4 = session->dst4.l3;
+	record->src6_port = cpu_to_be16(session->src6.l4);
+	record->dst6_port = cpu_to_be16(session->dst6.l4);
+	record->src4_port = cpu_to_be16(session->src4.l4);
+	record->dst4_port = cpu_to_be16(session->dst4.l4);
+	record->proto = session->proto;
+	record->state = session->state;
+	record->timer = session->timer_type;
+	record->flags = 0;
+	record->expiration = cpu_to_be32(jnla_get_session_dying_time(session));
+
+	if (is_dst6_implied(jool, session))
+		return sizeof(*record);
+
+	record->flags |= JOOLD_RECORD_DST6;
+	memcpy(record + 1, &session->dst6.l3, sizeof(session->dst6.l3));
+	return sizeof(*record) + sizeof(session->dst6.l3);
+}
+
+/*
+ * Reads the compact record at the beginning of @buffer into @session.
+ * Returns the number of bytes the record spans, or a negative error code.
+ */
+static int get_record(struct xlator *jool, void const *buffer, size_t len,
+		struct session_entry *session)
+{
+	struct joold_record const *record = buffer;
+	size_t size;
+	int error;
+
+	size = sizeof(*record);
+	if (len < size)
+		goto truncated;
+
+	/* (The protocol is validated by jnla_get_session_timeout().) */
+	if (record->flags & ~JOOLD_RECORD_DST6) {
+		log_err("Joold record has unknown flags: 0x%x", record->flags);
+		return -EINVAL;
+	}
+	if (record->state > TRANS) {
+		log_err("Joold record has an unknown TCP state: %u",
+				record->state);
+		return -EINVAL;
+	}
+	if (record->timer > SESSION_TIMER_SYN4) {
+		log_err("Joold record has an unknown timer: %u", record->timer);
+		return -EINVAL;
 	}
 
-	queue->root = nla_nest_start(queue->skb, JNLAR_SESSION_ENTRIES);
-	if (!queue->root) {
-		pr_err("Joold packets cannot contain any sessions.\n");
-		queue->msg_head = NULL;
-		goto kill_packet;
+	memset(session, 0, sizeof(*session));
+	session->src6.l3 = record->src6;
+	session->src6.l4 = be16_to_cpu(record->src6_port);
+	session->dst6.l4 = be16_to_cpu(record->dst6_port);
+	session->src4.l3 = record->src4;
+	session->src4.l4 = be16_to_cpu(record->src4_port);
+	session->dst4.l3 = record->dst4;
+	session->dst4.l4 = be16_to_cpu(record->dst4_port);
+	session->proto = record->proto;
+	session->state = record->state;
+	session->timer_type = record->timer;
+
+	if (record->flags & JOOLD_RECORD_DST6) {
+		if (len < size + sizeof(session->dst6.l3))
+			goto truncated;
+		memcpy(&session->dst6.l3, record + 1, sizeof(session->dst6.l3));
+		size += sizeof(session->dst6.l3);
+	} else {
+		error = __rfc6052_4to6(&jool->globals.pool6.prefix,
+				&session->dst4.l3, &session->dst6.l3);
+		if (error)
+			return error;
 	}
 
-	return 0;
+	error = jnla_get_session_timeout(&jool->globals.nat64.bib, session);
+	if (error)
+		return error;
+	session->update_time = jiffies
+			+ msecs_to_jiffies(be32_to_cpu(record->expiration))
+			- session->timeout;
+	session->has_stored = false;
 
-kill_packet:
-	kfree_skb(queue->skb);
-	queue->skb = NULL;
-	return -ENOMEM;
+	return size;
+
+truncated:
+	log_err("Joold record is truncated.");
+	return -EINVAL;
 }
 
-static bool should_send(struct xlator *jool)
+static struct hlist_head *get_bucket(struct joold_queue *queue,
+		struct session_entry const *session)
+{
+	u32 hash;
+
+	hash = jhash2((u32 const *)session->src6.l3.s6_addr32, 4, queue->seed);
+	hash = jhash_3words((__force u32)session->src4.l3.s_addr,
+			(session->src6.l4 << 16) | session->src4.l4,
+			session->proto, hash);
+	return &queue->index[hash_32(hash, JOOLD_HASH_BITS)];
+}
+
+/* Assumes the queue's lock is held. */
+static void rm_node(struct joold_queue *queue, struct joold_node *node)
+{
+	list_del(&node->nextprev);
+	hlist_del(&node->hook);
+	queue->count--;
+	wkmem_cache_free("joold node", node_cache, node);
+}
+
+/**
+ * Queues @session, or updates its queued copy if it's already there.
+ * Assumes the queue's lock is held.
+ */
+static void queue_session(struct xlator *jool, struct session_entry *session)
 {
 	struct joold_queue *queue;
+	struct hlist_head *bucket;
+	struct joold_node *node;
+
+	trace_jool_joold_enqueue(jool->iname, &session->src6, &session->dst6,
+			&session->src4, &session->dst4, session->proto,
+			session->state);
+
+	queue = jool->nat64.joold;
+	bucket = get_bucket(queue, session);
+
+	hlist_for_each_entry(node, bucket, hook) {
+		if (session_equals(&node->session, session)) {
+			node->session = *session;
+			return;
+		}
+	}
+
+	if (queue->count >= GLOBALS(jool).capacity) {
+		log_warn_once("Too many sessions are queuing up! Cannot synchronize fast enough; I will have to drop some sessions. Sorry.");
+		goto drop;
+	}
+
+	node = wkmem_cache_alloc("joold node", node_cache, GFP_ATOMIC);
+	if (!node)
+		goto drop; /* Discard it; can't do anything. */
+
+	node->session = *session;
+	list_add_tail(&node->nextprev, &queue->sessions);
+	hlist_add_head(&node->hook, bucket);
+	queue->count++;
+	return;
+
+drop:
+	jstat_inc(jool->stats, JSTAT_JOOLD_DROPPED);
+}
+
+/**
+ * Moves @stage's sessions to the queue.
+ * Assumes both @stage's and the queue's locks are held.
+ */
+static void drain_stage(struct xlator *jool, struct joold_stage *stage)
+{
+	unsigned int i;
+
+	for (i = 0; i < stage->count; i++)
+		queue_session(jool, &stage->sessions[i]);
+	stage->count = 0;
+}
+
+/**
+ * Moves every CPU's staged sessions to the queue.
+ * Assumes none of the locks are held.
+ */
+static void drain_stages(struct xlator *jool)
+{
+	struct joold_queue *queue;
+	struct joold_stage *stage;
+	int cpu;
+
+	queue = jool->nat64.joold;
+
+	for_each_possible_cpu(cpu) {
+		stage = per_cpu_ptr(queue->stages, cpu);
+
+		spin_lock_bh(&stage->lock);
+		if (stage->count) {
+			spin_lock(&queue->lock);
+			drain_stage(jool, stage);
+			spin_unlock(&queue->lock);
+		}
+		spin_unlock_bh(&stage->lock);
+	}
+}
+
+static bool is_window_full(struct xlator *jool)
+{
+	return READ_ONCE(jool->nat64.joold->in_flight)
+			>= max(GLOBALS(jool).window, 1u);
+}
+
+static bool is_deadline_passed(struct xlator *jool)
+{
 	unsigned long deadline;
 
+	deadline = msecs_to_jiffies(GLOBALS(jool).flush_deadline);
+	return time_before(READ_ONCE(jool->nat64.joold->last_flush_time)
+			+ deadline, jiffies);
+}
+
+static bool should_send(struct xlator *jool)
+{
+	struct joold_queue *queue;
+
 	queue = jool->nat64.joold;
-	if (!queue->skb)
+	if (queue->count == 0)
 		return false;
 
-	deadline = msecs_to_jiffies(GLOBALS(jool).flush_deadline);
-	if (time_before(queue->last_flush_time + deadline, jiffies))
+	if (is_deadline_passed(jool))
 		return true;
 
-	if (!queue->ack_received)
+	if (is_window_full(jool))
 		return false;
 
 	if (GLOBALS(jool).flush_asap)
 		return true;
 
-	if (queue->advertisement_count > 0)
-		return true;
-
-	return queue->skb_full;
+	return queue->count >= sessions_per_packet(jool);
 }
 
-/**
- * Assumes the lock is held.
- * If this returns a packet, you have to send it via send_to_userspace() after
- * releasing the spinlock.
+/*
+ * If the ACKs are not coming, assume they were lost.
+ * Assumes the queue's lock is held.
  */
-static struct sk_buff *send_to_userspace_prepare(struct xlator *jool)
+static void forget_lost_acks(struct xlator *jool)
 {
 	struct joold_queue *queue;
+
+	if (!is_deadline_passed(jool))
+		return;
+
+	queue = jool->nat64.joold;
+	WRITE_ONCE(queue->in_flight, 0);
+}
+
+/* Bytes a joold packet can spend on its records attribute. */
+static size_t records_room(struct xlator *jool)
+{
+	size_t room;
+	size_t overhead;
+
+	room = GLOBALS(jool).max_payload;
+	overhead = jnl_family()->hdrsize + nla_total_size(sizeof(u32));
+	return (room > overhead) ? (room - overhead) : 0;
+}
+
+/*
+ * Allocates a joold packet, and reserves @size bytes for @count records in it.
+ * @size includes the records header, which this writes.
+ * Returns the packet; @records will point to where the records go.
+ */
+static struct sk_buff *alloc_packet(struct xlator *jool, size_t size,
+		unsigned int count, void **msg_head, void **records)
+{
 	struct sk_buff *skb;
+	struct nlattr *attr;
+	struct joold_records_hdr *hdr;
 
-	if (!should_send(jool))
+	skb = genlmsg_new(GLOBALS(jool).max_payload, GFP_ATOMIC);
+	if (!skb)
 		return NULL;
 
+	*msg_head = genlmsg_put(skb, 0, 0, jnl_family(), 0, 0);
+	if (!(*msg_head)) {
+		pr_err("genlmsg_put() returned NULL.\n");
+		goto kill_packet;
+	}
+
+	attr = nla_reserve(skb, JNLAR_SESSION_RECORDS, size);
+	if (!attr) {
+		pr_err("Joold packets cannot contain any sessions.\n");
+		goto kill_packet;
+	}
+
+	hdr = nla_data(attr);
+	hdr->magic = cpu_to_be16(JOOLD_RECORDS_MAGIC);
+	hdr->version = JOOLD_RECORDS_VERSION;
+	hdr->reserved1 = 0;
+	hdr->count = cpu_to_be16(count);
+	hdr->reserved2 = 0;
+
+	*records = hdr + 1;
+	return skb;
+
+kill_packet:
+	kfree_skb(skb);
+	return NULL;
+}
+
+/*
+ * Stamps the next sequence number on @skb, and counts it as in flight.
+ * Assumes the queue's lock is held.
+ * If this succeeds, you have to send @skb via send_to_userspace() after
+ * releasing the spinlock.
+ */
+static int seal_packet(struct xlator *jool, struct sk_buff *skb,
+		void *msg_head)
+{
+	struct joold_queue *queue;
+
 	queue = jool->nat64.joold;
 
-	skb = queue->skb;
-	nla_nest_end(skb, queue->root);
-	genlmsg_end(skb, queue->msg_head);
+	if (nla_put_u32(skb, JNLAR_JOOLD_SEQ, queue->next_seq)) {
+		pr_err("Joold packets cannot contain a sequence number.\n");
+		return -EINVAL;
+	}
+
+	genlmsg_end(skb, msg_head);
 
 	/*
 	 * BTW: This sucks.
@@ -204,20 +567,91 @@ static struct sk_buff *send_to_userspace_prepare(struct xlator *jool)
 	 * But the alternative is to do the nlcore_send_multicast_message()
 	 * with the lock held, and I don't have the stomach for that.
 	 */
-	queue->skb = NULL;
-	queue->msg_head = NULL;
-	queue->root = NULL;
-	queue->ack_received = false;
-	queue->last_flush_time = jiffies;
+	queue->next_seq++;
+	WRITE_ONCE(queue->in_flight, queue->in_flight + 1);
+	WRITE_ONCE(queue->last_flush_time, jiffies);
+	return 0;
+}
+
+/**
+ * Serializes as many of the queued sessions as will fit in a packet, and
+ * dequeues them.
+ * Assumes the lock is held.
+ */
+static struct sk_buff *build_packet(struct xlator *jool)
+{
+	struct joold_queue *queue;
+	struct joold_node *node, *tmp;
+	struct sk_buff *skb;
+	void *msg_head;
+	void *cursor;
+	size_t room, size, rsize;
+	unsigned int count, i;
+
+	queue = jool->nat64.joold;
+	room = records_room(jool);
+
+	/* First, figure out how many of them fit. */
+	size = sizeof(struct joold_records_hdr);
+	count = 0;
+	list_for_each_entry(node, &queue->sessions, nextprev) {
+		rsize = record_size(jool, &node->session);
+		if (nla_total_size(size + rsize) > room)
+			break;
+		size += rsize;
+		count++;
+	}
+	if (!count)
+		goto too_small;
+
+	skb = alloc_packet(jool, size, count, &msg_head, &cursor);
+	if (!skb)
+		return NULL;
+
+	/* Then write them. */
+	i = 0;
+	list_for_each_entry_safe(node, tmp, &queue->sessions, nextprev) {
+		if (i == count)
+			break;
+		cursor += put_record(jool, cursor, &node->session);
+		rm_node(queue, node);
+		i++;
+	}
+
+	if (seal_packet(jool, skb, msg_head))
+		goto kill_packet;
+
 	return skb;
+
+kill_packet:
+	kfree_skb(skb);
+	return NULL;
+
+too_small:
+	log_warn_once("ss-max-payload is too small to fit a single session.");
+	return NULL;
 }
 
-static void send_to_userspace(struct sk_buff *skb, struct net *ns)
+/**
+ * Assumes the lock is held.
+ * If this returns a packet, you have to send it via send_to_userspace() after
+ * releasing the spinlock.
+ */
+static struct sk_buff *send_to_userspace_prepare(struct xlator *jool)
+{
+	if (!should_send(jool))
+		return NULL;
+
+	forget_lost_acks(jool);
+	return build_packet(jool);
+}
+
+static int send_to_userspace(struct sk_buff *skb, struct net *ns)
 {
 	int error;
 
 	if (!skb)
-		return;
+		return 0;
 
 	log_debug("Sending multicast message.");
 #if LINUX_VERSION_LOWER_THAN(3, 13, 0, 7, 1)
@@ -241,6 +675,8 @@ static void send_to_userspace(struct sk_buff *skb, struct net *ns)
 	} else {
 		log_debug("Multicast message sent.");
 	}
+
+	return error;
 }
 
 /**
@@ -249,7 +685,10 @@ static void send_to_userspace(struct sk_buff *skb, struct net *ns)
 struct joold_queue *joold_alloc(struct net *ns)
 {
 	struct joold_queue *queue;
+	struct joold_stage *stage;
 	bool cache_created;
+	unsigned int i;
+	int cpu;
 
 	cache_created = false;
 	if (!node_cache) {
@@ -259,27 +698,42 @@ struct joold_queue *joold_alloc(struct net *ns)
 	}
 
 	queue = wkmalloc(struct joold_queue, GFP_KERNEL);
-	if (!queue) {
-		if (cache_created)
-			joold_teardown();
-		return NULL;
+	if (!queue)
+		goto queue_fail;
+
+	queue->stages = alloc_percpu(struct joold_stage);
+	if (!queue->stages)
+		goto stages_fail;
+	for_each_possible_cpu(cpu) {
+		stage = per_cpu_ptr(queue->stages, cpu);
+		stage->count = 0;
+		spin_lock_init(&stage->lock);
 	}
 
-	queue->skb = NULL;
-	queue->msg_head = NULL;
-	queue->root = NULL;
-	queue->skb_full = false;
 	INIT_LIST_HEAD(&queue->sessions);
+	for (i = 0; i < JOOLD_HASH_SIZE; i++)
+		INIT_HLIST_HEAD(&queue->index[i]);
+	get_random_bytes(&queue->seed, sizeof(queue->seed));
 	queue->count = 0;
-	queue->advertisement_count = 0;
-	queue->ack_received = true;
+	queue->next_seq = 0;
+	queue->in_flight = 0;
 	queue->last_flush_time = jiffies;
 	queue->ns = ns;
+	memset(&queue->advertiser, 0, sizeof(queue->advertiser));
+	INIT_DELAYED_WORK(&queue->advertiser.work, advertise_round);
+	queue->advertiser.proto = ADVERTISE_PROTO_COUNT;
 
 	spin_lock_init(&queue->lock);
 	kref_init(&queue->refs);
 
 	return queue;
+
+stages_fail:
+	wkfree(struct joold_queue, queue);
+queue_fail:
+	if (cache_created)
+		joold_teardown();
+	return NULL;
 }
 
 void joold_get(struct joold_queue *queue)
@@ -289,18 +743,13 @@ void joold_get(struct joold_queue *queue)
 
 static void purge_sessions(struct joold_queue *queue)
 {
-	struct joold_node *node;
-
 	while (!list_empty(&queue->sessions)) {
-		node = list_first_entry(&queue->sessions, struct joold_node,
-				nextprev);
-		list_del(&node->nextprev);
-		wkmem_cache_free("joold node", node_cache, node);
+		rm_node(queue, list_first_entry(&queue->sessions,
+				struct joold_node, nextprev));
 	}
 
 	queue->count = 0;
-	queue->advertisement_count = 0;
-	queue->ack_received = true;
+	queue->in_flight = 0;
 	queue->last_flush_time = jiffies;
 }
 
@@ -310,6 +759,7 @@ static void joold_release(struct kref *refs)
 	queue = container_of(refs, struct joold_queue, refs);
 
 	purge_sessions(queue);
+	free_percpu(queue->stages);
 	wkfree(struct joold_queue, queue);
 }
 
@@ -318,221 +768,644 @@ void joold_put(struct joold_queue *queue)
 	kref_put(&queue->refs, joold_release);
 }
 
+/* Assumes the stage's lock is held. */
+static void stage_session(struct joold_stage *stage,
+		struct session_entry *entry)
+{
+	unsigned int i;
+
+	for (i = 0; i < stage->count; i++) {
+		if (session_equals(&stage->sessions[i], entry)) {
+			stage->sessions[i] = *entry;
+			return;
+		}
+	}
+
+	stage->sessions[stage->count++] = *entry;
+}
+
+static bool should_drain(struct xlator *jool, struct joold_stage *stage)
+{
+	if (stage->count >= JOOLD_STAGE_SIZE)
+		return true;
+	if (is_deadline_passed(jool))
+		return true;
+	return GLOBALS(jool).flush_asap && !is_window_full(jool);
+}
+
 /**
  * joold_add - Add the @entry session to @queue.
  *
  * This is the function that gets called whenever a packet translation
  * successfully triggers the creation of a session entry. @entry will be sent
  * to the joold daemon.
+ *
+ * The session is only copied to the current CPU's stage. The stage is handed
+ * over to the queue (and the queue flushed, if it's time) once it fills up, or
+ * right away if the window has room and we're in flush-asap mode.
  */
 void joold_add(struct xlator *jool, struct session_entry *entry)
 {
 	struct joold_queue *queue;
-	struct joold_node *copy;
+	struct joold_stage *stage;
 	struct sk_buff *skb;
 
 	if (!GLOBALS(jool).enabled)
 		return;
 
 	queue = jool->nat64.joold;
-
-	spin_lock_bh(&queue->lock);
-
-	if (!queue->skb && allocate_joold_skb(jool)) {
-		spin_unlock_bh(&queue->lock);
-		return;
-	}
-
-	queue->skb_full = jnla_put_session(queue->skb, JNLAL_ENTRY, entry);
-	if (queue->skb_full) {
-		copy = wkmem_cache_alloc("joold node", node_cache, GFP_ATOMIC);
-		if (copy) {
-			copy->is_group = false;
-			copy->single = *entry;
-			list_add_tail(&copy->nextprev, &queue->sessions);
-			queue->count++;
-		} /* Else discard it; can't do anything. */
+	skb = NULL;
+
+	local_bh_disable();
+	stage = this_cpu_ptr(queue->stages);
+	spin_lock(&stage->lock);
+
+	stage_session(stage, entry);
+	if (should_drain(jool, stage)) {
+		spin_lock(&queue->lock);
+		drain_stage(jool, stage);
+		skb = send_to_userspace_prepare(jool);
+		spin_unlock(&queue->lock);
 	}
 
-	skb = send_to_userspace_prepare(jool);
-
-	spin_unlock_bh(&queue->lock);
+	spin_unlock(&stage->lock);
+	local_bh_enable();
 
 	send_to_userspace(skb, jool->ns);
 }
 
-struct add_params {
-	struct session_entry new;
-	bool success;
+/*
+ * Sessions joold_sync() parses before handing them over to the BIB in one go.
+ * Some advertisements carry a whole session table, so this is what keeps the
+ * BIB from locking and unlocking per session.
+ */
+#define JOOLD_SYNC_BATCH 256
+
+struct sync_state {
+	struct session_entry *batch;
+	unsigned int count;
+	/** Sessions we couldn't even parse. */
+	unsigned int invalid;
+	struct bib_add_summary summary;
 };
 
-static enum session_fate collision_cb(struct session_entry *old, void *arg)
+static void sync_flush(struct xlator *jool, struct sync_state *state)
 {
-	struct add_params *params = arg;
-	struct session_entry *new = &params->new;
-
-	if (session_equals(old, new)) { /* It's the same session; update it. */
-		old->state = new->state;
-		old->timer_type = new->timer_type;
-		old->update_time = new->update_time;
-		params->success = true;
-		return FATE_TIMER_SLOW;
-	}
-
-	log_err("We're out of sync: Incoming %s session entry %pI6c#%u|%pI6c#%u|%pI4#%u|%pI4#%u collides with DB entry %pI6c#%u|%pI6c#%u|%pI4#%u|%pI4#%u.",
-			l4proto_to_string(new->proto),
-			&new->src6.l3, new->src6.l4,
-			&new->dst6.l3, new->dst6.l4,
-			&new->src4.l3, new->src4.l4,
-			&new->dst4.l3, new->dst4.l4,
-			&old->src6.l3, old->src6.l4,
-			&old->dst6.l3, old->dst6.l4,
-			&old->src4.l3, old->src4.l4,
-			&old->dst4.l3, old->dst4.l4);
-	params->success = false;
-	return FATE_PRESERVE;
+	bib_add_sessions(jool, state->batch, state->count, &state->summary);
+	state->count = 0;
 }
 
-static bool add_new_session(struct xlator *jool, struct nlattr *attr)
+/* Returns the slot where the next incoming session should be parsed. */
+static struct session_entry *sync_next(struct xlator *jool,
+		struct sync_state *state)
 {
-	struct add_params params;
-	struct collision_cb cb;
-	int error;
+	if (state->count == JOOLD_SYNC_BATCH)
+		sync_flush(jool, state);
+	return &state->batch[state->count];
+}
 
-	log_debug("Adding session!");
+static int validate_enabled(struct xlator *jool)
+{
+	if (!GLOBALS(jool).enabled) {
+		log_err("Session sync is disabled on this instance.");
+		return -EINVAL;
+	}
 
-	error = jnla_get_session(attr, "Joold session",
-			&jool->globals.nat64.bib, &params.new);
-	if (error)
-		return false;
+	return 0;
+}
 
-	params.success = true;
-	cb.cb = collision_cb;
-	cb.arg = &params;
+/* Old format: One nested attribute per session. */
+static void sync_entries(struct xlator *jool, struct nlattr *root,
+		struct sync_state *state)
+{
+	struct nlattr *attr;
+	int rem;
 
-	error = bib_add_session(jool, &params.new, &cb);
-	if (error == -EEXIST)
-		return params.success;
-	if (error) {
-		log_err("sessiondb_add() threw unknown error code %d.", error);
-		return false;
+	nla_for_each_nested(attr, root, rem) {
+		if (jnla_get_session(attr, "Joold session",
+				&jool->globals.nat64.bib,
+				sync_next(jool, state))) {
+			state->invalid++;
+			continue;
+		}
+		state->count++;
 	}
-
-	return true;
 }
 
-static int validate_enabled(struct xlator *jool)
+/* New format: See struct joold_records_hdr. */
+static int sync_records(struct xlator *jool, struct nlattr *root,
+		struct sync_state *state)
 {
-	if (!GLOBALS(jool).enabled) {
-		log_err("Session sync is disabled on this instance.");
+	struct joold_records_hdr const *hdr;
+	void const *cursor;
+	size_t len;
+	unsigned int count;
+	int rsize;
+
+	hdr = nla_data(root);
+	len = nla_len(root);
+	if (len < sizeof(*hdr) || be16_to_cpu(hdr->magic) != JOOLD_RECORDS_MAGIC) {
+		log_err("The joold packet lacks a valid records header.");
+		return -EINVAL;
+	}
+	if (hdr->version != JOOLD_RECORDS_VERSION) {
+		log_err("Unsupported joold wire format version: %u. (I only speak %u.)",
+				hdr->version, JOOLD_RECORDS_VERSION);
 		return -EINVAL;
 	}
 
+	cursor = hdr + 1;
+	len -= sizeof(*hdr);
+
+	for (count = be16_to_cpu(hdr->count); count > 0; count--) {
+		rsize = get_record(jool, cursor, len, sync_next(jool, state));
+		if (rsize < 0)
+			return rsize;
+		cursor += rsize;
+		len -= rsize;
+		state->count++;
+	}
+
 	return 0;
 }
 
 /**
- * joold_sync - Parses a bunch of sessions out of @data and adds them to @jool's
- * session database.
+ * joold_sync - Parses a bunch of sessions out of @root and adds them to
+ * @jool's session database.
  *
  * This is the function that gets called whenever the jool daemon sends data to
  * the @jool Jool instance.
  */
 int joold_sync(struct xlator *jool, struct nlattr *root)
 {
-	struct nlattr *attr;
-	int rem;
+	struct sync_state state;
+	struct bib_add_summary *summary;
 	int error;
-	bool success;
 
 	error = validate_enabled(jool);
 	if (error)
 		return error;
 
-	success = true;
-	nla_for_each_nested(attr, root, rem)
-		success &= add_new_session(jool, attr);
+	if (!root) {
+		log_err("The joold packet contains no sessions.");
+		return -EINVAL;
+	}
+
+	memset(&state, 0, sizeof(state));
+	state.batch = __wkmalloc("joold sync batch",
+			JOOLD_SYNC_BATCH * sizeof(struct session_entry),
+			GFP_KERNEL);
+	if (!state.batch)
+		return -ENOMEM;
 
-	log_debug("Done.");
-	return success ? 0 : -EINVAL;
+	if (nla_type(root) == JNLAR_SESSION_RECORDS)
+		error = sync_records(jool, root, &state);
+	else
+		sync_entries(jool, root, &state);
+	/* Whatever was parsed before an error is still good. */
+	sync_flush(jool, &state);
+
+	__wkfree("joold sync batch", state.batch);
+
+	summary = &state.summary;
+	if (state.invalid || summary->collisions || summary->failed) {
+		log_err("Out of sync: Of %u incoming sessions, %u were added, %u refreshed, %u collided with different local sessions, %u failed and %u were malformed.",
+				state.invalid + summary->added + summary->updated
+						+ summary->collisions
+						+ summary->failed,
+				summary->added, summary->updated,
+				summary->collisions, summary->failed,
+				state.invalid);
+		return error ? : -EINVAL;
+	}
+
+	log_debug("Synced %u sessions (%u new).",
+			summary->added + summary->updated, summary->added);
+	return error;
 }
 
-static int add_advertise_node(struct joold_queue *queue, l4_protocol proto)
+/*
+ * Sends as many packets as the window allows.
+ * Assumes the queue's lock is not held.
+ */
+static void flush(struct xlator *jool)
 {
-	struct joold_node *node;
+	struct joold_queue *queue;
+	struct sk_buff *skb;
 
-	node = wkmem_cache_alloc("joold node", node_cache, GFP_ATOMIC);
-	if (!node)
-		return -ENOMEM;
+	queue = jool->nat64.joold;
 
-	node->is_group = true;
-	memset(&node->group.offset, 0, sizeof(node->group.offset));
-	node->group.offset_set = false;
-	node->group.proto = proto;
+	do {
+		spin_lock_bh(&queue->lock);
+		skb = send_to_userspace_prepare(jool);
+		spin_unlock_bh(&queue->lock);
 
-	list_add_tail(&node->nextprev, &queue->sessions);
-	queue->count++;
-	queue->advertisement_count++;
+		send_to_userspace(skb, jool->ns);
+	} while (skb);
+}
+
+/*
+ * Schedules an advertisement round right away.
+ * Assumes the queue's lock is held.
+ */
+static void kick_advertiser(struct joold_queue *queue)
+{
+	if (!queue->advertiser.stopped)
+		mod_delayed_work(joold_wq, &queue->advertiser.work, 0);
+}
+
+/* Assumes the queue's lock is not held. */
+static void stop_advertisement(struct joold_queue *queue)
+{
+	struct joold_advertiser *adv = &queue->advertiser;
+
+	if (adv->proto >= ADVERTISE_PROTO_COUNT) {
+		log_info("Advertisement done: Sent %u sessions.", adv->sent);
+	} else {
+		log_info("Advertisement paused after %u of %u sessions. Advertise again to resume.",
+				adv->sent, adv->total);
+	}
+
+	spin_lock_bh(&queue->lock);
+	adv->active = false;
+	spin_unlock_bh(&queue->lock);
+}
+
+static void refill_tokens(struct xlator *jool, struct joold_advertiser *adv,
+		unsigned int per_packet)
+{
+	unsigned long now;
+	unsigned int rate;
+	unsigned int burst;
+	u64 earned;
+
+	now = jiffies;
+	rate = GLOBALS(jool).advertise_rate;
+	if (!rate) {
+		adv->tokens = UINT_MAX;
+		adv->last_refill = now;
+		return;
+	}
+
+	/* A tenth of a second's worth, but never less than a full packet. */
+	burst = max(rate / 10, per_packet);
+	earned = div_u64((u64)rate * (now - adv->last_refill), HZ);
+	if (earned) {
+		adv->tokens = min_t(u64, adv->tokens + earned, burst);
+		adv->last_refill = now;
+	}
+}
+
+struct advertise_batch {
+	struct session_entry *sessions;
+	unsigned int count;
+	unsigned int max;
+};
 
+static int collect_session(struct session_entry const *session, void *arg)
+{
+	struct advertise_batch *batch = arg;
+
+	if (batch->count == batch->max)
+		return 1; /* Full; stop iterating. */
+
+	batch->sessions[batch->count++] = *session;
 	return 0;
 }
 
-static int prepare_advertisement(struct joold_queue *queue)
+/*
+ * Serializes as many of @batch's sessions as will fit in a packet.
+ * Assumes the queue's lock is held.
+ */
+static struct sk_buff *build_advertisement(struct xlator *jool,
+		struct advertise_batch *batch, unsigned int *count)
+{
+	struct sk_buff *skb;
+	void *msg_head;
+	void *cursor;
+	size_t room, size, rsize;
+	unsigned int i;
+
+	room = records_room(jool);
+
+	size = sizeof(struct joold_records_hdr);
+	for (i = 0; i < batch->count; i++) {
+		rsize = record_size(jool, &batch->sessions[i]);
+		if (nla_total_size(size + rsize) > room)
+			break;
+		size += rsize;
+	}
+	if (!i) {
+		log_warn_once("ss-max-payload is too small to fit a single session.");
+		return NULL;
+	}
+	*count = i;
+
+	skb = alloc_packet(jool, size, i, &msg_head, &cursor);
+	if (!skb)
+		return NULL;
+
+	for (i = 0; i < *count; i++)
+		cursor += put_record(jool, cursor, &batch->sessions[i]);
+
+	if (seal_packet(jool, skb, msg_head)) {
+		kfree_skb(skb);
+		return NULL;
+	}
+
+	return skb;
+}
+
+/*
+ * Sends the advertisement's next packet.
+ * Returns 0 if it should keep going, 1 if it needs to wait for the window,
+ * negative if it needs to be paused.
+ */
+static int advertise_packet(struct xlator *jool, struct advertise_batch *batch)
 {
+	struct joold_queue *queue;
+	struct joold_advertiser *adv;
+	struct session_entry *last;
+	struct sk_buff *skb;
+	unsigned int count;
+	bool exhausted;
 	int error;
 
-	error = add_advertise_node(queue, L4PROTO_TCP);
-	if (error)
+	queue = jool->nat64.joold;
+	adv = &queue->advertiser;
+
+	batch->count = 0;
+	error = bib_foreach_session(jool, advertise_protos[adv->proto],
+			collect_session, batch,
+			adv->offset_set ? &adv->offset : NULL);
+	if (error < 0)
 		return error;
+	exhausted = !error;
+
+	if (batch->count == 0)
+		goto next_table;
+
+	spin_lock_bh(&queue->lock);
+	forget_lost_acks(jool);
+	if (is_window_full(jool)) {
+		spin_unlock_bh(&queue->lock);
+		return 1;
+	}
+	skb = build_advertisement(jool, batch, &count);
+	spin_unlock_bh(&queue->lock);
+	if (!skb)
+		return -ENOMEM;
 
-	error = add_advertise_node(queue, L4PROTO_UDP);
+	error = send_to_userspace(skb, jool->ns);
 	if (error)
-		return error;
+		return error; /* Don't move the cursor; nobody heard it. */
+
+	last = &batch->sessions[count - 1];
+	adv->offset.offset.src = last->src4;
+	adv->offset.offset.dst = last->dst4;
+	adv->offset.include_offset = false;
+	adv->offset_set = true;
+	adv->tokens -= min(adv->tokens, count);
+	adv->sent += count;
+	jstat_add(jool->stats, JSTAT_JOOLD_ADV_SENT, count);
+
+	if (!exhausted || count < batch->count)
+		return 0;
+	/* Fall through. */
+
+next_table:
+	adv->proto++;
+	adv->offset_set = false;
+	return 0;
+}
+
+/*
+ * Sends as much of the advertisement as ss-advertise-rate and the window
+ * allow.
+ * Returns true if the advertisement still needs more rounds.
+ */
+static bool advertise(struct xlator *jool)
+{
+	struct joold_queue *queue;
+	struct joold_advertiser *adv;
+	struct advertise_batch batch;
+	unsigned int per_packet;
+	int error;
+
+	queue = jool->nat64.joold;
+	adv = &queue->advertiser;
+
+	if (!GLOBALS(jool).enabled)
+		goto pause;
+
+	/* The live updates have priority over the window. */
+	flush(jool);
+
+	per_packet = sessions_per_packet(jool);
+	if (!per_packet) {
+		log_warn_once("ss-max-payload is too small to fit a single session.");
+		goto pause;
+	}
+
+	refill_tokens(jool, adv, per_packet);
+
+	batch.sessions = __wkmalloc("joold advertise batch",
+			per_packet * sizeof(struct session_entry), GFP_KERNEL);
+	if (!batch.sessions)
+		return true; /* Try again later. */
+
+	error = 0;
+	while (adv->proto < ADVERTISE_PROTO_COUNT && adv->tokens > 0) {
+		batch.max = min(adv->tokens, per_packet);
+		error = advertise_packet(jool, &batch);
+		if (error)
+			break;
+	}
+
+	__wkfree("joold advertise batch", batch.sessions);
+
+	if (error >= 0 && adv->proto < ADVERTISE_PROTO_COUNT)
+		return true;
+	/* Fall through. */
+
+pause:
+	stop_advertisement(queue);
+	return false;
+}
+
+static void advertise_round(struct work_struct *work)
+{
+	struct joold_advertiser *adv;
+	struct joold_queue *queue;
+	struct xlator jool;
+	char iname[INAME_MAX_SIZE];
+	xlator_flags flags;
+	bool active;
+	bool more = false;
+
+	adv = container_of(to_delayed_work(work), struct joold_advertiser,
+			work);
+	queue = container_of(adv, struct joold_queue, advertiser);
+
+	spin_lock_bh(&queue->lock);
+	active = adv->active;
+	memcpy(iname, adv->iname, sizeof(iname));
+	flags = adv->flags;
+	spin_unlock_bh(&queue->lock);
+
+	if (!active)
+		return;
 
-	return add_advertise_node(queue, L4PROTO_ICMP);
+	/*
+	 * This reference can't be the queue's last one, because the owner
+	 * waits for this round (in joold_stop()) before it drops its own.
+	 */
+	if (xlator_find(queue->ns, flags, iname, &jool)) {
+		/* The instance is gone; nobody is going to resume this. */
+		return;
+	}
+	if (jool.nat64.joold == queue)
+		more = advertise(&jool);
+	else
+		stop_advertisement(queue); /* Replaced by a brand new one. */
+	xlator_put(&jool);
+
+	/* (If an ACK already scheduled the next round, this is a no-op.) */
+	if (more)
+		queue_delayed_work(joold_wq, &adv->work, JOOLD_ADVERTISE_PERIOD);
 }
 
+/**
+ * joold_stop - Cancels @queue's advertisement rounds for good.
+ *
+ * Meant to be called by the instance that owns @queue, before it releases it.
+ * (Other instances might still hold references, but none of them can kick the
+ * advertiser anymore.) An advertisement in progress is abandoned; the queue is
+ * on its way out.
+ */
+void joold_stop(struct joold_queue *queue)
+{
+	spin_lock_bh(&queue->lock);
+	queue->advertiser.stopped = true;
+	spin_unlock_bh(&queue->lock);
+
+	cancel_delayed_work_sync(&queue->advertiser.work);
+}
+
+/**
+ * joold_advertise - Starts sending @jool's entire session table to joold,
+ * in the background.
+ *
+ * If a previous advertisement was paused halfway, this resumes it instead.
+ */
 int joold_advertise(struct xlator *jool)
 {
 	struct joold_queue *queue;
-	struct sk_buff *skb;
+	struct joold_advertiser *adv;
+	__u64 *stats;
 	int error;
 
 	error = validate_enabled(jool);
 	if (error)
 		return error;
 
+	stats = jstat_query(jool->stats);
+	if (!stats)
+		return -ENOMEM;
+
 	queue = jool->nat64.joold;
+	adv = &queue->advertiser;
 
 	spin_lock_bh(&queue->lock);
 
-	error = prepare_advertisement(queue);
-	skb = error ? NULL : send_to_userspace_prepare(jool);
+	if (adv->active) {
+		log_debug("An advertisement is already in progress.");
+		goto end;
+	}
 
-	spin_unlock_bh(&queue->lock);
+	if (adv->proto >= ADVERTISE_PROTO_COUNT) {
+		jstat_add(jool->stats, JSTAT_JOOLD_ADV_SENT, -(int)adv->sent);
+		jstat_add(jool->stats, JSTAT_JOOLD_ADV_TOTAL,
+				(int)stats[JSTAT_SESSIONS] - (int)adv->total);
+		adv->proto = 0;
+		adv->offset_set = false;
+		adv->sent = 0;
+		adv->total = stats[JSTAT_SESSIONS];
+	}
 
-	send_to_userspace(skb, jool->ns);
-	return error;
+	strcpy(adv->iname, jool->iname);
+	adv->flags = jool->flags;
+	adv->active = true;
+	adv->tokens = 0;
+	adv->last_refill = jiffies;
+	kick_advertiser(queue);
+	/* Fall through. */
+
+end:
+	spin_unlock_bh(&queue->lock);
+	kfree(stats);
+	return 0;
 }
 
-void joold_ack(struct xlator *jool)
+/**
+ * joold_ack - joold is done with the packet whose sequence number is @seq, as
+ * well as with every packet that was sent before it.
+ *
+ * @seq can be NULL, if joold doesn't know. (It's too old, or the packet was
+ * broken.) In this case, it counts as an ACK for the oldest packet in flight.
+ */
+void joold_ack(struct xlator *jool, __u32 const *seq)
 {
 	struct joold_queue *queue;
-	struct sk_buff *skb;
+	u32 oldest;
+	unsigned int acked;
 
 	if (validate_enabled(jool))
 		return;
 
 	queue = jool->nat64.joold;
+	drain_stages(jool);
 
 	spin_lock_bh(&queue->lock);
 
-	queue->ack_received = true;
-	skb = send_to_userspace_prepare(jool);
+	if (seq) {
+		oldest = queue->next_seq - queue->in_flight;
+		/* Unsigned wraparound makes stale ACKs fall out of range. */
+		acked = (*seq - oldest < queue->in_flight) ? (*seq - oldest + 1) : 0;
+	} else {
+		acked = queue->in_flight ? 1 : 0;
+	}
+
+	WRITE_ONCE(queue->in_flight, queue->in_flight - acked);
 
 	spin_unlock_bh(&queue->lock);
 
-	send_to_userspace(skb, jool->ns);
+	flush(jool);
+
+	/* Whatever room the live updates left is the advertisement's. */
+	spin_lock_bh(&queue->lock);
+	if (queue->advertiser.active)
+		kick_advertiser(queue);
+	spin_unlock_bh(&queue->lock);
+}
+
+/**
+ * joold_gauges - Writes the current values of @jool's JSTAT_JOOLD_QUEUED and
+ * JSTAT_JOOLD_IN_FLIGHT to @stats (which is JSTAT_COUNT long).
+ *
+ * They're read from the queue rather than counted in @jool's stats, because
+ * the queue outlives the stats during atomic configuration. Does not sleep.
+ */
+void joold_gauges(struct xlator *jool, __u64 *stats)
+{
+	struct joold_queue *queue;
+
+	if (!xlator_is_nat64(jool))
+		return;
+
+	queue = jool->nat64.joold;
+	stats[JSTAT_JOOLD_QUEUED] = READ_ONCE(queue->count);
+	stats[JSTAT_JOOLD_IN_FLIGHT] = READ_ONCE(queue->in_flight);
 }
 
 /**
@@ -540,22 +1413,16 @@ void joold_ack(struct xlator *jool)
  * the deadline is in the past and no new packets have triggered a flush.
  * It's just a last-resort attempt to prevent nodes from lingering here for too
  * long that's generally only useful in non-flush-asap mode.
+ *
+ * Returns the number of jiffies until it should be called again, or
+ * MAX_JIFFY_OFFSET if joold is disabled.
  */
-void joold_clean(struct xlator *jool)
+unsigned long joold_clean(struct xlator *jool)
 {
-	spinlock_t *lock;
-	struct sk_buff *skb;
-
 	if (!GLOBALS(jool).enabled)
-		return;
-
-	lock = &jool->nat64.joold->lock;
-
-	spin_lock_bh(lock);
+		return MAX_JIFFY_OFFSET;
 
-	skb = send_to_userspace_prepare(jool);
-
-	spin_unlock_bh(lock);
-
-	send_to_userspace(skb, jool->ns);
+	drain_stages(jool);
+	flush(jool);
+	return msecs_to_jiffies(GLOBALS(jool).flush_deadline);
 }
@@ -18,13 +18,15 @@ void joold_teardown(void);
 struct joold_queue *joold_alloc(struct net *ns);
 void joold_get(struct joold_queue *queue);
 void joold_put(struct joold_queue *queue);
+void joold_stop(struct joold_queue *queue);
 
 int joold_sync(struct xlator *jool, struct nlattr *root);
 void joold_add(struct xlator *jool, struct session_entry *entry);
 
 int joold_advertise(struct xlator *jool);
-void joold_ack(struct xlator *jool);
+void joold_ack(struct xlator *jool, __u32 const *seq);
+void joold_gauges(struct xlator *jool, __u64 *stats);
 
-void joold_clean(struct xlator *jool);
+unsigned long joold_clean(struct xlator *jool);
 
 #endif /* SRC_MOD_NAT64_JOOLD_H_ */
@@ -276,7 +276,70 @@ int jnla_get_bib(struct nlattr *attr, char const *name, struct bib_entry *entry)
 	return 0;
 }
 
-static int get_timeout(struct bib_config *config, struct session_entry *entry)
+int jnla_get_query(struct nlattr *attr, char const *name, struct bib_query *query)
+{
+	struct nlattr *attrs[JNLAQ_COUNT];
+	int error;
+
+	error = validate_null(attr, name);
+	if (error)
+		return error;
+
+	error = NLA_PARSE_NESTED(attrs, JNLAQ_MAX, attr, joolnl_query_policy);
+	if (error) {
+		log_err("The '%s' attribute is malformed.", name);
+		return error;
+	}
+
+	memset(query, 0, sizeof(*query));
+	query->src4.ports.max = 65535U;
+	query->subscriber_len = 128;
+
+	if (attrs[JNLAQ_SRC6]) {
+		error = jnla_get_prefix6(attrs[JNLAQ_SRC6], "IPv6 source filter", &query->src6.prefix);
+		if (error)
+			return error;
+		query->src6.set = true;
+	}
+	if (attrs[JNLAQ_SRC4]) {
+		error = jnla_get_prefix4(attrs[JNLAQ_SRC4], "IPv4 source filter", &query->src4.prefix);
+		if (error)
+			return error;
+		query->src4_set = true;
+	}
+	if (attrs[JNLAQ_SRC4_PORT_MIN]) {
+		query->src4.ports.min = nla_get_u16(attrs[JNLAQ_SRC4_PORT_MIN]);
+		query->src4_set = true;
+	}
+	if (attrs[JNLAQ_SRC4_PORT_MAX]) {
+		query->src4.ports.max = nla_get_u16(attrs[JNLAQ_SRC4_PORT_MAX]);
+		query->src4_set = true;
+	}
+	if (attrs[JNLAQ_DST4]) {
+		error = jnla_get_prefix4(attrs[JNLAQ_DST4], "IPv4 destination filter", &query->dst4.prefix);
+		if (error)
+			return error;
+		query->dst4.set = true;
+	}
+	if (attrs[JNLAQ_STATE]) {
+		query->state = nla_get_u8(attrs[JNLAQ_STATE]);
+		query->state_set = true;
+	}
+	if (attrs[JNLAQ_MIN_IDLE])
+		query->min_idle = nla_get_u32(attrs[JNLAQ_MIN_IDLE]);
+	if (attrs[JNLAQ_MODE])
+		query->mode = nla_get_u8(attrs[JNLAQ_MODE]);
+	if (attrs[JNLAQ_TOP])
+		query->top = nla_get_u32(attrs[JNLAQ_TOP]);
+	if (attrs[JNLAQ_SUBSCRIBER_LEN])
+		query->subscriber_len = nla_get_u8(attrs[JNLAQ_SUBSCRIBER_LEN]);
+
+	return 0;
+}
+
+/* Computes @entry's timeout, based on its protocol and timer. */
+int jnla_get_session_timeout(struct bib_config *config,
+		struct session_entry *entry)
 {
 	unsigned long timeout;
 
@@ -358,7 +421,7 @@ int jnla_get_session(struct nlattr *attr, char const *name, struct bib_config *c
 	if (attrs[JNLASE_TIMER])
 		entry->timer_type = nla_get_u8(attrs[JNLASE_TIMER]);
 
-	error = get_timeout(config, entry);
+	error = jnla_get_session_timeout(config, entry);
 	if (error)
 		return error;
 
@@ -600,7 +663,8 @@ int jnla_put_pool4(struct sk_buff *skb, int attrtype, struct pool4_entry const *
 	return 0;
 }
 
-int jnla_put_bib(struct sk_buff *skb, int attrtype, struct bib_entry const *bib)
+int jnla_put_pool4_usage(struct sk_buff *skb, int attrtype,
+		struct pool4_usage const *usage)
 {
 	struct nlattr *root;
 	int error;
@@ -609,10 +673,9 @@ int jnla_put_bib(struct sk_buff *skb, int attrtype, struct bib_entry const *bib)
 	if (!root)
 		return -EMSGSIZE;
 
-	error = jnla_put_taddr6(skb, JNLAB_SRC6, &bib->addr6)
-		|| jnla_put_taddr4(skb, JNLAB_SRC4, &bib->addr4)
-		|| nla_put_u8(skb, JNLAB_PROTO, bib->l4_proto)
-		|| nla_put_u8(skb, JNLAB_STATIC, bib->is_static);
+	error = jnla_put_pool4(skb, JNLAPU_ENTRY, &usage->entry)
+		|| nla_put_u32(skb, JNLAPU_IN_USE, usage->in_use)
+		|| nla_put_u32(skb, JNLAPU_EXHAUSTIONS, usage->exhaustions);
 	if (error) {
 		nla_nest_cancel(skb, root);
 		return -EMSGSIZE;
@@ -622,16 +685,33 @@ int jnla_put_bib(struct sk_buff *skb, int attrtype, struct bib_entry const *bib)
 	return 0;
 }
 
-int jnla_put_session(struct sk_buff *skb, int attrtype, struct session_entry const *entry)
+int jnla_put_bib(struct sk_buff *skb, int attrtype, struct bib_entry const *bib)
 {
 	struct nlattr *root;
-	unsigned long dying_time;
 	int error;
 
 	root = nla_nest_start(skb, attrtype);
 	if (!root)
 		return -EMSGSIZE;
 
+	error = jnla_put_taddr6(skb, JNLAB_SRC6, &bib->addr6)
+		|| jnla_put_taddr4(skb, JNLAB_SRC4, &bib->addr4)
+		|| nla_put_u8(skb, JNLAB_PROTO, bib->l4_proto)
+		|| nla_put_u8(skb, JNLAB_STATIC, bib->is_static);
+	if (error) {
+		nla_nest_cancel(skb, root);
+		return -EMSGSIZE;
+	}
+
+	nla_nest_end(skb, root);
+	return 0;
+}
+
+/* Milliseconds @entry has left. */
+__u32 jnla_get_session_dying_time(struct session_entry const *entry)
+{
+	unsigned long dying_time;
+
 	dying_time = entry->update_time + entry->timeout;
 	dying_time = (dying_time > jiffies)
 			? jiffies_to_msecs(dying_time - jiffies)
@@ -639,6 +719,18 @@ int jnla_put_session(struct sk_buff *skb, int attrtype, struct session_entry con
 	if (dying_time > MAX_U32)
 		dying_time = MAX_U32;
 
+	return dying_time;
+}
+
+int jnla_put_session(struct sk_buff *skb, int attrtype, struct session_entry const *entry)
+{
+	struct nlattr *root;
+	int error;
+
+	root = nla_nest_start(skb, attrtype);
+	if (!root)
+		return -EMSGSIZE;
+
 	error = jnla_put_taddr6(skb, JNLASE_SRC6, &entry->src6)
 		|| jnla_put_taddr6(skb, JNLASE_DST6, &entry->dst6)
 		|| jnla_put_taddr4(skb, JNLASE_SRC4, &entry->src4)
@@ -646,7 +738,8 @@ int jnla_put_session(struct sk_buff *skb, int attrtype, struct session_entry con
 		|| nla_put_u8(skb, JNLASE_PROTO, entry->proto)
 		|| nla_put_u8(skb, JNLASE_STATE, entry->state)
 		|| nla_put_u8(skb, JNLASE_TIMER, entry->timer_type)
-		|| nla_put_u32(skb, JNLASE_EXPIRATION, dying_time);
+		|| nla_put_u32(skb, JNLASE_EXPIRATION,
+				jnla_get_session_dying_time(entry));
 	if (error) {
 		nla_nest_cancel(skb, root);
 		return error;
@@ -678,6 +771,42 @@ int jnla_put_plateaus(struct sk_buff *skb, int attrtype, struct mtu_plateaus con
 	return 0;
 }
 
+int jnla_put_query_result(struct sk_buff *skb, int attrtype,
+		struct bib_query_result const *result)
+{
+	struct nlattr *root, *list, *entry;
+	unsigned int i;
+
+	root = nla_nest_start(skb, attrtype);
+	if (!root)
+		return -EMSGSIZE;
+
+	if (nla_put_u32(skb, JNLAQR_MATCHES, result->matches)
+			|| nla_put_u32(skb, JNLAQR_SUBSCRIBERS, result->subscribers))
+		goto cancel;
+
+	list = nla_nest_start(skb, JNLAQR_TOP);
+	if (!list)
+		goto cancel;
+	for (i = 0; i < result->top_count; i++) {
+		entry = nla_nest_start(skb, JNLAL_ENTRY);
+		if (!entry)
+			goto cancel;
+		if (jnla_put_prefix6(skb, JNLAQT_SUBSCRIBER, &result->top[i].subscriber)
+				|| nla_put_u32(skb, JNLAQT_MATCHES, result->top[i].matches))
+			goto cancel;
+		nla_nest_end(skb, entry);
+	}
+	nla_nest_end(skb, list);
+
+	nla_nest_end(skb, root);
+	return 0;
+
+cancel:
+	nla_nest_cancel(skb, root);
+	return -EMSGSIZE;
+}
+
 void report_put_failure(void)
 {
 	log_err("The allocated Netlink packet is too small to contain the response. This might be a bug; please report it. PAGE_SIZE is %lu.",
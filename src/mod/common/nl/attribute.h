@@ -27,6 +27,7 @@ int jnla_get_pool4(struct nlattr *attr, char const *name, struct pool4_entry *en
 int jnla_get_bib(struct nlattr *attr, char const *name, struct bib_entry *entry);
 int jnla_get_session(struct nlattr *attr, char const *name, struct bib_config *config, struct session_entry *entry);
 int jnla_get_plateaus(struct nlattr *attr, struct mtu_plateaus *out);
+int jnla_get_query(struct nlattr *attr, char const *name, struct bib_query *query);
 
 /* Note: None of these print error messages. */
 int jnla_put_addr6(struct sk_buff *skb, int attrtype, struct in6_addr const *addr);
@@ -37,9 +38,16 @@ int jnla_put_taddr6(struct sk_buff *skb, int attrtype, struct ipv6_transport_add
 int jnla_put_taddr4(struct sk_buff *skb, int attrtype, struct ipv4_transport_addr const *prefix);
 int jnla_put_eam(struct sk_buff *skb, int attrtype, struct eamt_entry const *eam);
 int jnla_put_pool4(struct sk_buff *skb, int attrtype, struct pool4_entry const *bib);
+int jnla_put_pool4_usage(struct sk_buff *skb, int attrtype,
+		struct pool4_usage const *usage);
 int jnla_put_bib(struct sk_buff *skb, int attrtype, struct bib_entry const *bib);
 int jnla_put_session(struct sk_buff *skb, int attrtype, struct session_entry const *entry);
 int jnla_put_plateaus(struct sk_buff *skb, int attrtype, struct mtu_plateaus const *plateaus);
+int jnla_put_query_result(struct sk_buff *skb, int attrtype, struct bib_query_result const *result);
+
+/* Session expiration helpers; also used by joold's compact records. */
+int jnla_get_session_timeout(struct bib_config *config, struct session_entry *entry);
+__u32 jnla_get_session_dying_time(struct session_entry const *entry);
 
 void report_put_failure(void);
 
@@ -1,18 +1,136 @@
 #include "mod/common/nl/bib.h"
 
+#include "mod/common/error_pool.h"
 #include "mod/common/log.h"
+#include "mod/common/wkmalloc.h"
 #include "mod/common/xlator.h"
 #include "mod/common/nl/attribute.h"
 #include "mod/common/nl/nl_common.h"
 #include "mod/common/nl/nl_core.h"
 #include "mod/common/db/pool4/db.h"
 #include "mod/common/db/bib/db.h"
+#include "mod/common/db/bib/query.h"
+
+/*
+ * Whatever needs to survive between the calls of a BIB dump.
+ * Lives in netlink_callback.args, which Netlink zeroes when the dump starts.
+ */
+struct bib_dump_state {
+	__u8 started;
+	__u8 done;
+	__u8 proto;
+	__u8 offset_set;
+	/* Last entry that was sent to userspace (or filtered out). */
+	struct ipv4_transport_addr offset;
+};
+
+struct bib_dump_args {
+	struct sk_buff *skb;
+	struct bib_dump_state *state;
+	/* Filters; NULL means "everything". */
+	struct bib_query const *query;
+};
+
+static int dump_bib_entry(struct bib_entry const *entry, void *arg)
+{
+	struct bib_dump_args *args = arg;
+
+	/* Entries that don't match are consumed all the same. */
+	if ((!args->query || bibq_match_bib(args->query, entry))
+			&& jnla_put_bib(args->skb, JNLAL_ENTRY, entry))
+		return 1;
+
+	args->state->offset = entry->addr4;
+	args->state->offset_set = true;
+	return 0;
+}
+
+/*
+ * Genetlink dumpit; Netlink keeps calling it (once per skb) until it returns
+ * zero. The table is only locked while bib_foreach() copies each chunk, so
+ * the packet path isn't stalled by huge tables.
+ */
+int handle_bib_dump(struct sk_buff *skb, struct netlink_callback *cb)
+{
+	struct bib_dump_state *state;
+	struct bib_dump_args args;
+	struct bib_query query;
+	struct nlattr *query_attr;
+	struct xlator jool;
+	struct jool_response response;
+	l4_protocol proto;
+	int error;
+
+	BUILD_BUG_ON(sizeof(struct bib_dump_state) > sizeof(cb->args));
+	state = (struct bib_dump_state *)cb->args;
+	if (state->done)
+		return 0;
+
+	log_debug("Sending BIB to userspace.");
+	error_pool_activate();
+
+	error = dump_handle_start(cb, XT_NAT64, &jool);
+	if (error)
+		goto fail;
+
+	if (!state->started) {
+		error = get_dump_proto(cb, &proto);
+		if (error)
+			goto revert_start;
+		state->proto = proto;
+		state->started = true;
+	}
+
+	args.query = NULL;
+	query_attr = get_dump_attr(cb, JNLAR_QUERY);
+	if (query_attr) {
+		error = jnla_get_query(query_attr, "Query", &query);
+		if (error)
+			goto revert_start;
+		error = bibq_validate(&query);
+		if (error)
+			goto revert_start;
+		args.query = &query;
+	}
+
+	error = jresponse_init_dump(&response, skb, cb);
+	if (error)
+		goto revert_start;
+
+	args.skb = skb;
+	args.state = state;
+	error = bib_foreach(jool.nat64.bib, state->proto, dump_bib_entry,
+			&args, state->offset_set ? &state->offset : NULL);
+	if (!error)
+		state->done = true;
+
+	error = jresponse_end_dump(&response, error);
+	if (error < 0)
+		goto revert_start;
+
+	request_handle_end(&jool);
+	error_pool_deactivate();
+	return error;
+
+revert_start:
+	request_handle_end(&jool);
+fail:
+	state->done = true;
+	error = jresponse_dump_error(skb, cb, error);
+	error_pool_deactivate();
+	return error;
+}
 
 static int serialize_bib_entry(struct bib_entry const *entry, void *arg)
 {
 	return jnla_put_bib(arg, JNLAL_ENTRY, entry) ? 1 : 0;
 }
 
+/*
+ * Paged version of handle_bib_dump(): One request per page, and userspace
+ * sends the last entry it got as JNLAR_OFFSET.
+ * joold and older clients still iterate this way.
+ */
 int handle_bib_foreach(struct sk_buff *skb, struct genl_info *info)
 {
 	struct xlator jool;
@@ -65,6 +183,73 @@ end:
 	return jresponse_send_simple(info, error);
 }
 
+/*
+ * Like a filtered foreach, except only the count (or the busiest subscribers)
+ * travels to userspace.
+ */
+int handle_bib_query(struct sk_buff *skb, struct genl_info *info)
+{
+	struct xlator jool;
+	struct bib_query query;
+	struct bib_query_result *result;
+	struct jool_response response;
+	__u8 proto;
+	int error;
+
+	log_debug("Querying the BIB.");
+
+	error = request_handle_start(info, XT_NAT64, &jool);
+	if (error)
+		goto end;
+
+	error = jnla_get_u8(info->attrs[JNLAR_PROTO], "Protocol", &proto);
+	if (error)
+		goto revert_start;
+	error = jnla_get_query(info->attrs[JNLAR_QUERY], "Query", &query);
+	if (error)
+		goto revert_start;
+	error = bibq_validate(&query);
+	if (error)
+		goto revert_start;
+	if (query.mode == BQM_LIST) {
+		log_err("List queries need to be requested as BIB dumps.");
+		error = -EINVAL;
+		goto revert_start;
+	}
+
+	result = wkmalloc(struct bib_query_result, GFP_KERNEL);
+	if (!result) {
+		error = -ENOMEM;
+		goto revert_start;
+	}
+
+	error = bibq_query_bib(jool.nat64.bib, proto, &query, result);
+	if (error)
+		goto revert_result;
+
+	error = jresponse_init(&response, info);
+	if (error)
+		goto revert_result;
+	error = jnla_put_query_result(response.skb, JNLAR_QUERY_RESULT, result);
+	if (error) {
+		report_put_failure();
+		goto revert_response;
+	}
+
+	wkfree(struct bib_query_result, result);
+	request_handle_end(&jool);
+	return jresponse_send(&response);
+
+revert_response:
+	jresponse_cleanup(&response);
+revert_result:
+	wkfree(struct bib_query_result, result);
+revert_start:
+	request_handle_end(&jool);
+end:
+	return jresponse_send_simple(info, error);
+}
+
 int handle_bib_add(struct sk_buff *skb, struct genl_info *info)
 {
 	struct xlator jool;
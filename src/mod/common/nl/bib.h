@@ -3,7 +3,9 @@
 
 #include <net/genetlink.h>
 
+int handle_bib_dump(struct sk_buff *skb, struct netlink_callback *cb);
 int handle_bib_foreach(struct sk_buff *skb, struct genl_info *info);
+int handle_bib_query(struct sk_buff *skb, struct genl_info *info);
 int handle_bib_add(struct sk_buff *skb, struct genl_info *info);
 int handle_bib_rm(struct sk_buff *skb, struct genl_info *info);
 
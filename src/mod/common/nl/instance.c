@@ -29,15 +29,16 @@ static int parse_instance(struct nlattr *root, struct instance_entry_usr *entry)
 			INAME_MAX_SIZE, entry->iname);
 }
 
-static int serialize_instance(struct xlator *entry, void *arg)
+/* Writes @entry's identifier (ns, framework, name) as a nested attribute. */
+int jnla_put_instance(struct sk_buff *skb, int attrtype,
+		struct xlator const *entry)
 {
-	struct sk_buff *skb = arg;
 	struct nlattr *root;
 	int error;
 
-	root = nla_nest_start(skb, JNLAL_ENTRY);
+	root = nla_nest_start(skb, attrtype);
 	if (!root)
-		return 1;
+		return -EMSGSIZE;
 
 	error = nla_put_u32(skb, JNLAIE_NS, ((__u64)entry->ns) & 0xFFFFFFFF);
 	if (error)
@@ -54,7 +55,12 @@ static int serialize_instance(struct xlator *entry, void *arg)
 
 cancel:
 	nla_nest_cancel(skb, root);
-	return 1;
+	return error;
+}
+
+static int serialize_instance(struct xlator *entry, void *arg)
+{
+	return jnla_put_instance(arg, JNLAL_ENTRY, entry) ? 1 : 0;
 }
 
 int handle_instance_foreach(struct sk_buff *skb, struct genl_info *info)
@@ -3,6 +3,7 @@
 
 #include <net/genetlink.h>
 #include "common/config.h"
+#include "mod/common/xlator.h"
 
 int handle_instance_foreach(struct sk_buff *skb, struct genl_info *info);
 int handle_instance_add(struct sk_buff *skb, struct genl_info *info);
@@ -10,4 +11,7 @@ int handle_instance_hello(struct sk_buff *skb, struct genl_info *info);
 int handle_instance_rm(struct sk_buff *skb, struct genl_info *info);
 int handle_instance_flush(struct sk_buff *skb, struct genl_info *info);
 
+int jnla_put_instance(struct sk_buff *skb, int attrtype,
+		struct xlator const *entry);
+
 #endif /* SRC_MOD_COMMON_NL_INSTANCE_H_ */
@@ -16,7 +16,9 @@ int handle_joold_add(struct sk_buff *skb, struct genl_info *info)
 	if (error)
 		goto end;
 
-	error = joold_sync(&jool, info->attrs[JNLAR_SESSION_ENTRIES]);
+	error = joold_sync(&jool, info->attrs[JNLAR_SESSION_RECORDS]
+			? info->attrs[JNLAR_SESSION_RECORDS]
+			: info->attrs[JNLAR_SESSION_ENTRIES]);
 	if (error)
 		goto revert_start;
 
@@ -53,6 +55,7 @@ end:
 int handle_joold_ack(struct sk_buff *skb, struct genl_info *info)
 {
 	struct xlator jool;
+	__u32 seq;
 	int error;
 
 	log_debug("Handling joold ack.");
@@ -61,7 +64,12 @@ int handle_joold_ack(struct sk_buff *skb, struct genl_info *info)
 	if (error)
 		return jresponse_send_simple(info, error);
 
-	joold_ack(&jool);
+	if (info->attrs[JNLAR_JOOLD_SEQ]) {
+		seq = nla_get_u32(info->attrs[JNLAR_JOOLD_SEQ]);
+		joold_ack(&jool, &seq);
+	} else {
+		joold_ack(&jool, NULL);
+	}
 
 	request_handle_end(&jool);
 	return 0; /* Do not ack the ack. */
@@ -5,18 +5,41 @@
 #include "mod/common/log.h"
 #include "mod/common/nl/nl_core.h"
 
-char *get_iname(struct genl_info *info)
+static char *hdr2iname(struct joolnlhdr *hdr)
 {
-	struct joolnlhdr *hdr;
-	hdr = get_jool_hdr(info);
 	return (hdr->iname[0] != 0) ? hdr->iname : INAME_DEFAULT;
 }
 
+char *get_iname(struct genl_info *info)
+{
+	return hdr2iname(get_jool_hdr(info));
+}
+
 struct joolnlhdr *get_jool_hdr(struct genl_info *info)
 {
 	return info->userhdr;
 }
 
+/* Dump (NLM_F_DUMP) version of get_jool_hdr(). */
+struct joolnlhdr *get_dump_hdr(struct netlink_callback *cb)
+{
+	if (nlmsg_len(cb->nlh) < GENL_HDRLEN + sizeof(struct joolnlhdr))
+		return NULL;
+	return genlmsg_data(nlmsg_data(cb->nlh));
+}
+
+/*
+ * Dumps don't get their attributes parsed by the kernel (at least not on all
+ * supported kernels), so they have to look them up themselves.
+ * Assumes get_dump_hdr() has already been validated.
+ */
+struct nlattr *get_dump_attr(struct netlink_callback *cb, int type)
+{
+	return nlmsg_find_attr(cb->nlh,
+			GENL_HDRLEN + sizeof(struct joolnlhdr),
+			type);
+}
+
 static char const *xt2str(xlator_type xt)
 {
 	switch (xt) {
@@ -68,22 +91,21 @@ static int validate_version(struct joolnlhdr *hdr)
 	return -EINVAL;
 }
 
-int request_handle_start(struct genl_info *info, xlator_type xt, struct xlator *jool)
+static int validate_capability(void)
 {
-	struct joolnlhdr *hdr;
-	int error;
-
 	if (!capable(CAP_NET_ADMIN)) {
 		log_err("CAP_NET_ADMIN capability required. (Maybe try su or sudo?)");
 		return -EPERM;
 	}
 
-	if (!info->attrs) {
-		log_err("Userspace request lacks Netlink attributes.");
-		return -EINVAL;
-	}
+	return 0;
+}
+
+static int __handle_start(struct joolnlhdr *hdr, xlator_type xt,
+		struct xlator *jool)
+{
+	int error;
 
-	hdr = get_jool_hdr(info);
 	if (!hdr) {
 		log_err("Userspace request lacks a Jool header.");
 		return -EINVAL;
@@ -101,9 +123,9 @@ int request_handle_start(struct genl_info *info, xlator_type xt, struct xlator *
 	}
 
 	if (jool) {
-		error = xlator_find_current(get_iname(info), XF_ANY | hdr->xt, jool);
+		error = xlator_find_current(hdr2iname(hdr), XF_ANY | hdr->xt, jool);
 		if (error == -ESRCH)
-			log_err("This namespace lacks an instance named '%s'.", get_iname(info));
+			log_err("This namespace lacks an instance named '%s'.", hdr2iname(hdr));
 		if (error)
 			return error;
 	}
@@ -111,6 +133,61 @@ int request_handle_start(struct genl_info *info, xlator_type xt, struct xlator *
 	return 0;
 }
 
+/*
+ * Reads the dump request's JNLAR_PROTO.
+ * (Older kernels don't validate dump requests against the policy.)
+ */
+int get_dump_proto(struct netlink_callback *cb, l4_protocol *result)
+{
+	struct nlattr *attr;
+
+	attr = get_dump_attr(cb, JNLAR_PROTO);
+	if (!attr) {
+		log_err("The request is missing a transport protocol.");
+		return -EINVAL;
+	}
+	if (nla_len(attr) < sizeof(__u8)) {
+		log_err("The request's transport protocol is truncated.");
+		return -EINVAL;
+	}
+
+	*result = nla_get_u8(attr);
+	return 0;
+}
+
+int request_handle_start(struct genl_info *info, xlator_type xt, struct xlator *jool)
+{
+	int error;
+
+	error = validate_capability();
+	if (error)
+		return error;
+
+	if (!info->attrs) {
+		log_err("Userspace request lacks Netlink attributes.");
+		return -EINVAL;
+	}
+
+	return __handle_start(get_jool_hdr(info), xt, jool);
+}
+
+/*
+ * Dump version of request_handle_start().
+ * Dumps are served over several calls, so this needs to happen during every
+ * one of them.
+ */
+int dump_handle_start(struct netlink_callback *cb, xlator_type xt,
+		struct xlator *jool)
+{
+	int error;
+
+	error = validate_capability();
+	if (error)
+		return error;
+
+	return __handle_start(get_dump_hdr(cb), xt, jool);
+}
+
 void request_handle_end(struct xlator *jool)
 {
 	if (jool)
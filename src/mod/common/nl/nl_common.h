@@ -7,8 +7,13 @@
 
 char *get_iname(struct genl_info *info);
 struct joolnlhdr *get_jool_hdr(struct genl_info *info);
+struct joolnlhdr *get_dump_hdr(struct netlink_callback *cb);
+struct nlattr *get_dump_attr(struct netlink_callback *cb, int type);
+int get_dump_proto(struct netlink_callback *cb, l4_protocol *result);
 
 int request_handle_start(struct genl_info *info, xlator_type xt, struct xlator *jool);
+int dump_handle_start(struct netlink_callback *cb, xlator_type xt,
+		struct xlator *jool);
 void request_handle_end(struct xlator *jool);
 
 #endif /* SRC_MOD_COMMON_NL_COMMON_H_ */
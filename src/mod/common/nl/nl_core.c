@@ -95,18 +95,50 @@ cancel:
 	return error;
 }
 
-int jresponse_send_simple(struct genl_info *info, int error_code)
+/*
+ * Writes @error_code and the error pool's message in @response.
+ * (Or does nothing, if @error_code is zero.)
+ */
+static int jresponse_put_error(struct jool_response *response, int error_code,
+		char *error_msg)
 {
-	struct jool_response response;
 	int error;
-	char *error_msg;
-	size_t error_msg_size;
 
 	if (error_code < 0)
 		error_code = abs(error_code);
 	else if (error_code > MAX_U16)
 		error_code = MAX_U16;
 
+	if (!error_code) {
+		log_debug("Sending ACK to userspace.");
+		return 0;
+	}
+
+	response->hdr->flags |= JOOLNLHDR_FLAGS_ERROR;
+
+	error = nla_put_u16(response->skb, JNLAERR_CODE, error_code);
+	if (error)
+		return error;
+
+	error = nla_put_string(response->skb, JNLAERR_MSG, error_msg);
+	if (error) {
+		error_msg[128] = '\0';
+		error = nla_put_string(response->skb, JNLAERR_MSG, error_msg);
+		if (error)
+			return error;
+	}
+
+	log_debug("Sending error code %d to userspace.", error_code);
+	return 0;
+}
+
+int jresponse_send_simple(struct genl_info *info, int error_code)
+{
+	struct jool_response response;
+	int error;
+	char *error_msg;
+	size_t error_msg_size;
+
 	error = error_pool_get_message(&error_msg, &error_msg_size);
 	if (error)
 		return error; /* Error msg already printed. */
@@ -115,24 +147,9 @@ int jresponse_send_simple(struct genl_info *info, int error_code)
 	if (error)
 		goto revert_msg;
 
-	if (error_code) {
-		response.hdr->flags |= JOOLNLHDR_FLAGS_ERROR;
-
-		error = nla_put_u16(response.skb, JNLAERR_CODE, error_code);
-		if (error)
-			goto revert_response;
-
-		error = nla_put_string(response.skb, JNLAERR_MSG, error_msg);
-		if (error) {
-			error_msg[128] = '\0';
-			error = nla_put_string(response.skb, JNLAERR_MSG, error_msg);
-			if (error)
-				goto revert_response;
-		}
-		log_debug("Sending error code %d to userspace.", error_code);
-	} else {
-		log_debug("Sending ACK to userspace.");
-	}
+	error = jresponse_put_error(&response, error_code, error_msg);
+	if (error)
+		goto revert_response;
 
 	error = jresponse_send(&response);
 	/* Fall through. */
@@ -144,3 +161,96 @@ revert_msg:
 	return error;
 }
 
+/*
+ * Dump (NLM_F_DUMP) version of jresponse_init().
+ *
+ * The message is appended to @skb, which belongs to Netlink. Every message of a
+ * dump is a NLM_F_MULTI, and Netlink itself appends the final NLMSG_DONE, so
+ * dumps don't use JOOLNLHDR_FLAGS_M.
+ */
+int jresponse_init_dump(struct jool_response *response, struct sk_buff *skb,
+		struct netlink_callback *cb)
+{
+	struct joolnlhdr *request_hdr;
+
+	request_hdr = get_dump_hdr(cb);
+	if (!request_hdr)
+		return -EINVAL;
+
+	response->info = NULL;
+	response->skb = skb;
+	response->hdr = genlmsg_put(skb, NETLINK_CB(cb->skb).portid,
+			cb->nlh->nlmsg_seq, jnl_family(), NLM_F_MULTI, 0);
+	if (!response->hdr)
+		return -EMSGSIZE;
+
+	memcpy(response->hdr, request_hdr, sizeof(*response->hdr));
+	response->initial_len = skb->len;
+	return 0;
+}
+
+/*
+ * Dump version of jresponse_send_array().
+ *
+ * @error is the result of the foreach that filled @response: negative on
+ * failure, positive if the skb ran out of room, zero if the table is
+ * exhausted.
+ * Returns what the dumpit should return.
+ */
+int jresponse_end_dump(struct jool_response *response, int error)
+{
+	if (error < 0) {
+		genlmsg_cancel(response->skb, response->hdr);
+		return error;
+	}
+
+	/* Not even one entry fit; not going to get better. */
+	if (error > 0 && response->skb->len == response->initial_len) {
+		genlmsg_cancel(response->skb, response->hdr);
+		report_put_failure();
+		return -EMSGSIZE;
+	}
+
+	genlmsg_end(response->skb, response->hdr);
+	return response->skb->len;
+}
+
+/*
+ * Dump version of jresponse_send_simple(). (Except it only makes sense for
+ * errors.)
+ *
+ * Userspace would otherwise only get the bare error code in the NLMSG_DONE, so
+ * this sends the error pool's message as a regular Jool error response
+ * instead.
+ * Returns what the dumpit should return.
+ */
+int jresponse_dump_error(struct sk_buff *skb, struct netlink_callback *cb,
+		int error_code)
+{
+	struct jool_response response;
+	int error;
+	char *error_msg;
+	size_t error_msg_size;
+
+	error = error_pool_get_message(&error_msg, &error_msg_size);
+	if (error)
+		return error_code;
+
+	error = jresponse_init_dump(&response, skb, cb);
+	if (error)
+		goto revert_msg;
+	error = jresponse_put_error(&response, error_code, error_msg);
+	if (error) {
+		genlmsg_cancel(skb, response.hdr);
+		goto revert_msg;
+	}
+
+	genlmsg_end(skb, response.hdr);
+	__wkfree("Error msg out", error_msg);
+	return skb->len;
+
+revert_msg:
+	__wkfree("Error msg out", error_msg);
+	return error_code;
+}
+
@@ -19,5 +19,11 @@ int jresponse_send_array(struct jool_response *response, int error);
 
 int jresponse_send_simple(struct genl_info *info, int error);
 
+int jresponse_init_dump(struct jool_response *response, struct sk_buff *skb,
+		struct netlink_callback *cb);
+int jresponse_end_dump(struct jool_response *response, int error);
+int jresponse_dump_error(struct sk_buff *skb, struct netlink_callback *cb,
+		int error);
+
 
 #endif /* SRC_MOD_COMMON_NL_CORE_H_ */
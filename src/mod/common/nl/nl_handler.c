@@ -1,5 +1,6 @@
 #include "mod/common/nl/nl_handler.h"
 
+#include <linux/capability.h>
 #include <linux/mutex.h>
 #include <linux/genetlink.h>
 
@@ -55,6 +56,15 @@ static struct nla_policy const jool_policy[JNLAR_COUNT] = {
 	[JNLAR_PROTO] = { .type = NLA_U8 },
 	[JNLAR_ATOMIC_INIT] = { .type = NLA_U8 },
 	[JNLAR_ATOMIC_END] = { .type = NLA_UNSPEC, .len = 0 },
+	[JNLAR_SESSION_RECORDS] = { .type = NLA_BINARY },
+	[JNLAR_JOOLD_SEQ] = { .type = NLA_U32 },
+	[JNLAR_QUERY] = { .type = NLA_NESTED },
+	[JNLAR_QUERY_RESULT] = { .type = NLA_NESTED },
+	[JNLAR_ATOMIC_DELTA] = { .type = NLA_UNSPEC, .len = 0 },
+	[JNLAR_ATOMIC_HOLD] = { .type = NLA_UNSPEC, .len = 0 },
+	[JNLAR_BL4_RM_ENTRIES] = { .type = NLA_NESTED },
+	[JNLAR_EAMT_RM_ENTRIES] = { .type = NLA_NESTED },
+	[JNLAR_POOL4_RM_ENTRIES] = { .type = NLA_NESTED },
 };
 
 #if LINUX_VERSION_AT_LEAST(5, 2, 0, 9999, 0)
@@ -96,6 +106,14 @@ static _CONST struct genl_ops ops[] = {
 		.cmd = JNLOP_STATS_FOREACH,
 		.doit = handle_stats_foreach,
 		JOOL_POLICY
+	}, {
+		.cmd = JNLOP_STATS_LATENCY,
+		.doit = handle_stats_latency,
+		JOOL_POLICY
+	}, {
+		.cmd = JNLOP_STATS_DUMP,
+		.dumpit = handle_stats_dump,
+		JOOL_POLICY
 	}, {
 		.cmd = JNLOP_GLOBAL_FOREACH,
 		.doit = handle_global_foreach,
@@ -152,9 +170,14 @@ static _CONST struct genl_ops ops[] = {
 		.cmd = JNLOP_POOL4_FLUSH,
 		.doit = handle_pool4_flush,
 		JOOL_POLICY
+	}, {
+		.cmd = JNLOP_POOL4_USAGE,
+		.doit = handle_pool4_usage,
+		JOOL_POLICY
 	}, {
 		.cmd = JNLOP_BIB_FOREACH,
 		.doit = handle_bib_foreach,
+		.dumpit = handle_bib_dump,
 		JOOL_POLICY
 	}, {
 		.cmd = JNLOP_BIB_ADD,
@@ -164,9 +187,18 @@ static _CONST struct genl_ops ops[] = {
 		.cmd = JNLOP_BIB_RM,
 		.doit = handle_bib_rm,
 		JOOL_POLICY
+	}, {
+		.cmd = JNLOP_BIB_QUERY,
+		.doit = handle_bib_query,
+		JOOL_POLICY
 	}, {
 		.cmd = JNLOP_SESSION_FOREACH,
 		.doit = handle_session_foreach,
+		.dumpit = handle_session_dump,
+		JOOL_POLICY
+	}, {
+		.cmd = JNLOP_SESSION_QUERY,
+		.doit = handle_session_query,
 		JOOL_POLICY
 	}, {
 		.cmd = JNLOP_FILE_HANDLE,
@@ -187,12 +219,43 @@ static _CONST struct genl_ops ops[] = {
 	}
 };
 
+/*
+ * The session log and the stats stream reveal the namespace's traffic, so only
+ * its administrators can subscribe to them.
+ */
+#if LINUX_VERSION_AT_LEAST(6, 7, 0, 9999, 0)
+#define ADMIN_MCGRP .flags = GENL_MCAST_CAP_NET_ADMIN,
+#else
+/* Older kernels ignore the group flags. See mcast_bind() instead. */
+#define ADMIN_MCGRP
+#endif
+
 static struct genl_multicast_group mc_groups[] = {
 	{
 		.name = JOOLNL_MULTICAST_GRP_NAME,
+	}, {
+		/* Index must be JNL_SLOG_GRP. */
+		.name = JOOLNL_SLOG_GRP_NAME,
+		ADMIN_MCGRP
+	}, {
+		/* Index must be JNL_STATS_GRP. */
+		.name = JOOLNL_STATS_GRP_NAME,
+		ADMIN_MCGRP
 	},
 };
 
+#if LINUX_VERSION_LOWER_THAN(6, 7, 0, 9999, 0) \
+		&& LINUX_VERSION_AT_LEAST(3, 19, 0, 8, 0)
+#define MCAST_BIND
+/* @group is the index of the group in mc_groups. */
+static int mcast_bind(struct net *ns, int group)
+{
+	if (group != JNL_SLOG_GRP && group != JNL_STATS_GRP)
+		return 0;
+	return ns_capable(ns->user_ns, CAP_NET_ADMIN) ? 0 : -EPERM;
+}
+#endif
+
 static struct genl_family jool_family = {
 #if LINUX_VERSION_LOWER_THAN(4, 10, 0, 7, 5)
 	/* This variable became "private" on kernel 4.10. */
@@ -210,6 +273,9 @@ static struct genl_family jool_family = {
 #endif
 	.pre_doit = pre_handle_request,
 	.post_doit = post_handle_request,
+#ifdef MCAST_BIND
+	.mcast_bind = mcast_bind,
+#endif
 
 #if LINUX_VERSION_AT_LEAST(4, 10, 0, 7, 5)
 	/*
@@ -255,6 +321,18 @@ static int register_family(void)
 		return error;
 	}
 
+	error = genl_register_mc_group(&jool_family, &(mc_groups[JNL_SLOG_GRP]));
+	if (error) {
+		log_err("Couldn't register the session log multicast group!");
+		return error;
+	}
+
+	error = genl_register_mc_group(&jool_family, &(mc_groups[JNL_STATS_GRP]));
+	if (error) {
+		log_err("Couldn't register the stats multicast group!");
+		return error;
+	}
+
 #elif LINUX_VERSION_LOWER_THAN(4, 10, 0, 7, 5)
 	error = genl_register_family_with_ops_groups(&jool_family, ops,
 			mc_groups);
@@ -290,6 +368,16 @@ u32 jnl_gid(void)
 {
 	return mc_groups[0].id;
 }
+
+u32 jnl_slog_gid(void)
+{
+	return mc_groups[JNL_SLOG_GRP].id;
+}
+
+u32 jnl_stats_gid(void)
+{
+	return mc_groups[JNL_STATS_GRP].id;
+}
 #endif
 
 struct genl_family *jnl_family(void)
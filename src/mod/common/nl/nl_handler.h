@@ -15,7 +15,16 @@ void nlhandler_teardown(void);
 
 int handle_jool_message(struct sk_buff *skb, struct genl_info *info);
 
+/*
+ * Indexes of the session log and stats groups among the family's multicast
+ * groups.
+ */
+#define JNL_SLOG_GRP 1
+#define JNL_STATS_GRP 2
+
 u32 jnl_gid(void);
+u32 jnl_slog_gid(void);
+u32 jnl_stats_gid(void);
 struct genl_family *jnl_family(void);
 
 #endif /* SRC_MOD_COMMON_NL_HANDLER_H_ */
@@ -8,11 +8,56 @@
 #include "mod/common/db/pool4/db.h"
 #include "mod/common/db/bib/db.h"
 
+/* Samples handled per JNLOP_POOL4_USAGE request. */
+#define USAGE_BATCH 32
+
+struct usage_batch {
+	struct pool4_entry *samples;
+	unsigned int count;
+};
+
 static int serialize_pool4_entry(struct pool4_entry const *entry, void *arg)
 {
 	return jnla_put_pool4(arg, JNLAL_ENTRY, entry) ? 1 : 0;
 }
 
+/*
+ * Reads the iteration offset of a pool4 foreach request.
+ * @offset->proto is always initialized; @result is NULL if iteration should
+ * start from the beginning.
+ */
+static int get_offset(struct genl_info *info, struct pool4_entry *offset,
+		struct pool4_entry **result)
+{
+	int error;
+
+	if (info->attrs[JNLAR_OFFSET]) {
+		error = jnla_get_pool4(info->attrs[JNLAR_OFFSET], "Iteration offset", offset);
+		if (error)
+			return error;
+		*result = offset;
+		log_debug("Offset: [%pI4/%u %u-%u %u %u %u %u]",
+				&offset->range.prefix.addr,
+				offset->range.prefix.len,
+				offset->range.ports.min,
+				offset->range.ports.max,
+				offset->mark,
+				offset->iterations,
+				offset->flags,
+				offset->proto);
+		return 0;
+	}
+
+	if (info->attrs[JNLAR_PROTO]) {
+		offset->proto = nla_get_u8(info->attrs[JNLAR_PROTO]);
+		*result = NULL;
+		return 0;
+	}
+
+	log_err("The request is missing a protocol.");
+	return -EINVAL;
+}
+
 int handle_pool4_foreach(struct sk_buff *skb, struct genl_info *info)
 {
 	struct xlator jool;
@@ -29,28 +74,9 @@ int handle_pool4_foreach(struct sk_buff *skb, struct genl_info *info)
 	if (error)
 		goto revert_start;
 
-	if (info->attrs[JNLAR_OFFSET]) {
-		error = jnla_get_pool4(info->attrs[JNLAR_OFFSET], "Iteration offset", &offset);
-		if (error)
-			goto revert_response;
-		offset_ptr = &offset;
-		log_debug("Offset: [%pI4/%u %u-%u %u %u %u %u]",
-				&offset.range.prefix.addr,
-				offset.range.prefix.len,
-				offset.range.ports.min,
-				offset.range.ports.max,
-				offset.mark,
-				offset.iterations,
-				offset.flags,
-				offset.proto);
-	} else if (info->attrs[JNLAR_PROTO]) {
-		offset.proto = nla_get_u8(info->attrs[JNLAR_PROTO]);
-		offset_ptr = NULL;
-	} else {
-		log_err("The request is missing a protocol.");
-		error = -EINVAL;
+	error = get_offset(info, &offset, &offset_ptr);
+	if (error)
 		goto revert_response;
-	}
 
 	error = pool4db_foreach_sample(jool.nat64.pool4,
 			offset.proto, serialize_pool4_entry, response.skb,
@@ -71,6 +97,99 @@ end:
 	return jresponse_send_simple(info, error);
 }
 
+static int collect_sample(struct pool4_entry const *sample, void *arg)
+{
+	struct usage_batch *batch = arg;
+
+	batch->samples[batch->count++] = *sample;
+	return (batch->count == USAGE_BATCH) ? 1 : 0;
+}
+
+/*
+ * Same as handle_pool4_foreach(), except every entry also carries how busy it
+ * is. Counting needs the BIB, so the samples are copied first, and then
+ * counted one by one; pool4 and the BIB are never locked at the same time.
+ */
+int handle_pool4_usage(struct sk_buff *skb, struct genl_info *info)
+{
+	struct xlator jool;
+	struct jool_response response;
+	struct pool4_entry offset, *offset_ptr;
+	struct usage_batch batch;
+	struct pool4_usage usage;
+	unsigned int i;
+	int more;
+	int error;
+
+	log_debug("Sending pool4 usage to userspace.");
+
+	error = request_handle_start(info, XT_NAT64, &jool);
+	if (error)
+		goto end;
+
+	error = get_offset(info, &offset, &offset_ptr);
+	if (error)
+		goto revert_start;
+
+	batch.samples = kmalloc_array(USAGE_BATCH, sizeof(*batch.samples),
+			GFP_KERNEL);
+	if (!batch.samples) {
+		error = -ENOMEM;
+		goto revert_start;
+	}
+	batch.count = 0;
+
+	/* Positive means there might be more samples after the batch. */
+	more = pool4db_foreach_sample(jool.nat64.pool4, offset.proto,
+			collect_sample, &batch, offset_ptr);
+	if (more < 0) {
+		error = more;
+		goto revert_batch;
+	}
+
+	error = jresponse_init(&response, info);
+	if (error)
+		goto revert_batch;
+
+	for (i = 0; i < batch.count; i++) {
+		usage.entry = batch.samples[i];
+
+		error = bib_count_range(jool.nat64.bib, usage.entry.proto,
+				&usage.entry.range, &usage.in_use);
+		if (error)
+			goto revert_response;
+		/* The batch is sorted by mark, so this rarely repeats. */
+		if (i == 0 || usage.entry.mark != batch.samples[i - 1].mark) {
+			usage.exhaustions = pool4db_get_exhaustions(
+					jool.nat64.pool4, usage.entry.proto,
+					usage.entry.mark);
+		}
+
+		if (jnla_put_pool4_usage(response.skb, JNLAL_ENTRY, &usage)) {
+			/* Userspace will ask for the rest later. */
+			more = 1;
+			break;
+		}
+	}
+
+	error = jresponse_send_array(&response, more);
+	if (error)
+		goto revert_response;
+
+	kfree(batch.samples);
+	request_handle_end(&jool);
+	return 0;
+
+revert_response:
+	jresponse_cleanup(&response);
+revert_batch:
+	kfree(batch.samples);
+revert_start:
+	request_handle_end(&jool);
+end:
+	return jresponse_send_simple(info, error);
+}
+
 int handle_pool4_add(struct sk_buff *skb, struct genl_info *info)
 {
 	struct xlator jool;
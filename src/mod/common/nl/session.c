@@ -1,11 +1,133 @@
 #include "mod/common/nl/session.h"
 
+#include "mod/common/error_pool.h"
 #include "mod/common/log.h"
+#include "mod/common/wkmalloc.h"
 #include "mod/common/xlator.h"
 #include "mod/common/nl/attribute.h"
 #include "mod/common/nl/nl_common.h"
 #include "mod/common/nl/nl_core.h"
 #include "mod/common/db/bib/db.h"
+#include "mod/common/db/bib/query.h"
+
+/*
+ * Whatever needs to survive between the calls of a session dump.
+ * (See bib_dump_state.)
+ */
+struct session_dump_state {
+	__u8 started;
+	__u8 done;
+	__u8 proto;
+	__u8 offset_set;
+	/* Last session that was sent to userspace (or filtered out). */
+	struct ipv4_transport_addr src4;
+	struct ipv4_transport_addr dst4;
+};
+
+struct session_dump_args {
+	struct sk_buff *skb;
+	struct session_dump_state *state;
+	/* Filters; NULL means "everything". */
+	struct bib_query const *query;
+};
+
+static int dump_session_entry(struct session_entry const *entry, void *arg)
+{
+	struct session_dump_args *args = arg;
+
+	/* Sessions that don't match are consumed all the same. */
+	if ((!args->query || bibq_match_session(args->query, entry))
+			&& jnla_put_session(args->skb, JNLAL_ENTRY, entry))
+		return 1;
+
+	args->state->src4 = entry->src4;
+	args->state->dst4 = entry->dst4;
+	args->state->offset_set = true;
+	return 0;
+}
+
+/* Genetlink dumpit. (See handle_bib_dump().) */
+int handle_session_dump(struct sk_buff *skb, struct netlink_callback *cb)
+{
+	struct session_dump_state *state;
+	struct session_dump_args args;
+	struct session_foreach_offset offset;
+	struct bib_query query;
+	struct nlattr *query_attr;
+	struct xlator jool;
+	struct jool_response response;
+	l4_protocol proto;
+	int error;
+
+	BUILD_BUG_ON(sizeof(struct session_dump_state) > sizeof(cb->args));
+	state = (struct session_dump_state *)cb->args;
+	if (state->done)
+		return 0;
+
+	log_debug("Sending session to userspace.");
+	error_pool_activate();
+
+	error = dump_handle_start(cb, XT_NAT64, &jool);
+	if (error)
+		goto fail;
+
+	if (!state->started) {
+		error = get_dump_proto(cb, &proto);
+		if (error)
+			goto revert_start;
+		state->proto = proto;
+		state->started = true;
+	}
+
+	args.query = NULL;
+	query_attr = get_dump_attr(cb, JNLAR_QUERY);
+	if (query_attr) {
+		error = jnla_get_query(query_attr, "Query", &query);
+		if (error)
+			goto revert_start;
+		error = bibq_validate(&query);
+		if (error)
+			goto revert_start;
+		args.query = &query;
+	}
+
+	error = jresponse_init_dump(&response, skb, cb);
+	if (error)
+		goto revert_start;
+
+	if (state->offset_set) {
+		offset.offset.src = state->src4;
+		offset.offset.dst = state->dst4;
+		offset.include_offset = false;
+		log_debug("Offset: [%pI4/%u %pI4/%u]",
+				&offset.offset.src.l3, offset.offset.src.l4,
+				&offset.offset.dst.l3, offset.offset.dst.l4);
+	}
+
+	args.skb = skb;
+	args.state = state;
+	error = bib_foreach_session(&jool, state->proto,
+			dump_session_entry, &args,
+			state->offset_set ? &offset : NULL);
+	if (!error)
+		state->done = true;
+
+	error = jresponse_end_dump(&response, error);
+	if (error < 0)
+		goto revert_start;
+
+	request_handle_end(&jool);
+	error_pool_deactivate();
+	return error;
+
+revert_start:
+	request_handle_end(&jool);
+fail:
+	state->done = true;
+	error = jresponse_dump_error(skb, cb, error);
+	error_pool_deactivate();
+	return error;
+}
 
 static int parse_offset(struct nlattr *root, struct session_foreach_offset *entry)
 {
@@ -40,6 +162,7 @@ static int serialize_session_entry(struct session_entry const *entry, void *arg)
 	return jnla_put_session(arg, JNLAL_ENTRY, entry) ? 1 : 0;
 }
 
+/* Paged version of handle_session_dump(). (See handle_bib_foreach().) */
 int handle_session_foreach(struct sk_buff *skb, struct genl_info *info)
 {
 	struct xlator jool;
@@ -94,3 +217,67 @@ revert_start:
 end:
 	return jresponse_send_simple(info, error);
 }
+
+/* Session version of handle_bib_query(). */
+int handle_session_query(struct sk_buff *skb, struct genl_info *info)
+{
+	struct xlator jool;
+	struct bib_query query;
+	struct bib_query_result *result;
+	struct jool_response response;
+	__u8 proto;
+	int error;
+
+	log_debug("Querying the session table.");
+
+	error = request_handle_start(info, XT_NAT64, &jool);
+	if (error)
+		goto end;
+
+	error = jnla_get_u8(info->attrs[JNLAR_PROTO], "Protocol", &proto);
+	if (error)
+		goto revert_start;
+	error = jnla_get_query(info->attrs[JNLAR_QUERY], "Query", &query);
+	if (error)
+		goto revert_start;
+	error = bibq_validate(&query);
+	if (error)
+		goto revert_start;
+	if (query.mode == BQM_LIST) {
+		log_err("List queries need to be requested as session dumps.");
+		error = -EINVAL;
+		goto revert_start;
+	}
+
+	result = wkmalloc(struct bib_query_result, GFP_KERNEL);
+	if (!result) {
+		error = -ENOMEM;
+		goto revert_start;
+	}
+
+	error = bibq_query_sessions(&jool, proto, &query, result);
+	if (error)
+		goto revert_result;
+
+	error = jresponse_init(&response, info);
+	if (error)
+		goto revert_result;
+	error = jnla_put_query_result(response.skb, JNLAR_QUERY_RESULT, result);
+	if (error) {
+		report_put_failure();
+		goto revert_response;
+	}
+
+	wkfree(struct bib_query_result, result);
+	request_handle_end(&jool);
+	return jresponse_send(&response);
+
+revert_response:
+	jresponse_cleanup(&response);
+revert_result:
+	wkfree(struct bib_query_result, result);
+revert_start:
+	request_handle_end(&jool);
+end:
+	return jresponse_send_simple(info, error);
+}
@@ -1,10 +1,16 @@
 #include "mod/common/nl/stats.h"
 
+#include "common/xlat.h"
+#include "mod/common/linux_version.h"
+#include "mod/common/error_pool.h"
+#include "mod/common/joold.h"
 #include "mod/common/log.h"
 #include "mod/common/stats.h"
 #include "mod/common/nl/attribute.h"
+#include "mod/common/nl/instance.h"
 #include "mod/common/nl/nl_common.h"
 #include "mod/common/nl/nl_core.h"
+#include "mod/common/nl/nl_handler.h"
 
 int handle_stats_foreach(struct sk_buff *skb, struct genl_info *info)
 {
@@ -33,6 +39,7 @@ int handle_stats_foreach(struct sk_buff *skb, struct genl_info *info)
 		error = -ENOMEM;
 		goto revert_start;
 	}
+	joold_gauges(&jool, stats);
 
 	/* Build response */
 	error = jresponse_init(&response, info);
@@ -71,3 +78,310 @@ revert_start:
 end:
 	return jresponse_send_simple(info, error);
 }
+
+static int put_histogram(struct sk_buff *skb, enum jool_stage stage,
+		__u64 const *buckets)
+{
+	struct nlattr *root;
+	unsigned int b;
+	int error;
+
+	root = nla_nest_start(skb, stage + 1);
+	if (!root)
+		return -EMSGSIZE;
+
+	for (b = 0; b < JSTAGE_BUCKETS; b++) {
+#if LINUX_VERSION_AT_LEAST(4, 7, 0, 7, 4)
+		error = nla_put_u64_64bit(skb, b + 1, buckets[b],
+				JSTAGE_PADDING);
+#else
+		error = nla_put_u64(skb, b + 1, buckets[b]);
+#endif
+		if (error) {
+			nla_nest_cancel(skb, root);
+			return error;
+		}
+	}
+
+	nla_nest_end(skb, root);
+	return 0;
+}
+
+int handle_stats_latency(struct sk_buff *skb, struct genl_info *info)
+{
+	struct xlator jool;
+	__u64 *histograms;
+	struct jool_response response;
+	enum jool_stage stage;
+	int error;
+
+	log_debug("Returning latency histograms.");
+
+	error = request_handle_start(info, XT_ANY, &jool);
+	if (error)
+		goto end;
+
+	histograms = jstat_query_latency(jool.stats);
+	if (!histograms) {
+		error = -ENOMEM;
+		goto revert_start;
+	}
+
+	error = jresponse_init(&response, info);
+	if (error)
+		goto revert_query;
+
+	/* The whole thing spans less than 3 KB, so it fits in one message. */
+	for (stage = 0; stage < JSTAGE_COUNT; stage++) {
+		error = put_histogram(response.skb, stage,
+				&histograms[stage * JSTAGE_BUCKETS]);
+		if (error)
+			goto revert_response;
+	}
+
+	kfree(histograms);
+	request_handle_end(&jool);
+	return jresponse_send(&response);
+
+revert_response:
+	report_put_failure();
+	jresponse_cleanup(&response);
+revert_query:
+	kfree(histograms);
+revert_start:
+	request_handle_end(&jool);
+end:
+	return jresponse_send_simple(info, error);
+}
+
+/*
+ * Whatever needs to survive between the calls of a stats dump.
+ * Lives in netlink_callback.args, which Netlink zeroes when the dump starts.
+ */
+struct stats_dump_state {
+	__u8 done;
+	__u8 offset_set;
+	/* Last instance that was sent to userspace. */
+	struct instance_entry_usr offset;
+};
+
+struct stats_dump_args {
+	struct sk_buff *skb;
+	struct stats_dump_state *state;
+	/* Scratch space for the folded stats. (JSTAT_COUNT long.) */
+	__u64 *stats;
+};
+
+/* Runs under RCU, so it can't sleep. */
+static int serialize_instance_stats(struct xlator *jool, void *arg)
+{
+	struct stats_dump_args *args = arg;
+	struct nlattr *root, *stats;
+	enum jool_stat_id id;
+
+	root = nla_nest_start(args->skb, JNLAL_ENTRY);
+	if (!root)
+		return 1;
+
+	if (jnla_put_instance(args->skb, JNLASTE_INSTANCE, jool))
+		goto cancel;
+
+	stats = nla_nest_start(args->skb, JNLASTE_STATS);
+	if (!stats)
+		goto cancel;
+	jstat_fold(jool->stats, args->stats);
+	joold_gauges(jool, args->stats);
+	for (id = 1; id <= JSTAT_UNKNOWN; id++) {
+#if LINUX_VERSION_AT_LEAST(4, 7, 0, 7, 4)
+		if (nla_put_u64_64bit(args->skb, id, args->stats[id],
+				JSTAT_PADDING))
+#else
+		if (nla_put_u64(args->skb, id, args->stats[id]))
+#endif
+			goto cancel;
+	}
+	nla_nest_end(args->skb, stats);
+
+	nla_nest_end(args->skb, root);
+
+	args->state->offset.ns = ((__u64)jool->ns) & 0xFFFFFFFF;
+	args->state->offset.xf = xlator_flags2xf(jool->flags);
+	strcpy(args->state->offset.iname, jool->iname);
+	args->state->offset_set = true;
+	return 0;
+
+cancel:
+	nla_nest_cancel(args->skb, root);
+	return 1;
+}
+
+/*
+ * Genetlink dumpit. Unlike the other stats operations, this one is not
+ * restricted to the current namespace: It sends the stats of every instance
+ * of the requester's type, so exporters can poll all of them at once.
+ * (See handle_bib_foreach() for the dump mechanics.)
+ */
+int handle_stats_dump(struct sk_buff *skb, struct netlink_callback *cb)
+{
+	struct stats_dump_state *state;
+	struct stats_dump_args args;
+	struct jool_response response;
+	int error;
+
+	BUILD_BUG_ON(sizeof(struct stats_dump_state) > sizeof(cb->args));
+	state = (struct stats_dump_state *)cb->args;
+	if (state->done)
+		return 0;
+
+	log_debug("Sending every instance's stats to userspace.");
+	error_pool_activate();
+
+	error = dump_handle_start(cb, XT_ANY, NULL);
+	if (error)
+		goto fail;
+
+	args.stats = kcalloc(JSTAT_COUNT, sizeof(__u64), GFP_KERNEL);
+	if (!args.stats) {
+		error = -ENOMEM;
+		goto revert_start;
+	}
+
+	error = jresponse_init_dump(&response, skb, cb);
+	if (error)
+		goto revert_alloc;
+
+	args.skb = skb;
+	args.state = state;
+	error = xlator_foreach(get_dump_hdr(cb)->xt, serialize_instance_stats,
+			&args, state->offset_set ? &state->offset : NULL);
+	if (!error)
+		state->done = true;
+
+	error = jresponse_end_dump(&response, error);
+	if (error < 0)
+		goto revert_alloc;
+
+	kfree(args.stats);
+	request_handle_end(NULL);
+	error_pool_deactivate();
+	return error;
+
+revert_alloc:
+	kfree(args.stats);
+revert_start:
+	request_handle_end(NULL);
+fail:
+	state->done = true;
+	error = jresponse_dump_error(skb, cb, error);
+	error_pool_deactivate();
+	return error;
+}
+
+/*
+ * Puts the gauges of @stats if @gauges, the nonzero counters otherwise.
+ * Returns the number of stats written, or -EMSGSIZE.
+ */
+static int put_stream(struct sk_buff *skb, enum joolnl_attr_root type,
+		__u64 const *stats, bool gauges)
+{
+	struct nlattr *root;
+	enum jool_stat_id id;
+	int written;
+	int error;
+
+	root = nla_nest_start(skb, type);
+	if (!root)
+		return -EMSGSIZE;
+
+	written = 0;
+	for (id = 1; id <= JSTAT_UNKNOWN; id++) {
+		if (jstat_is_gauge(id) != gauges)
+			continue;
+		if (!gauges && !stats[id])
+			continue;
+
+#if LINUX_VERSION_AT_LEAST(4, 7, 0, 7, 4)
+		error = nla_put_u64_64bit(skb, id, stats[id], JSTAT_PADDING);
+#else
+		error = nla_put_u64(skb, id, stats[id]);
+#endif
+		if (error) {
+			nla_nest_cancel(skb, root);
+			return error;
+		}
+
+		written++;
+	}
+
+	nla_nest_end(skb, root);
+	return written;
+}
+
+/**
+ * Multicasts (to the JOOLNL_STATS_GRP_NAME group) how much @jool's counters
+ * grew since the previous call, along with the current values of its gauges.
+ *
+ * Does nothing if nothing changed, so idle instances don't spam the group.
+ * Can sleep.
+ */
+void jnl_stats_stream(struct xlator *jool)
+{
+	__u64 *stats;
+	struct sk_buff *skb;
+	struct joolnlhdr *hdr;
+	int error;
+
+	stats = kcalloc(JSTAT_COUNT, sizeof(__u64), GFP_KERNEL);
+	if (!stats)
+		return;
+
+	error = jstat_delta(jool->stats, stats);
+	if (error <= 0)
+		goto end;
+	joold_gauges(jool, stats);
+
+	/* Each stat lands in one of the nests, maybe after a padding attr. */
+	skb = genlmsg_new(2 * nla_total_size(0)
+			+ JSTAT_COUNT * 2 * nla_total_size(sizeof(__u64)),
+			GFP_KERNEL);
+	if (!skb)
+		goto end;
+
+	hdr = genlmsg_put(skb, 0, 0, jnl_family(), 0, 0);
+	if (!hdr)
+		goto kill_skb;
+	hdr->version = htonl(xlat_version());
+	hdr->xt = xlator_flags2xt(jool->flags);
+	hdr->flags = 0;
+	hdr->reserved1 = 0;
+	hdr->reserved2 = 0;
+	memcpy(hdr->iname, jool->iname, INAME_MAX_SIZE);
+
+	if (put_stream(skb, JNLAR_STATS_DELTAS, stats, false) < 0)
+		goto kill_skb;
+	if (put_stream(skb, JNLAR_STATS_GAUGES, stats, true) < 0)
+		goto kill_skb;
+	genlmsg_end(skb, hdr);
+
+#if LINUX_VERSION_LOWER_THAN(3, 13, 0, 7, 1)
+	error = genlmsg_multicast_netns(jool->ns, skb, 0, jnl_stats_gid(),
+			GFP_KERNEL);
+#else
+	/* (See send_to_userspace() in joold.c.) */
+	error = genlmsg_multicast_netns(jnl_family(), jool->ns, skb, 0,
+			JNL_STATS_GRP, GFP_KERNEL);
+#endif
+	/*
+	 * -ESRCH means nobody is listening, which is normal.
+	 * The delta is lost either way; the next one doesn't include it.
+	 */
+	if (error && error != -ESRCH)
+		log_warn_once("Could not stream stats to userspace (errcode %d).",
+				error);
+	goto end;
+
+kill_skb:
+	kfree_skb(skb);
+end:
+	kfree(stats);
+}
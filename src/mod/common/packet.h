@@ -542,6 +542,35 @@ static inline bool pkt_is_icmp4_error(const struct packet *pkt)
 			&& is_icmp4_error(pkt_icmp4_hdr(pkt)->type);
 }
 
+/** Is @pkt a fragment? (First or otherwise.) */
+static inline bool pkt_is_fragment(const struct packet *pkt)
+{
+	switch (pkt_l3_proto(pkt)) {
+	case L3PROTO_IPV6:
+		return is_fragmented_ipv6(pkt_frag_hdr(pkt));
+	case L3PROTO_IPV4:
+		return is_fragmented_ipv4(pkt_ip4_hdr(pkt));
+	}
+
+	return false;
+}
+
+/**
+ * Is @pkt a fragment other than the first one? (ie. does it lack a layer-4
+ * header?)
+ */
+static inline bool pkt_is_subsequent_frag(const struct packet *pkt)
+{
+	switch (pkt_l3_proto(pkt)) {
+	case L3PROTO_IPV6:
+		return !is_first_frag6(pkt_frag_hdr(pkt));
+	case L3PROTO_IPV4:
+		return !is_first_frag4(pkt_ip4_hdr(pkt));
+	}
+
+	return false;
+}
+
 struct xlation;
 
 /**
@@ -34,6 +34,8 @@
  */
 #if LINUX_VERSION_AT_LEAST(5, 1, 0, 9999, 0)
 #define synchronize_rcu_bh synchronize_rcu
+#define call_rcu_bh call_rcu
+#define rcu_barrier_bh rcu_barrier
 #endif
 
 #endif /* SRC_MOD_COMMON_RCU_H_ */
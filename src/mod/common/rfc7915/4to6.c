@@ -20,7 +20,6 @@ verdict ttp46_alloc_skb(struct xlation *state)
 	struct sk_buff *out;
 	struct iphdr *hdr4_inner;
 	struct frag_hdr *hdr_frag;
-	struct skb_shared_info *shinfo;
 	int error;
 
 	/*
@@ -126,11 +125,7 @@ verdict ttp46_alloc_skb(struct xlation *state)
 	out->mark = in->skb->mark;
 	out->protocol = htons(ETH_P_IPV6);
 
-	shinfo = skb_shinfo(out);
-	if (shinfo->gso_type & SKB_GSO_TCPV4) {
-		shinfo->gso_type &= ~SKB_GSO_TCPV4;
-		shinfo->gso_type |= SKB_GSO_TCPV6;
-	}
+	ttpcomm_xlat_gso_type(out, L3PROTO_IPV6);
 
 	return VERDICT_CONTINUE;
 }
@@ -773,9 +768,6 @@ static bool can_compute_csum(struct xlation *state)
 	struct udphdr *hdr_udp;
 	bool amend_csum0;
 
-	if (xlation_is_nat64(state))
-		return true;
-
 	/*
 	 * RFC 7915#4.5:
 	 * A stateless translator cannot compute the UDP checksum of
@@ -789,9 +781,13 @@ static bool can_compute_csum(struct xlation *state)
 	 * JSTAT46_FRAGMENTED_ZERO_CSUM.)
 	 * It does not include the addresses/ports, which is OK because users
 	 * don't like it: https://github.com/NICMx/Jool/pull/129
+	 *
+	 * NAT64 always amends, but it too can only do so when the packet is not
+	 * fragmented. (Which, unless defrag is disabled, is always the case.)
 	 */
 	hdr4 = pkt_ip4_hdr(&state->in);
-	amend_csum0 = state->jool.globals.siit.compute_udp_csum_zero;
+	amend_csum0 = xlation_is_nat64(state)
+			|| state->jool.globals.siit.compute_udp_csum_zero;
 	if (is_mf_set_ipv4(hdr4) || !amend_csum0) {
 		hdr_udp = pkt_udp_hdr(&state->in);
 		log_debug("Dropping zero-checksum UDP packet: %pI4#%u->%pI4#%u",
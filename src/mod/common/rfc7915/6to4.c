@@ -18,7 +18,6 @@ verdict ttp64_alloc_skb(struct xlation *state)
 {
 	struct packet *in = &state->in;
 	struct sk_buff *out;
-	struct skb_shared_info *shinfo;
 	int error;
 
 	/*
@@ -108,11 +107,7 @@ verdict ttp64_alloc_skb(struct xlation *state)
 	out->mark = in->skb->mark;
 	out->protocol = htons(ETH_P_IP);
 
-	shinfo = skb_shinfo(out);
-	if (shinfo->gso_type & SKB_GSO_TCPV6) {
-		shinfo->gso_type &= ~SKB_GSO_TCPV6;
-		shinfo->gso_type |= SKB_GSO_TCPV4;
-	}
+	ttpcomm_xlat_gso_type(out, L3PROTO_IPV4);
 
 	return VERDICT_CONTINUE;
 }
@@ -4,6 +4,7 @@
 
 #include "common/config.h"
 #include "mod/common/ipv6_hdr_iterator.h"
+#include "mod/common/linux_version.h"
 #include "mod/common/packet.h"
 #include "mod/common/stats.h"
 #include "mod/common/rfc7915/4to6.h"
@@ -346,3 +347,56 @@ void partialize_skb(struct sk_buff *out_skb, unsigned int csum_offset)
 	out_skb->csum_start = skb_transport_header(out_skb) - out_skb->head;
 	out_skb->csum_offset = csum_offset;
 }
+
+/**
+ * Adjusts the GSO type of @skb (a freshly translated packet whose network
+ * protocol is now @proto) so the stack can keep treating it as a super-packet
+ * instead of having to segment it before the translation.
+ *
+ * gso_size is left alone; it is the number of layer-4 payload bytes per
+ * segment, and the translation does not change that. Whether the resulting
+ * segments still fit the outgoing MTU is sendpkt's business, since the route
+ * isn't known yet.
+ *
+ * SKB_GSO_UDP_L4, SKB_GSO_UDP, SKB_GSO_TCP_ECN and the tunnel types that
+ * encapsulate on top of UDP or GRE do not care about the outer network
+ * protocol, so they survive as they are.
+ */
+void ttpcomm_xlat_gso_type(struct sk_buff *skb, l3_protocol proto)
+{
+	struct skb_shared_info *shinfo;
+
+	if (!skb_is_gso(skb))
+		return;
+
+	shinfo = skb_shinfo(skb);
+	switch (proto) {
+	case L3PROTO_IPV6:
+		if (shinfo->gso_type & SKB_GSO_TCPV4) {
+			shinfo->gso_type &= ~SKB_GSO_TCPV4;
+			shinfo->gso_type |= SKB_GSO_TCPV6;
+		}
+#if LINUX_VERSION_AT_LEAST(4, 7, 0, 8, 0)
+		/* Fixed IDs are an IPv4 thing. */
+		shinfo->gso_type &= ~SKB_GSO_TCP_FIXEDID;
+		if (shinfo->gso_type & SKB_GSO_IPXIP4) {
+			shinfo->gso_type &= ~SKB_GSO_IPXIP4;
+			shinfo->gso_type |= SKB_GSO_IPXIP6;
+		}
+#endif
+		break;
+
+	case L3PROTO_IPV4:
+		if (shinfo->gso_type & SKB_GSO_TCPV6) {
+			shinfo->gso_type &= ~SKB_GSO_TCPV6;
+			shinfo->gso_type |= SKB_GSO_TCPV4;
+		}
+#if LINUX_VERSION_AT_LEAST(4, 7, 0, 8, 0)
+		if (shinfo->gso_type & SKB_GSO_IPXIP6) {
+			shinfo->gso_type &= ~SKB_GSO_IPXIP6;
+			shinfo->gso_type |= SKB_GSO_IPXIP4;
+		}
+#endif
+		break;
+	}
+}
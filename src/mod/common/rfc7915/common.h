@@ -48,6 +48,7 @@ struct translation_steps {
 struct translation_steps *ttpcomm_get_steps(struct packet *in);
 
 void partialize_skb(struct sk_buff *skb, unsigned int csum_offset);
+void ttpcomm_xlat_gso_type(struct sk_buff *skb, l3_protocol proto);
 bool will_need_frag_hdr(const struct iphdr *hdr);
 verdict ttpcomm_translate_inner_packet(struct xlation *state);
 
@@ -0,0 +1,293 @@
+#include "mod/common/session_log.h"
+
+#include <linux/ktime.h>
+#include <linux/percpu.h>
+#include <linux/skbuff.h>
+#include <linux/workqueue.h>
+#include <net/genetlink.h>
+#include "common/xlat.h"
+#include "mod/common/linux_version.h"
+#include "mod/common/log.h"
+#include "mod/common/wkmalloc.h"
+#include "mod/common/nl/nl_handler.h"
+
+/* Events per batch. (ie. per Netlink message.) */
+#define SLOG_BATCH 64
+/*
+ * Full batches allowed to wait for the flusher. Beyond this, the consumer is
+ * clearly not keeping up, so new batches are dropped.
+ */
+#define SLOG_MAX_PENDING 1024
+/* Maximum time an event can sit in a batch that isn't full. */
+#define SLOG_FLUSH_DELAY msecs_to_jiffies(100)
+
+struct slog_batch {
+	struct slog_event events[SLOG_BATCH];
+	unsigned int count;
+	spinlock_t lock;
+};
+
+struct session_log {
+	struct slog_batch __percpu *batches;
+	/* Full batches, already packed as Netlink messages. */
+	struct sk_buff_head pending;
+	/* Events lost since the last time somebody reported them to jstat. */
+	atomic_t dropped;
+
+	/* Namespace where the events will be multicasted. */
+	struct net *ns;
+	char iname[INAME_MAX_SIZE];
+
+	struct delayed_work flusher;
+	/*
+	 * Set by slog_stop(). No more events are accepted, and the flusher is
+	 * never scheduled again.
+	 * Written while holding every batch lock; read while holding any.
+	 */
+	bool stopped;
+	struct kref refs;
+};
+
+static void flush_log(struct work_struct *work);
+
+struct session_log *slog_alloc(struct net *ns, char const *iname)
+{
+	struct session_log *log;
+	struct slog_batch *batch;
+	int cpu;
+
+	log = wkmalloc(struct session_log, GFP_KERNEL);
+	if (!log)
+		return NULL;
+
+	log->batches = alloc_percpu(struct slog_batch);
+	if (!log->batches) {
+		wkfree(struct session_log, log);
+		return NULL;
+	}
+	for_each_possible_cpu(cpu) {
+		batch = per_cpu_ptr(log->batches, cpu);
+		batch->count = 0;
+		spin_lock_init(&batch->lock);
+	}
+
+	skb_queue_head_init(&log->pending);
+	atomic_set(&log->dropped, 0);
+	log->ns = ns;
+	strcpy(log->iname, iname);
+	INIT_DELAYED_WORK(&log->flusher, flush_log);
+	log->stopped = false;
+	kref_init(&log->refs);
+
+	return log;
+}
+
+void slog_get(struct session_log *log)
+{
+	kref_get(&log->refs);
+}
+
+/*
+ * The last xlator_put() can happen in softirq context, so this must not sleep.
+ * The owner already sent the final events during slog_stop().
+ */
+static void slog_release(struct kref *refs)
+{
+	struct session_log *log;
+	log = container_of(refs, struct session_log, refs);
+
+	skb_queue_purge(&log->pending);
+	free_percpu(log->batches);
+	wkfree(struct session_log, log);
+}
+
+void slog_put(struct session_log *log)
+{
+	kref_put(&log->refs, slog_release);
+}
+
+/*
+ * Moves @batch's events to a Netlink message, and queues it for the flusher.
+ * Drops the events if that's not possible.
+ * Assumes the batch's lock is held.
+ */
+static void pack_batch(struct session_log *log, struct slog_batch *batch)
+{
+	struct sk_buff *skb;
+	struct joolnlhdr *hdr;
+	size_t size;
+
+	if (!batch->count)
+		return;
+	if (skb_queue_len(&log->pending) >= SLOG_MAX_PENDING)
+		goto drop;
+
+	size = batch->count * sizeof(struct slog_event);
+	skb = genlmsg_new(nla_total_size(size), GFP_ATOMIC);
+	if (!skb)
+		goto drop;
+
+	hdr = genlmsg_put(skb, 0, 0, jnl_family(), 0, 0);
+	if (!hdr)
+		goto kill_skb;
+	hdr->version = htonl(xlat_version());
+	hdr->xt = XT_NAT64;
+	hdr->flags = 0;
+	hdr->reserved1 = 0;
+	hdr->reserved2 = 0;
+	memcpy(hdr->iname, log->iname, INAME_MAX_SIZE);
+
+	if (nla_put(skb, JNLAR_SLOG_EVENTS, size, batch->events))
+		goto kill_skb;
+	genlmsg_end(skb, hdr);
+
+	skb_queue_tail(&log->pending, skb);
+	batch->count = 0;
+	return;
+
+kill_skb:
+	kfree_skb(skb);
+drop:
+	atomic_add(batch->count, &log->dropped);
+	batch->count = 0;
+}
+
+static unsigned int count_events(struct sk_buff *skb)
+{
+	struct nlattr *attr;
+
+	attr = nlmsg_find_attr(nlmsg_hdr(skb),
+			GENL_HDRLEN + sizeof(struct joolnlhdr),
+			JNLAR_SLOG_EVENTS);
+	return attr ? (nla_len(attr) / sizeof(struct slog_event)) : 0;
+}
+
+static void send_batch(struct session_log *log, struct sk_buff *skb)
+{
+	unsigned int count;
+	int error;
+
+	count = count_events(skb);
+
+	/*
+	 * The log doesn't pin the namespace; the instance would never die if it
+	 * did. This one only needs to survive the multicast.
+	 */
+	if (!maybe_get_net(log->ns)) {
+		/* It's being torn down, along with its listeners. */
+		kfree_skb(skb);
+		atomic_add(count, &log->dropped);
+		return;
+	}
+
+#if LINUX_VERSION_LOWER_THAN(3, 13, 0, 7, 1)
+	error = genlmsg_multicast_netns(log->ns, skb, 0, jnl_slog_gid(),
+			GFP_KERNEL);
+#else
+	/* (See send_to_userspace() in joold.c.) */
+	error = genlmsg_multicast_netns(jnl_family(), log->ns, skb, 0,
+			JNL_SLOG_GRP, GFP_KERNEL);
+#endif
+	put_net(log->ns);
+	if (error) {
+		/* -ESRCH means nobody is listening. Still lost, though. */
+		atomic_add(count, &log->dropped);
+		log_warn_once("Could not stream %u BIB/session log events to userspace (errcode %d). Is 'jool session follow' running?",
+				count, error);
+	}
+}
+
+/*
+ * Sends everything that has been collected so far.
+ *
+ * Full batches are normally sent almost immediately; this mostly exists so
+ * slow traffic doesn't leave events waiting in half-empty batches forever.
+ */
+static void flush_log(struct work_struct *work)
+{
+	struct session_log *log;
+	struct slog_batch *batch;
+	struct sk_buff *skb;
+	int cpu;
+
+	log = container_of(to_delayed_work(work), struct session_log, flusher);
+
+	for_each_possible_cpu(cpu) {
+		batch = per_cpu_ptr(log->batches, cpu);
+		spin_lock_bh(&batch->lock);
+		pack_batch(log, batch);
+		spin_unlock_bh(&batch->lock);
+	}
+
+	while ((skb = skb_dequeue(&log->pending)) != NULL)
+		send_batch(log, skb);
+}
+
+/**
+ * slog_stop - Sends the events @log still has, and stops accepting new ones.
+ *
+ * Meant to be called by the instance that owns @log, before it releases it.
+ * (Other instances might still hold references, but they're not supposed to
+ * add events anymore.) Might sleep.
+ */
+void slog_stop(struct session_log *log)
+{
+	struct slog_batch *batch;
+	int cpu;
+
+	/*
+	 * Once we've held a batch's lock, nobody adding events to it can
+	 * schedule the flusher anymore.
+	 */
+	for_each_possible_cpu(cpu) {
+		batch = per_cpu_ptr(log->batches, cpu);
+		spin_lock_bh(&batch->lock);
+		log->stopped = true;
+		spin_unlock_bh(&batch->lock);
+	}
+
+	cancel_delayed_work_sync(&log->flusher);
+	flush_log(&log->flusher.work);
+}
+
+/**
+ * Queues @event for streaming to userspace.
+ *
+ * Does not sleep, and only touches the current CPU's batch (unless it fills
+ * up), so it's meant to be called from the packet path.
+ */
+void slog_add(struct xlator *jool, struct slog_event *event)
+{
+	struct session_log *log;
+	struct slog_batch *batch;
+	int dropped;
+
+	log = jool->nat64.slog;
+	event->time = ktime_to_ns(ktime_get_real());
+
+	local_bh_disable();
+	batch = this_cpu_ptr(log->batches);
+	spin_lock(&batch->lock);
+
+	if (unlikely(log->stopped)) {
+		atomic_inc(&log->dropped);
+		goto end;
+	}
+
+	batch->events[batch->count++] = *event;
+	if (batch->count == SLOG_BATCH) {
+		pack_batch(log, batch);
+		mod_delayed_work(system_wq, &log->flusher, 0);
+	} else if (batch->count == 1) {
+		queue_delayed_work(system_wq, &log->flusher, SLOG_FLUSH_DELAY);
+	}
+
+end:
+	spin_unlock(&batch->lock);
+	local_bh_enable();
+
+	if (unlikely(atomic_read(&log->dropped))) {
+		dropped = atomic_xchg(&log->dropped, 0);
+		jstat_add(jool->stats, JSTAT_SLOG_DROPPED, dropped);
+	}
+}
@@ -0,0 +1,25 @@
+#ifndef SRC_MOD_COMMON_SESSION_LOG_H_
+#define SRC_MOD_COMMON_SESSION_LOG_H_
+
+/**
+ * @file
+ * Binary BIB/session log, for when logging-bib and logging-session generate
+ * more lines than printk() can handle.
+ *
+ * Events are collected in per-CPU batches, which are multicasted to userspace
+ * (JOOLNL_SLOG_GRP_NAME group) once they fill up, or after a short while.
+ */
+
+#include "common/config.h"
+#include "mod/common/xlator.h"
+
+struct session_log;
+
+struct session_log *slog_alloc(struct net *ns, char const *iname);
+void slog_get(struct session_log *log);
+void slog_put(struct session_log *log);
+void slog_stop(struct session_log *log);
+
+void slog_add(struct xlator *jool, struct slog_event *event);
+
+#endif /* SRC_MOD_COMMON_SESSION_LOG_H_ */
@@ -1,6 +1,7 @@
 #include "mod/common/stats.h"
 
 #include <linux/kref.h>
+#include <linux/mutex.h>
 #include <net/ip.h>
 #include <net/snmp.h>
 #include "mod/common/linux_version.h"
@@ -10,8 +11,19 @@ struct jool_mib {
 	unsigned long mibs[JSTAT_COUNT];
 };
 
+/* One CPU's share of the latency histograms. */
+struct jool_latency {
+	__u64 buckets[JSTAGE_COUNT][JSTAGE_BUCKETS];
+};
+
 struct jool_stats {
 	DEFINE_SNMP_STAT(struct jool_mib, mib);
+	struct jool_latency __percpu *latency;
+
+	/* What jstat_delta() saw last time. Allocated on first use. */
+	__u64 *last;
+	struct mutex last_lock;
+
 	struct kref refcounter;
 };
 
@@ -31,12 +43,27 @@ struct jool_stats *jstat_alloc(void)
 			sizeof(struct jool_mib),
 			__alignof__(struct jool_mib)) < 0) {
 #endif
-		wkfree(struct jool_stats, result);
-		return NULL;
+		goto mib_fail;
 	}
-	kref_init(&result->refcounter);
 
+	result->latency = alloc_percpu(struct jool_latency);
+	if (!result->latency)
+		goto latency_fail;
+
+	result->last = NULL;
+	mutex_init(&result->last_lock);
+	kref_init(&result->refcounter);
 	return result;
+
+latency_fail:
+#if LINUX_VERSION_AT_LEAST(3, 16, 0, 8, 0)
+	free_percpu(result->mib);
+#else
+	snmp_mib_free((void __percpu **)result->mib);
+#endif
+mib_fail:
+	wkfree(struct jool_stats, result);
+	return NULL;
 }
 
 void jstat_get(struct jool_stats *stats)
@@ -54,6 +81,8 @@ static void jstat_release(struct kref *refcount)
 #else
 	snmp_mib_free((void __percpu **)stats->mib);
 #endif
+	free_percpu(stats->latency);
+	kfree(stats->last);
 	wkfree(struct jool_stats, stats);
 }
 
@@ -77,6 +106,23 @@ void jstat_add(struct jool_stats *stats, enum jool_stat_id stat, int addend)
 	SNMP_ADD_STATS(stats->mib, stat, addend);
 }
 
+/**
+ * Writes the stats (all CPUs added up) to @result, whose length must be
+ * JSTAT_COUNT. Does not sleep.
+ */
+void jstat_fold(struct jool_stats *stats, __u64 *result)
+{
+	int i;
+
+	for (i = 0; i < JSTAT_COUNT; i++) {
+#if LINUX_VERSION_AT_LEAST(3, 16, 0, 9999, 0)
+		result[i] = snmp_fold_field(stats->mib, i);
+#else
+		result[i] = snmp_fold_field((void __percpu **)stats->mib, i);
+#endif
+	}
+}
+
 /**
  * Returns the list of stats as an array. You will have to free it.
  * The array length will be JSTAT_COUNT.
@@ -84,18 +130,105 @@ void jstat_add(struct jool_stats *stats, enum jool_stat_id stat, int addend)
 __u64 *jstat_query(struct jool_stats *stats)
 {
 	__u64 *result;
-	int i;
 
 	result = kcalloc(JSTAT_COUNT, sizeof(__u64), GFP_KERNEL);
 	if (!result)
 		return NULL;
 
+	jstat_fold(stats, result);
+	return result;
+}
+
+/**
+ * Writes to @result how much every counter has grown since the previous call
+ * (or since @stats was created, during the first call), and the current value
+ * of every gauge. @result's length must be JSTAT_COUNT.
+ *
+ * Returns the number of stats that changed since the previous call, or a
+ * negative error code.
+ */
+int jstat_delta(struct jool_stats *stats, __u64 *result)
+{
+	__u64 value;
+	int changed;
+	int i;
+
+	mutex_lock(&stats->last_lock);
+
+	if (!stats->last) {
+		stats->last = kcalloc(JSTAT_COUNT, sizeof(__u64), GFP_KERNEL);
+		if (!stats->last) {
+			mutex_unlock(&stats->last_lock);
+			return -ENOMEM;
+		}
+	}
+
+	jstat_fold(stats, result);
+
+	changed = 0;
 	for (i = 0; i < JSTAT_COUNT; i++) {
-#if LINUX_VERSION_AT_LEAST(3, 16, 0, 9999, 0)
-		result[i] = snmp_fold_field(stats->mib, i);
-#else
-		result[i] = snmp_fold_field((void __percpu **)stats->mib, i);
-#endif
+		value = result[i];
+		if (value != stats->last[i])
+			changed++;
+		/* Counters are unsigned and can wrap; the subtraction copes. */
+		if (!jstat_is_gauge(i))
+			result[i] = value - stats->last[i];
+		stats->last[i] = value;
+	}
+
+	mutex_unlock(&stats->last_lock);
+	return changed;
+}
+
+/**
+ * Counts a successful pool4 port allocation that tried @iterations transport
+ * addresses. (See JSTAT_POOL4_ITER_1.)
+ */
+void jstat_pool4_iterations(struct jool_stats *stats, unsigned int iterations)
+{
+	unsigned int bucket;
+
+	bucket = iterations ? ((fls(iterations - 1) + 1) >> 1) : 0;
+	bucket = min_t(unsigned int, bucket, JSTAT_POOL4_ITER_BUCKETS - 1);
+	SNMP_INC_STATS(stats->mib, JSTAT_POOL4_ITER_1 + bucket);
+}
+
+/**
+ * Counts a run of @stage that took @cycles CPU cycles.
+ */
+void jstat_latency(struct jool_stats *stats, enum jool_stage stage,
+		cycles_t cycles)
+{
+	unsigned int bucket;
+
+	bucket = min_t(unsigned int, fls64(cycles), JSTAGE_BUCKETS - 1);
+	this_cpu_inc(stats->latency->buckets[stage][bucket]);
+}
+
+/**
+ * Returns the latency histograms, all CPUs added up. You will have to free
+ * the array.
+ * The array length will be JSTAGE_COUNT * JSTAGE_BUCKETS; stage s's bucket b
+ * is at index s * JSTAGE_BUCKETS + b.
+ */
+__u64 *jstat_query_latency(struct jool_stats *stats)
+{
+	struct jool_latency *latency;
+	__u64 *result;
+	unsigned int s, b;
+	int cpu;
+
+	result = kcalloc(JSTAGE_COUNT * JSTAGE_BUCKETS, sizeof(__u64),
+			GFP_KERNEL);
+	if (!result)
+		return NULL;
+
+	for_each_possible_cpu(cpu) {
+		latency = per_cpu_ptr(stats->latency, cpu);
+		for (s = 0; s < JSTAGE_COUNT; s++)
+			for (b = 0; b < JSTAGE_BUCKETS; b++)
+				result[s * JSTAGE_BUCKETS + b]
+						+= latency->buckets[s][b];
 	}
 
 	return result;
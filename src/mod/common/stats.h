@@ -1,6 +1,7 @@
 #ifndef SRC_MOD_COMMON_STATS_H_
 #define SRC_MOD_COMMON_STATS_H_
 
+#include <linux/timex.h>
 #include "common/stats.h"
 #include "mod/common/packet.h"
 
@@ -13,8 +14,15 @@ void jstat_put(struct jool_stats *stats);
 void jstat_inc(struct jool_stats *stats, enum jool_stat_id stat);
 void jstat_dec(struct jool_stats *stats, enum jool_stat_id stat);
 void jstat_add(struct jool_stats *stats, enum jool_stat_id stat, int addend);
+void jstat_pool4_iterations(struct jool_stats *stats, unsigned int iterations);
 
+void jstat_fold(struct jool_stats *stats, __u64 *result);
 __u64 *jstat_query(struct jool_stats *stats);
+int jstat_delta(struct jool_stats *stats, __u64 *result);
+
+void jstat_latency(struct jool_stats *stats, enum jool_stage stage,
+		cycles_t cycles);
+__u64 *jstat_query_latency(struct jool_stats *stats);
 
 #ifdef UNIT_TESTING
 int jstat_refcount(struct jool_stats *stats);
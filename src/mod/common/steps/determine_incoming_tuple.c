@@ -4,6 +4,7 @@
 #include "mod/common/ipv6_hdr_iterator.h"
 #include "mod/common/log.h"
 #include "mod/common/stats.h"
+#include "mod/common/db/bib/db.h"
 
 /*
  * There are several points in this module where the RFC says "drop the packet",
@@ -264,6 +265,32 @@ static verdict ipv6_icmp(struct xlation *state)
 	return untranslatable(state, JSTAT_UNKNOWN_ICMP6_TYPE);
 }
 
+/**
+ * Subsequent fragments do not have layer-4 headers, so their tuples have to be
+ * inherited from their first fragments. (Only happens when defrag is disabled.)
+ */
+static verdict handle_fragment(struct xlation *state)
+{
+	struct packet *in = &state->in;
+
+	/*
+	 * ICMP checksums (and ICMPv6's pseudoheader) cover the entire message,
+	 * so they cannot be translated one fragment at a time. ICMP errors are
+	 * not supposed to be fragmented anyway.
+	 */
+	if (pkt_l4_proto(in) == L4PROTO_ICMP) {
+		log_debug("Packet is a fragmented ICMP message; its checksum cannot be translated.");
+		return drop(state, JSTAT_FRAGMENTED_PING);
+	}
+
+	if (bib_frag_find(state->jool.nat64.bib, in, &in->tuple)) {
+		log_debug("The fragment's first fragment is unknown (or too old).");
+		return drop(state, JSTAT_FRAG_NO_FIRST);
+	}
+
+	return VERDICT_CONTINUE;
+}
+
 /**
  * Extracts relevant data from "skb" and stores it in the "tuple" tuple.
  *
@@ -277,6 +304,13 @@ verdict determine_in_tuple(struct xlation *state)
 
 	log_debug("Step 1: Determining the Incoming Tuple");
 
+	if (pkt_is_fragment(&state->in)
+			&& (pkt_is_subsequent_frag(&state->in)
+			|| pkt_l4_proto(&state->in) == L4PROTO_ICMP)) {
+		result = handle_fragment(state);
+		goto end;
+	}
+
 	switch (pkt_l3_proto(&state->in)) {
 	case L3PROTO_IPV4:
 		switch (pkt_l4_proto(&state->in)) {
@@ -311,6 +345,7 @@ verdict determine_in_tuple(struct xlation *state)
 		break;
 	}
 
+end:
 	if (result == VERDICT_CONTINUE)
 		log_tuple(&state->in.tuple);
 	log_debug("Done step 1.");
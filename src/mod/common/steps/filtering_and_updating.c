@@ -158,11 +158,14 @@ static verdict ipv6_simple(struct xlation *state)
 
 	error = bib_add6(state, masks, &state->in.tuple, &dst4);
 
+	mask_domain_report(state->jool.nat64.pool4, masks);
 	mask_domain_put(masks);
 
 	switch (error) {
 	case 0:
 		return succeed(state);
+	case -ENOENT:
+		return drop(state, JSTAT_POOL4_EXHAUSTED);
 	default:
 		/*
 		 * Error msg already printed, but since bib_add6() sprawls
@@ -458,6 +461,32 @@ static enum session_fate tcp_state_machine(struct session_entry *session,
 	return FATE_RM;
 }
 
+static bool tcp_offload(struct xlation *state)
+{
+	return state->jool.globals.nat64.bib.tcp_offload;
+}
+
+/**
+ * Keeps the offload table (see db/bib/offload.h) in sync with the session the
+ * state machine just updated.
+ */
+static void update_offload(struct xlation *state)
+{
+	struct session_entry *session;
+	struct tcphdr *hdr;
+
+	if (!tcp_offload(state) || !state->entries.session_set)
+		return;
+
+	session = &state->entries.session;
+	hdr = pkt_tcp_hdr(&state->in);
+
+	if (session->state == ESTABLISHED && !hdr->syn && !hdr->fin && !hdr->rst)
+		bib_offload_add(state->jool.nat64.bib, session);
+	else
+		bib_offload_rm(state->jool.nat64.bib, session);
+}
+
 /**
  * IPv6 half of RFC 6146 section 3.5.2.
  */
@@ -477,9 +506,14 @@ static verdict ipv6_tcp(struct xlation *state)
 	cb.arg = state;
 	result = bib_add_tcp6(state, masks, &dst4, &cb);
 
+	mask_domain_report(state->jool.nat64.pool4, masks);
 	mask_domain_put(masks);
 
-	return (result == VERDICT_CONTINUE) ? succeed(state) : result;
+	if (result != VERDICT_CONTINUE)
+		return result;
+
+	update_offload(state);
+	return succeed(state);
 }
 
 /**
@@ -500,8 +534,11 @@ static verdict ipv4_tcp(struct xlation *state)
 	cb.cb = tcp_state_machine;
 	cb.arg = state;
 	result = bib_add_tcp4(state, &dst6, &cb);
+	if (result != VERDICT_CONTINUE)
+		return result;
 
-	return (result == VERDICT_CONTINUE) ? succeed(state) : result;
+	update_offload(state);
+	return succeed(state);
 }
 
 #define pool6_contains(state, addr) \
@@ -519,6 +556,12 @@ verdict filtering_and_updating(struct xlation *state)
 
 	log_debug("Step 2: Filtering and Updating");
 
+	if (pkt_is_subsequent_frag(in)) {
+		/* The first fragment already did all of this. */
+		log_debug("Packet is a subsequent fragment; skipping step...");
+		return VERDICT_CONTINUE;
+	}
+
 	switch (pkt_l3_proto(in)) {
 	case L3PROTO_IPV6:
 		/* Get rid of hairpinning loops and unwanted packets. */
@@ -605,6 +648,46 @@ verdict filtering_and_updating(struct xlation *state)
 		return drop(state, JSTAT_UNKNOWN_L4_PROTO);
 	}
 
+	/* Let the subsequent fragments know the packet was let through. */
+	if (result == VERDICT_CONTINUE && pkt_is_fragment(in))
+		bib_frag_add(state->jool.nat64.bib, in);
+
 	log_debug("Done: Step 2.");
 	return result;
 }
+
+/**
+ * Shortcut to filtering_and_updating() for packets that belong to offloaded
+ * TCP connections. (See db/bib/offload.h.)
+ *
+ * Returns true if @state->entries was filled and filtering_and_updating() can
+ * be skipped. Returns false if the packet needs to take the long way.
+ */
+bool filtering_offloaded(struct xlation *state)
+{
+	struct packet *in = &state->in;
+	struct tcphdr *hdr;
+
+	if (!tcp_offload(state))
+		return false;
+	/* Also excludes ICMP errors, since their tuples are inverted. */
+	if (pkt_l4_proto(in) != L4PROTO_TCP)
+		return false;
+	/* Subsequent fragments lack TCP headers, first fragments must be cached. */
+	if (pkt_is_fragment(in))
+		return false;
+
+	/* These need the state machine. */
+	hdr = pkt_tcp_hdr(in);
+	if (hdr->syn || hdr->fin || hdr->rst)
+		return false;
+
+	if (bib_offload_find(state->jool.nat64.bib, &in->tuple,
+			&state->entries))
+		return false;
+
+	log_debug("Step 2: Offloaded.");
+	log_entries(&state->entries);
+	jstat_inc(state->jool.stats, JSTAT_TCP_OFFLOADED);
+	return true;
+}
@@ -11,6 +11,7 @@
 #include "mod/common/db/bib/entry.h"
 
 verdict filtering_and_updating(struct xlation *state);
+bool filtering_offloaded(struct xlation *state);
 enum session_fate tcp_est_expire_cb(struct session_entry *session, void *arg);
 
 #endif /* SRC_MOD_NAT64_FILTERING_AND_UPDATING_H_ */
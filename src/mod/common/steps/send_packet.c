@@ -1,12 +1,19 @@
 #include "send_packet.h"
 
 #include <linux/version.h>
+#include <net/ip6_route.h>
+#include <net/neighbour.h>
+#include <net/route.h>
 
 #include "mod/common/linux_version.h"
+#if LINUX_VERSION_AT_LEAST(4, 3, 0, 8, 0)
+#include <net/lwtunnel.h>
+#endif
 #include "mod/common/log.h"
 #include "mod/common/icmp_wrapper.h"
 #include "mod/common/packet.h"
 #include "mod/common/route.h"
+#include "mod/common/stats.h"
 
 static unsigned int get_nexthop_mtu(struct packet *pkt)
 {
@@ -22,8 +29,11 @@ static unsigned int get_nexthop_mtu(struct packet *pkt)
  * Returns false if GSO did nothing and MTU needs to be addressed still.
  * No other outcomes.
  */
-static bool handle_gso(struct packet *in)
+static bool handle_gso(struct packet *out, unsigned int mtu)
 {
+	struct skb_shared_info *shinfo;
+	unsigned int hdrs_len;
+
 	/*
 	 * This is how I understand GSO:
 	 *
@@ -45,14 +55,24 @@ static bool handle_gso(struct packet *in)
 	 * Therefore, if GSO is intended to happen, Jool should usually not
 	 * bounce Fragmentation Neededs back.
 	 *
-	 * The details on how this should be implemented, however, are a little
-	 * dodgy to me. Should I pay attention to type flags other than
-	 * SKB_GSO_TCPV4 and SKB_GSO_TCPV6? Why does SKB_GSO_UDP not care about
-	 * the network layer's protocol? What if gso_size does not exceed the
-	 * MTU of the next interface, but does exceed the MTU of some future
-	 * interface? This code will probably need to evolve depending on future
-	 * experience, and this first version tries to be as conservative as
-	 * possible.
+	 * However, the segments themselves still need to fit. The translation
+	 * preserved gso_size (layer-4 payload per segment), but the network
+	 * header grew or shrank in the process, so a segment size that was
+	 * computed for the incoming MTU might not suit the outgoing one. (The
+	 * typical case is IPv4 -> IPv6; the new header is 20 bytes larger.)
+	 *
+	 * TCP doesn't mind if we cut its segments smaller, so we recompute
+	 * gso_size against the outgoing MTU. SKB_GSO_DODGY and a zero gso_segs
+	 * tell the stack to validate the headers and recount the segments.
+	 *
+	 * UDP_L4 segments are whole datagrams whose size the application chose,
+	 * so they cannot be shrunk; if they don't fit, they get the same
+	 * treatment as any other oversized packet.
+	 *
+	 * Anything else (legacy UFO, tunnels, SCTP's GSO_BY_FRAGS, GRO'd
+	 * frag_lists) is left as it was; skb_segment() expects frag_list
+	 * members to be gso_size long, and the other types don't segment by
+	 * gso_size in any way we can safely fiddle with.
 	 *
 	 * For reference, this code works correctly on TCP packets traveling
 	 * through only veth pair interfaces, and was prompted by this bug
@@ -67,7 +87,33 @@ static bool handle_gso(struct packet *in)
 	 * This documentations talks about some SCTP quirk. I'm not yet sure if
 	 * it affects us.
 	 */
-	return skb_is_gso(in->skb);
+	if (!skb_is_gso(out->skb))
+		return false;
+
+	shinfo = skb_shinfo(out->skb);
+	hdrs_len = pkt_hdrs_len(out);
+	if (shinfo->gso_size + hdrs_len <= mtu)
+		return true;
+
+#if LINUX_VERSION_AT_LEAST(4, 18, 0, 8, 0)
+	if (shinfo->gso_type & SKB_GSO_UDP_L4)
+		return false;
+#endif
+	if (!(shinfo->gso_type & (SKB_GSO_TCPV4 | SKB_GSO_TCPV6)))
+		return true;
+#if LINUX_VERSION_AT_LEAST(4, 8, 0, 8, 0)
+	if (shinfo->gso_size == GSO_BY_FRAGS)
+		return true;
+#endif
+	if (shinfo->frag_list || mtu <= hdrs_len)
+		return true;
+
+	log_debug("Shrinking gso_size from %u to %u.", shinfo->gso_size,
+			mtu - hdrs_len);
+	shinfo->gso_size = mtu - hdrs_len;
+	shinfo->gso_type |= SKB_GSO_DODGY;
+	shinfo->gso_segs = 0;
+	return true;
 }
 
 static verdict whine_if_too_big(struct xlation *state)
@@ -77,13 +123,13 @@ static verdict whine_if_too_big(struct xlation *state)
 	unsigned int len;
 	unsigned int mtu;
 
-	if (handle_gso(in))
+	mtu = get_nexthop_mtu(out);
+	if (handle_gso(out, mtu))
 		return VERDICT_CONTINUE;
 	if (pkt_l3_proto(in) == L3PROTO_IPV4 && !is_df_set(pkt_ip4_hdr(in)))
 		return VERDICT_CONTINUE;
 
 	len = pkt_len(out);
-	mtu = get_nexthop_mtu(out);
 	if (len > mtu) {
 		/*
 		 * We don't have to worry about ICMP errors causing this because
@@ -107,6 +153,83 @@ static verdict whine_if_too_big(struct xlation *state)
 	return VERDICT_CONTINUE;
 }
 
+#if LINUX_VERSION_AT_LEAST(4, 2, 0, 8, 0)
+
+static bool can_xmit_directly(struct packet *out, struct dst_entry *dst)
+{
+#ifdef CONFIG_XFRM
+	if (dst->xfrm)
+		return false;
+#endif
+#if LINUX_VERSION_AT_LEAST(4, 3, 0, 8, 0)
+	if (lwtunnel_xmit_redirect(dst->lwtstate))
+		return false;
+#endif
+	/* We're not going to fragment; leave that to the kernel. */
+	if (!skb_is_gso(out->skb) && pkt_len(out) > dst_mtu(dst))
+		return false;
+
+	return true;
+}
+
+/*
+ * Hands @out over to the neighbour layer, skipping the rest of the output
+ * path. (Most notably, the LOCAL_OUT and POST_ROUTING hooks.)
+ *
+ * Returns false if @out needs to be sent the normal way. (It wasn't consumed.)
+ * Otherwise @out was consumed, and @error is the result of the transmission.
+ */
+static bool xmit_directly(struct packet *out, int *error)
+{
+	struct sk_buff *skb = out->skb;
+	struct dst_entry *dst = skb_dst(skb);
+	struct net_device *dev = dst->dev;
+	struct rtable *rt;
+	__be32 nexthop4;
+	struct in6_addr *nexthop6;
+
+	if (!can_xmit_directly(out, dst))
+		return false;
+	if (skb_cow_head(skb, LL_RESERVED_SPACE(dev)))
+		return false;
+
+	switch (pkt_l3_proto(out)) {
+	case L3PROTO_IPV4:
+		rt = (struct rtable *)dst;
+#if LINUX_VERSION_AT_LEAST(5, 2, 0, 9999, 0)
+		if (rt->rt_gw_family == AF_INET6)
+			return false;
+#endif
+		nexthop4 = rt_nexthop(rt, pkt_ip4_hdr(out)->daddr);
+		*error = neigh_xmit(NEIGH_ARP_TABLE, dev, &nexthop4, skb);
+		break;
+	case L3PROTO_IPV6:
+		nexthop6 = rt6_nexthop((struct rt6_info *)dst,
+				&pkt_ip6_hdr(out)->daddr);
+		*error = neigh_xmit(NEIGH_ND_TABLE, dev, nexthop6, skb);
+		break;
+	default:
+		return false;
+	}
+
+	/*
+	 * This is the one error neigh_xmit() returns without consuming @skb.
+	 * (The table is not registered; eg. the ipv6 module is not loaded.)
+	 * dst_output() will know what to do with it.
+	 */
+	return *error != -EAFNOSUPPORT;
+}
+
+#else
+
+static bool xmit_directly(struct packet *out, int *error)
+{
+	log_warn_once("direct-xmit requires kernel 4.2 or newer; ignoring.");
+	return false;
+}
+
+#endif
+
 verdict sendpkt_send(struct xlation *state)
 {
 	struct packet *out = &state->out;
@@ -135,6 +258,19 @@ verdict sendpkt_send(struct xlation *state)
 
 	/* skb_log(out->skb, "Translated packet"); */
 
+	if (state->jool.globals.direct_xmit) {
+		/* Implicit kfree_skb(out->skb) here, if it returns true. */
+		if (xmit_directly(out, &error)) {
+			if (error) {
+				log_debug("neigh_xmit() returned errcode %d.", error);
+				return drop(state, JSTAT_NEIGH_XMIT);
+			}
+			jstat_inc(state->jool.stats, JSTAT_NEIGH_XMIT_SENT);
+			return VERDICT_CONTINUE;
+		}
+		jstat_inc(state->jool.stats, JSTAT_NEIGH_XMIT_FALLBACK);
+	}
+
 	/*
 	 * Implicit kfree_skb(out->skb) here.
 	 *
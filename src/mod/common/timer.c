@@ -1,67 +1,64 @@
 #include "mod/common/timer.h"
 
-#include "mod/common/linux_version.h"
+#include "common/constants.h"
 #include "mod/common/xlator.h"
 #include "mod/common/joold.h"
 #include "mod/common/db/bib/db.h"
 
 /*
- * TODO (performance) We don't cancel the timer much at all; it seems like we
- * should be using a hrtimer instead.
+ * Bounds of the housekeeping period. Between them, each instance's period
+ * follows its nearest deadline, so busy instances (whose sessions expire all
+ * the time) are cleaned often, in small bites, and idle ones are left alone.
  *
- * 	the kernel has two core timer mechanisms. One of those — the
- * 	high-resolution timer (or "hrtimer") — subsystem, is focused on
- * 	near-term events where the timer is expected to run to completion. The
- * 	other subsystem is just called "kernel timers"; it offers less precision
- * 	but is more efficient in situations where the timer will probably be
- * 	canceled before it fires.
- * 		(Jonathan Corbet, 2017)
+ * A new session can show up right after a cleanup, so the maximum also bounds
+ * how late its expiration can be handled.
  */
+#define MIN_PERIOD msecs_to_jiffies(100)
+#define MAX_PERIOD msecs_to_jiffies(1000 * TCP_INCOMING_SYN)
 
-#define TIMER_PERIOD msecs_to_jiffies(2000)
+/* Runs the housekeepers. */
+static struct workqueue_struct *jtimer_wq;
 
-static struct timer_list timer;
+/**
+ * This function should be always called *after* other init()s.
+ */
+int jtimer_setup(void)
+{
+	jtimer_wq = alloc_workqueue("jool_housekeeping", WQ_UNBOUND, 0);
+	return jtimer_wq ? 0 : -ENOMEM;
+}
 
-static int clean_state(struct xlator *jool, void *args)
+/**
+ * This function should be always called *after* xlator_teardown(), because the
+ * instances own the housekeepers.
+ */
+void jtimer_teardown(void)
 {
-	bib_clean(jool);
-	joold_clean(jool);
-	return 0;
+	destroy_workqueue(jtimer_wq);
 }
 
-static void timer_function(
-#if LINUX_VERSION_AT_LEAST(4, 15, 0, 8, 0)
-		struct timer_list *arg
-#else
-		unsigned long arg
-#endif
-		)
+void jtimer_init(struct delayed_work *work, work_func_t fn)
 {
-	xlator_foreach(XT_NAT64, clean_state, NULL, NULL);
-	mod_timer(&timer, jiffies + TIMER_PERIOD);
+	INIT_DEFERRABLE_WORK(work, fn);
 }
 
 /**
- * This function should be always called *after* other init()s.
+ * Cleans @jool's databases.
+ * Returns the number of jiffies after which it should be cleaned again.
+ *
+ * Runs in process context.
  */
-int jtimer_setup(void)
+unsigned long jtimer_clean(struct xlator *jool)
 {
-#if LINUX_VERSION_AT_LEAST(4, 15, 0, 8, 0)
-	timer_setup(&timer, timer_function, 0);
-#else
-	init_timer(&timer);
-	timer.function = timer_function;
-	timer.expires = 0;
-	timer.data = 0;
-#endif
-	mod_timer(&timer, jiffies + TIMER_PERIOD);
-	return 0;
+	unsigned long next;
+
+	next = bib_clean(jool);
+	next = min(next, joold_clean(jool));
+
+	return clamp(next, MIN_PERIOD, MAX_PERIOD);
 }
 
-/**
- * This function should be always called *before* other destroy()s.
- */
-void jtimer_teardown(void)
+void jtimer_schedule(struct delayed_work *work, unsigned long delay)
 {
-	del_timer_sync(&timer);
+	queue_delayed_work(jtimer_wq, work, delay);
 }
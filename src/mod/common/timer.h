@@ -3,15 +3,23 @@
 
 /**
  * @file
- * An all-purpose timer used to trigger some of Jool's events. Always runs, as
- * long as Jool is modprobed. At time of writing, this induces session and
- * fragment expiration.
+ * Periodic housekeeping of NAT64 instances. At time of writing, this induces
+ * session and fragment expiration, and flushes joold.
  *
- * Why don't the session and fragment code manage their own timers?
- * Because that's more code and I don't see how it would improve anything.
+ * Every instance is cleaned by its own work, which runs on an unbound
+ * workqueue (so several instances can be cleaned in parallel, on whichever CPUs
+ * are available) and reschedules itself according to the instance's nearest
+ * deadline. The work is deferrable, so idle instances don't wake idle CPUs.
  */
 
+#include <linux/workqueue.h>
+#include "mod/common/xlator.h"
+
 int jtimer_setup(void);
 void jtimer_teardown(void);
 
+void jtimer_init(struct delayed_work *work, work_func_t fn);
+unsigned long jtimer_clean(struct xlator *jool);
+void jtimer_schedule(struct delayed_work *work, unsigned long delay);
+
 #endif /* SRC_MOD_NAT64_TIMER_H_ */
@@ -0,0 +1,44 @@
+#include "mod/common/packet.h"
+#include "mod/common/translation_state.h"
+
+#define CREATE_TRACE_POINTS
+#include "mod/common/tracepoint.h"
+
+void jtrace_addr4(struct in_addr const *addr4, struct in6_addr *result)
+{
+	ipv6_addr_set_v4mapped(addr4->s_addr, result);
+}
+
+/*
+ * Addresses come from the incoming packet's network header, since SIIT never
+ * computes a tuple. Ports are only available once NAT64 has computed it.
+ */
+void jtrace_tuple(struct xlation *state, struct in6_addr *src,
+		struct in6_addr *dst, __u16 *sport, __u16 *dport)
+{
+	struct tuple *tuple = &state->in.tuple;
+	struct ipv6hdr *hdr6;
+	struct iphdr *hdr4;
+
+	switch (pkt_l3_proto(&state->in)) {
+	case L3PROTO_IPV6:
+		hdr6 = pkt_ip6_hdr(&state->in);
+		*src = hdr6->saddr;
+		*dst = hdr6->daddr;
+		*sport = tuple->src.addr6.l4;
+		*dport = tuple->dst.addr6.l4;
+		return;
+	case L3PROTO_IPV4:
+		hdr4 = pkt_ip4_hdr(&state->in);
+		ipv6_addr_set_v4mapped(hdr4->saddr, src);
+		ipv6_addr_set_v4mapped(hdr4->daddr, dst);
+		*sport = tuple->src.addr4.l4;
+		*dport = tuple->dst.addr4.l4;
+		return;
+	}
+
+	memset(src, 0, sizeof(*src));
+	memset(dst, 0, sizeof(*dst));
+	*sport = 0;
+	*dport = 0;
+}
@@ -0,0 +1,224 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM jool
+
+#if !defined(SRC_MOD_COMMON_TRACEPOINT_H_) || defined(TRACE_HEADER_MULTI_READ)
+#define SRC_MOD_COMMON_TRACEPOINT_H_
+
+/*
+ * Kernel tracepoints.
+ *
+ * Not to be confused with trace.h, which printks every packet when the "trace"
+ * global is enabled. These are compiled into static key NOPs, so they cost
+ * nothing until somebody attaches to them (through ftrace, perf, bpftrace,
+ * etc):
+ *
+ * 	# echo 1 > /sys/kernel/tracing/events/jool/enable
+ * 	# cat /sys/kernel/tracing/trace_pipe
+ *
+ * IPv4 addresses are stored as IPv4-mapped IPv6 addresses, so every event can
+ * print them the same way.
+ */
+
+#include <linux/tracepoint.h>
+#include "common/stats.h"
+#include "mod/common/translation_state.h"
+
+#ifndef SRC_MOD_COMMON_TRACEPOINT_HELPERS_
+#define SRC_MOD_COMMON_TRACEPOINT_HELPERS_
+
+void jtrace_tuple(struct xlation *state, struct in6_addr *src,
+		struct in6_addr *dst, __u16 *sport, __u16 *dport);
+void jtrace_addr4(struct in_addr const *addr4, struct in6_addr *result);
+
+/* Kernels older than 4.2 print the raw numbers instead. */
+#ifndef TRACE_DEFINE_ENUM
+#define TRACE_DEFINE_ENUM(a)
+#endif
+
+#endif
+
+#define show_jool_verdict(verdict) __print_symbolic(verdict,		\
+		{ VERDICT_CONTINUE, "continue" },			\
+		{ VERDICT_DROP, "drop" },				\
+		{ VERDICT_UNTRANSLATABLE, "untranslatable" },		\
+		{ VERDICT_STOLEN, "stolen" })
+
+#define show_jool_stage(stage) __print_symbolic(stage,			\
+		{ JSTAGE_IN_TUPLE, "in-tuple" },			\
+		{ JSTAGE_FILTERING, "filtering" },			\
+		{ JSTAGE_OUT_TUPLE, "out-tuple" },			\
+		{ JSTAGE_TRANSLATE, "translate" },			\
+		{ JSTAGE_SEND, "send" })
+
+#define show_jool_l4proto(proto) __print_symbolic(proto,		\
+		{ L4PROTO_TCP, "TCP" },					\
+		{ L4PROTO_UDP, "UDP" },					\
+		{ L4PROTO_ICMP, "ICMP" },				\
+		{ L4PROTO_OTHER, "other" })
+
+/* So userspace tools (perf, bpftrace) can resolve the symbols above. */
+TRACE_DEFINE_ENUM(VERDICT_CONTINUE);
+TRACE_DEFINE_ENUM(VERDICT_DROP);
+TRACE_DEFINE_ENUM(VERDICT_UNTRANSLATABLE);
+TRACE_DEFINE_ENUM(VERDICT_STOLEN);
+TRACE_DEFINE_ENUM(JSTAGE_IN_TUPLE);
+TRACE_DEFINE_ENUM(JSTAGE_FILTERING);
+TRACE_DEFINE_ENUM(JSTAGE_OUT_TUPLE);
+TRACE_DEFINE_ENUM(JSTAGE_TRANSLATE);
+TRACE_DEFINE_ENUM(JSTAGE_SEND);
+TRACE_DEFINE_ENUM(L4PROTO_TCP);
+TRACE_DEFINE_ENUM(L4PROTO_UDP);
+TRACE_DEFINE_ENUM(L4PROTO_ICMP);
+TRACE_DEFINE_ENUM(L4PROTO_OTHER);
+
+/*
+ * A packet just went through one of the translation stages.
+ *
+ * Ports are only known in NAT64, and only from the in-tuple stage onwards.
+ */
+TRACE_EVENT(jool_stage,
+	TP_PROTO(struct xlation *state, enum jool_stage stage, verdict result),
+	TP_ARGS(state, stage, result),
+
+	TP_STRUCT__entry(
+		__array(char, iname, INAME_MAX_SIZE)
+		__array(__u8, src, sizeof(struct in6_addr))
+		__array(__u8, dst, sizeof(struct in6_addr))
+		__field(__u16, sport)
+		__field(__u16, dport)
+		__field(__u8, l4proto)
+		__field(__u8, stage)
+		__field(__u8, result)
+	),
+
+	TP_fast_assign(
+		strncpy(__entry->iname, state->jool.iname, INAME_MAX_SIZE);
+		jtrace_tuple(state,
+				(struct in6_addr *)__entry->src,
+				(struct in6_addr *)__entry->dst,
+				&__entry->sport, &__entry->dport);
+		__entry->l4proto = pkt_l4_proto(&state->in);
+		__entry->stage = stage;
+		__entry->result = result;
+	),
+
+	TP_printk("%s %s %pI6c#%u->%pI6c#%u %s: %s",
+		__entry->iname,
+		show_jool_stage(__entry->stage),
+		__entry->src, __entry->sport,
+		__entry->dst, __entry->dport,
+		show_jool_l4proto(__entry->l4proto),
+		show_jool_verdict(__entry->result))
+);
+
+DECLARE_EVENT_CLASS(jool_session,
+	TP_PROTO(char const *iname,
+		struct ipv6_transport_addr const *src6,
+		struct ipv6_transport_addr const *dst6,
+		struct ipv4_transport_addr const *src4,
+		struct ipv4_transport_addr const *dst4,
+		l4_protocol proto, tcp_state state),
+	TP_ARGS(iname, src6, dst6, src4, dst4, proto, state),
+
+	TP_STRUCT__entry(
+		__array(char, iname, INAME_MAX_SIZE)
+		__array(__u8, src6, sizeof(struct in6_addr))
+		__array(__u8, dst6, sizeof(struct in6_addr))
+		__array(__u8, src4, sizeof(struct in6_addr))
+		__array(__u8, dst4, sizeof(struct in6_addr))
+		__field(__u16, src6_port)
+		__field(__u16, dst6_port)
+		__field(__u16, src4_port)
+		__field(__u16, dst4_port)
+		__field(__u8, proto)
+		__field(__u8, state)
+	),
+
+	TP_fast_assign(
+		strncpy(__entry->iname, iname, INAME_MAX_SIZE);
+		memcpy(__entry->src6, &src6->l3, sizeof(struct in6_addr));
+		memcpy(__entry->dst6, &dst6->l3, sizeof(struct in6_addr));
+		jtrace_addr4(&src4->l3, (struct in6_addr *)__entry->src4);
+		jtrace_addr4(&dst4->l3, (struct in6_addr *)__entry->dst4);
+		__entry->src6_port = src6->l4;
+		__entry->dst6_port = dst6->l4;
+		__entry->src4_port = src4->l4;
+		__entry->dst4_port = dst4->l4;
+		__entry->proto = proto;
+		__entry->state = state;
+	),
+
+	TP_printk("%s %pI6c#%u|%pI6c#%u|%pI6c#%u|%pI6c#%u|%s state:%u",
+		__entry->iname,
+		__entry->src6, __entry->src6_port,
+		__entry->dst6, __entry->dst6_port,
+		__entry->src4, __entry->src4_port,
+		__entry->dst4, __entry->dst4_port,
+		show_jool_l4proto(__entry->proto),
+		__entry->state)
+);
+
+#define JOOL_SESSION_EVENT(name)					\
+DEFINE_EVENT(jool_session, name,					\
+	TP_PROTO(char const *iname,					\
+		struct ipv6_transport_addr const *src6,			\
+		struct ipv6_transport_addr const *dst6,			\
+		struct ipv4_transport_addr const *src4,			\
+		struct ipv4_transport_addr const *dst4,			\
+		l4_protocol proto, tcp_state state),			\
+	TP_ARGS(iname, src6, dst6, src4, dst4, proto, state))
+
+/* A session (and maybe its BIB entry) was added to the database. */
+JOOL_SESSION_EVENT(jool_session_create);
+/* A session (and maybe its BIB entry) timed out and was removed. */
+JOOL_SESSION_EVENT(jool_session_expire);
+/* An idle TCP session is about to be probed. (RFC 6146, section 3.5.2.2) */
+JOOL_SESSION_EVENT(jool_session_probe);
+/* A session was queued for synchronization. (See joold.c.) */
+JOOL_SESSION_EVENT(jool_joold_enqueue);
+
+/*
+ * pool4 was asked for a transport address to mask a new BIB entry.
+ * @attempts is the number of masks that were already taken.
+ */
+TRACE_EVENT(jool_pool4_alloc,
+	TP_PROTO(struct ipv6_transport_addr const *src6,
+		struct ipv4_transport_addr const *src4,
+		l4_protocol proto, unsigned int attempts, int error),
+	TP_ARGS(src6, src4, proto, attempts, error),
+
+	TP_STRUCT__entry(
+		__array(__u8, src6, sizeof(struct in6_addr))
+		__array(__u8, src4, sizeof(struct in6_addr))
+		__field(__u16, src6_port)
+		__field(__u16, src4_port)
+		__field(__u8, proto)
+		__field(unsigned int, attempts)
+		__field(int, error)
+	),
+
+	TP_fast_assign(
+		memcpy(__entry->src6, &src6->l3, sizeof(struct in6_addr));
+		jtrace_addr4(&src4->l3, (struct in6_addr *)__entry->src4);
+		__entry->src6_port = src6->l4;
+		__entry->src4_port = src4->l4;
+		__entry->proto = proto;
+		__entry->attempts = attempts;
+		__entry->error = error;
+	),
+
+	TP_printk("%pI6c#%u -> %pI6c#%u %s attempts:%u error:%d",
+		__entry->src6, __entry->src6_port,
+		__entry->src4, __entry->src4_port,
+		show_jool_l4proto(__entry->proto),
+		__entry->attempts, __entry->error)
+);
+
+#endif /* SRC_MOD_COMMON_TRACEPOINT_H_ */
+
+/* This part must be outside the header guard. */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH mod/common
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE tracepoint
+#include <trace/define_trace.h>
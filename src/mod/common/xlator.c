@@ -1,22 +1,27 @@
 #include "mod/common/xlator.h"
 
-#include <linux/hashtable.h>
+#include <linux/hash.h>
+#include <linux/rculist.h>
 #include <linux/sched.h>
+#include <linux/workqueue.h>
 
 #include "common/types.h"
 #include "common/xlat.h"
 #include "db/global.h"
 #include "mod/common/atomic_config.h"
 #include "mod/common/joold.h"
+#include "mod/common/session_log.h"
 #include "mod/common/kernel_hook.h"
 #include "mod/common/linux_version.h"
 #include "mod/common/log.h"
 #include "mod/common/rcu.h"
+#include "mod/common/timer.h"
 #include "mod/common/wkmalloc.h"
 #include "mod/common/db/blacklist4.h"
 #include "mod/common/db/eam.h"
 #include "mod/common/db/pool4/db.h"
 #include "mod/common/db/bib/db.h"
+#include "mod/common/nl/stats.h"
 #include "mod/common/steps/handling_hairpinning_nat64.h"
 #include "mod/common/steps/handling_hairpinning_siit.h"
 
@@ -47,11 +52,18 @@ struct jool_instance {
 	 */
 	struct xlator jool;
 
-	struct hlist_node table_hook;
+	/*
+	 * Nodes in the table's name and namespace buckets, respectively.
+	 *
+	 * There are two of each because readers might still be traversing the
+	 * old table while it's being replaced by a resized one. Each table
+	 * chains one of the pairs. (See struct instance_table.hook.)
+	 */
+	struct hlist_node name_hook[2];
+	struct hlist_node ns_hook[2];
 	bool hash_set;
 	u32 hash;
 
-	struct list_head list_hook;
 #if LINUX_VERSION_AT_LEAST(4, 13, 0, 8, 0)
 	/**
 	 * This points to a 2-sized array for nf_register_net_hooks().
@@ -65,11 +77,72 @@ struct jool_instance {
 	 */
 	struct nf_hook_ops *nf_ops;
 #endif
+
+	/* Periodically cleans the instance's databases. (NAT64 only.) */
+	struct delayed_work housekeeper;
+	/* Periodically multicasts the stats. (See stats-stream-interval.) */
+	struct delayed_work streamer;
+	/*
+	 * Whether the instance is in charge of stopping @jool's joold queue and
+	 * session log. (NAT64 only.) Only listed instances can own them.
+	 * Replacement candidates don't, because they might be sharing the
+	 * running instance's; swap_instances() hands them over once the
+	 * candidate is committed.
+	 */
+	bool joold_owner;
+
+	/* Links the instance to its graveyard, once it's been unlisted. */
+	struct hlist_node grave_hook;
 };
 
-static DEFINE_HASHTABLE(instances, 6); /* The identifier is (ns, xt, iname). */
-static struct list_head __rcu *netfilter_instances;
+/**
+ * A bunch of instances that are no longer listed, but might still be in use by
+ * packets that found them before that.
+ *
+ * They are destroyed together once the RCU grace period ends, so the caller
+ * doesn't have to wait for it. (It used to; that meant userspace requests and
+ * namespace teardown stalled once per removal.)
+ */
+struct graveyard {
+	struct hlist_head instances;
+	struct rcu_head rcu;
+	struct work_struct work;
+};
+
+/**
+ * The instance database. Every instance is listed twice: Once by identifier
+ * ((ns, xt, iname)), and once by namespace only. The latter is what the packet
+ * path and namespace teardown need, and it's also cheap, because namespaces
+ * rarely hold more than a handful of instances.
+ *
+ * The table is replaced by a bigger or smaller one whenever the instance count
+ * strays too far from the bucket count. (See resize_table().)
+ *
+ * Writers need the mutex. Readers only need RCU.
+ */
+struct instance_table {
+	/* Each of the bucket arrays has 2^@bits buckets. */
+	unsigned int bits;
+	/* Index of the name_hook and ns_hook the buckets chain. (0 or 1.) */
+	unsigned int hook;
+
+	struct hlist_head *by_name;
+	struct hlist_head *by_ns;
+
+	struct rcu_head rcu;
+	struct hlist_head buckets[];
+};
+
+#define TABLE_MIN_BITS 6
+#define TABLE_MAX_BITS 16
+
+static struct instance_table __rcu *instances;
+static unsigned int instance_count;
+/* Replaced tables whose grace period might not have ended yet. */
+static atomic_t old_tables = ATOMIC_INIT(0);
 static DEFINE_MUTEX(lock);
+/* Destroys the graveyards. (Destruction can sleep, so not in RCU callbacks.) */
+static struct workqueue_struct *reaper;
 
 static void (*defrag_enable)(struct net *ns);
 
@@ -98,30 +171,239 @@ static u32 get_instance_hash(struct jool_instance *instance)
 	return instance->hash;
 }
 
+/* Requires either RCU or the mutex. */
+static struct instance_table *get_table(void)
+{
+	return rcu_dereference_check(instances,
+			rcu_read_lock_bh_held() || lockdep_is_held(&lock));
+}
+
+/*
+ * Walks the nodes chained in @bucket. Readers and writers can both use it; the
+ * latter can even hlist_del_rcu() @pos.
+ */
+#define bucket_for_each(pos, bucket)					\
+	for (pos = rcu_dereference_raw(hlist_first_rcu(bucket));	\
+	     pos;							\
+	     pos = rcu_dereference_raw(hlist_next_rcu(pos)))
+
+static struct hlist_head *name_bucket(struct instance_table *table, u32 hash)
+{
+	return &table->by_name[hash_32(hash, table->bits)];
+}
+
+static struct hlist_head *ns_bucket(struct instance_table *table,
+		struct net *ns)
+{
+	return &table->by_ns[hash_ptr(ns, table->bits)];
+}
+
+static struct jool_instance *name_entry(struct instance_table *table,
+		struct hlist_node *node)
+{
+	return table->hook
+			? hlist_entry(node, struct jool_instance, name_hook[1])
+			: hlist_entry(node, struct jool_instance, name_hook[0]);
+}
+
+static struct jool_instance *ns_entry(struct instance_table *table,
+		struct hlist_node *node)
+{
+	return table->hook
+			? hlist_entry(node, struct jool_instance, ns_hook[1])
+			: hlist_entry(node, struct jool_instance, ns_hook[0]);
+}
+
+static struct instance_table *alloc_table(unsigned int bits, unsigned int hook)
+{
+	struct instance_table *table;
+	unsigned int size;
+	unsigned int i;
+
+	size = 1u << bits;
+	table = __wkmalloc("instance table", sizeof(struct instance_table)
+			+ 2 * size * sizeof(struct hlist_head),
+			GFP_KERNEL | __GFP_NOWARN);
+	if (!table)
+		return NULL;
+
+	table->bits = bits;
+	table->hook = hook;
+	table->by_name = table->buckets;
+	table->by_ns = table->buckets + size;
+	for (i = 0; i < 2 * size; i++)
+		INIT_HLIST_HEAD(&table->buckets[i]);
+
+	return table;
+}
+
+static void free_old_table(struct rcu_head *rcu)
+{
+	__wkfree("instance table", container_of(rcu, struct instance_table,
+			rcu));
+	atomic_dec(&old_tables);
+}
+
+static void housekeep(struct work_struct *work)
+{
+	struct jool_instance *instance;
+
+	instance = container_of(to_delayed_work(work), struct jool_instance,
+			housekeeper);
+	jtimer_schedule(&instance->housekeeper, jtimer_clean(&instance->jool));
+}
+
+/* (msecs_to_jiffies() rounds up, so this is never zero if the global isn't.) */
+static unsigned long stream_interval(struct jool_instance *instance)
+{
+	return msecs_to_jiffies(instance->jool.globals.stats_stream_interval);
+}
+
+static void stream_stats(struct work_struct *work)
+{
+	struct jool_instance *instance;
+
+	instance = container_of(to_delayed_work(work), struct jool_instance,
+			streamer);
+	jnl_stats_stream(&instance->jool);
+	queue_delayed_work(system_wq, &instance->streamer,
+			stream_interval(instance));
+}
+
+/* Needs to happen right after the instance is allocated. */
+static void init_instance(struct jool_instance *instance)
+{
+	instance->hash_set = false;
+	instance->hash = 0;
+#if LINUX_VERSION_AT_LEAST(4, 13, 0, 8, 0)
+	instance->nf_ops = NULL;
+#endif
+	jtimer_init(&instance->housekeeper, housekeep);
+	INIT_DELAYED_WORK(&instance->streamer, stream_stats);
+	instance->joold_owner = false;
+}
+
+/*
+ * Requires the mutex.
+ *
+ * Also starts the housekeeper and the stats streamer. (They'll be stopped by
+ * destroy_jool_instance().)
+ */
+static void list_instance(struct jool_instance *instance)
+{
+	struct instance_table *table = get_table();
+
+	hlist_add_head_rcu(&instance->name_hook[table->hook],
+			name_bucket(table, get_instance_hash(instance)));
+	hlist_add_head_rcu(&instance->ns_hook[table->hook],
+			ns_bucket(table, instance->jool.ns));
+	instance_count++;
+
+	if (xlator_is_nat64(&instance->jool))
+		jtimer_schedule(&instance->housekeeper, 0);
+	if (instance->jool.globals.stats_stream_interval)
+		queue_delayed_work(system_wq, &instance->streamer,
+				stream_interval(instance));
+}
+
+/* Requires the mutex. */
+static void unlist_instance(struct jool_instance *instance)
+{
+	struct instance_table *table = get_table();
+
+	hlist_del_rcu(&instance->name_hook[table->hook]);
+	hlist_del_rcu(&instance->ns_hook[table->hook]);
+	instance_count--;
+}
+
+/**
+ * Replaces the table with a bigger one if there are more instances than
+ * buckets, or with a smaller one if there are less than a quarter.
+ *
+ * The new table chains the instances through their other hooks, so the old
+ * table remains intact for the readers that might still be traversing it.
+ * Those are the hooks the table before the old one used, so if that one is
+ * still waiting for its grace period, the resize is postponed to the next
+ * (un)listing. (Waiting here would block every other writer.)
+ * Failure is not a problem either; the current table just stays.
+ *
+ * Requires the mutex. Meant to be called after a batch of (un)listings.
+ */
+static void resize_table(void)
+{
+	struct instance_table *old;
+	struct instance_table *new;
+	struct jool_instance *instance;
+	struct hlist_node *node;
+	unsigned int bits;
+	unsigned int i;
+
+	old = get_table();
+	bits = old->bits;
+	while (bits < TABLE_MAX_BITS && instance_count > (1u << bits))
+		bits++;
+	while (bits > TABLE_MIN_BITS && instance_count < (1u << bits) / 4)
+		bits--;
+	if (bits == old->bits)
+		return;
+	if (atomic_read(&old_tables))
+		return;
+
+	new = alloc_table(bits, !old->hook);
+	if (!new)
+		return;
+
+	for (i = 0; i < (1u << old->bits); i++) {
+		bucket_for_each(node, &old->by_name[i]) {
+			instance = name_entry(old, node);
+			hlist_add_head(&instance->name_hook[new->hook],
+					name_bucket(new, get_instance_hash(instance)));
+			hlist_add_head(&instance->ns_hook[new->hook],
+					ns_bucket(new, instance->jool.ns));
+		}
+	}
+
+	rcu_assign_pointer(instances, new);
+	atomic_inc(&old_tables);
+	call_rcu_bh(&old->rcu, free_old_table);
+}
+
+/* Requires either RCU or the mutex. */
 static struct jool_instance *find_instance(struct net *ns, xlator_type xt,
 		char const *iname)
 {
+	struct instance_table *table;
 	struct jool_instance *instance;
-	u32 hash;
+	struct hlist_node *node;
 
-	hash = get_hash(ns, xt, iname);
-	hash_for_each_possible_rcu(instances, instance, table_hook, hash)
+	table = get_table();
+	bucket_for_each(node, name_bucket(table, get_hash(ns, xt, iname))) {
+		instance = name_entry(table, node);
 		if ((ns == instance->jool.ns)
 				&& (xt & instance->jool.flags)
 				&& (strcmp(iname, instance->jool.iname) == 0))
 			return instance;
+	}
 
 	return NULL;
 }
 
-static void destroy_jool_instance(struct jool_instance *instance, bool unhook)
+/*
+ * Hooks are only unregistered if the instance still owns them. (ie. it was
+ * added, and it wasn't replaced.)
+ */
+static void destroy_jool_instance(struct jool_instance *instance)
 {
+	cancel_delayed_work_sync(&instance->housekeeper);
+	cancel_delayed_work_sync(&instance->streamer);
+	if (xlator_is_nat64(&instance->jool) && instance->joold_owner) {
+		joold_stop(instance->jool.nat64.joold);
+		slog_stop(instance->jool.nat64.slog);
+	}
+
 #if LINUX_VERSION_AT_LEAST(4, 13, 0, 8, 0)
-	if (xlator_is_netfilter(&instance->jool)) {
-		if (unhook) {
-			nf_unregister_net_hooks(instance->jool.ns,
-					instance->nf_ops, 2);
-		}
+	if (instance->nf_ops) {
+		nf_unregister_net_hooks(instance->jool.ns, instance->nf_ops, 2);
 		__wkfree("nf_hook_ops", instance->nf_ops);
 	}
 #endif
@@ -131,6 +413,68 @@ static void destroy_jool_instance(struct jool_instance *instance, bool unhook)
 	wkfree(struct jool_instance, instance);
 }
 
+static void destroy_instances(struct hlist_head *dead)
+{
+	struct jool_instance *instance;
+	struct hlist_node *tmp;
+
+	hlist_for_each_entry_safe(instance, tmp, dead, grave_hook)
+		destroy_jool_instance(instance);
+}
+
+static void reap_graveyard(struct work_struct *work)
+{
+	struct graveyard *graveyard;
+
+	graveyard = container_of(work, struct graveyard, work);
+	destroy_instances(&graveyard->instances);
+	wkfree(struct graveyard, graveyard);
+}
+
+/* Runs in softirq context, so it can only hand the graveyard over. */
+static void graveyard_ready(struct rcu_head *rcu)
+{
+	struct graveyard *graveyard;
+
+	graveyard = container_of(rcu, struct graveyard, rcu);
+	queue_work(reaper, &graveyard->work);
+}
+
+/**
+ * Destroys the instances listed in @dead (through their grave_hooks) once
+ * nobody can be using them anymore. Does not wait for that to happen.
+ *
+ * The instances must have already been removed from the database.
+ */
+static void retire_instances(struct hlist_head *dead)
+{
+	struct graveyard *graveyard;
+
+	if (hlist_empty(dead))
+		return; /* Requesting a grace period for no reason is bad. */
+
+	graveyard = wkmalloc(struct graveyard, GFP_KERNEL);
+	if (!graveyard) {
+		/* Fine; do it the slow way. */
+		synchronize_rcu_bh();
+		destroy_instances(dead);
+		return;
+	}
+
+	hlist_move_list(dead, &graveyard->instances);
+	INIT_WORK(&graveyard->work, reap_graveyard);
+	call_rcu_bh(&graveyard->rcu, graveyard_ready);
+}
+
+/**
+ * Waits until every instance retired so far has been destroyed.
+ */
+static void wait_for_retirements(void)
+{
+	rcu_barrier_bh(); /* All graveyards are queued after this. */
+	flush_workqueue(reaper);
+}
+
 static void xlator_get(struct xlator *jool)
 {
 	jstat_get(jool->stats);
@@ -144,6 +488,7 @@ static void xlator_get(struct xlator *jool)
 		pool4db_get(jool->nat64.pool4);
 		bib_get(jool->nat64.bib);
 		joold_get(jool->nat64.joold);
+		slog_get(jool->nat64.slog);
 		break;
 	}
 }
@@ -155,37 +500,20 @@ static void xlator_get(struct xlator *jool)
 static void __flush_detach(struct net *ns, xlator_type xt,
 		struct hlist_head *detached)
 {
+	struct instance_table *table;
 	struct jool_instance *instance;
-	struct hlist_node *tmp;
-	size_t i;
+	struct hlist_node *node;
 
-	hash_for_each_safe(instances, i, tmp, instance, table_hook) {
+	table = get_table();
+	bucket_for_each(node, ns_bucket(table, ns)) {
+		instance = ns_entry(table, node);
 		if (instance->jool.ns == ns && (instance->jool.flags & xt)) {
-			hash_del_rcu(&instance->table_hook);
-			hlist_add_head(&instance->table_hook, detached);
-			if (instance->jool.flags & XF_NETFILTER)
-				list_del_rcu(&instance->list_hook);
+			unlist_instance(instance);
+			hlist_add_head(&instance->grave_hook, detached);
 		}
 	}
 }
 
-/**
- * Actually deletes all of the jool_instance nodes listed in @detached.
- */
-static void __flush_delete(struct hlist_head *detached)
-{
-	struct jool_instance *instance;
-	struct hlist_node *tmp;
-
-	if (hlist_empty(detached))
-		return; /* Calling synchronize_rcu_bh() for no reason is bad. */
-
-	synchronize_rcu_bh();
-
-	hlist_for_each_entry_safe(instance, tmp, detached, table_hook)
-		destroy_jool_instance(instance, true);
-}
-
 /**
  * Called whenever the user deletes a namespace. Supposed to delete all the
  * instances inserted in that namespace.
@@ -198,19 +526,24 @@ void jool_xlator_flush_net(struct net *ns, xlator_type xt)
 
 	mutex_lock(&lock);
 	__flush_detach(ns, xt, &detached);
+	resize_table();
 	mutex_unlock(&lock);
 
-	__flush_delete(&detached);
+	retire_instances(&detached);
 }
 EXPORT_SYMBOL_GPL(jool_xlator_flush_net);
 
 /**
- * Called whenever the user deletes... several namespaces? I'm not really sure.
- * The idea seems to be to minimize the net amount of synchronize_rcu_bh()
- * calls, but the kernel seems to always call flush_net() first and
- * flush_batch() next. It seems self-defeating to me.
+ * Called whenever the user deletes one or more namespaces, after flush_net()
+ * has been called on each of them.
  *
- * Maybe delete flush_net(); I guess it's redundant.
+ * flush_net() doesn't wait for the instances to die, so this is where that
+ * happens. It needs to, because they still use their namespace (to unregister
+ * their hooks, and to send their last joold and session log messages), and
+ * the namespace will be freed as soon as this returns.
+ *
+ * Waiting here rather than in flush_net() means the whole batch of namespaces
+ * pays for a single grace period.
  */
 void jool_xlator_flush_batch(struct list_head *net_exit_list, xlator_type xt)
 {
@@ -220,9 +553,11 @@ void jool_xlator_flush_batch(struct list_head *net_exit_list, xlator_type xt)
 	mutex_lock(&lock);
 	list_for_each_entry(ns, net_exit_list, exit_list)
 		__flush_detach(ns, xt, &detached);
+	resize_table();
 	mutex_unlock(&lock);
 
-	__flush_delete(&detached);
+	retire_instances(&detached);
+	wait_for_retirements();
 }
 EXPORT_SYMBOL_GPL(jool_xlator_flush_batch);
 
@@ -231,21 +566,28 @@ EXPORT_SYMBOL_GPL(jool_xlator_flush_batch);
  */
 int xlator_setup(void)
 {
-	struct list_head *list;
+	struct instance_table *table;
 #if LINUX_VERSION_LOWER_THAN(4, 13, 0, 8, 0)
 	int error;
 #endif
 
-	list = __wkmalloc("xlator DB", sizeof(struct list_head), GFP_KERNEL);
-	if (!list)
+	table = alloc_table(TABLE_MIN_BITS, 0);
+	if (!table)
 		return -ENOMEM;
-	INIT_LIST_HEAD(list);
-	RCU_INIT_POINTER(netfilter_instances, list);
+	RCU_INIT_POINTER(instances, table);
+	instance_count = 0;
+
+	reaper = alloc_workqueue("jool_reaper", 0, 0);
+	if (!reaper) {
+		__wkfree("instance table", table);
+		return -ENOMEM;
+	}
 
 #if LINUX_VERSION_LOWER_THAN(4, 13, 0, 8, 0)
 	error = nf_register_hooks(netfilter_hooks, ARRAY_SIZE(netfilter_hooks));
 	if (error) {
-		__wkfree("xlator DB", list);
+		destroy_workqueue(reaper);
+		__wkfree("instance table", table);
 		return error;
 	}
 #endif
@@ -264,16 +606,24 @@ void xlator_set_defrag(void (*_defrag_enable)(struct net *ns))
  */
 void xlator_teardown(void)
 {
-	struct list_head *ni;
+	struct instance_table *table;
+	unsigned int i;
 
 #if LINUX_VERSION_LOWER_THAN(4, 13, 0, 8, 0)
 	nf_unregister_hooks(netfilter_hooks, ARRAY_SIZE(netfilter_hooks));
 #endif
 
-	WARN(!hash_empty(instances), "There are elements in the xlator table after a cleanup.");
-	ni = rcu_dereference_raw(netfilter_instances);
-	WARN(!list_empty(ni), "There are elements in the xlator list after a cleanup.");
-	__wkfree("xlator DB", ni);
+	wait_for_retirements(); /* Also frees the old tables. */
+	destroy_workqueue(reaper);
+
+	table = rcu_dereference_raw(instances);
+	for (i = 0; i < (2u << table->bits); i++) {
+		if (!hlist_empty(&table->buckets[i])) {
+			WARN(1, "There are elements in the xlator table after a cleanup.");
+			break;
+		}
+	}
+	__wkfree("instance table", table);
 }
 
 static int init_siit(struct xlator *jool, struct ipv6_prefix *pool6)
@@ -326,11 +676,16 @@ static int init_nat64(struct xlator *jool, struct ipv6_prefix *pool6)
 	jool->nat64.joold = joold_alloc(jool->ns);
 	if (!jool->nat64.joold)
 		goto joold_fail;
+	jool->nat64.slog = slog_alloc(jool->ns, jool->iname);
+	if (!jool->nat64.slog)
+		goto slog_fail;
 
 	jool->is_hairpin = is_hairpin_nat64;
 	jool->handling_hairpinning = handling_hairpinning_nat64;
 	return 0;
 
+slog_fail:
+	joold_put(jool->nat64.joold);
 joold_fail:
 	bib_put(jool->nat64.bib);
 bib_fail:
@@ -417,10 +772,13 @@ static int basic_add_validations(char *iname, xlator_flags flags,
  */
 static int validate_collision(struct net *ns, char *iname, xlator_flags flags)
 {
+	struct instance_table *table;
 	struct jool_instance *instance;
-	size_t i;
+	struct hlist_node *node;
 
-	hash_for_each(instances, i, instance, table_hook) {
+	table = get_table();
+	bucket_for_each(node, ns_bucket(table, ns)) {
+		instance = ns_entry(table, node);
 		if (instance->jool.ns != ns)
 			continue;
 		if (xlator_flags2xt(instance->jool.flags) != xlator_flags2xt(flags))
@@ -445,8 +803,6 @@ static int validate_collision(struct net *ns, char *iname, xlator_flags flags)
  */
 static int __xlator_add(struct jool_instance *new, struct xlator *result)
 {
-	struct list_head *list;
-
 #if LINUX_VERSION_AT_LEAST(4, 13, 0, 8, 0)
 	if (xlator_is_netfilter(&new->jool)) {
 		struct nf_hook_ops *ops;
@@ -471,12 +827,8 @@ static int __xlator_add(struct jool_instance *new, struct xlator *result)
 	}
 #endif
 
-	hash_add_rcu(instances, &new->table_hook, get_instance_hash(new));
-	if (new->jool.flags & XF_NETFILTER) {
-		list = rcu_dereference_protected(netfilter_instances,
-				lockdep_is_held(&lock));
-		list_add_tail_rcu(&new->list_hook, list);
-	}
+	new->joold_owner = true;
+	list_instance(new);
 
 	if (new->jool.flags & XT_NAT64)
 		defrag_enable(new->jool.ns);
@@ -528,11 +880,7 @@ int xlator_add(xlator_flags flags, char *iname, struct ipv6_prefix *pool6,
 		put_net(ns);
 		return error;
 	}
-	instance->hash_set = false;
-	instance->hash = 0;
-#if LINUX_VERSION_AT_LEAST(4, 13, 0, 8, 0)
-	instance->nf_ops = NULL;
-#endif
+	init_instance(instance);
 
 	/* Error roads from now no longer need to free @instance. */
 	/* Error roads from now need to properly destroy @instance. */
@@ -548,6 +896,7 @@ int xlator_add(xlator_flags flags, char *iname, struct ipv6_prefix *pool6,
 	error = __xlator_add(instance, result);
 	if (error)
 		goto mutex_fail;
+	resize_table();
 
 	mutex_unlock(&lock);
 	put_net(ns);
@@ -556,7 +905,7 @@ int xlator_add(xlator_flags flags, char *iname, struct ipv6_prefix *pool6,
 
 mutex_fail:
 	mutex_unlock(&lock);
-	destroy_jool_instance(instance, false);
+	destroy_jool_instance(instance);
 	put_net(ns);
 	return error;
 }
@@ -564,6 +913,7 @@ mutex_fail:
 static int __xlator_rm(struct net *ns, char *iname, xlator_type xt)
 {
 	struct jool_instance *instance;
+	HLIST_HEAD(dead);
 
 	mutex_lock(&lock);
 
@@ -574,23 +924,23 @@ static int __xlator_rm(struct net *ns, char *iname, xlator_type xt)
 		return -ESRCH;
 	}
 
-	hash_del_rcu(&instance->table_hook);
-	if (instance->jool.flags & XF_NETFILTER)
-		list_del_rcu(&instance->list_hook);
+	unlist_instance(instance);
+	hlist_add_head(&instance->grave_hook, &dead);
+	resize_table();
 
 	mutex_unlock(&lock);
-	synchronize_rcu_bh();
 
 	/*
-	 * Nobody can kref_get the databases now:
+	 * Once the grace period ends, nobody will be able to kref_get the
+	 * databases anymore:
 	 * Other code should not do it because of the
 	 * xlator_find() contract, and xlator_find()'s
 	 * xlator_get() already happened. Other xlator_find()'s
 	 * xlator_get()s are not going to get in the way either
 	 * because the instance is no longer listed.
-	 * So finally return everything.
+	 * So that's when everything is returned.
 	 */
-	destroy_jool_instance(instance, true);
+	retire_instances(&dead);
 	return 0;
 }
 
@@ -622,11 +972,15 @@ int xlator_rm(xlator_type xt, char *iname)
 	return error;
 }
 
-int xlator_replace(struct xlator *jool)
-{
+/* One of the instances being replaced (or added) by xlator_replace_batch(). */
+struct replacement {
+	/* NULL means @new is not replacing anything; it's being added. */
 	struct jool_instance *old;
 	struct jool_instance *new;
-	struct list_head *list;
+};
+
+static int prepare_replacement(struct xlator *jool, struct replacement *r)
+{
 	int error;
 
 	error = basic_add_validations(jool->iname, jool->flags,
@@ -636,84 +990,209 @@ int xlator_replace(struct xlator *jool)
 	if (error)
 		return error;
 
-	new = wkmalloc(struct jool_instance, GFP_KERNEL);
-	if (!new)
+	r->old = NULL;
+	r->new = wkmalloc(struct jool_instance, GFP_KERNEL);
+	if (!r->new)
 		return -ENOMEM;
-	memcpy(&new->jool, jool, sizeof(*jool));
-	xlator_get(&new->jool);
-	new->hash_set = false;
-#if LINUX_VERSION_AT_LEAST(4, 13, 0, 8, 0)
-	new->nf_ops = NULL;
-#endif
+	memcpy(&r->new->jool, jool, sizeof(*jool));
+	xlator_get(&r->new->jool);
+	init_instance(r->new);
 
-	mutex_lock(&lock);
+	return 0;
+}
 
-	old = find_instance(jool->ns, xlator_flags2xt(jool->flags), jool->iname);
-	if (!old) {
-		/* Not found, hence not replacing. Add it instead. */
-		error = __xlator_add(new, NULL);
-		if (error)
-			destroy_jool_instance(new, false);
+static bool same_instance(struct jool_instance *i1, struct jool_instance *i2)
+{
+	return (i1->jool.ns == i2->jool.ns)
+			&& (xlator_get_type(&i1->jool) == xlator_get_type(&i2->jool))
+			&& (strcmp(i1->jool.iname, i2->jool.iname) == 0);
+}
 
-		mutex_unlock(&lock);
-		return error;
+/*
+ * Finds the instance @r is going to replace, and makes sure the replacement is
+ * legal. @prev are the replacements that precede @r in the same batch.
+ *
+ * Requires the mutex to be locked.
+ */
+static int validate_replacement(struct replacement *r,
+		struct replacement *prev, unsigned int prev_count)
+{
+	struct jool_instance *new = r->new;
+	struct jool_instance *old;
+	unsigned int i;
+
+	for (i = 0; i < prev_count; i++) {
+		if (same_instance(prev[i].new, new)) {
+			log_err("Instance '%s' was committed twice in the same transaction.",
+					new->jool.iname);
+			return -EINVAL;
+		}
+	}
+
+	old = find_instance(new->jool.ns, xlator_flags2xt(new->jool.flags),
+			new->jool.iname);
+	if (!old) {
+		/* Not found, hence not replacing. It will be added instead. */
+		return validate_collision(new->jool.ns, new->jool.iname,
+				new->jool.flags);
 	}
 
 	if (xlator_get_framework(&old->jool) != xlator_get_framework(&new->jool)) {
 		log_err("Sorry; you can't change an instance's framework for now.");
-		goto abort;
+		return -EINVAL;
 	}
 	if (xlator_is_nat64(&new->jool) && !prefix6_equals(
 			&old->jool.globals.pool6.prefix,
 			&new->jool.globals.pool6.prefix)) {
 		log_err("Sorry; you can't change a NAT64 instance's pool6 for now.");
-		goto abort;
+		return -EINVAL;
+	}
+
+	r->old = old;
+	return 0;
+}
+
+/*
+ * Unlists the instances @r added. Meant to revert a batch that failed halfway.
+ *
+ * Requires the mutex to be locked.
+ */
+static void unlist_added(struct replacement *r, unsigned int count)
+{
+	unsigned int i;
+
+	for (i = 0; i < count; i++) {
+		if (!r[i].old)
+			unlist_instance(r[i].new);
 	}
+}
+
+/* Requires the mutex to be locked. */
+static void swap_instances(struct replacement *r)
+{
+	struct jool_instance *old = r->old;
+	struct jool_instance *new = r->new;
 
 	new->hash_set = old->hash_set;
 	new->hash = old->hash;
 #if LINUX_VERSION_AT_LEAST(4, 13, 0, 8, 0)
+	/* Packets don't touch this, so it can move right away. */
 	new->nf_ops = old->nf_ops;
+	old->nf_ops = NULL;
 #endif
 	/*
-	 * The old BIB and joold must survive,
+	 * The old BIB, joold and session log must survive,
 	 * because they shouldn't be reset by atomic configuration.
+	 * (@old keeps its own references, because packets might still be
+	 * borrowing them until it's retired.)
 	 */
 	if (xlator_is_nat64(&new->jool)) {
 		bib_put(new->jool.nat64.bib);
 		joold_put(new->jool.nat64.joold);
+		slog_put(new->jool.nat64.slog);
 		new->jool.nat64.bib = old->jool.nat64.bib;
 		new->jool.nat64.joold = old->jool.nat64.joold;
+		new->jool.nat64.slog = old->jool.nat64.slog;
+		bib_get(new->jool.nat64.bib);
+		joold_get(new->jool.nat64.joold);
+		slog_get(new->jool.nat64.slog);
+		new->joold_owner = true;
+		old->joold_owner = false;
+	}
+
+	/* Listed first, so packets always find one of them. */
+	list_instance(new);
+	unlist_instance(old);
+}
+
+/**
+ * Replaces the running instances that share names (and namespaces) with
+ * @jools. The ones that don't exist yet are added instead.
+ *
+ * Either all of them are committed, or none of them are. Also, the old
+ * instances are retired within the same RCU grace period, so committing several
+ * at once is much cheaper than committing them one by one. (Not that anybody
+ * waits for it.)
+ */
+int xlator_replace_batch(struct xlator **jools, unsigned int count)
+{
+	struct replacement *r;
+	unsigned int prepared;
+	unsigned int added;
+	unsigned int i;
+	HLIST_HEAD(dead);
+	int error;
+
+	if (count == 0)
+		return 0;
+
+	r = __wkmalloc("xlator replacements", count * sizeof(*r), GFP_KERNEL);
+	if (!r)
+		return -ENOMEM;
+
+	for (prepared = 0; prepared < count; prepared++) {
+		error = prepare_replacement(jools[prepared], &r[prepared]);
+		if (error)
+			goto revert_prepare;
 	}
 
-	hash_del(&old->table_hook);
-	hash_add(instances, &new->table_hook, get_instance_hash(new));
-	if (old->jool.flags & XF_NETFILTER) {
-		list = rcu_dereference_protected(netfilter_instances,
-						lockdep_is_held(&lock));
-		list_del_rcu(&old->list_hook);
-		list_add_rcu(&new->list_hook, list);
+	mutex_lock(&lock);
+
+	for (i = 0; i < count; i++) {
+		error = validate_replacement(&r[i], r, i);
+		if (error)
+			goto revert_lock;
 	}
-	mutex_unlock(&lock);
 
-	synchronize_rcu_bh();
+	/* Additions are the only step that can fail, so do them first. */
+	for (added = 0; added < count; added++) {
+		if (r[added].old)
+			continue;
+		error = __xlator_add(r[added].new, NULL);
+		if (error)
+			goto revert_add;
+	}
 
-#if LINUX_VERSION_AT_LEAST(4, 13, 0, 8, 0)
-	old->nf_ops = NULL;
-#endif
-	if (xlator_is_nat64(&old->jool)) {
-		old->jool.nat64.bib = NULL;
-		old->jool.nat64.joold = NULL;
+	for (i = 0; i < count; i++) {
+		if (r[i].old) {
+			swap_instances(&r[i]);
+			hlist_add_head(&r[i].old->grave_hook, &dead);
+			log_info("Replaced instance '%s'.", r[i].new->jool.iname);
+		}
 	}
 
-	destroy_jool_instance(old, false);
-	log_info("Replaced instance '%s'.", jool->iname);
+	resize_table();
+	mutex_unlock(&lock);
+
+	retire_instances(&dead);
+	__wkfree("xlator replacements", r);
 	return 0;
 
-abort:
+revert_add:
+	unlist_added(r, added);
 	mutex_unlock(&lock);
-	destroy_jool_instance(new, false);
-	return -EINVAL;
+	for (i = 0; i < count; i++) {
+		if (!r[i].old && i < added)
+			hlist_add_head(&r[i].new->grave_hook, &dead);
+		else
+			destroy_jool_instance(r[i].new);
+	}
+	retire_instances(&dead);
+	__wkfree("xlator replacements", r);
+	return error;
+
+revert_lock:
+	mutex_unlock(&lock);
+revert_prepare:
+	for (i = 0; i < prepared; i++)
+		destroy_jool_instance(r[i].new);
+	__wkfree("xlator replacements", r);
+	return error;
+}
+
+int xlator_replace(struct xlator *jool)
+{
+	return xlator_replace_batch(&jool, 1);
 }
 
 int xlator_flush(xlator_type xt)
@@ -816,14 +1295,17 @@ int xlator_find_current(const char *iname, xlator_flags flags,
 
 int xlator_find_netfilter(struct net *ns, struct xlator *result)
 {
-	struct list_head *list;
+	struct instance_table *table;
 	struct jool_instance *instance;
+	struct hlist_node *node;
 
 	rcu_read_lock_bh();
 
-	list = rcu_dereference_bh(netfilter_instances);
-	list_for_each_entry_rcu(instance, list, list_hook) {
-		if (ns == instance->jool.ns) {
+	table = get_table();
+	bucket_for_each(node, ns_bucket(table, ns)) {
+		instance = ns_entry(table, node);
+		if (ns == instance->jool.ns
+				&& (instance->jool.flags & XF_NETFILTER)) {
 			xlator_get(&instance->jool);
 			memcpy(result, &instance->jool, sizeof(*result));
 			rcu_read_unlock_bh();
@@ -864,49 +1346,139 @@ void xlator_put(struct xlator *jool)
 			bib_put(jool->nat64.bib);
 		if (jool->nat64.joold)
 			joold_put(jool->nat64.joold);
+		if (jool->nat64.slog)
+			slog_put(jool->nat64.slog);
 		return;
 	}
 
 	WARN(1, "Unknown translator type: %d", xlator_get_type(jool));
 }
 
-static bool offset_equals(struct instance_entry_usr *offset,
+/* Instances xlator_foreach() sorts at a time. */
+#define FOREACH_BATCH 32
+
+/* The namespace, as userspace sees it. (See struct instance_entry_usr.) */
+static __u32 ns_key(struct net *ns)
+{
+	return ((__u64)ns) & 0xFFFFFFFF;
+}
+
+/* Order in which xlator_foreach() visits the instances. */
+static int compare_keys(__u32 ns1, char const *iname1,
+		__u32 ns2, char const *iname2)
+{
+	if (ns1 != ns2)
+		return (ns1 < ns2) ? -1 : 1;
+	return strcmp(iname1, iname2);
+}
+
+static int compare_instances(struct jool_instance *i1,
+		struct jool_instance *i2)
+{
+	return compare_keys(ns_key(i1->jool.ns), i1->jool.iname,
+			ns_key(i2->jool.ns), i2->jool.iname);
+}
+
+/*
+ * Inserts @instance in @batch (which is sorted, and @count long), dropping the
+ * last instance if @batch is full. Does nothing if @batch is full and
+ * @instance would be the last one.
+ */
+static void batch_insert(struct jool_instance **batch, unsigned int *count,
 		struct jool_instance *instance)
 {
-	return (offset->ns == ((__u64)instance->jool.ns & 0xFFFFFFFF))
-			&& (strcmp(offset->iname, instance->jool.iname) == 0);
+	unsigned int i = *count;
+
+	if (i == FOREACH_BATCH) {
+		if (compare_instances(instance, batch[i - 1]) >= 0)
+			return;
+		i--;
+	} else {
+		(*count)++;
+	}
+
+	for (; i > 0 && compare_instances(instance, batch[i - 1]) < 0; i--)
+		batch[i] = batch[i - 1];
+	batch[i] = instance;
+}
+
+/*
+ * Collects (in @batch) the first FOREACH_BATCH instances of type @xt that come
+ * after @ns and @iname, in order. (All of them, if @iname is NULL.)
+ * Returns how many were found.
+ *
+ * Requires RCU.
+ */
+static unsigned int collect_batch(struct instance_table *table, xlator_type xt,
+		__u32 ns, char const *iname, struct jool_instance **batch)
+{
+	struct jool_instance *instance;
+	struct hlist_node *node;
+	unsigned int count = 0;
+	unsigned int i;
+
+	for (i = 0; i < (1u << table->bits); i++) {
+		bucket_for_each(node, &table->by_name[i]) {
+			instance = name_entry(table, node);
+			if (!(xlator_flags2xt(instance->jool.flags) & xt))
+				continue;
+			if (iname && compare_keys(ns_key(instance->jool.ns),
+					instance->jool.iname, ns, iname) <= 0)
+				continue;
+			batch_insert(batch, &count, instance);
+		}
+	}
+
+	return count;
 }
 
+/**
+ * Calls @cb on every instance of type @xt, sorted by namespace, then name.
+ * If @offset is not NULL, starts after the instance it names.
+ *
+ * Resuming by key rather than by position means instances added, removed or
+ * moved (by a table resize) between dump pages can't make the dump skip or
+ * repeat the other ones. @offset doesn't even need to exist anymore.
+ *
+ * @cb runs under RCU, so it can't sleep. It can return nonzero to stop the
+ * iteration; that value is returned.
+ */
 int xlator_foreach(xlator_type xt, xlator_foreach_cb cb, void *args,
 		struct instance_entry_usr *offset)
 {
-	struct jool_instance *instance;
+	struct jool_instance *batch[FOREACH_BATCH];
+	struct instance_table *table;
+	__u32 ns = 0;
+	char const *iname = NULL;
+	unsigned int count;
 	unsigned int i;
 	int error = 0;
 
-	rcu_read_lock_bh();
+	if (offset) {
+		ns = offset->ns;
+		iname = offset->iname;
+	}
 
-	hash_for_each(instances, i, instance, table_hook) {
-		if (!(xlator_flags2xt(instance->jool.flags) & xt))
-			continue;
+	rcu_read_lock_bh();
+	table = get_table();
 
-		if (offset) {
-			if (offset_equals(offset, instance))
-				offset = NULL;
-		} else {
-			error = cb(&instance->jool, args);
+	do {
+		count = collect_batch(table, xt, ns, iname, batch);
+		for (i = 0; i < count; i++) {
+			error = cb(&batch[i]->jool, args);
 			if (error)
-				break;
+				goto end;
 		}
-	}
 
-	rcu_read_unlock_bh();
+		if (count) {
+			ns = ns_key(batch[count - 1]->jool.ns);
+			iname = batch[count - 1]->jool.iname;
+		}
+	} while (count == FOREACH_BATCH);
 
-	if (error)
-		return error;
-	if (offset)
-		return -ESRCH;
-	return 0;
+end:
+	rcu_read_unlock_bh();
+	return error;
 }
 
 xlator_type xlator_get_type(struct xlator *instance)
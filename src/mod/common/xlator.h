@@ -42,6 +42,7 @@ struct xlator {
 			struct pool4 *pool4;
 			struct bib *bib;
 			struct joold_queue *joold;
+			struct session_log *slog;
 		} nat64;
 	};
 
@@ -65,6 +66,7 @@ void jool_xlator_flush_batch(struct list_head *net_exit_list, xlator_type xt);
 int xlator_init(struct xlator *jool, struct net *ns, char *iname,
 		xlator_flags flags, struct ipv6_prefix *pool6);
 int xlator_replace(struct xlator *jool);
+int xlator_replace_batch(struct xlator **jools, unsigned int count);
 
 /* Any context (reads) */
 
@@ -32,6 +32,10 @@ static char const *banner = "\n"
 	";   |.'      `--''                      \\   \\####/      '  ,/   \n"
 	"'---'                                    `---`--`       '--'    \n";
 
+static bool defrag = true;
+module_param(defrag, bool, 0444);
+MODULE_PARM_DESC(defrag, "Reassemble fragmented packets before translating them? (If disabled, fragments are translated individually.)");
+
 static int iptables_error;
 
 /** iptables module registration object */
@@ -73,6 +77,14 @@ static struct pernet_operations joolns_ops = {
 
 static void defrag_enable(struct net *ns)
 {
+	/*
+	 * Note: This only means *we* won't request defrag. If something else
+	 * (eg. conntrack) does, the fragments will still be reassembled before
+	 * they reach us.
+	 */
+	if (!defrag)
+		return;
+
 #if LINUX_VERSION_AT_LEAST(4, 10, 0, 8, 0)
 	nf_defrag_ipv4_enable(ns);
 	nf_defrag_ipv6_enable(ns);
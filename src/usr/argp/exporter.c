@@ -0,0 +1,463 @@
+#include "usr/argp/exporter.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <netdb.h>
+#include <poll.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include "usr/argp/log.h"
+#include "usr/nl/stats.h"
+
+#define CONTENT_TYPE "application/openmetrics-text; version=1.0.0; charset=utf-8"
+/* Scrapers only send a request line and a few headers. */
+#define REQUEST_MAX 2048
+/* A client that takes longer than this is dropped, so it can't stall polls. */
+#define CLIENT_TIMEOUT_SEC 1
+
+/* The latest successful poll. */
+struct snapshot {
+	struct joolnl_instance_stats *instances;
+	size_t count;
+	size_t capacity;
+};
+
+/* The rendered scrape. */
+struct page {
+	char *text;
+	size_t len;
+	size_t capacity;
+};
+
+static int page_printf(struct page *page, char const *fmt, ...)
+		CHECK_FORMAT(2, 3);
+
+static int page_printf(struct page *page, char const *fmt, ...)
+{
+	va_list args;
+	size_t available;
+	char *text;
+	int len;
+
+	available = page->capacity - page->len;
+	va_start(args, fmt);
+	len = vsnprintf(page->text + page->len, available, fmt, args);
+	va_end(args);
+	if (len < 0)
+		return -EINVAL;
+
+	if (len >= available) {
+		text = realloc(page->text, 2 * page->capacity + len);
+		if (!text)
+			return -ENOMEM;
+		page->text = text;
+		page->capacity = 2 * page->capacity + len;
+
+		va_start(args, fmt);
+		vsnprintf(page->text + page->len, len + 1, fmt, args);
+		va_end(args);
+	}
+
+	page->len += len;
+	return 0;
+}
+
+/* Escapes HELP texts and label values. (Backslash, quote and newline.) */
+static int page_escape(struct page *page, char const *str)
+{
+	int error;
+
+	for (; *str; str++) {
+		switch (*str) {
+		case '\\':
+			error = page_printf(page, "\\\\");
+			break;
+		case '"':
+			error = page_printf(page, "\\\"");
+			break;
+		case '\n':
+			error = page_printf(page, "\\n");
+			break;
+		default:
+			error = page_printf(page, "%c", *str);
+		}
+		if (error)
+			return error;
+	}
+
+	return 0;
+}
+
+/* "JSTAT_RECEIVED6" -> "jool_received6", "JSTAT64_TTL" -> "jool_64_ttl" */
+static void metric_name(char const *stat, char *result, size_t size)
+{
+	size_t i;
+
+	if (strncmp(stat, "JSTAT", 5) == 0)
+		stat += 5;
+	if (stat[0] == '_')
+		stat++;
+
+	snprintf(result, size, "jool_%s", stat);
+	for (i = 0; result[i]; i++)
+		result[i] = tolower((unsigned char)result[i]);
+}
+
+static int render_labels(struct page *page, char const *xt,
+		struct instance_entry_usr const *instance)
+{
+	int error;
+
+	error = page_printf(page, "{namespace=\"%08x\",xlator=\"%s\",jool_instance=\"",
+			instance->ns, xt);
+	if (error)
+		return error;
+	error = page_escape(page, instance->iname);
+	if (error)
+		return error;
+	return page_printf(page, "\"}");
+}
+
+/*
+ * OpenMetrics wants every sample of a metric family together, so the loops are
+ * stat -> instance, which is the opposite of how the kernel sends them.
+ */
+static int render(struct page *page, struct snapshot const *snapshot,
+		char const *xt, bool up)
+{
+	struct joolnl_stat_metadata const *meta;
+	struct joolnl_instance_stats const *entry;
+	char name[64];
+	enum jool_stat_id id;
+	bool gauge;
+	size_t i;
+	int error;
+
+	page->len = 0;
+
+	error = page_printf(page, "# TYPE jool_up gauge\n"
+			"# HELP jool_up Whether the latest poll of the kernel module succeeded. (If not, the other metrics are stale.)\n"
+			"jool_up %d\n", up);
+	if (error)
+		return error;
+
+	for (id = 1; id <= JSTAT_UNKNOWN; id++) {
+		meta = joolnl_stat_meta(id);
+		metric_name(meta->name, name, sizeof(name));
+		gauge = jstat_is_gauge(id);
+
+		error = page_printf(page, "# TYPE %s %s\n# HELP %s ", name,
+				gauge ? "gauge" : "counter", name);
+		if (error)
+			return error;
+		error = page_escape(page, meta->doc);
+		if (error)
+			return error;
+		error = page_printf(page, "\n");
+		if (error)
+			return error;
+
+		for (i = 0; i < snapshot->count; i++) {
+			entry = &snapshot->instances[i];
+			error = page_printf(page, "%s%s", name,
+					gauge ? "" : "_total");
+			if (error)
+				return error;
+			error = render_labels(page, xt, &entry->instance);
+			if (error)
+				return error;
+			error = page_printf(page, " %llu\n",
+					(unsigned long long)entry->stats[id]);
+			if (error)
+				return error;
+		}
+	}
+
+	return page_printf(page, "# EOF\n");
+}
+
+static struct jool_result collect(struct joolnl_instance_stats const *entry,
+		void *arg)
+{
+	struct snapshot *snapshot = arg;
+	struct joolnl_instance_stats *instances;
+	size_t capacity;
+
+	if (snapshot->count == snapshot->capacity) {
+		capacity = snapshot->capacity ? (2 * snapshot->capacity) : 8;
+		instances = realloc(snapshot->instances,
+				capacity * sizeof(*instances));
+		if (!instances)
+			return result_from_enomem();
+		snapshot->instances = instances;
+		snapshot->capacity = capacity;
+	}
+
+	snapshot->instances[snapshot->count++] = *entry;
+	return result_success();
+}
+
+/*
+ * Polls the kernel module, and renders the result. If the poll fails, the
+ * previous snapshot is rendered again, and flagged as stale.
+ */
+static int refresh(struct joolnl_socket *sk, struct snapshot *snapshot,
+		struct snapshot *scratch, struct page *page, char const *xt)
+{
+	struct snapshot tmp;
+	struct jool_result result;
+	bool up;
+
+	scratch->count = 0;
+	result = joolnl_stats_dump(sk, collect, scratch);
+	up = !result.error;
+	if (up) {
+		tmp = *snapshot;
+		*snapshot = *scratch;
+		*scratch = tmp;
+	} else {
+		pr_result(&result);
+	}
+
+	return render(page, snapshot, xt, up);
+}
+
+static int listen_unix(char const *path)
+{
+	struct sockaddr_un addr;
+	struct stat st;
+	int fd;
+
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		pr_err("Unix socket path is too long: %s", path);
+		return -1;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+
+	/* Probably left behind by a previous run. Don't touch anything else. */
+	if (stat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+		unlink(path);
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) {
+		pr_err("socket() failed: %s", strerror(errno));
+		return -1;
+	}
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr))) {
+		pr_err("Cannot bind to %s: %s", path, strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+static int listen_tcp(char const *address, unsigned int port)
+{
+	struct addrinfo hints;
+	struct addrinfo *addrs, *addr;
+	char service[16];
+	int yes = 1;
+	int fd;
+	int error;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_PASSIVE | AI_NUMERICSERV;
+	snprintf(service, sizeof(service), "%u", port);
+
+	error = getaddrinfo(address ? address : "localhost", service, &hints,
+			&addrs);
+	if (error) {
+		pr_err("Cannot resolve '%s': %s", address, gai_strerror(error));
+		return -1;
+	}
+
+	fd = -1;
+	for (addr = addrs; addr; addr = addr->ai_next) {
+		fd = socket(addr->ai_family, addr->ai_socktype,
+				addr->ai_protocol);
+		if (fd < 0)
+			continue;
+		setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+		if (bind(fd, addr->ai_addr, addr->ai_addrlen) == 0)
+			break;
+		close(fd);
+		fd = -1;
+	}
+	freeaddrinfo(addrs);
+
+	if (fd < 0)
+		pr_err("Cannot bind to port %u: %s", port, strerror(errno));
+	return fd;
+}
+
+static void send_all(int fd, char const *buf, size_t len)
+{
+	ssize_t sent;
+
+	while (len > 0) {
+		sent = send(fd, buf, len, MSG_NOSIGNAL);
+		if (sent <= 0) {
+			if (sent < 0 && errno == EINTR)
+				continue;
+			return; /* Client's problem. */
+		}
+		buf += sent;
+		len -= sent;
+	}
+}
+
+static void respond(int fd, char const *status, char const *type,
+		char const *body, size_t len)
+{
+	char head[256];
+	int head_len;
+
+	head_len = snprintf(head, sizeof(head),
+			"HTTP/1.1 %s\r\n"
+			"Content-Type: %s\r\n"
+			"Content-Length: %zu\r\n"
+			"Connection: close\r\n"
+			"\r\n", status, type, len);
+	send_all(fd, head, head_len);
+	send_all(fd, body, len);
+}
+
+/* Minimal HTTP: One GET per connection, and it's always for the metrics. */
+static void serve(int fd, struct page const *page)
+{
+	char request[REQUEST_MAX];
+	struct timeval timeout;
+	size_t len;
+	ssize_t got;
+	char *path;
+
+	timeout.tv_sec = CLIENT_TIMEOUT_SEC;
+	timeout.tv_usec = 0;
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+	len = 0;
+	do {
+		got = recv(fd, request + len, sizeof(request) - len - 1, 0);
+		if (got <= 0)
+			return;
+		len += got;
+		request[len] = '\0';
+	} while (!strstr(request, "\r\n\r\n") && len < sizeof(request) - 1);
+
+	if (strncmp(request, "GET ", 4) != 0) {
+		respond(fd, "405 Method Not Allowed", "text/plain",
+				"Only GET is supported.\n", 23);
+		return;
+	}
+
+	path = request + 4;
+	path[strcspn(path, " ?")] = '\0';
+	if (strcmp(path, "/metrics") != 0 && strcmp(path, "/") != 0) {
+		respond(fd, "404 Not Found", "text/plain",
+				"Try /metrics.\n", 14);
+		return;
+	}
+
+	respond(fd, "200 OK", CONTENT_TYPE, page->text, page->len);
+}
+
+static unsigned long long now_ms(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000ull + now.tv_nsec / 1000000;
+}
+
+/**
+ * Serves @sk's instances' stats according to @cfg. Only returns on error.
+ */
+int exporter_run(struct joolnl_socket *sk, struct exporter_config const *cfg)
+{
+	struct snapshot snapshot = { 0 };
+	struct snapshot scratch = { 0 };
+	struct page page;
+	struct pollfd listener;
+	unsigned long long next, now;
+	char const *xt;
+	int client;
+	int error;
+
+	xt = (sk->xt == XT_SIIT) ? "SIIT" : "NAT64";
+
+	page.capacity = 64 * 1024;
+	page.len = 0;
+	page.text = malloc(page.capacity);
+	if (!page.text) {
+		pr_err("Out of memory.");
+		return -ENOMEM;
+	}
+
+	listener.fd = cfg->unix_path
+			? listen_unix(cfg->unix_path)
+			: listen_tcp(cfg->address, cfg->port);
+	if (listener.fd < 0) {
+		error = -EINVAL;
+		goto end;
+	}
+	if (listen(listener.fd, 16)) {
+		error = -errno;
+		pr_err("listen() failed: %s", strerror(errno));
+		goto close_listener;
+	}
+	listener.events = POLLIN;
+
+	next = 0;
+	while (true) {
+		now = now_ms();
+		if (now >= next) {
+			error = refresh(sk, &snapshot, &scratch, &page, xt);
+			if (error) {
+				pr_err("Cannot render the metrics: %s",
+						strerror(-error));
+				goto close_listener;
+			}
+			next = now + cfg->interval;
+		}
+
+		error = poll(&listener, 1, next - now);
+		if (error < 0) {
+			if (errno == EINTR)
+				continue;
+			error = -errno;
+			pr_err("poll() failed: %s", strerror(errno));
+			goto close_listener;
+		}
+		if (!(listener.revents & POLLIN))
+			continue;
+
+		client = accept(listener.fd, NULL, NULL);
+		if (client < 0)
+			continue; /* Client gave up; not our problem. */
+		serve(client, &page);
+		close(client);
+	}
+
+close_listener:
+	close(listener.fd);
+end:
+	free(snapshot.instances);
+	free(scratch.instances);
+	free(page.text);
+	return error;
+}
@@ -0,0 +1,27 @@
+#ifndef SRC_USR_ARGP_EXPORTER_H_
+#define SRC_USR_ARGP_EXPORTER_H_
+
+/**
+ * @file
+ * `stats serve`: Long-running OpenMetrics (Prometheus) exporter.
+ *
+ * Polls the stats of every instance (of the socket's type, in every namespace)
+ * through a single Netlink socket, and serves the latest poll over HTTP, so
+ * scrapes never reach the kernel module.
+ */
+
+#include "usr/nl/core.h"
+
+struct exporter_config {
+	/* If not NULL, listen on this Unix socket instead of TCP. */
+	char const *unix_path;
+	/* TCP listening address. NULL means loopback. */
+	char const *address;
+	unsigned int port;
+	/* Milliseconds between polls. */
+	unsigned int interval;
+};
+
+int exporter_run(struct joolnl_socket *sk, struct exporter_config const *cfg);
+
+#endif /* SRC_USR_ARGP_EXPORTER_H_ */
@@ -73,6 +73,21 @@ static struct cmd_option stats_ops[] = {
 			.xt = XT_ANY,
 			.handler = handle_stats_display,
 			.handle_autocomplete = autocomplete_stats_display,
+		}, {
+			.label = "latency",
+			.xt = XT_ANY,
+			.handler = handle_stats_latency,
+			.handle_autocomplete = autocomplete_stats_latency,
+		}, {
+			.label = "follow",
+			.xt = XT_ANY,
+			.handler = handle_stats_follow,
+			.handle_autocomplete = autocomplete_stats_follow,
+		}, {
+			.label = "serve",
+			.xt = XT_ANY,
+			.handler = handle_stats_serve,
+			.handle_autocomplete = autocomplete_stats_serve,
 		},
 		{ 0 },
 };
@@ -202,6 +217,11 @@ static struct cmd_option session_ops[] = {
 			.xt = XT_NAT64,
 			.handler = handle_session_display,
 			.handle_autocomplete = autocomplete_session_display,
+		}, {
+			.label = "follow",
+			.xt = XT_NAT64,
+			.handler = handle_session_follow,
+			.handle_autocomplete = autocomplete_session_follow,
 		},
 		{ 0 },
 };
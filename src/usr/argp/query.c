@@ -0,0 +1,170 @@
+#include "usr/argp/query.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <arpa/inet.h>
+
+#include "common/session.h"
+#include "usr/argp/log.h"
+#include "usr/argp/userspace-types.h"
+#include "usr/util/str_utils.h"
+
+#define ARRAY_SIZE(array) (sizeof(array) / sizeof(array[0]))
+
+static struct {
+	tcp_state state;
+	char const *name;
+} const states[] = {
+	{ ESTABLISHED, "ESTABLISHED" },
+	{ V4_INIT, "V4_INIT" },
+	{ V6_INIT, "V6_INIT" },
+	{ V4_FIN_RCV, "V4_FIN_RCV" },
+	{ V6_FIN_RCV, "V6_FIN_RCV" },
+	{ V4_FIN_V6_FIN_RCV, "V4_FIN_V6_FIN_RCV" },
+	{ TRANS, "TRANS" },
+};
+
+char const *tcp_state_to_string(tcp_state state)
+{
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(states); i++)
+		if (states[i].state == state)
+			return states[i].name;
+
+	return "UNKNOWN";
+}
+
+static int parse_tcp_state(void *void_field, int key, char *str)
+{
+	struct wargp_tcp_state *field = void_field;
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(states); i++) {
+		if (strcasecmp(str, states[i].name) == 0) {
+			field->set = true;
+			field->state = states[i].state;
+			return 0;
+		}
+	}
+
+	pr_err("Unknown TCP state: '%s'", str);
+	return -EINVAL;
+}
+
+struct wargp_type wt_tcp_state = {
+	.argument = "<state>",
+	.parse = parse_tcp_state,
+	.candidates = "ESTABLISHED V4_INIT V6_INIT V4_FIN_RCV V6_FIN_RCV V4_FIN_V6_FIN_RCV TRANS",
+};
+
+/* Format: <IPv4 prefix>[#<port range>] */
+static int parse_src4(void *void_field, int key, char *str)
+{
+	struct wargp_src4 *field = void_field;
+	struct jool_result result;
+	char *ports;
+
+	ports = strchr(str, '#');
+	if (ports) {
+		*ports = '\0';
+		ports++;
+	}
+
+	result = str_to_prefix4(str, &field->range.prefix);
+	if (result.error)
+		return pr_result(&result);
+
+	if (ports) {
+		result = str_to_port_range(ports, &field->range.ports);
+		if (result.error)
+			return pr_result(&result);
+	} else {
+		field->range.ports.min = 0;
+		field->range.ports.max = 65535;
+	}
+
+	field->set = true;
+	return 0;
+}
+
+struct wargp_type wt_src4 = {
+	.argument = "<IPv4 prefix>[#<port range>]",
+	.parse = parse_src4,
+};
+
+int wargp_query_build(struct wargp_query const *args, struct bib_query *query)
+{
+	memset(query, 0, sizeof(*query));
+
+	query->src6.set = args->src6.set;
+	query->src6.prefix = args->src6.prefix;
+	query->src4_set = args->src4.set;
+	query->src4.prefix = args->src4.range.prefix;
+	query->src4.ports = args->src4.range.ports;
+	query->dst4.set = args->dst4.set;
+	query->dst4.prefix = args->dst4.prefix;
+	query->state_set = args->state.set;
+	query->state = args->state.state;
+	query->min_idle = args->min_idle;
+
+	if (args->count.value && args->top) {
+		pr_err("--count and --top are mutually exclusive.");
+		return -EINVAL;
+	}
+	if (args->top > BIB_QUERY_MAX_TOP) {
+		pr_err("--top cannot exceed %u.", BIB_QUERY_MAX_TOP);
+		return -EINVAL;
+	}
+	if (args->subscriber_len > 128) {
+		pr_err("--subscriber-len cannot exceed 128.");
+		return -EINVAL;
+	}
+
+	if (args->top) {
+		query->mode = BQM_TOP;
+		query->top = args->top;
+		query->subscriber_len = args->subscriber_len
+				? args->subscriber_len
+				: 128;
+	} else if (args->count.value) {
+		query->mode = BQM_COUNT;
+	} else {
+		query->mode = BQM_LIST;
+	}
+
+	return 0;
+}
+
+void print_query_result(struct bib_query const *query,
+		struct bib_query_result const *result,
+		bool csv, bool no_headers)
+{
+	char str[INET6_ADDRSTRLEN];
+	struct bib_query_top const *top;
+	unsigned int i;
+
+	if (query->mode == BQM_COUNT) {
+		if (show_csv_header(no_headers, csv))
+			printf("Matches\n");
+		printf(csv ? "%u\n" : "Matches: %u\n", result->matches);
+		return;
+	}
+
+	if (csv) {
+		if (show_csv_header(no_headers, csv))
+			printf("Subscriber,Matches\n");
+	} else {
+		printf("Matches: %u\n", result->matches);
+		printf("Subscribers: %u\n", result->subscribers);
+	}
+
+	for (i = 0; i < result->top_count; i++) {
+		top = &result->top[i];
+		inet_ntop(AF_INET6, &top->subscriber.addr, str, sizeof(str));
+		printf(csv ? "%s/%u,%u\n" : "  %s/%u\t%u\n",
+				str, top->subscriber.len, top->matches);
+	}
+}
@@ -0,0 +1,111 @@
+#ifndef SRC_USR_ARGP_QUERY_H_
+#define SRC_USR_ARGP_QUERY_H_
+
+/**
+ * @file
+ * Filter and aggregation flags (struct bib_query) of `bib display` and
+ * `session display`.
+ */
+
+#include "common/config.h"
+#include "common/session.h"
+#include "usr/argp/wargp.h"
+
+struct wargp_src4 {
+	bool set;
+	struct ipv4_range range;
+};
+
+struct wargp_tcp_state {
+	bool set;
+	__u8 state;
+};
+
+struct wargp_query {
+	struct wargp_prefix6 src6;
+	struct wargp_src4 src4;
+	struct wargp_prefix4 dst4;
+	struct wargp_tcp_state state;
+	__u32 min_idle;
+	struct wargp_bool count;
+	__u32 top;
+	__u32 subscriber_len;
+};
+
+extern struct wargp_type wt_src4;
+extern struct wargp_type wt_tcp_state;
+
+#define ARGP_QUERY_SRC6 4000
+#define ARGP_QUERY_SRC4 4001
+#define ARGP_QUERY_DST4 4002
+#define ARGP_QUERY_STATE 4003
+#define ARGP_QUERY_MIN_IDLE 4004
+#define ARGP_QUERY_COUNT 4005
+#define ARGP_QUERY_TOP 4006
+#define ARGP_QUERY_SUBSCRIBER_LEN 4007
+
+/* Flags that apply to both tables. */
+#define WARGP_QUERY_BIB(container, field) \
+	{ \
+		.name = "src6", \
+		.key = ARGP_QUERY_SRC6, \
+		.doc = "Only include entries whose IPv6 address belongs to this prefix", \
+		.offset = offsetof(container, field.src6), \
+		.type = &wt_prefix6, \
+	}, { \
+		.name = "src4", \
+		.key = ARGP_QUERY_SRC4, \
+		.doc = "Only include entries masked by this IPv4 prefix (and port range)", \
+		.offset = offsetof(container, field.src4), \
+		.type = &wt_src4, \
+	}, { \
+		.name = "count", \
+		.key = ARGP_QUERY_COUNT, \
+		.doc = "Only print the number of matching entries", \
+		.offset = offsetof(container, field.count), \
+		.type = &wt_bool, \
+	}, { \
+		.name = "top", \
+		.key = ARGP_QUERY_TOP, \
+		.doc = "Only print the N subscribers with the most matching entries", \
+		.offset = offsetof(container, field.top), \
+		.type = &wt_u32, \
+	}, { \
+		.name = "subscriber-len", \
+		.key = ARGP_QUERY_SUBSCRIBER_LEN, \
+		.doc = "Length of the IPv6 prefix that identifies a subscriber (--top). Default: 128", \
+		.offset = offsetof(container, field.subscriber_len), \
+		.type = &wt_u32, \
+	}
+
+/* Flags that only make sense in the session table. */
+#define WARGP_QUERY_SESSION(container, field) \
+	WARGP_QUERY_BIB(container, field), \
+	{ \
+		.name = "dst4", \
+		.key = ARGP_QUERY_DST4, \
+		.doc = "Only include sessions whose remote IPv4 address belongs to this prefix", \
+		.offset = offsetof(container, field.dst4), \
+		.type = &wt_prefix4, \
+	}, { \
+		.name = "state", \
+		.key = ARGP_QUERY_STATE, \
+		.doc = "Only include TCP sessions in this state", \
+		.offset = offsetof(container, field.state), \
+		.type = &wt_tcp_state, \
+	}, { \
+		.name = "min-idle", \
+		.key = ARGP_QUERY_MIN_IDLE, \
+		.doc = "Only include sessions that have not seen traffic in this many milliseconds", \
+		.offset = offsetof(container, field.min_idle), \
+		.type = &wt_u32, \
+	}
+
+char const *tcp_state_to_string(tcp_state state);
+
+int wargp_query_build(struct wargp_query const *args, struct bib_query *query);
+void print_query_result(struct bib_query const *query,
+		struct bib_query_result const *result,
+		bool csv, bool no_headers);
+
+#endif /* SRC_USR_ARGP_QUERY_H_ */
@@ -4,6 +4,7 @@
 
 #include "usr/argp/dns.h"
 #include "usr/argp/log.h"
+#include "usr/argp/query.h"
 #include "usr/argp/requirements.h"
 #include "usr/argp/userspace-types.h"
 #include "usr/argp/wargp.h"
@@ -17,6 +18,7 @@ struct display_args {
 	struct wargp_bool no_headers;
 	struct wargp_bool csv;
 	struct wargp_bool numeric;
+	struct wargp_query query;
 };
 
 static struct wargp_option display_opts[] = {
@@ -26,6 +28,7 @@ static struct wargp_option display_opts[] = {
 	WARGP_NO_HEADERS(struct display_args, no_headers),
 	WARGP_CSV(struct display_args, csv),
 	WARGP_NUMERIC(struct display_args, numeric),
+	WARGP_QUERY_BIB(struct display_args, query),
 	{ 0 },
 };
 
@@ -59,10 +62,15 @@ static struct jool_result print_entry(struct bib_entry const *entry, void *args)
 int handle_bib_display(char *iname, int argc, char **argv, void const *arg)
 {
 	struct display_args dargs = { 0 };
+	struct bib_query query;
+	struct bib_query_result qresult;
 	struct joolnl_socket sk;
 	struct jool_result result;
 
 	result.error = wargp_parse(display_opts, argc, argv, &dargs);
+	if (result.error)
+		return result.error;
+	result.error = wargp_query_build(&dargs.query, &query);
 	if (result.error)
 		return result.error;
 
@@ -70,12 +78,22 @@ int handle_bib_display(char *iname, int argc, char **argv, void const *arg)
 	if (result.error)
 		return pr_result(&result);
 
+	if (query.mode != BQM_LIST) {
+		result = joolnl_bib_query(&sk, iname, dargs.proto.proto,
+				&query, &qresult);
+		if (!result.error)
+			print_query_result(&query, &qresult, dargs.csv.value,
+					dargs.no_headers.value);
+		goto end;
+	}
+
 	if (show_csv_header(dargs.no_headers.value, dargs.csv.value))
 		printf("Protocol,IPv6 Address,IPv6 L4-ID,IPv4 Address,IPv4 L4-ID,Static?\n");
 
-	result = joolnl_bib_foreach(&sk, iname, dargs.proto.proto,
+	result = joolnl_bib_foreach(&sk, iname, dargs.proto.proto, &query,
 			print_entry, &dargs);
 
+end:
 	joolnl_teardown(&sk);
 	return pr_result(&result);
 }
@@ -1,6 +1,7 @@
 #include "usr/argp/wargp/file.h"
 
 #include <errno.h>
+#include <stdlib.h>
 
 #include "usr/argp/log.h"
 #include "usr/argp/requirements.h"
@@ -9,19 +10,55 @@
 #include "usr/nl/core.h"
 #include "usr/nl/file.h"
 
+#define ARGP_INCREMENTAL 5000
+
+struct file_names {
+	char **values;
+	unsigned int count;
+};
+
 struct update_args {
-	struct wargp_string file_name;
+	struct file_names files;
 	struct wargp_bool force;
+	struct wargp_bool incremental;
+};
+
+static int parse_file_name(void *void_field, int key, char *str)
+{
+	struct file_names *field = void_field;
+	char **values;
+
+	values = realloc(field->values, (field->count + 1) * sizeof(char *));
+	if (!values) {
+		pr_err("Out of memory.");
+		return -ENOMEM;
+	}
+
+	values[field->count] = str;
+	field->values = values;
+	field->count++;
+	return 0;
+}
+
+struct wargp_type wt_file_names = {
+	.argument = "<file>...",
+	.parse = parse_file_name,
 };
 
 static struct wargp_option update_opts[] = {
 	WARGP_FORCE(struct update_args, force),
 	{
-		.name = "File name",
+		.name = "incremental",
+		.key = ARGP_INCREMENTAL,
+		.doc = "The files only describe changes to the running instances; keep everything else",
+		.offset = offsetof(struct update_args, incremental),
+		.type = &wt_bool,
+	}, {
+		.name = "File names",
 		.key = ARGP_KEY_ARG,
-		.doc = "Path to a JSON file containing Jool's configuration.",
-		.offset = offsetof(struct update_args, file_name),
-		.type = &wt_string,
+		.doc = "Paths to JSON files containing Jool's configuration. (All of them will be committed as a single transaction.)",
+		.offset = offsetof(struct update_args, files),
+		.type = &wt_file_names,
 	},
 	{ 0 },
 };
@@ -34,25 +71,34 @@ int handle_file_update(char *iname, int argc, char **argv, void const *arg)
 
 	result.error = wargp_parse(update_opts, argc, argv, &uargs);
 	if (result.error)
-		return result.error;
+		goto end;
 
-	if (!uargs.file_name.value) {
+	if (!uargs.files.count) {
 		struct requirement reqs[] = {
 				{ false, "a file name" },
 				{ 0 }
 		};
-		return requirement_print(reqs);
+		result.error = requirement_print(reqs);
+		goto end;
 	}
 
 	result = joolnl_setup(&sk, xt_get());
-	if (result.error)
-		return pr_result(&result);
+	if (result.error) {
+		result.error = pr_result(&result);
+		goto end;
+	}
 
-	result = joolnl_file_parse(&sk, xt_get(), iname, uargs.file_name.value,
-			uargs.force.value);
+	result = joolnl_file_parse(&sk, xt_get(), iname, uargs.files.values,
+			uargs.files.count, uargs.force.value,
+			uargs.incremental.value);
 
 	joolnl_teardown(&sk);
-	return pr_result(&result);
+	result.error = pr_result(&result);
+	/* Fall through */
+
+end:
+	free(uargs.files.values);
+	return result.error;
 }
 
 void autocomplete_file_update(void const *args)
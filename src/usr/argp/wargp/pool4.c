@@ -1,9 +1,12 @@
 #include "usr/argp/wargp/pool4.h"
 
 #include "usr/util/str_utils.h"
+#include "usr/nl/bib.h"
 #include "usr/nl/core.h"
 #include "usr/nl/pool4.h"
+#include "usr/nl/stats.h"
 #include "usr/argp/log.h"
+#include "usr/argp/query.h"
 #include "usr/argp/requirements.h"
 #include "usr/argp/userspace-types.h"
 #include "usr/argp/wargp.h"
@@ -12,18 +15,37 @@
 #define ARGP_MARK 3000
 #define ARGP_MAX_ITERATIONS 3001
 #define ARGP_QUICK 'q'
+#define ARGP_USAGE 3002
+#define ARGP_TOP 3003
+#define ARGP_SUBSCRIBER_LEN 3004
+
+struct usage_counter {
+	__u32 ports;
+	__u32 in_use;
+};
 
 struct display_args {
 	struct wargp_l4proto proto;
 	struct wargp_bool no_headers;
 	struct wargp_bool csv;
+	struct wargp_bool usage;
+	__u32 top;
+	__u32 subscriber_len;
 
 	struct {
 		bool initialized;
 		__u32 mark;
 		__u8 proto;
+		/* --usage only */
+		struct in_addr addr;
+		__u32 exhaustions;
+		bool mark_printed;
 	} last;
 
+	/* --usage: Pending totals of the last address, and the last mark. */
+	struct usage_counter addr_usage;
+	struct usage_counter mark_usage;
+
 	unsigned int count;
 };
 
@@ -33,6 +55,25 @@ static struct wargp_option display_opts[] = {
 	WARGP_ICMP(struct display_args, proto, "Print the ICMP table"),
 	WARGP_NO_HEADERS(struct display_args, no_headers),
 	WARGP_CSV(struct display_args, csv),
+	{
+		.name = "usage",
+		.key = ARGP_USAGE,
+		.doc = "Print how many of each address' ports are taken, and how well port allocation is doing",
+		.offset = offsetof(struct display_args, usage),
+		.type = &wt_bool,
+	}, {
+		.name = "top",
+		.key = ARGP_TOP,
+		.doc = "(--usage) Also print the N subscribers holding the most ports",
+		.offset = offsetof(struct display_args, top),
+		.type = &wt_u32,
+	}, {
+		.name = "subscriber-len",
+		.key = ARGP_SUBSCRIBER_LEN,
+		.doc = "Length of the IPv6 prefix that identifies a subscriber (--top). Default: 128",
+		.offset = offsetof(struct display_args, subscriber_len),
+		.type = &wt_u32,
+	},
 	{ 0 },
 };
 
@@ -110,13 +151,234 @@ static struct jool_result handle_display_response(struct pool4_entry const *entr
 	return result_success();
 }
 
+static void print_usage_separator(void)
+{
+	print_table_separator(0, 10, 5, 15, 7, 7, 6, 11, 0);
+}
+
+static void print_usage_row(struct display_args *args, char const *label,
+		struct usage_counter const *counter, bool first)
+{
+	double percent;
+
+	if (args->csv.value) {
+		printf("%u,%s,%s,%u,%u,%u\n", args->last.mark,
+				l4proto_to_string(args->last.proto), label,
+				counter->ports, counter->in_use,
+				args->last.exhaustions);
+		return;
+	}
+
+	percent = counter->ports
+			? (100.0 * counter->in_use / counter->ports)
+			: 0;
+
+	if (first) {
+		print_usage_separator();
+		printf("| %10u | %5s ", args->last.mark,
+				l4proto_to_string(args->last.proto));
+	} else {
+		printf("| %10s | %5s ", "", "");
+	}
+	printf("| %15s | %7u | %7u | %5.1f%% ", label, counter->ports,
+			counter->in_use, percent);
+	if (first)
+		printf("| %11u |\n", args->last.exhaustions);
+	else
+		printf("| %11s |\n", "");
+}
+
+/* Prints the pending address row. */
+static void flush_address(struct display_args *args)
+{
+	if (!args->last.initialized)
+		return;
+
+	print_usage_row(args, inet_ntoa(args->last.addr), &args->addr_usage,
+			!args->last.mark_printed);
+	args->last.mark_printed = true;
+
+	args->mark_usage.ports += args->addr_usage.ports;
+	args->mark_usage.in_use += args->addr_usage.in_use;
+	memset(&args->addr_usage, 0, sizeof(args->addr_usage));
+}
+
+/* Prints the pending address row, and the mark's totals. */
+static void flush_mark(struct display_args *args)
+{
+	flush_address(args);
+	if (!args->last.initialized)
+		return;
+
+	if (!args->csv.value)
+		print_usage_row(args, "(total)", &args->mark_usage, false);
+	memset(&args->mark_usage, 0, sizeof(args->mark_usage));
+	args->last.mark_printed = false;
+}
+
+/*
+ * The kernel sends one row per port range, but users think in addresses, so
+ * the ranges of each address (of each mark) are added up here.
+ */
+static struct jool_result handle_usage_response(struct pool4_usage const *usage,
+		void *args)
+{
+	struct display_args *dargs = args;
+	struct pool4_entry const *entry = &usage->entry;
+
+	if (print_common_values(entry, dargs)) {
+		flush_mark(dargs);
+	} else if (entry->range.prefix.addr.s_addr
+			!= dargs->last.addr.s_addr) {
+		flush_address(dargs);
+	}
+
+	dargs->last.initialized = true;
+	dargs->last.mark = entry->mark;
+	dargs->last.proto = entry->proto;
+	dargs->last.addr = entry->range.prefix.addr;
+	dargs->last.exhaustions = usage->exhaustions;
+	dargs->addr_usage.ports += port_range_count(&entry->range.ports);
+	dargs->addr_usage.in_use += usage->in_use;
+
+	dargs->count++;
+	return result_success();
+}
+
+static struct jool_result collect_stat(struct joolnl_stat const *stat,
+		void *args)
+{
+	__u64 *stats = args;
+	stats[stat->meta.id] = stat->value;
+	return result_success();
+}
+
+static struct jool_result print_iterations(struct joolnl_socket *sk,
+		char const *iname)
+{
+	static char const *labels[] = {
+		"1", "2-4", "5-16", "17-64", "65-256", "257-1024",
+		"1025-4096", ">4096",
+	};
+	__u64 stats[JSTAT_COUNT] = { 0 };
+	struct jool_result result;
+	unsigned int i;
+
+	result = joolnl_stats_foreach(sk, iname, collect_stat, stats);
+	if (result.error)
+		return result;
+
+	printf("\nPort allocations (all protocols), by tries needed:\n");
+	for (i = 0; i < JSTAT_POOL4_ITER_BUCKETS; i++) {
+		printf("  %10s: %llu\n", labels[i], (unsigned long long)
+				stats[JSTAT_POOL4_ITER_1 + i]);
+	}
+	printf("  %10s: %llu\n", "Failed", (unsigned long long)
+			stats[JSTAT_POOL4_EXHAUSTED]);
+
+	return result_success();
+}
+
+static struct jool_result print_top(struct joolnl_socket *sk,
+		char const *iname, struct display_args *dargs)
+{
+	struct bib_query query;
+	struct bib_query_result qresult;
+	struct jool_result result;
+
+	memset(&query, 0, sizeof(query));
+	query.mode = BQM_TOP;
+	query.top = dargs->top;
+	query.subscriber_len = dargs->subscriber_len
+			? dargs->subscriber_len
+			: 128;
+
+	result = joolnl_bib_query(sk, iname, dargs->proto.proto, &query,
+			&qresult);
+	if (result.error)
+		return result;
+
+	printf("\nTop subscribers, by %s ports in use:\n",
+			l4proto_to_string(dargs->proto.proto));
+	print_query_result(&query, &qresult, false, false);
+	return result_success();
+}
+
+static int validate_usage_args(struct display_args *dargs)
+{
+	if (!dargs->usage.value && (dargs->top || dargs->subscriber_len)) {
+		pr_err("--top and --subscriber-len require --usage.");
+		return -EINVAL;
+	}
+	if (dargs->csv.value && dargs->top) {
+		pr_err("--csv only prints the usage table. (Try 'bib display --top --csv' for the subscribers.)");
+		return -EINVAL;
+	}
+	if (dargs->top > BIB_QUERY_MAX_TOP) {
+		pr_err("--top cannot exceed %u.", BIB_QUERY_MAX_TOP);
+		return -EINVAL;
+	}
+	if (dargs->subscriber_len > 128) {
+		pr_err("--subscriber-len cannot exceed 128.");
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static int display_usage(struct joolnl_socket *sk, char const *iname,
+		struct display_args *dargs)
+{
+	struct jool_result result;
+
+	if (!dargs->no_headers.value) {
+		if (dargs->csv.value) {
+			printf("Mark,Protocol,Address,Ports,In use,Exhaustions\n");
+		} else {
+			print_usage_separator();
+			printf("| %10s | %5s | %15s | %7s | %7s | %6s | %11s |\n",
+					"Mark", "Proto", "Address", "Ports",
+					"In use", "Usage", "Exhaustions");
+		}
+	}
+
+	result = joolnl_pool4_usage(sk, iname, dargs->proto.proto,
+			handle_usage_response, dargs);
+	if (result.error)
+		return pr_result(&result);
+	flush_mark(dargs);
+
+	if (dargs->csv.value)
+		return 0;
+
+	if (dargs->count == 0)
+		print_usage_separator(); /* Header border */
+	print_usage_separator(); /* Table border */
+
+	result = print_iterations(sk, iname);
+	if (result.error)
+		return pr_result(&result);
+
+	if (dargs->top) {
+		result = print_top(sk, iname, dargs);
+		if (result.error)
+			return pr_result(&result);
+	}
+
+	return 0;
+}
+
 int handle_pool4_display(char *iname, int argc, char **argv, void const *arg)
 {
 	struct display_args dargs = { 0 };
 	struct joolnl_socket sk;
 	struct jool_result result;
+	int error;
 
 	result.error = wargp_parse(display_opts, argc, argv, &dargs);
+	if (result.error)
+		return result.error;
+	result.error = validate_usage_args(&dargs);
 	if (result.error)
 		return result.error;
 
@@ -124,6 +386,12 @@ int handle_pool4_display(char *iname, int argc, char **argv, void const *arg)
 	if (result.error)
 		return pr_result(&result);
 
+	if (dargs.usage.value) {
+		error = display_usage(&sk, iname, &dargs);
+		joolnl_teardown(&sk);
+		return error;
+	}
+
 	if (!dargs.no_headers.value) {
 		if (dargs.csv.value)
 			printf("Mark,Protocol,Address,Min port,Max port,Iterations,Iterations fixed\n");
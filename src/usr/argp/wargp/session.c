@@ -8,6 +8,7 @@
 #include "usr/nl/session.h"
 #include "usr/argp/dns.h"
 #include "usr/argp/log.h"
+#include "usr/argp/query.h"
 #include "usr/argp/userspace-types.h"
 #include "usr/argp/wargp.h"
 #include "usr/argp/xlator_type.h"
@@ -17,6 +18,7 @@ struct display_args {
 	struct wargp_bool csv;
 	struct wargp_bool numeric;
 	struct wargp_l4proto proto;
+	struct wargp_query query;
 };
 
 static struct wargp_option display_opts[] = {
@@ -26,31 +28,10 @@ static struct wargp_option display_opts[] = {
 	WARGP_NO_HEADERS(struct display_args, no_headers),
 	WARGP_CSV(struct display_args, csv),
 	WARGP_NUMERIC(struct display_args, numeric),
+	WARGP_QUERY_SESSION(struct display_args, query),
 	{ 0 },
 };
 
-static char *tcp_state_to_string(tcp_state state)
-{
-	switch (state) {
-	case ESTABLISHED:
-		return "ESTABLISHED";
-	case V4_INIT:
-		return "V4_INIT";
-	case V6_INIT:
-		return "V6_INIT";
-	case V4_FIN_RCV:
-		return "V4_FIN_RCV";
-	case V6_FIN_RCV:
-		return "V6_FIN_RCV";
-	case V4_FIN_V6_FIN_RCV:
-		return "V4_FIN_V6_FIN_RCV";
-	case TRANS:
-		return "TRANS";
-	}
-
-	return "UNKNOWN";
-}
-
 static struct jool_result handle_display_response(
 		struct session_entry_usr const *entry, void *args)
 {
@@ -101,10 +82,15 @@ static struct jool_result handle_display_response(
 int handle_session_display(char *iname, int argc, char **argv, void const *arg)
 {
 	struct display_args dargs = { 0 };
+	struct bib_query query;
+	struct bib_query_result qresult;
 	struct joolnl_socket sk;
 	struct jool_result result;
 
 	result.error = wargp_parse(display_opts, argc, argv, &dargs);
+	if (result.error)
+		return result.error;
+	result.error = wargp_query_build(&dargs.query, &query);
 	if (result.error)
 		return result.error;
 
@@ -112,6 +98,15 @@ int handle_session_display(char *iname, int argc, char **argv, void const *arg)
 	if (result.error)
 		return pr_result(&result);
 
+	if (query.mode != BQM_LIST) {
+		result = joolnl_session_query(&sk, iname, dargs.proto.proto,
+				&query, &qresult);
+		if (!result.error)
+			print_query_result(&query, &qresult, dargs.csv.value,
+					dargs.no_headers.value);
+		goto end;
+	}
+
 	if (!dargs.csv.value) {
 		printf("---------------------------------\n");
 	} else if (show_csv_header(dargs.no_headers.value, dargs.csv.value)) {
@@ -123,9 +118,10 @@ int handle_session_display(char *iname, int argc, char **argv, void const *arg)
 		printf("Expires in,State\n");
 	}
 
-	result = joolnl_session_foreach(&sk, iname, dargs.proto.proto,
+	result = joolnl_session_foreach(&sk, iname, dargs.proto.proto, &query,
 			handle_display_response, &dargs);
 
+end:
 	joolnl_teardown(&sk);
 
 	return pr_result(&result);
@@ -135,3 +131,126 @@ void autocomplete_session_display(void const *args)
 {
 	print_wargp_opts(display_opts);
 }
+
+struct follow_args {
+	struct wargp_bool no_headers;
+	struct wargp_bool csv;
+};
+
+static struct wargp_option follow_opts[] = {
+	WARGP_NO_HEADERS(struct follow_args, no_headers),
+	WARGP_CSV(struct follow_args, csv),
+	{ 0 },
+};
+
+static char *slog_type_to_string(__u8 type)
+{
+	switch (type) {
+	case SLOG_BIB_ADD:
+		return "Mapped";
+	case SLOG_BIB_RM:
+		return "Forgot";
+	case SLOG_SESSION_ADD:
+		return "Added session";
+	case SLOG_SESSION_RM:
+		return "Forgot session";
+	}
+
+	return "Unknown";
+}
+
+static void print_event(struct slog_event const *event, bool csv)
+{
+	struct ipv6_transport_addr src6, dst6;
+	struct ipv4_transport_addr src4, dst4;
+	bool is_bib;
+	char *separator;
+
+	src6.l3 = event->src6;
+	src6.l4 = event->src6_port;
+	dst6.l3 = event->dst6;
+	dst6.l4 = event->dst6_port;
+	src4.l3 = event->src4;
+	src4.l4 = event->src4_port;
+	dst4.l3 = event->dst4;
+	dst4.l4 = event->dst4_port;
+	is_bib = event->type == SLOG_BIB_ADD || event->type == SLOG_BIB_RM;
+	separator = csv ? "," : "#";
+
+	/* Numeric only; DNS lookups would never keep up. */
+	printf("%llu.%09llu%s%s%s%s%s",
+			(unsigned long long)(event->time / 1000000000),
+			(unsigned long long)(event->time % 1000000000),
+			csv ? "," : " ",
+			slog_type_to_string(event->type),
+			csv ? "," : " ",
+			l4proto_to_string(event->proto),
+			csv ? "," : " ");
+	print_addr6(&src6, true, separator, event->proto);
+	printf(csv ? "," : "|");
+	if (is_bib) {
+		printf(csv ? ",," : "-|");
+	} else {
+		print_addr6(&dst6, true, separator, event->proto);
+		printf(csv ? "," : "|");
+	}
+	print_addr4(&src4, true, separator, event->proto);
+	if (is_bib) {
+		printf(csv ? ",,\n" : "|-\n");
+	} else {
+		printf(csv ? "," : "|");
+		print_addr4(&dst4, true, separator, event->proto);
+		printf("\n");
+	}
+}
+
+static struct jool_result handle_follow_events(struct slog_event const *events,
+		unsigned int count, void *args)
+{
+	struct follow_args *fargs = args;
+	unsigned int i;
+
+	for (i = 0; i < count; i++)
+		print_event(&events[i], fargs->csv.value);
+
+	/* One flush per batch; if stdout is a pipe, let it buffer the rest. */
+	if (fflush(stdout))
+		return result_from_error(-EIO, "Cannot write to stdout.");
+	return result_success();
+}
+
+int handle_session_follow(char *iname, int argc, char **argv, void const *arg)
+{
+	struct follow_args fargs = { 0 };
+	struct joolnl_socket sk;
+	struct jool_result result;
+
+	result.error = wargp_parse(follow_opts, argc, argv, &fargs);
+	if (result.error)
+		return result.error;
+
+	result = joolnl_setup(&sk, xt_get());
+	if (result.error)
+		return pr_result(&result);
+
+	if (show_csv_header(fargs.no_headers.value, fargs.csv.value)) {
+		printf("Time,Event,Protocol,");
+		printf("IPv6 Remote Address,IPv6 Remote L4-ID,");
+		printf("IPv6 Local Address,IPv6 Local L4-ID,");
+		printf("IPv4 Local Address,IPv4 Local L4-ID,");
+		printf("IPv4 Remote Address,IPv4 Remote L4-ID\n");
+		fflush(stdout);
+	}
+
+	result = joolnl_session_follow(&sk, iname, handle_follow_events,
+			&fargs);
+
+	joolnl_teardown(&sk);
+
+	return pr_result(&result);
+}
+
+void autocomplete_session_follow(void const *args)
+{
+	print_wargp_opts(follow_opts);
+}
@@ -4,4 +4,7 @@
 int handle_session_display(char *iname, int argc, char **argv, void const *arg);
 void autocomplete_session_display(void const *args);
 
+int handle_session_follow(char *iname, int argc, char **argv, void const *arg);
+void autocomplete_session_follow(void const *args);
+
 #endif /* SRC_USR_ARGP_WARGP_SESSION_H_ */
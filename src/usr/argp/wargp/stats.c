@@ -1,7 +1,12 @@
 #include "usr/argp/wargp/stats.h"
 
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
 #include "usr/nl/core.h"
 #include "usr/nl/stats.h"
+#include "usr/argp/exporter.h"
 #include "usr/argp/log.h"
 #include "usr/argp/userspace-types.h"
 #include "usr/argp/wargp.h"
@@ -85,3 +90,284 @@ void autocomplete_stats_display(void const *args)
 {
 	print_wargp_opts(display_opts);
 }
+
+struct latency_args {
+	struct wargp_bool all;
+	struct wargp_bool explain;
+	struct wargp_bool no_headers;
+	struct wargp_bool csv;
+};
+
+static struct wargp_option latency_opts[] = {
+	{
+		.name = "all",
+		.key = 'a',
+		.doc = "Do not filter out empty buckets",
+		.offset = offsetof(struct latency_args, all),
+		.type = &wt_bool,
+	}, {
+		.name = "explain",
+		.key = 'e',
+		.doc = "Print a description of what each stage is",
+		.offset = offsetof(struct latency_args, explain),
+		.type = &wt_bool,
+	},
+	WARGP_NO_HEADERS(struct latency_args, no_headers),
+	WARGP_CSV(struct latency_args, csv),
+	{ 0 },
+};
+
+/* Smallest cycle count bucket @b can hold. (See JSTAGE_BUCKETS.) */
+static unsigned long long bucket_min(unsigned int b)
+{
+	return b ? (1ull << (b - 1)) : 0;
+}
+
+static void print_histogram(struct latency_args *largs,
+		struct joolnl_stage_metadata const *meta, __u64 const *buckets)
+{
+	unsigned long long samples;
+	unsigned int b;
+
+	samples = 0;
+	for (b = 0; b < JSTAGE_BUCKETS; b++)
+		samples += buckets[b];
+	if (!largs->all.value && samples == 0)
+		return;
+
+	if (!largs->csv.value) {
+		printf("%s: %llu samples\n", meta->name, samples);
+		if (largs->explain.value)
+			printf("%s\n", meta->doc);
+	}
+
+	for (b = 0; b < JSTAGE_BUCKETS; b++) {
+		if (!largs->all.value && buckets[b] == 0)
+			continue;
+
+		if (largs->csv.value) {
+			printf("%s,%llu,", meta->name, bucket_min(b));
+			if (b < JSTAGE_BUCKETS - 1)
+				printf("%llu", bucket_min(b + 1));
+			printf(",%llu\n", buckets[b]);
+		} else if (b < JSTAGE_BUCKETS - 1) {
+			printf("\t[%llu, %llu) cycles: %llu\n", bucket_min(b),
+					bucket_min(b + 1), buckets[b]);
+		} else {
+			printf("\t[%llu, +inf) cycles: %llu\n", bucket_min(b),
+					buckets[b]);
+		}
+	}
+
+	if (!largs->csv.value)
+		printf("\n");
+}
+
+int handle_stats_latency(char *iname, int argc, char **argv, void const *arg)
+{
+	struct latency_args largs = { 0 };
+	struct joolnl_socket sk;
+	struct joolnl_latency latency;
+	struct jool_result result;
+	unsigned int s;
+
+	result.error = wargp_parse(latency_opts, argc, argv, &largs);
+	if (result.error)
+		return result.error;
+
+	result = joolnl_setup(&sk, xt_get());
+	if (result.error)
+		return pr_result(&result);
+
+	result = joolnl_stats_latency(&sk, iname, &latency);
+
+	joolnl_teardown(&sk);
+	if (result.error)
+		return pr_result(&result);
+
+	if (show_csv_header(largs.no_headers.value, largs.csv.value))
+		printf("Stage,Cycles from,Cycles to,Count\n");
+
+	for (s = 0; s < JSTAGE_COUNT; s++)
+		print_histogram(&largs, joolnl_stage_meta(s), latency.buckets[s]);
+
+	return 0;
+}
+
+void autocomplete_stats_latency(void const *args)
+{
+	print_wargp_opts(latency_opts);
+}
+
+struct follow_args {
+	struct wargp_bool no_headers;
+	struct wargp_bool csv;
+};
+
+static struct wargp_option follow_opts[] = {
+	WARGP_NO_HEADERS(struct follow_args, no_headers),
+	WARGP_CSV(struct follow_args, csv),
+	{ 0 },
+};
+
+static void print_stream(struct joolnl_stat const *stats, unsigned int count,
+		char const *time, char const *kind, bool csv)
+{
+	unsigned int i;
+
+	for (i = 0; i < count; i++) {
+		if (csv) {
+			printf("%s,%s,%s,%llu\n", time, stats[i].meta.name, kind,
+					stats[i].value);
+		} else if (strcmp(kind, "delta") == 0) {
+			printf("\t%s: +%llu\n", stats[i].meta.name,
+					stats[i].value);
+		} else {
+			printf("\t%s: %llu\n", stats[i].meta.name,
+					stats[i].value);
+		}
+	}
+}
+
+static struct jool_result handle_follow_delta(
+		struct joolnl_stats_delta const *delta, void *args)
+{
+	struct follow_args *fargs = args;
+	struct timespec now;
+	char time[32];
+
+	/* The kernel doesn't timestamp deltas; arrival time is close enough. */
+	clock_gettime(CLOCK_REALTIME, &now);
+	snprintf(time, sizeof(time), "%llu.%09lu",
+			(unsigned long long)now.tv_sec, now.tv_nsec);
+
+	if (!fargs->csv.value)
+		printf("%s\n", time);
+	print_stream(delta->deltas, delta->delta_count, time, "delta",
+			fargs->csv.value);
+	print_stream(delta->gauges, delta->gauge_count, time, "gauge",
+			fargs->csv.value);
+
+	if (fflush(stdout))
+		return result_from_error(-EIO, "Cannot write to stdout.");
+	return result_success();
+}
+
+int handle_stats_follow(char *iname, int argc, char **argv, void const *arg)
+{
+	struct follow_args fargs = { 0 };
+	struct joolnl_socket sk;
+	struct jool_result result;
+
+	result.error = wargp_parse(follow_opts, argc, argv, &fargs);
+	if (result.error)
+		return result.error;
+
+	result = joolnl_setup(&sk, xt_get());
+	if (result.error)
+		return pr_result(&result);
+
+	if (show_csv_header(fargs.no_headers.value, fargs.csv.value)) {
+		printf("Time,Stat,Kind,Value\n");
+		fflush(stdout);
+	}
+
+	result = joolnl_stats_follow(&sk, iname, handle_follow_delta, &fargs);
+
+	joolnl_teardown(&sk);
+	return pr_result(&result);
+}
+
+void autocomplete_stats_follow(void const *args)
+{
+	print_wargp_opts(follow_opts);
+}
+
+#define ARGP_SERVE_ADDRESS 6000
+#define ARGP_SERVE_PORT 6001
+#define ARGP_SERVE_UNIX 6002
+#define ARGP_SERVE_INTERVAL 6003
+
+struct serve_args {
+	struct wargp_string address;
+	__u32 port;
+	struct wargp_string unix_path;
+	__u32 interval;
+};
+
+static struct wargp_option serve_opts[] = {
+	{
+		.name = "address",
+		.key = ARGP_SERVE_ADDRESS,
+		.doc = "Address to listen on (Default: localhost)",
+		.offset = offsetof(struct serve_args, address),
+		.type = &wt_string,
+	}, {
+		.name = "port",
+		.key = ARGP_SERVE_PORT,
+		.doc = "TCP port to listen on (Default: 9280)",
+		.offset = offsetof(struct serve_args, port),
+		.type = &wt_u32,
+	}, {
+		.name = "unix",
+		.key = ARGP_SERVE_UNIX,
+		.doc = "Listen on this Unix socket instead of TCP",
+		.offset = offsetof(struct serve_args, unix_path),
+		.type = &wt_string,
+	}, {
+		.name = "interval",
+		.key = ARGP_SERVE_INTERVAL,
+		.doc = "Milliseconds between kernel polls (Default: 5000)",
+		.offset = offsetof(struct serve_args, interval),
+		.type = &wt_u32,
+	},
+	{ 0 },
+};
+
+int handle_stats_serve(char *iname, int argc, char **argv, void const *arg)
+{
+	struct serve_args sargs = { 0 };
+	struct exporter_config cfg;
+	struct joolnl_socket sk;
+	struct jool_result result;
+	int error;
+
+	sargs.port = 9280;
+	sargs.interval = 5000;
+
+	result.error = wargp_parse(serve_opts, argc, argv, &sargs);
+	if (result.error)
+		return result.error;
+
+	if (iname) {
+		pr_err("stats serve exports every instance; it does not take an instance name.");
+		return -EINVAL;
+	}
+	if (sargs.port > 65535) {
+		pr_err("Port %u is out of range.", sargs.port);
+		return -EINVAL;
+	}
+	if (sargs.interval == 0) {
+		pr_err("The poll interval cannot be zero.");
+		return -EINVAL;
+	}
+
+	cfg.unix_path = sargs.unix_path.value;
+	cfg.address = sargs.address.value;
+	cfg.port = sargs.port;
+	cfg.interval = sargs.interval;
+
+	result = joolnl_setup(&sk, xt_get());
+	if (result.error)
+		return pr_result(&result);
+
+	error = exporter_run(&sk, &cfg);
+
+	joolnl_teardown(&sk);
+	return error;
+}
+
+void autocomplete_stats_serve(void const *args)
+{
+	print_wargp_opts(serve_opts);
+}
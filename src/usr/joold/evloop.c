@@ -0,0 +1,94 @@
+#include "usr/joold/evloop.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+
+#include "usr/joold/log.h"
+
+#define EVLOOP_BATCH 16
+
+static int epfd = -1;
+
+int evloop_setup(void)
+{
+	epfd = epoll_create1(0);
+	if (epfd < 0) {
+		pr_perror("epoll_create1() failed", errno);
+		return 1;
+	}
+
+	return 0;
+}
+
+void evloop_teardown(void)
+{
+	close(epfd);
+}
+
+static int ctl(int op, int fd, unsigned int events,
+		struct evloop_handler *handler)
+{
+	struct epoll_event event;
+
+	event.events = events;
+	event.data.ptr = handler;
+	if (epoll_ctl(epfd, op, fd, &event)) {
+		pr_perror("epoll_ctl() failed", errno);
+		return 1;
+	}
+
+	return 0;
+}
+
+int evloop_add(int fd, unsigned int events, struct evloop_handler *handler)
+{
+	return ctl(EPOLL_CTL_ADD, fd, events, handler);
+}
+
+int evloop_mod(int fd, unsigned int events, struct evloop_handler *handler)
+{
+	return ctl(EPOLL_CTL_MOD, fd, events, handler);
+}
+
+/* (Closing @fd also does this, but only if nobody else holds a duplicate.) */
+void evloop_del(int fd)
+{
+	epoll_ctl(epfd, EPOLL_CTL_DEL, fd, NULL);
+}
+
+/*
+ * Both directions are served by a single thread. The sockets are only read
+ * when they have something, and each read picks up as many packets as it can
+ * get, so they can be forwarded in batches.
+ *
+ * Handlers must not free other handlers, because their events might still be
+ * pending in the current batch. Freeing themselves is fine.
+ */
+int evloop_run(void)
+{
+	struct epoll_event events[EVLOOP_BATCH];
+	struct evloop_handler *handler;
+	int count;
+	int i;
+
+	syslog(LOG_INFO, "Listening...");
+
+	do {
+		count = epoll_wait(epfd, events, EVLOOP_BATCH, -1);
+		if (count < 0) {
+			if (errno == EINTR)
+				continue;
+			pr_perror("epoll_wait() failed", errno);
+			return 1;
+		}
+
+		for (i = 0; i < count; i++) {
+			handler = events[i].data.ptr;
+			handler->cb(handler, events[i].events);
+		}
+	} while (true);
+}
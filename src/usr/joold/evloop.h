@@ -0,0 +1,23 @@
+#ifndef SRC_USR_JOOLD_EVLOOP_H_
+#define SRC_USR_JOOLD_EVLOOP_H_
+
+/**
+ * joold's main (and only) loop. The sockets register themselves here, and get
+ * called back whenever they have something to do.
+ */
+
+struct evloop_handler {
+	/** Called whenever the handler's file descriptor has @events pending. */
+	void (*cb)(struct evloop_handler *handler, unsigned int events);
+};
+
+int evloop_setup(void);
+void evloop_teardown(void);
+
+int evloop_add(int fd, unsigned int events, struct evloop_handler *handler);
+int evloop_mod(int fd, unsigned int events, struct evloop_handler *handler);
+void evloop_del(int fd);
+
+int evloop_run(void);
+
+#endif /* SRC_USR_JOOLD_EVLOOP_H_ */
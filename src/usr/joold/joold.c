@@ -1,32 +1,16 @@
 #include <errno.h>
-#include <pthread.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <syslog.h>
 #include "log.h"
 #include "common/types.h"
 #include "common/xlat.h"
+#include "usr/joold/evloop.h"
 #include "usr/joold/modsocket.h"
 #include "usr/joold/netsocket.h"
 
-static void cancel_thread(pthread_t thread)
-{
-	int error;
-
-	error = pthread_cancel(thread);
-	if (!error)
-		pthread_join(thread, NULL);
-	/*
-	 * else:
-	 * Well, `man 3 pthread_cancel` just `exit(EXIT_FAILURE)`s when
-	 * `pthread_cancel()` fails.
-	 * Let's instead be good citizens by closing the sockets anyway.
-	 */
-}
-
 int main(int argc, char **argv)
 {
-	pthread_t mod2net_thread;
-	pthread_t net2mod_thread;
 	int error;
 
 	printf("Remember that joold is intended as a daemon, so it outputs straight to syslog.\n");
@@ -36,34 +20,24 @@ int main(int argc, char **argv)
 
 	openlog("joold", 0, LOG_DAEMON);
 
-	error = netsocket_setup(argc, argv);
+	error = evloop_setup();
 	if (error)
 		goto end;
+	error = netsocket_setup(argc, argv);
+	if (error)
+		goto revert_evloop;
 	error = modsocket_setup(argc, argv);
-	if (error) {
-		netsocket_teardown();
-		goto end;
-	}
-
-	error = pthread_create(&mod2net_thread, NULL, modsocket_listen, NULL);
-	if (error) {
-		pr_perror("Module-to-network thread initialization", error);
-		goto clean;
-	}
-	error = pthread_create(&net2mod_thread, NULL, netsocket_listen, NULL);
-	if (error) {
-		pr_perror("Network-to-module thread initialization", error);
-		cancel_thread(mod2net_thread);
-		goto clean;
-	}
+	if (error)
+		goto revert_netsocket;
 
-	pthread_join(net2mod_thread, NULL);
-	pthread_join(mod2net_thread, NULL);
-	/* Fall through. */
+	error = evloop_run();
 
-clean:
 	modsocket_teardown();
+	/* Fall through. */
+revert_netsocket:
 	netsocket_teardown();
+revert_evloop:
+	evloop_teardown();
 	/* Fall through. */
 
 end:
@@ -1,33 +1,50 @@
 #include "modsocket.h"
 
 #include <errno.h>
+#include <stdbool.h>
 #include <string.h>
 #include <syslog.h>
 #include <netlink/genl/ctrl.h>
 #include <netlink/genl/genl.h>
+#include <sys/epoll.h>
 
 #include "usr/util/cJSON.h"
 #include "usr/util/file.h"
+#include "usr/nl/attribute.h"
+#include "usr/nl/common.h"
 #include "usr/nl/joold.h"
+#include "usr/joold/evloop.h"
 #include "usr/joold/log.h"
 #include "usr/joold/netsocket.h"
 
+/** Receives the sessions the kernel module multicasts. */
 static struct joolnl_socket jsocket;
+/** Sends sessions and ACKs to the kernel module, and receives its errors. */
+static struct joolnl_socket rsocket;
+/** Pages through the session table on behalf of modsocket_dump(). */
+static struct joolnl_socket dsocket;
 static char *iname;
 
+static struct evloop_handler jhandler;
+static struct evloop_handler rhandler;
+
+/** Sequence number of the last kernel packet we queued for the network. */
+static __u32 last_seq;
+static bool last_seq_set;
+
 /* Called by the net socket whenever joold receives data from the network. */
-void modsocket_send(void *request, size_t request_len)
+void modsocket_send(struct iovec *blobs, unsigned int count)
 {
 	struct jool_result result;
-	result = joolnl_joold_add(&jsocket, iname, request, request_len);
+	result = joolnl_joold_add(&rsocket, iname, blobs, count);
 	pr_result(&result);
 }
 
-static void do_ack(void)
+static void do_ack(__u32 const *seq)
 {
 	struct jool_result result;
 
-	result = joolnl_joold_ack(&jsocket, iname);
+	result = joolnl_joold_ack(&rsocket, iname, seq);
 	if (result.error)
 		pr_result(&result);
 }
@@ -43,6 +60,7 @@ static int updated_entries_cb(struct nl_msg *msg, void *arg)
 	struct genlmsghdr *ghdr;
 	struct joolnlhdr *jhdr;
 	struct nlattr *root;
+	struct nlattr *seq_attr;
 	struct jool_result result;
 
 	syslog(LOG_DEBUG, "Received a packet from kernelspace.");
@@ -50,7 +68,7 @@ static int updated_entries_cb(struct nl_msg *msg, void *arg)
 	nhdr = nlmsg_hdr(msg);
 	if (!genlmsg_valid_hdr(nhdr, sizeof(struct joolnlhdr))) {
 		syslog(LOG_ERR, "Kernel sent invalid data: Message too short to contain headers");
-		do_ack();
+		do_ack(NULL);
 		return -EINVAL;
 	}
 	ghdr = genlmsg_hdr(nhdr);
@@ -59,14 +77,15 @@ static int updated_entries_cb(struct nl_msg *msg, void *arg)
 	if (jhdr->flags & JOOLNLHDR_FLAGS_ERROR) {
 		result = joolnl_msg2result(msg);
 		result.error = pr_result(&result);
-		do_ack();
+		do_ack(NULL);
 		return (result.error < 0) ? result.error : -result.error;
 	}
 
 	root = genlmsg_attrdata(ghdr, sizeof(struct joolnlhdr));
-	if (nla_type(root) != JNLAR_SESSION_ENTRIES) {
+	if (nla_type(root) != JNLAR_SESSION_RECORDS
+			&& nla_type(root) != JNLAR_SESSION_ENTRIES) {
 		syslog(LOG_ERR, "Kernel sent invalid data: Message lacks a session container");
-		do_ack();
+		do_ack(NULL);
 		return -EINVAL;
 	}
 
@@ -76,7 +95,16 @@ static int updated_entries_cb(struct nl_msg *msg, void *arg)
 	 * (See modsocket_send())
 	 */
 	netsocket_send(nla_data(root), nla_len(root));
-	do_ack();
+
+	/* The ACK waits until the packet has actually left; see modsocket_recv(). */
+	seq_attr = nla_find(root, genlmsg_attrlen(ghdr, sizeof(struct joolnlhdr)),
+			JNLAR_JOOLD_SEQ);
+	if (seq_attr) {
+		last_seq = nla_get_u32(seq_attr);
+		last_seq_set = true;
+	} else {
+		do_ack(NULL);
+	}
 	return 0;
 }
 
@@ -122,42 +150,138 @@ static int read_json(int argc, char **argv)
 	return 0;
 }
 
-static int create_socket(void)
+static int response_cb(struct nl_msg *msg, void *arg)
+{
+	struct jool_result result;
+
+	result = joolnl_msg2result(msg);
+	pr_result(&result);
+	return 0;
+}
+
+static int create_socket(struct joolnl_socket *socket, nl_recvmsg_msg_cb_t cb)
 {
-	int family_mc_grp;
 	struct jool_result result;
 
-	result = joolnl_setup(&jsocket, XT_NAT64);
+	result = joolnl_setup(socket, XT_NAT64);
 	if (result.error)
 		return pr_result(&result);
 
-	result.error = nl_socket_modify_cb(jsocket.sk, NL_CB_VALID,
-			NL_CB_CUSTOM, updated_entries_cb, NULL);
+	result.error = nl_socket_modify_cb(socket->sk, NL_CB_VALID,
+			NL_CB_CUSTOM, cb, NULL);
 	if (result.error) {
 		syslog(LOG_ERR, "Couldn't modify receiver socket's callbacks.");
 		goto fail;
 	}
 
+	/* Multicasts and errors don't follow our sequence numbers. */
+	nl_socket_disable_seq_check(socket->sk);
+
+	/* The event loop reads until the socket runs dry. */
+	result.error = nl_socket_set_nonblocking(socket->sk);
+	if (result.error) {
+		syslog(LOG_ERR, "Couldn't make the Netlink socket nonblocking.");
+		goto fail;
+	}
+
+	return 0;
+
+fail:
+	joolnl_teardown(socket);
+	syslog(LOG_ERR, "Netlink error message: %s", nl_geterror(result.error));
+	return result.error;
+}
+
+static int create_sockets(void)
+{
+	int family_mc_grp;
+	struct jool_result result;
+	int error;
+
+	/* Big enough for a full batch of network packets. */
+	nlmsg_set_default_size(NETSOCKET_BATCH * JOOLD_MAX_PAYLOAD + 4096);
+
+	error = create_socket(&rsocket, response_cb);
+	if (error)
+		return error;
+	error = create_socket(&jsocket, updated_entries_cb);
+	if (error)
+		goto fail1;
+	/* Dumps are request-response, so this one keeps the defaults. */
+	result = joolnl_setup(&dsocket, XT_NAT64);
+	if (result.error) {
+		error = pr_result(&result);
+		goto fail2;
+	}
+
 	family_mc_grp = genl_ctrl_resolve_grp(jsocket.sk, JOOLNL_FAMILY,
 			JOOLNL_MULTICAST_GRP_NAME);
 	if (family_mc_grp < 0) {
 		syslog(LOG_ERR, "Unable to resolve the Netlink multicast group.");
-		result.error = family_mc_grp;
-		goto fail;
+		error = family_mc_grp;
+		goto fail3;
 	}
 
-	result.error = nl_socket_add_membership(jsocket.sk, family_mc_grp);
-	if (result.error) {
+	error = nl_socket_add_membership(jsocket.sk, family_mc_grp);
+	if (error) {
 		syslog(LOG_ERR, "Can't register to the Netlink multicast group.");
-		goto fail;
+		goto fail3;
 	}
 
 	return 0;
 
-fail:
+fail3:
+	joolnl_teardown(&dsocket);
+	syslog(LOG_ERR, "Netlink error message: %s", nl_geterror(error));
+fail2:
 	joolnl_teardown(&jsocket);
-	syslog(LOG_ERR, "Netlink error message: %s", nl_geterror(result.error));
-	return result.error;
+fail1:
+	joolnl_teardown(&rsocket);
+	return error;
+}
+
+/*
+ * Forwards whatever the kernel module has multicasted (up to NETSOCKET_BATCH
+ * packets) to the network, then ACKs all of it at once.
+ */
+static void modsocket_recv(struct evloop_handler *handler, unsigned int events)
+{
+	unsigned int i;
+	int error;
+
+	for (i = 0; i < NETSOCKET_BATCH; i++) {
+		error = nl_recvmsgs_default(jsocket.sk);
+		if (error == -NLE_AGAIN)
+			break;
+		if (error < 0) {
+			syslog(LOG_ERR, "Error receiving packet from kernelspace: %s",
+					nl_geterror(error));
+		}
+	}
+
+	netsocket_flush();
+
+	/* ACKs are cumulative, so the last one covers the whole batch. */
+	if (last_seq_set) {
+		do_ack(&last_seq);
+		last_seq_set = false;
+	}
+}
+
+/* Prints the errors the kernel module answered our requests with. */
+static void modsocket_recv_responses(struct evloop_handler *handler,
+		unsigned int events)
+{
+	int error;
+
+	do {
+		error = nl_recvmsgs_default(rsocket.sk);
+	} while (error >= 0);
+
+	if (error != -NLE_AGAIN) {
+		syslog(LOG_ERR, "Error receiving response from kernelspace: %s",
+				nl_geterror(error));
+	}
 }
 
 int modsocket_setup(int argc, char **argv)
@@ -168,26 +292,140 @@ int modsocket_setup(int argc, char **argv)
 	if (error)
 		return error;
 
-	return create_socket();
+	error = create_sockets();
+	if (error) {
+		free(iname);
+		return error;
+	}
+
+	jhandler.cb = modsocket_recv;
+	error = evloop_add(nl_socket_get_fd(jsocket.sk), EPOLLIN, &jhandler);
+	if (error)
+		goto fail;
+	rhandler.cb = modsocket_recv_responses;
+	error = evloop_add(nl_socket_get_fd(rsocket.sk), EPOLLIN, &rhandler);
+	if (error)
+		goto fail;
+
+	return 0;
+
+fail:
+	modsocket_teardown();
+	return error;
 }
 
 void modsocket_teardown(void)
 {
 	free(iname);
+	iname = NULL;
+	joolnl_teardown(&dsocket);
 	joolnl_teardown(&jsocket);
+	joolnl_teardown(&rsocket);
 }
 
-void *modsocket_listen(void *arg)
+#define DUMP_PROTO_COUNT 3
+static l4_protocol const dump_protos[DUMP_PROTO_COUNT] = {
+	L4PROTO_TCP, L4PROTO_UDP, L4PROTO_ICMP,
+};
+
+struct dump_args {
+	struct modsocket_cursor *cursor;
+	modsocket_dump_cb cb;
+	void *arg;
+};
+
+static struct jool_result handle_dump_response(struct nl_msg *response,
+		void *arg)
 {
-	int error;
+	struct dump_args *args = arg;
+	struct modsocket_cursor *cursor = args->cursor;
+	struct genlmsghdr *ghdr;
+	struct nlattr *attr;
+	int rem;
+	bool empty;
+	bool done;
+	struct jool_result result;
 
-	do {
-		error = nl_recvmsgs_default(jsocket.sk);
-		if (error < 0) {
-			syslog(LOG_ERR, "Error receiving packet from kernelspace: %s",
-					nl_geterror(error));
+	result = joolnl_init_foreach_list(response, "session", &done);
+	if (result.error)
+		return result;
+
+	ghdr = genlmsg_hdr(nlmsg_hdr(response));
+	empty = true;
+	foreach_entry(attr, ghdr, rem) {
+		if (nla_len(attr) > sizeof(cursor->offset)) {
+			return result_from_error(
+				-EINVAL,
+				"The kernel's session attributes are too big for me."
+			);
 		}
-	} while (true);
+		memcpy(cursor->offset, nla_data(attr), nla_len(attr));
+		cursor->offset_len = nla_len(attr);
+		empty = false;
+	}
+
+	/*
+	 * The page is a list of session attributes, which is exactly what
+	 * the legacy session container looks like. So it can be handed to
+	 * the peers as is.
+	 */
+	if (!empty) {
+		args->cb(genlmsg_attrdata(ghdr, sizeof(struct joolnlhdr)),
+				genlmsg_attrlen(ghdr, sizeof(struct joolnlhdr)),
+				args->arg);
+	}
+
+	if (done) {
+		cursor->proto++;
+		cursor->offset_len = 0;
+		cursor->done = (cursor->proto >= DUMP_PROTO_COUNT);
+	}
+	return result_success();
+}
+
+/*
+ * Fetches the next page of the kernel's session table, and hands it over to
+ * @cb as a session container.
+ *
+ * @cursor remembers where the previous call left off; zero it to start from
+ * the beginning. Once there is nothing left to dump, @cursor->done is set.
+ *
+ * Pages are read on demand, so whoever is calling this can keep its own pace.
+ * The result is not an atomic snapshot; sessions that change between pages are
+ * expected to be caught up by the usual multicasts.
+ */
+int modsocket_dump(struct modsocket_cursor *cursor, modsocket_dump_cb cb,
+		void *arg)
+{
+	struct nl_msg *msg;
+	struct dump_args args;
+	struct jool_result result;
+
+	if (cursor->done)
+		return 0;
+
+	result = joolnl_alloc_msg(&dsocket, iname, JNLOP_SESSION_FOREACH, 0,
+			&msg);
+	if (result.error)
+		return pr_result(&result);
+
+	if (nla_put_u8(msg, JNLAR_PROTO, dump_protos[cursor->proto]) < 0)
+		goto cancel;
+	if (cursor->offset_len && nla_put(msg, JNLAR_OFFSET, cursor->offset_len,
+			cursor->offset) < 0)
+		goto cancel;
+
+	args.cursor = cursor;
+	args.cb = cb;
+	args.arg = arg;
+	result = joolnl_request(&dsocket, msg, handle_dump_response, &args);
+	if (result.error)
+		return pr_result(&result);
 
 	return 0;
+
+cancel:
+	nlmsg_free(msg);
+	result = joolnl_err_msgsize();
+	return pr_result(&result);
 }
@@ -5,12 +5,29 @@
  * This is the socket we use to talk to the kernel module.
  */
 
+#include <stdbool.h>
 #include <stddef.h>
+#include <sys/uio.h>
 
 int modsocket_setup(int argc, char **argv);
 void modsocket_teardown(void);
 
-void *modsocket_listen(void *arg);
-void modsocket_send(void *buffer, size_t size);
+void modsocket_send(struct iovec *blobs, unsigned int count);
+
+/** Bookmark of a modsocket_dump() in progress. */
+struct modsocket_cursor {
+	/** Index of the protocol whose table is being dumped. */
+	unsigned int proto;
+	/** Last session attribute we've dumped; the next page starts after it. */
+	char offset[256];
+	/** Zero means "start from the beginning of the table." */
+	size_t offset_len;
+	/** The whole table has been dumped. */
+	bool done;
+};
+
+typedef void (*modsocket_dump_cb)(void *blob, size_t size, void *arg);
+int modsocket_dump(struct modsocket_cursor *cursor, modsocket_dump_cb cb,
+		void *arg);
 
 #endif /* SRC_USR_JOOLD_MODSOCKET_H_ */
@@ -1,3 +1,5 @@
+/* recvmmsg() and sendmmsg() */
+#define _GNU_SOURCE
 #include "usr/joold/netsocket.h"
 
 #include <errno.h>
@@ -10,9 +12,13 @@
 #include <arpa/inet.h>
 #include <net/if.h>
 #include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
 
 #include "log.h"
 #include "modsocket.h"
+#include "usr/joold/evloop.h"
+#include "usr/joold/stream.h"
 #include "common/config.h"
 #include "common/types.h"
 #include "usr/util/cJSON.h"
@@ -42,12 +48,23 @@ struct netsocket_config {
 	bool ttl_set;
 };
 
+/** The peers are reached through a stream (stream.c) instead of multicast. */
+static bool streaming;
+
 static int sk;
+static struct evloop_handler handler;
 /** Processed version of the configuration's hostname and service. */
 static struct addrinfo *addr_candidates;
 /** Candidate from @addr_candidates that we managed to bind the socket with. */
 static struct addrinfo *bound_address;
 
+/** Where recvmmsg() drops the packets it reads from the network. */
+static char in_buffers[NETSOCKET_BATCH][JOOLD_MAX_PAYLOAD];
+/** Kernel packets waiting for the next netsocket_flush(). */
+static char out_buffers[NETSOCKET_BATCH][JOOLD_MAX_PAYLOAD];
+static struct iovec out_iovs[NETSOCKET_BATCH];
+static unsigned int out_count;
+
 static struct in_addr *get_addr4(struct addrinfo *addr)
 {
 	return &((struct sockaddr_in *)addr->ai_addr)->sin_addr;
@@ -430,75 +447,167 @@ static int adjust_mcast_opts(struct netsocket_config *cfg)
 	return 1;
 }
 
-int netsocket_setup(int argc, char **argv)
+/*
+ * Reads whatever the network has for us (up to NETSOCKET_BATCH packets), and
+ * hands it over to the kernel module in one go.
+ */
+static void netsocket_recv(struct evloop_handler *handler, unsigned int events)
+{
+	struct mmsghdr msgs[NETSOCKET_BATCH];
+	struct iovec iovs[NETSOCKET_BATCH];
+	int count;
+	int i;
+
+	memset(msgs, 0, sizeof(msgs));
+	for (i = 0; i < NETSOCKET_BATCH; i++) {
+		iovs[i].iov_base = in_buffers[i];
+		iovs[i].iov_len = sizeof(in_buffers[i]);
+		msgs[i].msg_hdr.msg_iov = &iovs[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	count = recvmmsg(sk, msgs, NETSOCKET_BATCH, MSG_DONTWAIT, NULL);
+	if (count < 0) {
+		if (errno != EAGAIN && errno != EWOULDBLOCK)
+			pr_perror("Error receiving packets from the network",
+					errno);
+		return;
+	}
+
+	syslog(LOG_DEBUG, "Received %d packets from the network.", count);
+	for (i = 0; i < count; i++)
+		iovs[i].iov_len = msgs[i].msg_len;
+	modsocket_send(iovs, count);
+}
+
+static int udp_setup(cJSON *json)
 {
-	cJSON *json;
 	struct netsocket_config cfg;
 	int error;
 
-	error = read_json(argc, argv, &json);
-	if (error)
-		return error;
-
 	error = json_to_config(json, &cfg);
 	if (error)
-		goto end;
+		return error;
 
 	error = create_socket(&cfg);
 	if (error)
-		goto end;
+		return error;
 
 	error = adjust_mcast_opts(&cfg);
-	if (error) {
-		close(sk);
-		freeaddrinfo(addr_candidates);
-		goto end;
+	if (error)
+		goto fail;
+
+	handler.cb = netsocket_recv;
+	error = evloop_add(sk, EPOLLIN, &handler);
+	if (error)
+		goto fail;
+
+	return 0;
+
+fail:
+	close(sk);
+	freeaddrinfo(addr_candidates);
+	return error;
+}
+
+int netsocket_setup(int argc, char **argv)
+{
+	cJSON *json;
+	cJSON *protocol;
+	int error;
+
+	error = read_json(argc, argv, &json);
+	if (error)
+		return error;
+
+	protocol = cJSON_GetObjectItem(json, "protocol");
+	if (!protocol || strcmp(protocol->valuestring, "udp") == 0) {
+		error = udp_setup(json);
+	} else if (strcmp(protocol->valuestring, "tcp") == 0) {
+		streaming = true;
+		error = stream_setup(json, false);
+	} else if (strcmp(protocol->valuestring, "unix") == 0) {
+		streaming = true;
+		error = stream_setup(json, true);
+	} else {
+		syslog(LOG_ERR, "Unknown protocol: '%s'. (Expected 'udp', 'tcp' or 'unix'.)",
+				protocol->valuestring);
+		error = 1;
 	}
-	/* Fall through. */
 
-end:
 	cJSON_Delete(json);
 	return error;
 }
 
 void netsocket_teardown(void)
 {
+	if (streaming) {
+		stream_teardown();
+		return;
+	}
+
 	close(sk);
 	freeaddrinfo(addr_candidates);
 }
 
-void *netsocket_listen(void *arg)
-{
-	char buffer[JOOLD_MAX_PAYLOAD];
-	int bytes;
 
-	syslog(LOG_INFO, "Listening...");
+/*
+ * Queues @buffer for the peers.
+ * It will actually be sent during the next netsocket_flush().
+ */
+void netsocket_send(void *buffer, size_t size)
+{
+	if (streaming) {
+		stream_send(buffer, size);
+		return;
+	}
 
-	do {
-		bytes = recv(sk, buffer, sizeof(buffer), 0);
-		if (bytes < 0) {
-			pr_perror("Error receiving packet from the network",
-					errno);
-			continue;
-		}
+	if (size > JOOLD_MAX_PAYLOAD) {
+		syslog(LOG_ERR, "Kernel packet is too big (%zu bytes); dropping it.",
+				size);
+		return;
+	}
 
-		syslog(LOG_DEBUG, "Received %d bytes from the network.", bytes);
-		modsocket_send(buffer, bytes);
-	} while (true);
+	if (out_count == NETSOCKET_BATCH)
+		netsocket_flush();
 
-	return NULL;
+	memcpy(out_buffers[out_count], buffer, size);
+	out_iovs[out_count].iov_base = out_buffers[out_count];
+	out_iovs[out_count].iov_len = size;
+	out_count++;
 }
 
-void netsocket_send(void *buffer, size_t size)
+/* Sends the packets queued by netsocket_send(). */
+void netsocket_flush(void)
 {
-	int bytes;
-
-	syslog(LOG_DEBUG, "Sending %zu bytes to the network...", size);
-	bytes = sendto(sk, buffer, size, 0,
-			bound_address->ai_addr,
-			bound_address->ai_addrlen);
-	if (bytes < 0)
-		pr_perror("Could not send a packet to the network", errno);
-	else
-		syslog(LOG_DEBUG, "Sent %d bytes to the network.\n", bytes);
+	struct mmsghdr msgs[NETSOCKET_BATCH];
+	unsigned int i;
+	int sent;
+
+	if (streaming) {
+		stream_flush();
+		return;
+	}
+	if (!out_count)
+		return;
+
+	memset(msgs, 0, sizeof(msgs));
+	for (i = 0; i < out_count; i++) {
+		msgs[i].msg_hdr.msg_name = bound_address->ai_addr;
+		msgs[i].msg_hdr.msg_namelen = bound_address->ai_addrlen;
+		msgs[i].msg_hdr.msg_iov = &out_iovs[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	syslog(LOG_DEBUG, "Sending %u packets to the network...", out_count);
+	for (i = 0; i < out_count; i += sent) {
+		sent = sendmmsg(sk, &msgs[i], out_count - i, 0);
+		if (sent < 0) {
+			pr_perror("Could not send a packet to the network",
+					errno);
+			sent = 1; /* Skip the offending packet. */
+		}
+	}
+
+	out_count = 0;
 }
@@ -3,14 +3,20 @@
 
 /**
  * This is the socket we use to talk to other joold instances in the network.
+ *
+ * It's normally a multicast UDP socket, but the configuration can also swap
+ * it for stream connections. (See stream.h.)
  */
 
 #include <stddef.h>
 
+/** Maximum number of packets we read or write per syscall. */
+#define NETSOCKET_BATCH 32
+
 int netsocket_setup(int argc, char **argv);
 void netsocket_teardown(void);
 
-void *netsocket_listen(void *arg);
 void netsocket_send(void *buffer, size_t size);
+void netsocket_flush(void);
 
 #endif /* SRC_USR_JOOLD_NETSOCKET_H_ */
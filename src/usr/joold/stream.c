@@ -0,0 +1,820 @@
+/* accept4() */
+#define _GNU_SOURCE
+#include "usr/joold/stream.h"
+
+#include <errno.h>
+#include <netdb.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <sys/un.h>
+
+#include "common/config.h"
+#include "usr/joold/evloop.h"
+#include "usr/joold/log.h"
+#include "usr/joold/modsocket.h"
+#include "usr/joold/netsocket.h"
+
+/* Every frame is preceded by its length, as a 32-bit big endian integer. */
+#define FRAME_HDR_LEN sizeof(__u32)
+/*
+ * Frames carry either the kernel's session packets or session table pages,
+ * both of which are much smaller than this. Also, a full batch of them still
+ * fits in a single Netlink request. (See modsocket_send().)
+ */
+#define STREAM_MAX_FRAME (NETSOCKET_BATCH * JOOLD_MAX_PAYLOAD)
+/* Snapshot pages are only fetched while the peer's queue is below this. */
+#define STREAM_LOW_WATER (256 * 1024)
+/* Peers whose queue grows beyond this are considered dead. */
+#define STREAM_MAX_BUFFERED (16 * 1024 * 1024)
+/* Maximum snapshot pages fetched per event, so the kernel isn't starved. */
+#define STREAM_SNAPSHOT_PAGES 16
+/* Seconds between attempts to reach the peers we're disconnected from. */
+#define STREAM_RECONNECT_INTERVAL 5
+
+struct stream_buffer {
+	char *data;
+	/** First byte that hasn't been consumed yet. */
+	size_t start;
+	/** One byte past the last one that has been written. */
+	size_t end;
+	size_t capacity;
+};
+
+struct stream_peer;
+
+/** A peer from the configuration; we're supposed to connect to it. */
+struct stream_remote {
+	char name[INET6_ADDRSTRLEN + 8];
+	struct sockaddr_storage addr;
+	socklen_t addrlen;
+	/** Current connection to this remote. NULL if there is none. */
+	struct stream_peer *peer;
+};
+
+struct stream_peer {
+	/* (Needs to be the first member; see peer_cb().) */
+	struct evloop_handler handler;
+	int fd;
+	char name[INET6_ADDRSTRLEN + 8];
+	/** Configured peer this connection belongs to. NULL if it's inbound. */
+	struct stream_remote *remote;
+	/** Events @fd is currently registered with. */
+	unsigned int events;
+
+	/** connect() hasn't finished yet. */
+	bool connecting;
+	/** We gave up on the peer; it's only waiting to be closed. */
+	bool broken;
+	/** The session table is still being dumped to the peer. */
+	bool snapshotting;
+	struct modsocket_cursor cursor;
+
+	struct stream_buffer in;
+	struct stream_buffer out;
+
+	struct stream_peer *next;
+	struct stream_peer *prev;
+};
+
+static bool is_local;
+
+static int listener = -1;
+static struct evloop_handler listener_handler;
+/** UNIX only. Needs to be unlinked during teardown. */
+static char *listen_path;
+
+static int timer = -1;
+static struct evloop_handler timer_handler;
+
+static struct stream_remote *remotes;
+static unsigned int remote_count;
+
+static struct stream_peer *peers;
+
+static size_t buffer_len(struct stream_buffer *buffer)
+{
+	return buffer->end - buffer->start;
+}
+
+/* Makes sure there's room for @len more bytes at the end of @buffer. */
+static int buffer_reserve(struct stream_buffer *buffer, size_t len)
+{
+	size_t capacity;
+	char *data;
+
+	if (buffer->start == buffer->end)
+		buffer->start = buffer->end = 0;
+	if (buffer->end + len <= buffer->capacity)
+		return 0;
+
+	/* Try to reclaim the space that has already been consumed. */
+	if (buffer->start) {
+		memmove(buffer->data, buffer->data + buffer->start,
+				buffer_len(buffer));
+		buffer->end -= buffer->start;
+		buffer->start = 0;
+		if (buffer->end + len <= buffer->capacity)
+			return 0;
+	}
+
+	capacity = buffer->capacity ? buffer->capacity : STREAM_MAX_FRAME;
+	while (capacity < buffer->end + len)
+		capacity *= 2;
+
+	data = realloc(buffer->data, capacity);
+	if (!data)
+		return -ENOMEM;
+
+	buffer->data = data;
+	buffer->capacity = capacity;
+	return 0;
+}
+
+static void update_events(struct stream_peer *peer)
+{
+	unsigned int events;
+
+	if (peer->connecting)
+		events = EPOLLOUT;
+	else if (buffer_len(&peer->out) || peer->snapshotting)
+		events = EPOLLIN | EPOLLOUT;
+	else
+		events = EPOLLIN;
+
+	if (events != peer->events && !peer->broken) {
+		if (!evloop_mod(peer->fd, events, &peer->handler))
+			peer->events = events;
+	}
+}
+
+/*
+ * Gives up on @peer.
+ *
+ * It's not freed right away because there might be an event for it waiting
+ * in the loop. Instead, shutdown() guarantees it will get one more EPOLLHUP,
+ * and the peer closes itself then.
+ */
+static void peer_break(struct stream_peer *peer)
+{
+	if (peer->broken)
+		return;
+
+	peer->broken = true;
+	shutdown(peer->fd, SHUT_RDWR);
+}
+
+static void peer_close(struct stream_peer *peer)
+{
+	syslog(LOG_INFO, "Closing the connection with %s.", peer->name);
+
+	close(peer->fd);
+
+	if (peer->prev)
+		peer->prev->next = peer->next;
+	else
+		peers = peer->next;
+	if (peer->next)
+		peer->next->prev = peer->prev;
+	if (peer->remote)
+		peer->remote->peer = NULL;
+
+	free(peer->in.data);
+	free(peer->out.data);
+	free(peer);
+}
+
+/* Queues @size bytes from @buffer as a frame for @peer. */
+static void frame_append(struct stream_peer *peer, void *buffer, size_t size)
+{
+	__u32 len;
+
+	if (peer->broken)
+		return;
+
+	if (buffer_len(&peer->out) + FRAME_HDR_LEN + size > STREAM_MAX_BUFFERED) {
+		syslog(LOG_ERR, "%s is not keeping up; dropping it.",
+				peer->name);
+		peer_break(peer);
+		return;
+	}
+
+	if (buffer_reserve(&peer->out, FRAME_HDR_LEN + size)) {
+		syslog(LOG_ERR, "Out of memory; dropping %s.", peer->name);
+		peer_break(peer);
+		return;
+	}
+
+	len = htonl(size);
+	memcpy(peer->out.data + peer->out.end, &len, FRAME_HDR_LEN);
+	memcpy(peer->out.data + peer->out.end + FRAME_HDR_LEN, buffer, size);
+	peer->out.end += FRAME_HDR_LEN + size;
+}
+
+static void snapshot_cb(void *blob, size_t size, void *arg)
+{
+	frame_append(arg, blob, size);
+}
+
+/*
+ * Sends as much of @peer's queue as the socket will take, refilling it with
+ * snapshot pages as it drains.
+ */
+static int peer_write(struct stream_peer *peer)
+{
+	unsigned int pages;
+	ssize_t sent;
+
+	pages = 0;
+	do {
+		while (peer->snapshotting
+				&& buffer_len(&peer->out) < STREAM_LOW_WATER
+				&& pages < STREAM_SNAPSHOT_PAGES) {
+			if (modsocket_dump(&peer->cursor, snapshot_cb, peer))
+				return 1;
+			if (peer->broken)
+				return 1;
+			pages++;
+
+			if (peer->cursor.done) {
+				peer->snapshotting = false;
+				syslog(LOG_INFO, "%s has been sent the whole session table.",
+						peer->name);
+			}
+		}
+
+		if (!buffer_len(&peer->out))
+			return 0;
+
+		sent = send(peer->fd, peer->out.data + peer->out.start,
+				buffer_len(&peer->out), MSG_DONTWAIT | MSG_NOSIGNAL);
+		if (sent < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				return 0;
+			if (errno == EINTR)
+				continue;
+			pr_perror("Could not send sessions to a peer", errno);
+			return 1;
+		}
+
+		peer->out.start += sent;
+	} while (true);
+}
+
+/* Hands the complete frames @peer has sent us over to the kernel. */
+static int parse_frames(struct stream_peer *peer)
+{
+	struct stream_buffer *in = &peer->in;
+	struct iovec blobs[NETSOCKET_BATCH];
+	unsigned int count;
+	size_t total;
+	__u32 len;
+
+	count = 0;
+	total = 0;
+
+	while (buffer_len(in) >= FRAME_HDR_LEN) {
+		memcpy(&len, in->data + in->start, FRAME_HDR_LEN);
+		len = ntohl(len);
+		if (len > STREAM_MAX_FRAME) {
+			syslog(LOG_ERR, "%s sent a %u-byte frame; it doesn't seem to be a joold.",
+					peer->name, len);
+			return 1;
+		}
+		if (buffer_len(in) < FRAME_HDR_LEN + len)
+			break;
+
+		if (count == NETSOCKET_BATCH || total + len > STREAM_MAX_FRAME) {
+			modsocket_send(blobs, count);
+			count = 0;
+			total = 0;
+		}
+
+		if (len) {
+			blobs[count].iov_base = in->data + in->start
+					+ FRAME_HDR_LEN;
+			blobs[count].iov_len = len;
+			count++;
+			total += len;
+		}
+		in->start += FRAME_HDR_LEN + len;
+	}
+
+	if (count)
+		modsocket_send(blobs, count);
+	return 0;
+}
+
+static int peer_read(struct stream_peer *peer)
+{
+	unsigned int i;
+	ssize_t got;
+
+	for (i = 0; i < NETSOCKET_BATCH; i++) {
+		if (buffer_reserve(&peer->in, STREAM_MAX_FRAME)) {
+			syslog(LOG_ERR, "Out of memory.");
+			return 1;
+		}
+
+		got = recv(peer->fd, peer->in.data + peer->in.end,
+				peer->in.capacity - peer->in.end, MSG_DONTWAIT);
+		if (got == 0) {
+			syslog(LOG_INFO, "%s closed the connection.", peer->name);
+			return 1;
+		}
+		if (got < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				return 0;
+			if (errno == EINTR)
+				continue;
+			pr_perror("Could not receive sessions from a peer", errno);
+			return 1;
+		}
+
+		peer->in.end += got;
+		if (parse_frames(peer))
+			return 1;
+	}
+
+	return 0;
+}
+
+/* The connection is up; the snapshot goes first. */
+static void peer_established(struct stream_peer *peer)
+{
+	syslog(LOG_INFO, "Connected to %s. Sending it the session table...",
+			peer->name);
+
+	peer->connecting = false;
+	memset(&peer->cursor, 0, sizeof(peer->cursor));
+	peer->snapshotting = true;
+	update_events(peer);
+}
+
+static void finish_connect(struct stream_peer *peer)
+{
+	int error;
+	socklen_t len;
+
+	len = sizeof(error);
+	if (getsockopt(peer->fd, SOL_SOCKET, SO_ERROR, &error, &len))
+		error = errno;
+	if (error) {
+		pr_perror("Could not connect to a peer", error);
+		peer_close(peer);
+		return;
+	}
+
+	peer_established(peer);
+}
+
+static void peer_cb(struct evloop_handler *handler, unsigned int events)
+{
+	struct stream_peer *peer = (struct stream_peer *)handler;
+
+	if (peer->connecting) {
+		finish_connect(peer);
+		return;
+	}
+
+	if (peer->broken || (events & EPOLLERR))
+		goto close;
+	if ((events & (EPOLLIN | EPOLLHUP)) && peer_read(peer))
+		goto close;
+	if ((events & EPOLLOUT) && peer_write(peer))
+		goto close;
+
+	update_events(peer);
+	return;
+
+close:
+	peer_close(peer);
+}
+
+static struct stream_peer *peer_create(int fd, char const *name,
+		struct stream_remote *remote, bool connecting)
+{
+	struct stream_peer *peer;
+
+	peer = calloc(1, sizeof(struct stream_peer));
+	if (!peer) {
+		syslog(LOG_ERR, "Out of memory.");
+		close(fd);
+		return NULL;
+	}
+
+	peer->handler.cb = peer_cb;
+	peer->fd = fd;
+	snprintf(peer->name, sizeof(peer->name), "%s", name);
+	peer->remote = remote;
+	peer->connecting = connecting;
+	peer->events = connecting ? EPOLLOUT : EPOLLIN;
+
+	if (evloop_add(fd, peer->events, &peer->handler)) {
+		close(fd);
+		free(peer);
+		return NULL;
+	}
+
+	peer->next = peers;
+	if (peers)
+		peers->prev = peer;
+	peers = peer;
+	if (remote)
+		remote->peer = peer;
+	return peer;
+}
+
+static void remote_connect(struct stream_remote *remote)
+{
+	struct stream_peer *peer;
+	int fd;
+
+	fd = socket(remote->addr.ss_family,
+			SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd < 0) {
+		pr_perror("socket() failed", errno);
+		return;
+	}
+
+	if (connect(fd, (struct sockaddr *)&remote->addr, remote->addrlen)) {
+		if (errno != EINPROGRESS) {
+			syslog(LOG_DEBUG, "Could not connect to %s: errcode %d",
+					remote->name, errno);
+			close(fd);
+			return;
+		}
+		peer_create(fd, remote->name, remote, true);
+		return;
+	}
+
+	peer = peer_create(fd, remote->name, remote, false);
+	if (peer)
+		peer_established(peer);
+}
+
+static void timer_cb(struct evloop_handler *handler, unsigned int events)
+{
+	uint64_t expirations;
+	unsigned int i;
+
+	if (read(timer, &expirations, sizeof(expirations)) < 0)
+		return;
+
+	for (i = 0; i < remote_count; i++)
+		if (!remotes[i].peer)
+			remote_connect(&remotes[i]);
+}
+
+static void print_addr(struct sockaddr *addr, char *buffer, size_t size)
+{
+	char str[INET6_ADDRSTRLEN];
+
+	switch (addr->sa_family) {
+	case AF_INET:
+		inet_ntop(AF_INET, &((struct sockaddr_in *)addr)->sin_addr,
+				str, sizeof(str));
+		snprintf(buffer, size, "%s#%u", str,
+				ntohs(((struct sockaddr_in *)addr)->sin_port));
+		return;
+	case AF_INET6:
+		inet_ntop(AF_INET6, &((struct sockaddr_in6 *)addr)->sin6_addr,
+				str, sizeof(str));
+		snprintf(buffer, size, "%s#%u", str,
+				ntohs(((struct sockaddr_in6 *)addr)->sin6_port));
+		return;
+	}
+
+	snprintf(buffer, size, "local peer");
+}
+
+static void listener_cb(struct evloop_handler *handler, unsigned int events)
+{
+	struct sockaddr_storage addr;
+	socklen_t addrlen;
+	char name[INET6_ADDRSTRLEN + 8];
+	struct stream_peer *peer;
+	int fd;
+
+	do {
+		addrlen = sizeof(addr);
+		fd = accept4(listener, (struct sockaddr *)&addr, &addrlen,
+				SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (fd < 0) {
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+				pr_perror("accept() failed", errno);
+			return;
+		}
+
+		print_addr((struct sockaddr *)&addr, name, sizeof(name));
+		peer = peer_create(fd, name, NULL, false);
+		if (peer)
+			peer_established(peer);
+	} while (true);
+}
+
+static int json_to_sockaddr_un(char *path, struct sockaddr_storage *addr,
+		socklen_t *addrlen)
+{
+	struct sockaddr_un *un = (struct sockaddr_un *)addr;
+
+	if (strlen(path) >= sizeof(un->sun_path)) {
+		syslog(LOG_ERR, "Socket path '%s' is too long.", path);
+		return 1;
+	}
+
+	memset(addr, 0, sizeof(*addr));
+	un->sun_family = AF_UNIX;
+	strcpy(un->sun_path, path);
+	*addrlen = sizeof(*un);
+	return 0;
+}
+
+static int parse_remote(cJSON *json, struct stream_remote *remote)
+{
+	struct addrinfo hints = { 0 };
+	struct addrinfo *info;
+	cJSON *addr, *port;
+	int err;
+
+	if (is_local) {
+		addr = cJSON_GetObjectItem(json, "path");
+		if (!addr) {
+			syslog(LOG_ERR, "Peer lacks a 'path'.");
+			return 1;
+		}
+		snprintf(remote->name, sizeof(remote->name), "%s",
+				addr->valuestring);
+		return json_to_sockaddr_un(addr->valuestring, &remote->addr,
+				&remote->addrlen);
+	}
+
+	addr = cJSON_GetObjectItem(json, "address");
+	port = cJSON_GetObjectItem(json, "port");
+	if (!addr || !port) {
+		syslog(LOG_ERR, "Peers need an 'address' and a 'port'.");
+		return 1;
+	}
+
+	hints.ai_socktype = SOCK_STREAM;
+	err = getaddrinfo(addr->valuestring, port->valuestring, &hints, &info);
+	if (err) {
+		syslog(LOG_ERR, "getaddrinfo() failed: %s", gai_strerror(err));
+		return err;
+	}
+
+	memcpy(&remote->addr, info->ai_addr, info->ai_addrlen);
+	remote->addrlen = info->ai_addrlen;
+	snprintf(remote->name, sizeof(remote->name), "%s#%s",
+			addr->valuestring, port->valuestring);
+
+	freeaddrinfo(info);
+	return 0;
+}
+
+static int parse_remotes(cJSON *json)
+{
+	cJSON *child;
+	unsigned int i;
+	int error;
+
+	json = cJSON_GetObjectItem(json, "peers");
+	if (!json)
+		return 0;
+	if (json->type != cJSON_Array) {
+		syslog(LOG_ERR, "'peers' is supposed to be an array.");
+		return 1;
+	}
+
+	remote_count = cJSON_GetArraySize(json);
+	remotes = calloc(remote_count, sizeof(struct stream_remote));
+	if (remote_count && !remotes) {
+		syslog(LOG_ERR, "Out of memory.");
+		return -ENOMEM;
+	}
+
+	i = 0;
+	for (child = json->child; child; child = child->next) {
+		error = parse_remote(child, &remotes[i++]);
+		if (error)
+			return error;
+	}
+
+	return 0;
+}
+
+static int try_listen(int family, struct sockaddr *addr, socklen_t addrlen)
+{
+	int yes = 1;
+
+	listener = socket(family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+			0);
+	if (listener < 0) {
+		pr_perror("socket() failed", errno);
+		return 1;
+	}
+
+	if (family != AF_UNIX && setsockopt(listener, SOL_SOCKET, SO_REUSEADDR,
+			&yes, sizeof(yes))) {
+		pr_perror("setsockopt(SO_REUSEADDR) failed", errno);
+		goto fail;
+	}
+	if (bind(listener, addr, addrlen)) {
+		pr_perror("bind() failed", errno);
+		goto fail;
+	}
+	if (listen(listener, SOMAXCONN)) {
+		pr_perror("listen() failed", errno);
+		goto fail;
+	}
+
+	return 0;
+
+fail:
+	close(listener);
+	listener = -1;
+	return 1;
+}
+
+static int create_listener(cJSON *json)
+{
+	struct addrinfo hints = { 0 };
+	struct addrinfo *candidates, *candidate;
+	struct sockaddr_storage addr;
+	socklen_t addrlen;
+	cJSON *child, *port;
+	int error;
+
+	if (is_local) {
+		child = cJSON_GetObjectItem(json, "listen path");
+		if (!child)
+			return 0;
+
+		error = json_to_sockaddr_un(child->valuestring, &addr, &addrlen);
+		if (error)
+			return error;
+		/* Probably a leftover from a previous run. */
+		unlink(child->valuestring);
+		error = try_listen(AF_UNIX, (struct sockaddr *)&addr, addrlen);
+		if (error)
+			return error;
+
+		listen_path = strdup(child->valuestring);
+		goto success;
+	}
+
+	port = cJSON_GetObjectItem(json, "listen port");
+	if (!port)
+		return 0;
+	child = cJSON_GetObjectItem(json, "listen address");
+
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_PASSIVE;
+	error = getaddrinfo(child ? child->valuestring : NULL,
+			port->valuestring, &hints, &candidates);
+	if (error) {
+		syslog(LOG_ERR, "getaddrinfo() failed: %s", gai_strerror(error));
+		return error;
+	}
+
+	error = 1;
+	for (candidate = candidates; candidate; candidate = candidate->ai_next) {
+		syslog(LOG_INFO, "Trying an address candidate...");
+		error = try_listen(candidate->ai_family, candidate->ai_addr,
+				candidate->ai_addrlen);
+		if (!error)
+			break;
+	}
+
+	freeaddrinfo(candidates);
+	if (error) {
+		syslog(LOG_ERR, "None of the candidates yielded a valid socket.");
+		return error;
+	}
+	/* Fall through. */
+
+success:
+	listener_handler.cb = listener_cb;
+	error = evloop_add(listener, EPOLLIN, &listener_handler);
+	if (error)
+		return error;
+
+	syslog(LOG_INFO, "Waiting for peers to connect.");
+	return 0;
+}
+
+static int create_timer(void)
+{
+	struct itimerspec interval = { 0 };
+	unsigned int i;
+
+	if (!remote_count)
+		return 0;
+
+	timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (timer < 0) {
+		pr_perror("timerfd_create() failed", errno);
+		return 1;
+	}
+
+	interval.it_value.tv_sec = STREAM_RECONNECT_INTERVAL;
+	interval.it_interval.tv_sec = STREAM_RECONNECT_INTERVAL;
+	if (timerfd_settime(timer, 0, &interval, NULL)) {
+		pr_perror("timerfd_settime() failed", errno);
+		return 1;
+	}
+
+	timer_handler.cb = timer_cb;
+	if (evloop_add(timer, EPOLLIN, &timer_handler))
+		return 1;
+
+	/* Don't wait for the first tick. */
+	for (i = 0; i < remote_count; i++)
+		remote_connect(&remotes[i]);
+	return 0;
+}
+
+/*
+ * @json is the network socket's configuration.
+ * @local selects UNIX sockets. (Otherwise, TCP.)
+ */
+int stream_setup(cJSON *json, bool local)
+{
+	int error;
+
+	is_local = local;
+
+	error = parse_remotes(json);
+	if (error)
+		goto fail;
+	error = create_listener(json);
+	if (error)
+		goto fail;
+	if (listener < 0 && !remote_count) {
+		syslog(LOG_ERR, "I have neither a listening socket nor peers to connect to.");
+		error = 1;
+		goto fail;
+	}
+	error = create_timer();
+	if (error)
+		goto fail;
+
+	return 0;
+
+fail:
+	stream_teardown();
+	return error;
+}
+
+void stream_teardown(void)
+{
+	while (peers)
+		peer_close(peers);
+
+	if (timer >= 0) {
+		close(timer);
+		timer = -1;
+	}
+	if (listener >= 0) {
+		close(listener);
+		listener = -1;
+	}
+	if (listen_path) {
+		unlink(listen_path);
+		free(listen_path);
+		listen_path = NULL;
+	}
+
+	free(remotes);
+	remotes = NULL;
+	remote_count = 0;
+}
+
+/*
+ * Queues @buffer for every connected peer.
+ * It will actually be sent once the peers' sockets are ready to take it.
+ */
+void stream_send(void *buffer, size_t size)
+{
+	struct stream_peer *peer;
+
+	for (peer = peers; peer; peer = peer->next)
+		if (!peer->connecting)
+			frame_append(peer, buffer, size);
+}
+
+/* Asks the event loop to write whatever stream_send() queued. */
+void stream_flush(void)
+{
+	struct stream_peer *peer;
+
+	for (peer = peers; peer; peer = peer->next)
+		update_events(peer);
+}
@@ -0,0 +1,28 @@
+#ifndef SRC_USR_JOOLD_STREAM_H_
+#define SRC_USR_JOOLD_STREAM_H_
+
+/**
+ * The stream flavor of the network socket. (See netsocket.h.)
+ *
+ * Instead of multicasting datagrams, joold keeps a stream connection (TCP or
+ * UNIX) with every peer. The sessions travel in length-prefixed frames.
+ *
+ * Every new connection starts with a dump of the local session table (the
+ * "snapshot"), after which the regular session updates (the "deltas") follow
+ * in the same stream. The snapshot is read from the kernel one page at a time,
+ * and only while the connection keeps up, so a slow peer does not make joold
+ * buffer the entire table. If a peer stops reading altogether, it is
+ * disconnected, and will get a new snapshot once it comes back.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "usr/util/cJSON.h"
+
+int stream_setup(cJSON *json, bool local);
+void stream_teardown(void);
+
+void stream_send(void *buffer, size_t size);
+void stream_flush(void);
+
+#endif /* SRC_USR_JOOLD_STREAM_H_ */
@@ -184,6 +184,23 @@ struct jool_result nla_get_taddr4(struct nlattr *root, struct ipv4_transport_add
 	return result_success();
 }
 
+struct jool_result nla_get_instance(struct nlattr *root,
+		struct instance_entry_usr *out)
+{
+	struct nlattr *attrs[JNLAIE_COUNT];
+	struct jool_result result;
+
+	result = jnla_parse_nested(attrs, JNLAIE_MAX, root,
+			joolnl_instance_entry_policy);
+	if (result.error)
+		return result;
+
+	out->ns = nla_get_u32(attrs[JNLAIE_NS]);
+	out->xf = nla_get_u8(attrs[JNLAIE_XF]);
+	strcpy(out->iname, nla_get_string(attrs[JNLAIE_INAME]));
+	return result_success();
+}
+
 struct jool_result nla_get_eam(struct nlattr *root, struct eamt_entry *out)
 {
 	struct nlattr *attrs[JNLAE_COUNT];
@@ -218,6 +235,21 @@ struct jool_result nla_get_pool4(struct nlattr *root, struct pool4_entry *out)
 	return nla_get_prefix4(attrs[JNLAP4_PREFIX], &out->range.prefix);
 }
 
+struct jool_result nla_get_pool4_usage(struct nlattr *root,
+		struct pool4_usage *out)
+{
+	struct nlattr *attrs[JNLAPU_COUNT];
+	struct jool_result result;
+
+	result = jnla_parse_nested(attrs, JNLAPU_MAX, root, joolnl_pool4_usage_policy);
+	if (result.error)
+		return result;
+
+	out->in_use = nla_get_u32(attrs[JNLAPU_IN_USE]);
+	out->exhaustions = nla_get_u32(attrs[JNLAPU_EXHAUSTIONS]);
+	return nla_get_pool4(attrs[JNLAPU_ENTRY], &out->entry);
+}
+
 struct jool_result nla_get_bib(struct nlattr *root, struct bib_entry *out)
 {
 	struct nlattr *attrs[JNLAB_COUNT];
@@ -265,6 +297,51 @@ struct jool_result nla_get_session(struct nlattr *root, struct session_entry_usr
 	return result_success();
 }
 
+struct jool_result nla_get_query_result(struct nlattr *root,
+		struct bib_query_result *out)
+{
+	struct nlattr *attrs[JNLAQR_COUNT];
+	struct nlattr *tops[JNLAQT_COUNT];
+	struct nlattr *attr;
+	int rem;
+	struct jool_result result;
+
+	result = jnla_parse_nested(attrs, JNLAQR_MAX, root, joolnl_query_result_policy);
+	if (result.error)
+		return result;
+
+	memset(out, 0, sizeof(*out));
+	if (attrs[JNLAQR_MATCHES])
+		out->matches = nla_get_u32(attrs[JNLAQR_MATCHES]);
+	if (attrs[JNLAQR_SUBSCRIBERS])
+		out->subscribers = nla_get_u32(attrs[JNLAQR_SUBSCRIBERS]);
+	if (!attrs[JNLAQR_TOP])
+		return result_success();
+
+	result = jnla_validate_list(nla_data(attrs[JNLAQR_TOP]),
+			nla_len(attrs[JNLAQR_TOP]), "top subscriber",
+			joolnl_struct_list_policy);
+	if (result.error)
+		return result;
+
+	nla_for_each_nested(attr, attrs[JNLAQR_TOP], rem) {
+		if (out->top_count >= BIB_QUERY_MAX_TOP)
+			break;
+
+		result = jnla_parse_nested(tops, JNLAQT_MAX, attr, joolnl_query_top_policy);
+		if (result.error)
+			return result;
+		result = nla_get_prefix6(tops[JNLAQT_SUBSCRIBER],
+				&out->top[out->top_count].subscriber);
+		if (result.error)
+			return result;
+		out->top[out->top_count].matches = nla_get_u32(tops[JNLAQT_MATCHES]);
+		out->top_count++;
+	}
+
+	return result_success();
+}
+
 struct jool_result nla_get_plateaus(struct nlattr *root,
 		struct mtu_plateaus *out)
 {
@@ -522,3 +599,39 @@ nla_put_failure:
 	nla_nest_cancel(msg, root);
 	return -NLE_NOMEM;
 }
+
+int nla_put_query(struct nl_msg *msg, int attrtype, struct bib_query const *query)
+{
+	struct nlattr *root;
+
+	root = nla_nest_start(msg, attrtype);
+	if (!root)
+		return -NLE_NOMEM;
+
+	if (query->src6.set && nla_put_prefix6(msg, JNLAQ_SRC6, &query->src6.prefix) < 0)
+		goto nla_put_failure;
+	if (query->src4_set) {
+		if (nla_put_prefix4(msg, JNLAQ_SRC4, &query->src4.prefix) < 0)
+			goto nla_put_failure;
+		NLA_PUT_U16(msg, JNLAQ_SRC4_PORT_MIN, query->src4.ports.min);
+		NLA_PUT_U16(msg, JNLAQ_SRC4_PORT_MAX, query->src4.ports.max);
+	}
+	if (query->dst4.set && nla_put_prefix4(msg, JNLAQ_DST4, &query->dst4.prefix) < 0)
+		goto nla_put_failure;
+	if (query->state_set)
+		NLA_PUT_U8(msg, JNLAQ_STATE, query->state);
+	if (query->min_idle)
+		NLA_PUT_U32(msg, JNLAQ_MIN_IDLE, query->min_idle);
+	NLA_PUT_U8(msg, JNLAQ_MODE, query->mode);
+	if (query->mode == BQM_TOP) {
+		NLA_PUT_U32(msg, JNLAQ_TOP, query->top);
+		NLA_PUT_U8(msg, JNLAQ_SUBSCRIBER_LEN, query->subscriber_len);
+	}
+
+	nla_nest_end(msg, root);
+	return 0;
+
+nla_put_failure:
+	nla_nest_cancel(msg, root);
+	return -NLE_NOMEM;
+}
@@ -28,11 +28,14 @@ struct jool_result nla_get_prefix6(struct nlattr *attr, struct ipv6_prefix *out)
 struct jool_result nla_get_prefix4(struct nlattr *attr, struct ipv4_prefix *out);
 struct jool_result nla_get_taddr6(struct nlattr *attr, struct ipv6_transport_addr *out);
 struct jool_result nla_get_taddr4(struct nlattr *attr, struct ipv4_transport_addr *out);
+struct jool_result nla_get_instance(struct nlattr *attr, struct instance_entry_usr *out);
 struct jool_result nla_get_eam(struct nlattr *attr, struct eamt_entry *out);
 struct jool_result nla_get_pool4(struct nlattr *attr, struct pool4_entry *out);
+struct jool_result nla_get_pool4_usage(struct nlattr *attr, struct pool4_usage *out);
 struct jool_result nla_get_bib(struct nlattr *attr, struct bib_entry *out);
 struct jool_result nla_get_session(struct nlattr *attr, struct session_entry_usr *out);
 struct jool_result nla_get_plateaus(struct nlattr *attr, struct mtu_plateaus *out);
+struct jool_result nla_get_query_result(struct nlattr *attr, struct bib_query_result *out);
 
 /*
  * Implementation notes:
@@ -70,5 +73,6 @@ int nla_put_bib_attrs(struct nl_msg *msg, int attrtype,
 		l4_protocol proto,
 		bool is_static);
 int nla_put_session(struct nl_msg *msg, int attrtype, struct session_entry_usr const *entry);
+int nla_put_query(struct nl_msg *msg, int attrtype, struct bib_query const *query);
 
 #endif /* SRC_USR_NL_ATTRIBUTE_H_ */
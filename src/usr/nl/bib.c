@@ -8,8 +8,6 @@
 struct foreach_args {
 	joolnl_bib_foreach_cb cb;
 	void *args;
-	bool done;
-	struct bib_entry last;
 };
 
 static struct jool_result handle_foreach_response(struct nl_msg *response,
@@ -19,9 +17,10 @@ static struct jool_result handle_foreach_response(struct nl_msg *response,
 	struct nlattr *attr;
 	int rem;
 	struct bib_entry entry;
+	bool done; /* Unused; dumps end with NLMSG_DONE instead. */
 	struct jool_result result;
 
-	result = joolnl_init_foreach_list(response, "bib", &args->done);
+	result = joolnl_init_foreach_list(response, "bib", &done);
 	if (result.error)
 		return result;
 
@@ -33,53 +32,51 @@ static struct jool_result handle_foreach_response(struct nl_msg *response,
 		result = args->cb(&entry, args->args);
 		if (result.error)
 			return result;
-
-		memcpy(&args->last, &entry, sizeof(entry));
 	}
 
 	return result_success();
 }
 
+/**
+ * @query is optional. If present, only the entries that match its filters will
+ * be handed to @cb. (Its mode is ignored.)
+ */
 struct jool_result joolnl_bib_foreach(struct joolnl_socket *sk, char const *iname,
-	l4_protocol proto, joolnl_bib_foreach_cb cb, void *_args)
+	l4_protocol proto, struct bib_query const *query,
+	joolnl_bib_foreach_cb cb, void *_args)
 {
 	struct nl_msg *msg;
 	struct foreach_args args;
 	struct jool_result result;
-	bool first_request;
 
 	args.cb = cb;
 	args.args = _args;
-	args.done = true;
-	memset(&args.last, 0, sizeof(args.last));
-	first_request = true;
 
-	do {
-		result = joolnl_alloc_msg(sk, iname, JNLOP_BIB_FOREACH, 0, &msg);
-		if (result.error)
-			return result;
+	result = joolnl_alloc_msg(sk, iname, JNLOP_BIB_FOREACH, 0, &msg);
+	if (result.error)
+		return result;
 
-		if (first_request) {
-			if (nla_put_u8(msg, JNLAR_PROTO, proto) < 0)
-				goto cancel;
-			first_request = false;
+	if (nla_put_u8(msg, JNLAR_PROTO, proto) < 0)
+		goto cancel;
+	if (query && nla_put_query(msg, JNLAR_QUERY, query) < 0)
+		goto cancel;
 
-		} else if (nla_put_bib(msg, JNLAR_OFFSET, &args.last) < 0) {
-			goto cancel;
-		}
-
-		result = joolnl_request(sk, msg, handle_foreach_response, &args);
-		if (result.error)
-			return result;
-	} while (!args.done);
-
-	return result_success();
+	return joolnl_dump(sk, msg, handle_foreach_response, &args);
 
 cancel:
 	nlmsg_free(msg);
 	return joolnl_err_msgsize();
 }
 
+/** Counts (or ranks by subscriber) the BIB entries that match @query. */
+struct jool_result joolnl_bib_query(struct joolnl_socket *sk,
+		char const *iname, l4_protocol proto,
+		struct bib_query const *query, struct bib_query_result *result)
+{
+	return joolnl_query_table(sk, iname, JNLOP_BIB_QUERY, proto, query,
+			result);
+}
+
 static struct jool_result __update(struct joolnl_socket *sk, char const *iname,
 		enum joolnl_operation op,
 		struct ipv6_transport_addr const *a6,
@@ -12,10 +12,19 @@ struct jool_result joolnl_bib_foreach(
 	struct joolnl_socket *sk,
 	char const *iname,
 	l4_protocol proto,
+	struct bib_query const *query,
 	joolnl_bib_foreach_cb cb,
 	void *args
 );
 
+struct jool_result joolnl_bib_query(
+	struct joolnl_socket *sk,
+	char const *iname,
+	l4_protocol proto,
+	struct bib_query const *query,
+	struct bib_query_result *result
+);
+
 struct jool_result joolnl_bib_add(
 	struct joolnl_socket *sk,
 	char const *iname,
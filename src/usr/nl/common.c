@@ -1,7 +1,10 @@
 #include "usr/nl/common.h"
 
+#include <errno.h>
+#include <string.h>
 #include <netlink/errno.h>
 #include <netlink/msg.h>
+#include <netlink/genl/ctrl.h>
 #include <netlink/genl/genl.h>
 #include "common/config.h"
 #include "usr/nl/attribute.h"
@@ -53,3 +56,123 @@ struct jool_result joolnl_init_foreach_list(struct nl_msg *msg,
 		joolnl_struct_list_policy
 	);
 }
+
+static struct jool_result handle_query_response(struct nl_msg *response,
+		void *arg)
+{
+	static struct nla_policy query_policy[JNLAR_COUNT] = {
+		[JNLAR_QUERY_RESULT] = { .type = NLA_NESTED },
+	};
+	struct nlattr *attrs[JNLAR_COUNT];
+	struct jool_result result;
+
+	result = jnla_parse_msg(response, attrs, JNLAR_MAX, query_policy, false);
+	if (result.error)
+		return result;
+	if (!attrs[JNLAR_QUERY_RESULT]) {
+		return result_from_error(
+			-EINVAL,
+			"The kernel module's response lacks the query result."
+		);
+	}
+
+	return nla_get_query_result(attrs[JNLAR_QUERY_RESULT], arg);
+}
+
+/*
+ * Sends a BQM_COUNT or BQM_TOP @query to the BIB (@op = JNLOP_BIB_QUERY) or
+ * session table (@op = JNLOP_SESSION_QUERY).
+ */
+struct jool_result joolnl_query_table(struct joolnl_socket *sk,
+		char const *iname, enum joolnl_operation op, l4_protocol proto,
+		struct bib_query const *query, struct bib_query_result *result)
+{
+	struct nl_msg *msg;
+	struct jool_result jresult;
+
+	jresult = joolnl_alloc_msg(sk, iname, op, 0, &msg);
+	if (jresult.error)
+		return jresult;
+
+	if (nla_put_u8(msg, JNLAR_PROTO, proto) < 0
+			|| nla_put_query(msg, JNLAR_QUERY, query) < 0) {
+		nlmsg_free(msg);
+		return joolnl_err_msgsize();
+	}
+
+	return joolnl_request(sk, msg, handle_query_response, result);
+}
+
+/**
+ * Returns @msg's Generic Netlink header, if @msg is a valid multicast from
+ * instance @iname. Returns NULL otherwise.
+ *
+ * (Every instance of the namespace multicasts to the same groups.)
+ */
+struct genlmsghdr *joolnl_follow_hdr(struct nl_msg *msg, char const *iname)
+{
+	struct nlmsghdr *nhdr;
+	struct genlmsghdr *ghdr;
+	struct joolnlhdr *jhdr;
+
+	nhdr = nlmsg_hdr(msg);
+	if (!genlmsg_valid_hdr(nhdr, sizeof(struct joolnlhdr)))
+		return NULL;
+	ghdr = genlmsg_hdr(nhdr);
+	jhdr = genlmsg_user_hdr(ghdr);
+
+	return (strncmp(jhdr->iname, iname, INAME_MAX_SIZE) == 0) ? ghdr : NULL;
+}
+
+/**
+ * Joins the @group multicast group, and hands every message it receives to
+ * @cb. @what names the stream, for error messages.
+ *
+ * Only returns on error. If @cb wants to stop, it should store its error in
+ * @cb_result and return NL_STOP.
+ */
+struct jool_result joolnl_follow(struct joolnl_socket *sk, char const *group,
+		char const *what, int rcvbuf, nl_recvmsg_msg_cb_t cb, void *args,
+		struct jool_result *cb_result)
+{
+	int id;
+	int error;
+
+	*cb_result = result_success();
+
+	id = genl_ctrl_resolve_grp(sk->sk, JOOLNL_FAMILY, group);
+	if (id < 0) {
+		return result_from_error(id,
+				"Cannot resolve the %s multicast group: %s",
+				what, nl_geterror(id));
+	}
+
+	error = nl_socket_add_membership(sk->sk, id);
+	if (error) {
+		return result_from_error(error,
+				"Cannot join the %s multicast group: %s",
+				what, nl_geterror(error));
+	}
+
+	/* Multicasts don't follow our sequence numbers. */
+	nl_socket_disable_seq_check(sk->sk);
+	error = nl_socket_modify_cb(sk->sk, NL_CB_VALID, NL_CB_CUSTOM, cb,
+			args);
+	if (error) {
+		return result_from_error(error,
+				"Cannot register the Netlink callback: %s",
+				nl_geterror(error));
+	}
+	/* Not fatal; we'll just lose more messages if we fall behind. */
+	nl_socket_set_buffer_size(sk->sk, rcvbuf, 0);
+
+	do {
+		error = nl_recvmsgs_default(sk->sk);
+		/* -NLE_NOMEM is a receive buffer overflow. Keep going. */
+	} while (!cb_result->error && (error >= 0 || error == -NLE_NOMEM));
+
+	if (cb_result->error)
+		return *cb_result;
+	return result_from_error(error, "Error receiving the %s: %s", what,
+			nl_geterror(error));
+}
@@ -2,6 +2,8 @@
 #define SRC_USR_NL_COMMON_H_
 
 #include <netlink/msg.h>
+#include "common/config.h"
+#include "usr/nl/core.h"
 #include "usr/util/result.h"
 
 struct jool_result joolnl_err_msgsize(void);
@@ -10,4 +12,13 @@ struct jool_result joolnl_init_foreach(struct nl_msg *response, bool *done);
 struct jool_result joolnl_init_foreach_list(struct nl_msg *msg,
 		char const *what, bool *done);
 
+struct jool_result joolnl_query_table(struct joolnl_socket *sk,
+		char const *iname, enum joolnl_operation op, l4_protocol proto,
+		struct bib_query const *query, struct bib_query_result *result);
+
+struct genlmsghdr *joolnl_follow_hdr(struct nl_msg *msg, char const *iname);
+struct jool_result joolnl_follow(struct joolnl_socket *sk, char const *group,
+		char const *what, int rcvbuf, nl_recvmsg_msg_cb_t cb, void *args,
+		struct jool_result *cb_result);
+
 #endif /* SRC_USR_NL_COMMON_H_ */
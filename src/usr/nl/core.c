@@ -32,6 +32,17 @@ struct response_cb {
 struct jool_result joolnl_alloc_msg(struct joolnl_socket *socket,
 		char const *iname, enum joolnl_operation op, __u8 flags,
 		struct nl_msg **out)
+{
+	return joolnl_alloc_msg_size(socket, iname, op, flags, 0, out);
+}
+
+/**
+ * Same as joolnl_alloc_msg(), except the message can hold @size bytes instead
+ * of libnl's default (one page). Zero means libnl's default.
+ */
+struct jool_result joolnl_alloc_msg_size(struct joolnl_socket *socket,
+		char const *iname, enum joolnl_operation op, __u8 flags,
+		size_t size, struct nl_msg **out)
 {
 	struct nl_msg *msg;
 	struct joolnlhdr *hdr;
@@ -41,7 +52,7 @@ struct jool_result joolnl_alloc_msg(struct joolnl_socket *socket,
 	if (error)
 		return result_from_error(error, INAME_VALIDATE_ERRMSG);
 
-	msg = nlmsg_alloc();
+	msg = size ? nlmsg_alloc_size(size) : nlmsg_alloc();
 	if (!msg)
 		return result_from_enomem();
 
@@ -141,6 +152,26 @@ end:
  */
 struct jool_result joolnl_request(struct joolnl_socket *socket,
 		struct nl_msg *msg, joolnl_response_cb cb, void *cb_arg)
+{
+	struct jool_result result;
+
+	result = joolnl_send(socket, msg);
+	if (result.error)
+		return result;
+
+	return joolnl_receive(socket, cb, cb_arg);
+}
+
+/**
+ * Waits for the response to the oldest request (sent through joolnl_send())
+ * that hasn't been answered yet, and hands it over to @cb.
+ *
+ * The kernel module answers requests in order, so several of them can be sent
+ * before the first response is read. (Mind the socket's receive buffer,
+ * though.)
+ */
+struct jool_result joolnl_receive(struct joolnl_socket *socket,
+		joolnl_response_cb cb, void *cb_arg)
 {
 	struct response_cb callback;
 	int error;
@@ -153,7 +184,6 @@ struct jool_result joolnl_request(struct joolnl_socket *socket,
 	error = nl_socket_modify_cb(socket->sk, NL_CB_MSG_IN, NL_CB_CUSTOM,
 			response_handler, &callback);
 	if (error < 0) {
-		nlmsg_free(msg);
 		return result_from_error(
 			error,
 			"Could not register response handler: %s\n",
@@ -161,30 +191,125 @@ struct jool_result joolnl_request(struct joolnl_socket *socket,
 		);
 	}
 
+	error = nl_recvmsgs_default(socket->sk);
+	if (error < 0) {
+		if ((callback.result.flags & JRF_INITIALIZED)
+				&& callback.result.error) {
+			/* nl_recvmsgs_default() failed during our callback */
+			return callback.result;
+		}
+
+		/* nl_recvmsgs_default() failed before or after our callback */
+		return result_from_error(
+			error,
+			"Error receiving the kernel module's response: %s",
+			nl_geterror(error)
+		);
+	}
+
+	return result_success();
+}
+
+/**
+ * Like joolnl_request(), except the request is a dump (NLM_F_DUMP): The kernel
+ * module answers with as many messages as it needs, and @cb is called once for
+ * each of them.
+ *
+ * Consumes @msg, even on error.
+ */
+struct jool_result joolnl_dump(struct joolnl_socket *socket,
+		struct nl_msg *msg, joolnl_response_cb cb, void *cb_arg)
+{
+	struct response_cb callback;
+	struct nl_cb *sk_cb, *dump_cb;
+	struct jool_result result;
+	int error;
+
+	callback.cb = cb;
+	callback.arg = cb_arg;
+	memset(&callback.result, 0, sizeof(callback.result));
+
+	/*
+	 * Work on a copy so the socket's own callbacks (see joolnl_request())
+	 * don't see the dump. Also, NLMSG_DONE is not a Jool response, so
+	 * only the data messages (NL_CB_VALID) are handed to @cb.
+	 */
+	sk_cb = nl_socket_get_cb(socket->sk);
+	dump_cb = nl_cb_clone(sk_cb);
+	nl_cb_put(sk_cb);
+	if (!dump_cb) {
+		nlmsg_free(msg);
+		return result_from_enomem();
+	}
+	nl_cb_set(dump_cb, NL_CB_MSG_IN, NL_CB_DEFAULT, NULL, NULL);
+	error = nl_cb_set(dump_cb, NL_CB_VALID, NL_CB_CUSTOM, response_handler,
+			&callback);
+	if (error < 0) {
+		nlmsg_free(msg);
+		result = result_from_error(
+			error,
+			"Could not register response handler: %s\n",
+			nl_geterror(error)
+		);
+		goto end;
+	}
+
+	nlmsg_hdr(msg)->nlmsg_flags |= NLM_F_DUMP;
 	error = nl_send_auto(socket->sk, msg);
 	nlmsg_free(msg);
 	if (error < 0) {
-		return result_from_error(
+		result = result_from_error(
 			error,
 			"Could not dispatch the request to kernelspace: %s",
 			nl_geterror(error)
 		);
+		goto end;
 	}
 
-	error = nl_recvmsgs_default(socket->sk);
+	error = nl_recvmsgs(socket->sk, dump_cb);
 	if (error < 0) {
 		if ((callback.result.flags & JRF_INITIALIZED)
 				&& callback.result.error) {
-			/* nl_recvmsgs_default() failed during our callback */
-			return callback.result;
+			result = callback.result;
+			goto end;
 		}
 
-		/* nl_recvmsgs_default() failed before or after our callback */
-		return result_from_error(
+		result = result_from_error(
 			error,
 			"Error receiving the kernel module's response: %s",
 			nl_geterror(error)
 		);
+		goto end;
+	}
+
+	result = result_success();
+	/* Fall through. */
+
+end:
+	nl_cb_put(dump_cb);
+	return result;
+}
+
+/*
+ * Like joolnl_request(), except it doesn't wait for the response.
+ * Meant for requests the kernel module only answers when they fail, in which
+ * case the caller is expected to pick up the error from @socket on its own,
+ * and for pipelining. (See joolnl_receive().)
+ *
+ * Consumes @msg, even on error.
+ */
+struct jool_result joolnl_send(struct joolnl_socket *socket, struct nl_msg *msg)
+{
+	int error;
+
+	error = nl_send_auto(socket->sk, msg);
+	nlmsg_free(msg);
+	if (error < 0) {
+		return result_from_error(
+			error,
+			"Could not dispatch the request to kernelspace: %s",
+			nl_geterror(error)
+		);
 	}
 
 	return result_success();
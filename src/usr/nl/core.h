@@ -17,10 +17,18 @@ void joolnl_teardown(struct joolnl_socket *socket);
 struct jool_result joolnl_alloc_msg(struct joolnl_socket *socket,
 		char const *iname, enum joolnl_operation op, __u8 flags,
 		struct nl_msg **out);
+struct jool_result joolnl_alloc_msg_size(struct joolnl_socket *socket,
+		char const *iname, enum joolnl_operation op, __u8 flags,
+		size_t size, struct nl_msg **out);
 
 typedef struct jool_result (*joolnl_response_cb)(struct nl_msg *, void *);
 struct jool_result joolnl_request(struct joolnl_socket *sk, struct nl_msg *msg,
 		joolnl_response_cb cb, void *cb_arg);
+struct jool_result joolnl_dump(struct joolnl_socket *sk, struct nl_msg *msg,
+		joolnl_response_cb cb, void *cb_arg);
+struct jool_result joolnl_send(struct joolnl_socket *sk, struct nl_msg *msg);
+struct jool_result joolnl_receive(struct joolnl_socket *sk,
+		joolnl_response_cb cb, void *cb_arg);
 
 struct jool_result joolnl_msg2result(struct nl_msg *response);
 
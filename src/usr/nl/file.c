@@ -21,13 +21,32 @@
 #define OPTNAME_BLACKLIST		"blacklist4"
 #define OPTNAME_POOL4			"pool4"
 #define OPTNAME_BIB			"bib"
+#define OPTNAME_REMOVE			"remove"
 #define OPTNAME_MAX_ITERATIONS		"max-iterations"
 
+/*
+ * Table entries are packed into messages this big. (libnl's default is one
+ * page, which only fits a few dozen BIB entries.)
+ */
+#define BULK_MSG_SIZE (64 * 1024)
+/* Maximum number of requests sent before the oldest response is read. */
+#define MAX_IN_FLIGHT 8
+/*
+ * Socket buffer sizes we ask for. The send buffer needs to fit one bulk
+ * message, the receive buffer needs to fit MAX_IN_FLIGHT responses.
+ * (The kernel caps them at net.core.[rw]mem_max.)
+ */
+#define BULK_SOCKBUF_SIZE (4 * BULK_MSG_SIZE)
+
 /* TODO (warning) These variables prevent this module from being thread-safe. */
 static struct joolnl_socket sk;
 static char const *iname;
+static char iname_buffer[INAME_MAX_SIZE];
 static xlator_flags flags;
 static __u8 force;
+static bool delta;
+/* Requests whose responses haven't been read yet. */
+static unsigned int in_flight;
 
 struct json_meta {
 	char const *name; /* This being NULL signals the end of the array. */
@@ -37,6 +56,12 @@ struct json_meta {
 	void *arg2;
 	bool mandatory;
 	bool already_found;
+	/*
+	 * If not NULL, the tag is walked by stream_object(), and this takes
+	 * care of it instead of @handler. It receives the cursor, @arg1 and
+	 * @arg2. (See json_foreach_member().)
+	 */
+	struct jool_result (*stream)(char const **, void const *, void *);
 };
 
 /*
@@ -126,62 +151,211 @@ static struct jool_result handle_object(cJSON *obj, struct json_meta *metadata)
 	return result_success();
 }
 
-static struct jool_result handle_array(cJSON *json, int attrtype, char *name,
-		struct jool_result (*entry_handler)(cJSON *, struct nl_msg *))
+/*
+ * ==================================
+ * ========== Stream handlers =======
+ * ==================================
+ */
+
+static struct jool_result stream_member(char const *key, char const **cursor,
+		void *arg)
+{
+	struct json_meta *meta;
+	cJSON *json;
+	struct jool_result result;
+
+	if (strcasecmp(key, "comment") == 0)
+		return json_skip_value(cursor);
+
+	for (meta = arg; meta->name; meta++) {
+		if (strcasecmp(key, meta->name) != 0)
+			continue;
+
+		if (meta->already_found)
+			return duplicates_found(meta->name);
+		meta->already_found = true;
+
+		if (meta->stream)
+			return meta->stream(cursor, meta->arg1, meta->arg2);
+
+		result = json_parse_member(cursor, key, &json);
+		if (result.error)
+			return result;
+		result = meta->handler(json, meta->arg1, meta->arg2);
+		cJSON_Delete(json);
+		return result;
+	}
+
+	return result_from_error(-EINVAL, "Unknown tag: '%s'", key);
+}
+
+/*
+ * Same as handle_object(), except the object is walked in text form, and only
+ * the members that don't have a @stream handler are parsed.
+ */
+static struct jool_result stream_object(char const **cursor, char const *name,
+		struct json_meta *metadata)
+{
+	struct json_meta *meta;
+	struct jool_result result;
+
+	result = json_foreach_member(cursor, name, stream_member, metadata);
+	if (result.error)
+		return result;
+
+	for (meta = metadata; meta->name; meta++)
+		if (meta->mandatory && !meta->already_found)
+			return missing_tag(name, meta->name);
+
+	return result_success();
+}
+
+static struct jool_result skip_tag(char const **cursor, void const *arg1,
+		void *arg2)
+{
+	return json_skip_value(cursor);
+}
+
+/*
+ * ==================================
+ * ============ Pipelining ==========
+ * ==================================
+ *
+ * The kernel module answers requests in order, so there's no need to wait for
+ * a response before sending the next request. (The transaction is rolled back
+ * as soon as one of them fails, so the ones that follow will fail too, and
+ * only the first error matters.)
+ */
+
+/* Reads the response to the oldest request in flight. */
+static struct jool_result receive_response(void)
 {
+	in_flight--;
+	return joolnl_receive(&sk, NULL, NULL);
+}
+
+/* Sends @msg. Only waits if there are too many requests in flight. */
+static struct jool_result send_request(struct nl_msg *msg)
+{
+	struct jool_result result;
+
+	if (in_flight >= MAX_IN_FLIGHT) {
+		result = receive_response();
+		if (result.error) {
+			nlmsg_free(msg);
+			return result;
+		}
+	}
+
+	result = joolnl_send(&sk, msg);
+	if (result.error)
+		return result;
+
+	in_flight++;
+	return result_success();
+}
+
+/* Waits for every request in flight. Returns the first error. */
+static struct jool_result receive_responses(void)
+{
+	struct jool_result result;
+
+	while (in_flight) {
+		result = receive_response();
+		if (result.error)
+			return result;
+	}
+
+	return result_success();
+}
+
+/*
+ * ==================================
+ * ========= Array handlers =========
+ * ==================================
+ */
+
+struct array_state {
+	int attrtype;
+	struct jool_result (*entry_handler)(cJSON *, struct nl_msg *);
+
+	/* The message being filled, and its entries. */
 	struct nl_msg *msg;
 	struct nlattr *root;
 	unsigned int entries_written;
+};
+
+static struct jool_result send_array_msg(struct array_state *state)
+{
+	struct nl_msg *msg = state->msg;
+
+	nla_nest_end(msg, state->root);
+
+	/* send_request() consumes @msg, even on error. */
+	state->msg = NULL;
+	state->root = NULL;
+	state->entries_written = 0;
+	return send_request(msg);
+}
+
+static struct jool_result add_array_entry(cJSON *json, void *arg)
+{
+	struct array_state *state = arg;
 	struct jool_result result;
 
-	if (json->type != cJSON_Array)
-		return type_mismatch(name, json, "Array");
-
-	msg = NULL;
-	entries_written = 0;
-	for (json = json->child; json; json = json->next) {
-		if (msg == NULL) {
-			result = joolnl_alloc_msg(&sk, iname, JNLOP_FILE_HANDLE,
-					force, &msg);
-			if (result.error)
-				return result;
-
-			root = nla_nest_start(msg, attrtype);
-			if (!root)
-				goto too_small;
-		}
+	if (state->msg == NULL) {
+		result = joolnl_alloc_msg_size(&sk, iname, JNLOP_FILE_HANDLE,
+				force, BULK_MSG_SIZE, &state->msg);
+		if (result.error)
+			return result;
 
-		result = entry_handler(json, msg);
-		if (result.error) {
-			if (result.error != -NLE_NOMEM)
-				return result;
-			result_cleanup(&result);
-
-			if (entries_written == 0)
-				goto too_small;
-
-			nla_nest_end(msg, root);
-			result = joolnl_request(&sk, msg, NULL, NULL);
-			if (result.error)
-				return result;
-
-			msg = NULL;
-			json = json->prev;
-			entries_written = 0;
-		} else {
-			entries_written++;
-		}
+		state->root = nla_nest_start(state->msg, state->attrtype);
+		if (!state->root)
+			return joolnl_err_msgsize();
 	}
 
-	if (entries_written == 0)
-		return result_success();
+	result = state->entry_handler(json, state->msg);
+	if (result.error != -NLE_NOMEM) {
+		if (!result.error)
+			state->entries_written++;
+		return result;
+	}
+	result_cleanup(&result);
 
-	nla_nest_end(msg, root);
-	return joolnl_request(&sk, msg, NULL, NULL);
+	if (state->entries_written == 0)
+		return joolnl_err_msgsize();
 
-too_small:
-	nlmsg_free(msg);
-	return joolnl_err_msgsize();
+	/* The message is full; send it, then retry on a new one. */
+	result = send_array_msg(state);
+	if (result.error)
+		return result;
+	return add_array_entry(json, arg);
+}
+
+/*
+ * Uploads the array @cursor points to, one message at a time. Only one entry
+ * is ever parsed at a time.
+ */
+static struct jool_result stream_array(char const **cursor, int attrtype,
+		char *name, struct jool_result (*entry_handler)(cJSON *, struct nl_msg *))
+{
+	struct array_state state;
+	struct jool_result result;
+
+	state.attrtype = attrtype;
+	state.entry_handler = entry_handler;
+	state.msg = NULL;
+	state.root = NULL;
+	state.entries_written = 0;
+
+	result = json_foreach_element(cursor, name, add_array_entry, &state);
+	if (result.error) {
+		if (state.msg)
+			nlmsg_free(state.msg);
+		return result;
+	}
+
+	return state.entries_written ? send_array_msg(&state) : result;
 }
 
 static struct jool_result write_global(struct cJSON *json, void const *meta,
@@ -242,7 +416,7 @@ static struct jool_result handle_global(cJSON *json)
 
 	nla_nest_end(msg, root);
 	free(meta);
-	return joolnl_request(&sk, msg, NULL, NULL);
+	return send_request(msg);
 
 revert_meta:
 	free(meta);
@@ -459,34 +633,74 @@ static struct jool_result handle_bib_entry(cJSON *json, struct nl_msg *msg)
  * ==========================================
  */
 
-static struct jool_result do_nothing(cJSON *json, void const *arg1, void *arg2)
+static struct jool_result handle_global_tag(cJSON *json, void const *arg1, void *arg2)
 {
-	return result_success();
+	return handle_global(json);
 }
 
-static struct jool_result handle_global_tag(cJSON *json, void const *arg1, void *arg2)
+static struct jool_result stream_eamt_tag(char const **cursor,
+		void const *arg1, void *arg2)
 {
-	return handle_global(json);
+	return stream_array(cursor, JNLAR_EAMT_ENTRIES, OPTNAME_EAMT, handle_eam_entry);
+}
+
+static struct jool_result stream_bl4_tag(char const **cursor,
+		void const *arg1, void *arg2)
+{
+	return stream_array(cursor, JNLAR_BL4_ENTRIES, OPTNAME_BLACKLIST, handle_blacklist_entry);
+}
+
+static struct jool_result stream_pool4_tag(char const **cursor,
+		void const *arg1, void *arg2)
+{
+	return stream_array(cursor, JNLAR_POOL4_ENTRIES, OPTNAME_POOL4, handle_pool4_entry);
+}
+
+static struct jool_result stream_bib_tag(char const **cursor,
+		void const *arg1, void *arg2)
+{
+	return stream_array(cursor, JNLAR_BIB_ENTRIES, OPTNAME_BIB, handle_bib_entry);
 }
 
-static struct jool_result handle_eamt_tag(cJSON *json, void const *arg1, void *arg2)
+static struct jool_result stream_eamt_rm_tag(char const **cursor,
+		void const *arg1, void *arg2)
 {
-	return handle_array(json, JNLAR_EAMT_ENTRIES, OPTNAME_EAMT, handle_eam_entry);
+	return stream_array(cursor, JNLAR_EAMT_RM_ENTRIES, OPTNAME_EAMT, handle_eam_entry);
 }
 
-static struct jool_result handle_bl4_tag(cJSON *json, void const *arg1, void *arg2)
+static struct jool_result stream_bl4_rm_tag(char const **cursor,
+		void const *arg1, void *arg2)
 {
-	return handle_array(json, JNLAR_BL4_ENTRIES, OPTNAME_BLACKLIST, handle_blacklist_entry);
+	return stream_array(cursor, JNLAR_BL4_RM_ENTRIES, OPTNAME_BLACKLIST, handle_blacklist_entry);
 }
 
-static struct jool_result handle_pool4_tag(cJSON *json, void const *arg1, void *arg2)
+static struct jool_result stream_pool4_rm_tag(char const **cursor,
+		void const *arg1, void *arg2)
 {
-	return handle_array(json, JNLAR_POOL4_ENTRIES, OPTNAME_POOL4, handle_pool4_entry);
+	return stream_array(cursor, JNLAR_POOL4_RM_ENTRIES, OPTNAME_POOL4, handle_pool4_entry);
+}
+
+static struct jool_result stream_siit_remove_tag(char const **cursor,
+		void const *arg1, void *arg2)
+{
+	struct json_meta meta[] = {
+		{ .name = OPTNAME_EAMT, .stream = stream_eamt_rm_tag },
+		{ .name = OPTNAME_BLACKLIST, .stream = stream_bl4_rm_tag },
+		{ NULL },
+	};
+
+	return stream_object(cursor, OPTNAME_REMOVE, meta);
 }
 
-static struct jool_result handle_bib_tag(cJSON *json, void const *arg1, void *arg2)
+static struct jool_result stream_nat64_remove_tag(char const **cursor,
+		void const *arg1, void *arg2)
 {
-	return handle_array(json, JNLAR_BIB_ENTRIES, OPTNAME_BIB, handle_bib_entry);
+	struct json_meta meta[] = {
+		{ .name = OPTNAME_POOL4, .stream = stream_pool4_rm_tag },
+		{ NULL },
+	};
+
+	return stream_object(cursor, OPTNAME_REMOVE, meta);
 }
 
 /*
@@ -495,34 +709,36 @@ static struct jool_result handle_bib_tag(cJSON *json, void const *arg1, void *ar
  * ==================================
  */
 
-static struct jool_result parse_siit_json(cJSON *json)
+static struct jool_result parse_siit_json(char const **cursor)
 {
 	struct json_meta meta[] = {
 		/* instance and framework were already handled. */
-		{ OPTNAME_INAME, do_nothing, NULL, NULL, true },
-		{ OPTNAME_FW, do_nothing, NULL, NULL, true },
-		{ OPTNAME_GLOBAL, handle_global_tag, NULL, NULL, false },
-		{ OPTNAME_EAMT, handle_eamt_tag, NULL, NULL, false },
-		{ OPTNAME_BLACKLIST, handle_bl4_tag, NULL, NULL, false },
+		{ .name = OPTNAME_INAME, .stream = skip_tag, .mandatory = true },
+		{ .name = OPTNAME_FW, .stream = skip_tag, .mandatory = true },
+		{ .name = OPTNAME_GLOBAL, .handler = handle_global_tag },
+		{ .name = OPTNAME_EAMT, .stream = stream_eamt_tag },
+		{ .name = OPTNAME_BLACKLIST, .stream = stream_bl4_tag },
+		{ .name = OPTNAME_REMOVE, .stream = stream_siit_remove_tag },
 		{ NULL },
 	};
 
-	return handle_object(json, meta);
+	return stream_object(cursor, "root", meta);
 }
 
-static struct jool_result parse_nat64_json(cJSON *json)
+static struct jool_result parse_nat64_json(char const **cursor)
 {
 	struct json_meta meta[] = {
 		/* instance and framework were already handled. */
-		{ OPTNAME_INAME, do_nothing, NULL, NULL, true },
-		{ OPTNAME_FW, do_nothing, NULL, NULL, true },
-		{ OPTNAME_GLOBAL, handle_global_tag, NULL, NULL, false },
-		{ OPTNAME_POOL4, handle_pool4_tag, NULL, NULL, false },
-		{ OPTNAME_BIB, handle_bib_tag, NULL, NULL, false },
+		{ .name = OPTNAME_INAME, .stream = skip_tag, .mandatory = true },
+		{ .name = OPTNAME_FW, .stream = skip_tag, .mandatory = true },
+		{ .name = OPTNAME_GLOBAL, .handler = handle_global_tag },
+		{ .name = OPTNAME_POOL4, .stream = stream_pool4_tag },
+		{ .name = OPTNAME_BIB, .stream = stream_bib_tag },
+		{ .name = OPTNAME_REMOVE, .stream = stream_nat64_remove_tag },
 		{ NULL },
 	};
 
-	return handle_object(json, meta);
+	return stream_object(cursor, "root", meta);
 }
 
 /*
@@ -551,7 +767,9 @@ static struct jool_result handle_instance_tag(cJSON *json, void const *_iname,
 		);
 	}
 
-	iname = json->valuestring;
+	/* (@json is about to be deleted.) */
+	strcpy(iname_buffer, json->valuestring);
+	iname = iname_buffer;
 	return result_success();
 }
 
@@ -584,17 +802,18 @@ static struct jool_result handle_framework_tag(cJSON *json,
 /*
  * Sets the @iname and @flags global variables according to @_iname and @json.
  */
-static struct jool_result prepare_instance(char const *_iname, cJSON *json)
+static struct jool_result prepare_instance(char const *_iname, char const *json)
 {
 	struct json_meta meta[] = {
 		{ OPTNAME_INAME, handle_instance_tag, _iname, NULL, false },
 		{ OPTNAME_FW, handle_framework_tag, NULL, NULL, true },
 		/* The rest will be handled later. */
-		{ OPTNAME_GLOBAL, do_nothing },
-		{ OPTNAME_EAMT, do_nothing },
-		{ OPTNAME_BLACKLIST, do_nothing },
-		{ OPTNAME_POOL4, do_nothing },
-		{ OPTNAME_BIB, do_nothing },
+		{ .name = OPTNAME_GLOBAL, .stream = skip_tag },
+		{ .name = OPTNAME_EAMT, .stream = skip_tag },
+		{ .name = OPTNAME_BLACKLIST, .stream = skip_tag },
+		{ .name = OPTNAME_POOL4, .stream = skip_tag },
+		{ .name = OPTNAME_BIB, .stream = skip_tag },
+		{ .name = OPTNAME_REMOVE, .stream = skip_tag },
 		{ NULL },
 	};
 	struct jool_result result;
@@ -613,7 +832,7 @@ static struct jool_result prepare_instance(char const *_iname, cJSON *json)
 	if (result.error)
 		return result_from_error(result.error, INAME_VALIDATE_ERRMSG);
 
-	result = handle_object(json, meta);
+	result = stream_object(&json, "root", meta);
 	if (result.error)
 		return result;
 
@@ -631,7 +850,11 @@ static struct jool_result prepare_instance(char const *_iname, cJSON *json)
  * =================================
  */
 
-static struct jool_result send_ctrl_msg(bool init)
+/*
+ * @hold: Postpone the commit until the next one that isn't held. (So several
+ * files can be committed as a single transaction.)
+ */
+static struct jool_result send_ctrl_msg(bool init, bool hold)
 {
 	struct nl_msg *msg;
 	struct jool_result result;
@@ -640,50 +863,54 @@ static struct jool_result send_ctrl_msg(bool init)
 	if (result.error)
 		return result;
 
-	if (init)
+	if (init) {
 		NLA_PUT_U8(msg, JNLAR_ATOMIC_INIT, xlator_flags2xf(flags));
-	else
+		if (delta)
+			NLA_PUT(msg, JNLAR_ATOMIC_DELTA, 0, NULL);
+	} else {
 		NLA_PUT(msg, JNLAR_ATOMIC_END, 0, NULL);
+		if (hold)
+			NLA_PUT(msg, JNLAR_ATOMIC_HOLD, 0, NULL);
+	}
 
-	result = joolnl_request(&sk, msg, NULL, NULL);
-	if (result.error)
-		return result;
-
-	return result_success();
+	return send_request(msg);
 
 nla_put_failure:
 	nlmsg_free(msg);
 	return result;
 }
 
-static struct jool_result do_parsing(char const *iname, char *buffer)
+static struct jool_result do_parsing(char const *iname, char const *buffer,
+		bool hold)
 {
-	cJSON *json;
+	char const *cursor;
 	struct jool_result result;
 
-	json = cJSON_Parse(buffer);
-	if (!json) {
-		return result_from_error(
-			-EINVAL,
-			"The JSON parser got confused around the beginning of this string:\n"
-			"%s", cJSON_GetErrorPtr()
-		);
-	}
+	/* First pass: Find out who the file is for. */
+	result = prepare_instance(iname, buffer);
+	if (result.error)
+		return result;
 
-	result = prepare_instance(iname, json);
+	/*
+	 * If the previous file failed, the INIT would start a new transaction
+	 * as if nothing happened, so make sure it didn't.
+	 */
+	result = receive_responses();
 	if (result.error)
-		goto fail;
+		return result;
 
-	result = send_ctrl_msg(true);
+	result = send_ctrl_msg(true, false);
 	if (result.error)
-		goto fail;
+		return result;
 
+	/* Second pass: Upload the rest. */
+	cursor = buffer;
 	switch (xlator_flags2xt(flags)) {
 	case XT_SIIT:
-		result = parse_siit_json(json);
+		result = parse_siit_json(&cursor);
 		break;
 	case XT_NAT64:
-		result = parse_nat64_json(json);
+		result = parse_nat64_json(&cursor);
 		break;
 	default:
 		result = result_from_error(
@@ -693,86 +920,116 @@ static struct jool_result do_parsing(char const *iname, char *buffer)
 	}
 
 	if (result.error)
-		goto fail;
-
-	/*
-	 * Send the control message before deleting, because @iname might point
-	 * to the json object, and send_ctrl_msg() needs @iname.
-	 */
-	result = send_ctrl_msg(false);
-	cJSON_Delete(json);
-	return result;
+		return result;
 
-fail:
-	cJSON_Delete(json);
-	return result;
+	return send_ctrl_msg(false, hold);
 }
 
+/**
+ * Uploads the configuration described by @file_names as a single atomic
+ * transaction.
+ *
+ * The files are walked as text, and the table entries are parsed one at a
+ * time, so memory usage does not depend on the size of the tables. The entries
+ * are packed into large messages, and several of them are sent before waiting
+ * for the kernel's responses.
+ *
+ * @delta: If true, the files only describe changes to apply to the running
+ *     instances. Otherwise they describe the instances' entire configuration.
+ */
 struct jool_result joolnl_file_parse(struct joolnl_socket *_sk, xlator_type xt,
-		char const *iname, char const *file_name, bool _force)
+		char const *iname, char * const *file_names, unsigned int file_count,
+		bool _force, bool _delta)
 {
 	char *buffer;
+	unsigned int i;
 	struct jool_result result;
+	struct jool_result result2;
 
 	sk = *_sk;
-	flags = xt;
 	force = _force ? JOOLNLHDR_FLAGS_FORCE : 0;
+	delta = _delta;
+	in_flight = 0;
 
-	result = file_to_string(file_name, &buffer);
-	if (result.error)
+	/* Not fatal; libnl's defaults only cost more, smaller messages. */
+	nl_socket_set_buffer_size(sk.sk, BULK_SOCKBUF_SIZE, BULK_SOCKBUF_SIZE);
+
+	result = result_success();
+	for (i = 0; i < file_count && !result.error; i++) {
+		flags = xt;
+
+		result = file_to_string(file_names[i], &buffer);
+		if (result.error)
+			break;
+
+		result = do_parsing(iname, buffer, i < file_count - 1);
+		free(buffer);
+	}
+
+	/*
+	 * The kernel already rolled back on the first failure, so the
+	 * responses still in flight can only repeat it, or mislead.
+	 */
+	result2 = receive_responses();
+	if (result.error) {
+		result_cleanup(&result2);
 		return result;
+	}
 
-	result = do_parsing(iname, buffer);
-	free(buffer);
-	return result;
+	return result2;
 }
 
-static struct jool_result __json_get_iname(cJSON *root, char **out)
+static struct jool_result find_iname(char const *key, char const **cursor,
+		void *arg)
 {
-	cJSON *child;
+	char **out = arg;
+	cJSON *json;
+	struct jool_result result;
 
-	if (root->type != cJSON_Object)
-		return type_mismatch("root", root, "Object");
+	if (strcasecmp(key, OPTNAME_INAME) != 0 || *out)
+		return json_skip_value(cursor);
 
-	for (child = root->child; child; child = child->next) {
-		if (tagname_equals(child, OPTNAME_INAME)) {
-			*out = strdup(child->valuestring);
-			return ((*out) != NULL)
-					? result_success()
-					: result_from_enomem();
-		}
+	result = json_parse_member(cursor, key, &json);
+	if (result.error)
+		return result;
+
+	if (json->type != cJSON_String) {
+		result = string_expected(json->string, json);
+		cJSON_Delete(json);
+		return result;
 	}
 
-	return result_from_error(
-		-EINVAL,
-		"The file does not contain an instance name."
-	);
+	*out = strdup(json->valuestring);
+	cJSON_Delete(json);
+	return ((*out) != NULL) ? result_success() : result_from_enomem();
 }
 
 struct jool_result joolnl_file_get_iname(char const *file_name, char **out)
 {
 	char *json_string;
-	cJSON *json;
+	char const *cursor;
 	struct jool_result result;
 
 	result = file_to_string(file_name, &json_string);
 	if (result.error)
 		return result;
 
-	json = cJSON_Parse(json_string);
-
+	*out = NULL;
+	cursor = json_string;
+	result = json_foreach_member(&cursor, "root", find_iname, out);
 	free(json_string);
+	if (result.error) {
+		free(*out);
+		*out = NULL;
+		return result;
+	}
 
-	if (!json) {
+	if (!(*out)) {
 		return result_from_error(
 			-EINVAL,
-			"The JSON parser got confused around the beginning of this string:\n"
-			"%s", cJSON_GetErrorPtr()
+			"The file does not contain an instance name."
 		);
 	}
 
-	result = __json_get_iname(json, out);
-
-	cJSON_Delete(json);
-	return result;
+	return result_success();
 }
@@ -8,8 +8,10 @@ struct jool_result joolnl_file_parse(
 	struct joolnl_socket *sk,
 	xlator_type xt,
 	char const *iname,
-	char const *file_name,
-	bool force
+	char * const *file_names,
+	unsigned int file_count,
+	bool force,
+	bool delta
 );
 
 struct jool_result joolnl_file_get_iname(
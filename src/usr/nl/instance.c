@@ -32,23 +32,6 @@ nla_put_failure:
 	return joolnl_err_msgsize();
 }
 
-static struct jool_result attr2entry(struct nlattr *root,
-		struct instance_entry_usr *entry)
-{
-	struct nlattr *attrs[JNLAIE_COUNT];
-	struct jool_result result;
-
-	result = jnla_parse_nested(attrs, JNLAIE_MAX, root,
-			joolnl_instance_entry_policy);
-	if (result.error)
-		return result;
-
-	entry->ns = nla_get_u32(attrs[JNLAIE_NS]);
-	entry->xf = nla_get_u8(attrs[JNLAIE_XF]);
-	strcpy(entry->iname, nla_get_string(attrs[JNLAIE_INAME]));
-	return result_success();
-}
-
 static struct jool_result handle_foreach_response(struct nl_msg *response,
 		void *arg)
 {
@@ -63,7 +46,7 @@ static struct jool_result handle_foreach_response(struct nl_msg *response,
 		return result;
 
 	foreach_entry(attr, genlmsg_hdr(nlmsg_hdr(response)), rem) {
-		result = attr2entry(attr, &entry);
+		result = nla_get_instance(attr, &entry);
 		if (result.error)
 			return result;
 
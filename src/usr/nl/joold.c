@@ -1,33 +1,140 @@
 #include "usr/nl/joold.h"
 
 #include <stddef.h>
+#include <string.h>
 #include <netlink/msg.h>
 #include "common/config.h"
 
-struct jool_result joolnl_joold_add(struct joolnl_socket *sk, char const *iname,
-		void const *data, size_t data_len)
+/*
+ * The daemons forward the session container's payload without its attribute
+ * header, so we need to figure out which container it came from.
+ * (See struct joold_records_hdr.)
+ */
+static int get_container_type(struct iovec const *blob)
+{
+	struct joold_records_hdr const *hdr = blob->iov_base;
+
+	if (blob->iov_len >= sizeof(*hdr)
+			&& ntohs(hdr->magic) == JOOLD_RECORDS_MAGIC)
+		return JNLAR_SESSION_RECORDS;
+	return JNLAR_SESSION_ENTRIES;
+}
+
+/* Sessions declared by @blob's records header. */
+static unsigned int get_record_count(struct iovec const *blob)
+{
+	return ntohs(((struct joold_records_hdr *)blob->iov_base)->count);
+}
+
+/*
+ * Can @blob be merged with other containers of the same type?
+ *
+ * Nested attributes can simply be concatenated. Records can too, as long as
+ * we understand their header well enough to rewrite it.
+ */
+static bool is_mergeable(struct iovec const *blob)
+{
+	struct joold_records_hdr const *hdr = blob->iov_base;
+
+	return get_container_type(blob) == JNLAR_SESSION_ENTRIES
+			|| hdr->version == JOOLD_RECORDS_VERSION;
+}
+
+/* Sends @blobs to the kernel as a single @type container. */
+static struct jool_result add_container(struct joolnl_socket *sk,
+		char const *iname, int type, struct iovec const *blobs,
+		unsigned int count)
 {
 	struct nl_msg *msg;
+	struct nlattr *attr;
+	struct joold_records_hdr *hdr;
+	char *cursor;
+	size_t skip, len;
+	unsigned int i;
 	struct jool_result result;
 
+	/* Records containers get a single header, which we rebuild. */
+	skip = (type == JNLAR_SESSION_RECORDS) ? sizeof(*hdr) : 0;
+	len = skip;
+	for (i = 0; i < count; i++)
+		len += blobs[i].iov_len - skip;
+
 	result = joolnl_alloc_msg(sk, iname, JNLOP_JOOLD_ADD, 0, &msg);
 	if (result.error)
 		return result;
 
-	result.error = nla_put(msg, JNLAR_SESSION_ENTRIES, data_len, data);
-	if (result.error < 0) {
+	attr = nla_reserve(msg, type, len);
+	if (!attr) {
 		nlmsg_free(msg);
-		/*
-		 * This is fine as long as page size > 1500.
-		 * But admittedly, it's not the most elegant implementation.
-		 */
 		return result_from_error(
-			result.error,
+			-NLE_NOMEM,
 			"Can't send joold sessions to kernel: Packet too small."
 		);
 	}
 
-	return joolnl_request(sk, msg, NULL, NULL);
+	cursor = nla_data(attr);
+	hdr = (struct joold_records_hdr *)cursor;
+	memcpy(cursor, blobs[0].iov_base, skip);
+	cursor += skip;
+
+	for (i = 0; i < count; i++) {
+		memcpy(cursor, (char *)blobs[i].iov_base + skip,
+				blobs[i].iov_len - skip);
+		cursor += blobs[i].iov_len - skip;
+	}
+
+	if (type == JNLAR_SESSION_RECORDS) {
+		len = 0;
+		for (i = 0; i < count; i++)
+			len += get_record_count(&blobs[i]);
+		hdr->count = htons(len);
+	}
+
+	return joolnl_send(sk, msg);
+}
+
+/*
+ * Hands the session containers in @blobs (as received from other joolds) over
+ * to the kernel module.
+ *
+ * Consecutive containers of the same type are merged, so the whole batch
+ * usually travels in a single request.
+ */
+struct jool_result joolnl_joold_add(struct joolnl_socket *sk, char const *iname,
+		struct iovec const *blobs, unsigned int count)
+{
+	unsigned int first, last;
+	unsigned int sessions;
+	int type;
+	struct jool_result result;
+
+	for (first = 0; first < count; first = last) {
+		type = get_container_type(&blobs[first]);
+		last = first + 1;
+
+		if (is_mergeable(&blobs[first])) {
+			sessions = (type == JNLAR_SESSION_RECORDS)
+					? get_record_count(&blobs[first]) : 0;
+			for (; last < count; last++) {
+				if (get_container_type(&blobs[last]) != type)
+					break;
+				if (!is_mergeable(&blobs[last]))
+					break;
+				if (type == JNLAR_SESSION_RECORDS) {
+					sessions += get_record_count(&blobs[last]);
+					if (sessions > 0xFFFFu)
+						break;
+				}
+			}
+		}
+
+		result = add_container(sk, iname, type, &blobs[first],
+				last - first);
+		if (result.error)
+			return result;
+	}
+
+	return result_success();
 }
 
 struct jool_result joolnl_joold_advertise(struct joolnl_socket *sk,
@@ -43,7 +150,12 @@ struct jool_result joolnl_joold_advertise(struct joolnl_socket *sk,
 	return joolnl_request(sk, msg, NULL, NULL);
 }
 
-struct jool_result joolnl_joold_ack(struct joolnl_socket *sk, char const *iname)
+/*
+ * @seq is the sequence number of the packet being ACKed. NULL means "unknown,"
+ * which ACKs the oldest packet in flight.
+ */
+struct jool_result joolnl_joold_ack(struct joolnl_socket *sk, char const *iname,
+		__u32 const *seq)
 {
 	struct nl_msg *msg;
 	struct jool_result result;
@@ -52,5 +164,13 @@ struct jool_result joolnl_joold_ack(struct joolnl_socket *sk, char const *iname)
 	if (result.error)
 		return result;
 
-	return joolnl_request(sk, msg, NULL, NULL);
+	if (seq && nla_put_u32(msg, JNLAR_JOOLD_SEQ, *seq) < 0) {
+		nlmsg_free(msg);
+		return result_from_error(
+			-NLE_NOMEM,
+			"Can't send joold ACK to kernel: Packet too small."
+		);
+	}
+
+	return joolnl_send(sk, msg);
 }
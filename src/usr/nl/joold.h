@@ -1,13 +1,14 @@
 #ifndef SRC_USR_NL_JOOLD_H_
 #define SRC_USR_NL_JOOLD_H_
 
+#include <sys/uio.h>
 #include "usr/nl/core.h"
 
 struct jool_result joolnl_joold_add(
 	struct joolnl_socket *sk,
 	char const *iname,
-	void const *data,
-	size_t data_len
+	struct iovec const *blobs,
+	unsigned int count
 );
 
 struct jool_result joolnl_joold_advertise(
@@ -17,7 +18,8 @@ struct jool_result joolnl_joold_advertise(
 
 struct jool_result joolnl_joold_ack(
 	struct joolnl_socket *sk,
-	char const *iname
+	char const *iname,
+	__u32 const *seq
 );
 
 #endif /* SRC_USR_NL_JOOLD_H_ */
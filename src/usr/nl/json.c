@@ -1,6 +1,9 @@
 #include "usr/nl/json.h"
 
 #include <errno.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
 
 struct jool_result type_mismatch(char const *field, cJSON *json,
 		char const *expected)
@@ -93,3 +96,228 @@ struct jool_result validate_uint(char const *field_name, cJSON *node,
 
 	return result_success();
 }
+
+/*
+ * =================================
+ * =========== Streaming ===========
+ * =================================
+ *
+ * cJSON can only parse whole documents, which is a problem when the document
+ * is a configuration file with hundreds of thousands of entries: The tree
+ * costs several times the size of the text.
+ *
+ * So these functions walk the text instead, and only hand over fully parsed
+ * trees one object member or array element at a time. @cursor always points
+ * to the value being walked, and is moved past it on success.
+ */
+
+/* How much of the offending text the syntax errors print. */
+#define SYNTAX_ERROR_CONTEXT 64
+
+struct jool_result json_syntax_error(char const *str)
+{
+	return result_from_error(
+		-EINVAL,
+		"The JSON parser got confused around the beginning of this string:\n"
+		"%.*s", SYNTAX_ERROR_CONTEXT, str ? str : "(unknown)"
+	);
+}
+
+static char const *skip_whitespace(char const *str)
+{
+	while (*str && (unsigned char)*str <= 32)
+		str++;
+	return str;
+}
+
+/* Same as cJSON_ParseWithOpts(), except it moves @cursor. */
+static struct jool_result parse_value(char const **cursor, cJSON **out)
+{
+	*out = cJSON_ParseWithOpts(*cursor, cursor, false);
+	return (*out) ? result_success() : json_syntax_error(cJSON_GetErrorPtr());
+}
+
+static struct jool_result container_expected(char const *str,
+		char const *name, char const *expected)
+{
+	cJSON *json;
+	struct jool_result result;
+
+	result = parse_value(&str, &json);
+	if (result.error)
+		return result;
+
+	result = type_mismatch(name, json, expected);
+	cJSON_Delete(json);
+	return result;
+}
+
+/**
+ * Parses the value @cursor points to, and names it @key. (ie. The result looks
+ * like a member of its parent object.)
+ */
+struct jool_result json_parse_member(char const **cursor, char const *key,
+		cJSON **out)
+{
+	struct jool_result result;
+
+	result = parse_value(cursor, out);
+	if (result.error)
+		return result;
+
+	(*out)->string = strdup(key);
+	if (!(*out)->string) {
+		cJSON_Delete(*out);
+		return result_from_enomem();
+	}
+
+	return result_success();
+}
+
+/**
+ * Moves @cursor past the value it points to, without parsing it.
+ * Assumes the value will be validated later, so it's only as strict as it
+ * needs to be to find the end.
+ */
+struct jool_result json_skip_value(char const **cursor)
+{
+	char const *str;
+	unsigned int depth;
+
+	str = skip_whitespace(*cursor);
+	depth = 0;
+
+	do {
+		switch (*str) {
+		case '\0':
+			return json_syntax_error(*cursor);
+		case '"':
+			for (str++; *str != '"'; str++) {
+				if (*str == '\0')
+					return json_syntax_error(*cursor);
+				if (*str == '\\' && str[1] != '\0')
+					str++;
+			}
+			str++;
+			break;
+		case '{':
+		case '[':
+			depth++;
+			str++;
+			break;
+		case '}':
+		case ']':
+			if (depth == 0)
+				return json_syntax_error(str);
+			depth--;
+			str++;
+			break;
+		default:
+			/* Scalar, or the stuff between container members. */
+			str++;
+			if (depth == 0) {
+				while (*str && !strchr(",:}] \t\r\n", *str))
+					str++;
+			}
+		}
+	} while (depth > 0);
+
+	*cursor = str;
+	return result_success();
+}
+
+/**
+ * Calls @cb once for every member of the object @cursor points to.
+ * @cb receives the member's key, and has to move the cursor past the member's
+ * value (through json_parse_member(), json_skip_value() or a nested walk).
+ *
+ * @name is the object's name, for error messages.
+ */
+struct jool_result json_foreach_member(char const **cursor, char const *name,
+		json_member_cb cb, void *arg)
+{
+	char const *str;
+	cJSON *key;
+	struct jool_result result;
+
+	str = skip_whitespace(*cursor);
+	if (*str != '{')
+		return container_expected(str, name, "Object");
+
+	str = skip_whitespace(str + 1);
+	if (*str == '}')
+		goto end;
+
+	do {
+		result = parse_value(&str, &key);
+		if (result.error)
+			return result;
+		if (key->type != cJSON_String) {
+			cJSON_Delete(key);
+			return json_syntax_error(str);
+		}
+
+		str = skip_whitespace(str);
+		if (*str != ':') {
+			cJSON_Delete(key);
+			return json_syntax_error(str);
+		}
+		str++;
+
+		result = cb(key->valuestring, &str, arg);
+		cJSON_Delete(key);
+		if (result.error)
+			return result;
+
+		str = skip_whitespace(str);
+		if (*str == ',')
+			str = skip_whitespace(str + 1);
+		else if (*str != '}')
+			return json_syntax_error(str);
+	} while (*str != '}');
+
+end:	*cursor = str + 1;
+	return result_success();
+}
+
+/**
+ * Calls @cb once for every element of the array @cursor points to. Each
+ * element only exists during its own call.
+ *
+ * @name is the array's name, for error messages.
+ */
+struct jool_result json_foreach_element(char const **cursor, char const *name,
+		json_element_cb cb, void *arg)
+{
+	char const *str;
+	cJSON *element;
+	struct jool_result result;
+
+	str = skip_whitespace(*cursor);
+	if (*str != '[')
+		return container_expected(str, name, "Array");
+
+	str = skip_whitespace(str + 1);
+	if (*str == ']')
+		goto end;
+
+	do {
+		result = parse_value(&str, &element);
+		if (result.error)
+			return result;
+
+		result = cb(element, arg);
+		cJSON_Delete(element);
+		if (result.error)
+			return result;
+
+		str = skip_whitespace(str);
+		if (*str == ',')
+			str = skip_whitespace(str + 1);
+		else if (*str != ']')
+			return json_syntax_error(str);
+	} while (*str != ']');
+
+end:	*cursor = str + 1;
+	return result_success();
+}
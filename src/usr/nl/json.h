@@ -10,4 +10,17 @@ struct jool_result type_mismatch(char const *field, cJSON *json,
 struct jool_result validate_uint(char const *field_name, cJSON *node,
 		__u64 min, __u64 max);
 
+typedef struct jool_result (*json_member_cb)(char const *, char const **,
+		void *);
+typedef struct jool_result (*json_element_cb)(cJSON *, void *);
+
+struct jool_result json_syntax_error(char const *str);
+struct jool_result json_parse_member(char const **cursor, char const *key,
+		cJSON **out);
+struct jool_result json_skip_value(char const **cursor);
+struct jool_result json_foreach_member(char const **cursor, char const *name,
+		json_member_cb cb, void *arg);
+struct jool_result json_foreach_element(char const **cursor, char const *name,
+		json_element_cb cb, void *arg);
+
 #endif /* SRC_USR_NL_JSON_H_ */
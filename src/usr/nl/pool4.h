@@ -16,6 +16,18 @@ struct jool_result joolnl_pool4_foreach(
 	void *args
 );
 
+typedef struct jool_result (*joolnl_pool4_usage_cb)(
+	struct pool4_usage const *usage, void *args
+);
+
+struct jool_result joolnl_pool4_usage(
+	struct joolnl_socket *sk,
+	char const *iname,
+	l4_protocol proto,
+	joolnl_pool4_usage_cb cb,
+	void *args
+);
+
 struct jool_result joolnl_pool4_add(
 	struct joolnl_socket *sk,
 	char const *iname,
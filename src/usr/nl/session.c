@@ -1,6 +1,7 @@
 #include "usr/nl/session.h"
 
 #include <errno.h>
+#include <string.h>
 #include <netlink/genl/genl.h>
 #include "usr/nl/attribute.h"
 #include "usr/nl/common.h"
@@ -8,8 +9,6 @@
 struct foreach_args {
 	joolnl_session_foreach_cb cb;
 	void *args;
-	bool done;
-	struct session_entry_usr last;
 };
 
 static struct jool_result handle_foreach_response(struct nl_msg *response,
@@ -19,9 +18,10 @@ static struct jool_result handle_foreach_response(struct nl_msg *response,
 	struct nlattr *attr;
 	int rem;
 	struct session_entry_usr entry;
+	bool done; /* Unused; dumps end with NLMSG_DONE instead. */
 	struct jool_result result;
 
-	result = joolnl_init_foreach_list(response, "session", &args->done);
+	result = joolnl_init_foreach_list(response, "session", &done);
 	if (result.error)
 		return result;
 
@@ -33,50 +33,105 @@ static struct jool_result handle_foreach_response(struct nl_msg *response,
 		result = args->cb(&entry, args->args);
 		if (result.error)
 			return result;
-
-		memcpy(&args->last, &entry, sizeof(entry));
 	}
 
 	return result_success();
 }
 
+/**
+ * @query is optional. If present, only the sessions that match its filters
+ * will be handed to @cb. (Its mode is ignored.)
+ */
 struct jool_result joolnl_session_foreach(struct joolnl_socket *sk,
 		char const *iname, l4_protocol proto,
+		struct bib_query const *query,
 		joolnl_session_foreach_cb cb, void *_args)
 {
 	struct nl_msg *msg;
 	struct foreach_args args;
 	struct jool_result result;
-	bool first_request;
 
 	args.cb = cb;
 	args.args = _args;
-	args.done = true;
-	memset(&args.last, 0, sizeof(args.last));
-	first_request = true;
 
-	do {
-		result = joolnl_alloc_msg(sk, iname, JNLOP_SESSION_FOREACH, 0, &msg);
-		if (result.error)
-			return result;
-
-		if (nla_put_u8(msg, JNLAR_PROTO, proto) < 0)
-			goto cancel;
+	result = joolnl_alloc_msg(sk, iname, JNLOP_SESSION_FOREACH, 0, &msg);
+	if (result.error)
+		return result;
 
-		if (first_request)
-			first_request = false;
-		else if (nla_put_session(msg, JNLAR_OFFSET, &args.last) < 0)
-			goto cancel;
+	if (nla_put_u8(msg, JNLAR_PROTO, proto) < 0)
+		goto cancel;
+	if (query && nla_put_query(msg, JNLAR_QUERY, query) < 0)
+		goto cancel;
 
-		result = joolnl_request(sk, msg, handle_foreach_response, &args);
-		if (result.error)
-			return result;
-	} while (!args.done);
-
-	return result_success();
+	return joolnl_dump(sk, msg, handle_foreach_response, &args);
 
 cancel:
 	nlmsg_free(msg);
 	return joolnl_err_msgsize();
 }
 
+/** Counts (or ranks by subscriber) the sessions that match @query. */
+struct jool_result joolnl_session_query(struct joolnl_socket *sk,
+		char const *iname, l4_protocol proto,
+		struct bib_query const *query, struct bib_query_result *result)
+{
+	return joolnl_query_table(sk, iname, JNLOP_SESSION_QUERY, proto, query,
+			result);
+}
+
+/*
+ * Big enough to absorb a few hundred batches while the consumer is busy
+ * writing. (The kernel counts what doesn't fit as JSTAT_SLOG_DROPPED.)
+ */
+#define FOLLOW_RCVBUF (8 * 1024 * 1024)
+
+struct follow_args {
+	joolnl_session_follow_cb cb;
+	void *args;
+	char const *iname;
+	struct jool_result result;
+};
+
+static int handle_follow_msg(struct nl_msg *msg, void *arg)
+{
+	struct follow_args *args = arg;
+	struct genlmsghdr *ghdr;
+	struct nlattr *attr;
+
+	ghdr = joolnl_follow_hdr(msg, args->iname);
+	if (!ghdr)
+		return NL_SKIP;
+
+	attr = nla_find(genlmsg_attrdata(ghdr, sizeof(struct joolnlhdr)),
+			genlmsg_attrlen(ghdr, sizeof(struct joolnlhdr)),
+			JNLAR_SLOG_EVENTS);
+	if (!attr)
+		return NL_SKIP;
+
+	args->result = args->cb(nla_data(attr),
+			nla_len(attr) / sizeof(struct slog_event),
+			args->args);
+	return args->result.error ? NL_STOP : NL_OK;
+}
+
+/**
+ * Subscribes to @iname's BIB/session log stream (see logging-stream), and
+ * hands every batch of events to @cb. Only returns on error.
+ */
+struct jool_result joolnl_session_follow(struct joolnl_socket *sk,
+		char const *iname, joolnl_session_follow_cb cb, void *_args)
+{
+	struct follow_args args;
+	int error;
+
+	error = iname_validate(iname, true);
+	if (error)
+		return result_from_error(error, INAME_VALIDATE_ERRMSG);
+
+	args.cb = cb;
+	args.args = _args;
+	args.iname = iname ? iname : "default";
+
+	return joolnl_follow(sk, JOOLNL_SLOG_GRP_NAME, "session log",
+			FOLLOW_RCVBUF, handle_follow_msg, &args, &args.result);
+}
@@ -30,8 +30,28 @@ struct jool_result joolnl_session_foreach(
 	struct joolnl_socket *sk,
 	char const *iname,
 	l4_protocol proto,
+	struct bib_query const *query,
 	joolnl_session_foreach_cb cb,
 	void *args
 );
 
+struct jool_result joolnl_session_query(
+	struct joolnl_socket *sk,
+	char const *iname,
+	l4_protocol proto,
+	struct bib_query const *query,
+	struct bib_query_result *result
+);
+
+typedef struct jool_result (*joolnl_session_follow_cb)(
+	struct slog_event const *events, unsigned int count, void *args
+);
+
+struct jool_result joolnl_session_follow(
+	struct joolnl_socket *sk,
+	char const *iname,
+	joolnl_session_follow_cb cb,
+	void *args
+);
+
 #endif /* SRC_USR_NL_SESSION_H_ */
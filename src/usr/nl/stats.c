@@ -1,6 +1,7 @@
 #include "usr/nl/stats.h"
 
 #include <errno.h>
+#include <string.h>
 #include <netlink/genl/genl.h>
 #include "usr/nl/attribute.h"
 #include "usr/nl/common.h"
@@ -27,6 +28,7 @@ static struct joolnl_stat_metadata const jstat_metadatas[] = {
 	DEFINE_STAT(JSTAT_L3HDR_OFFSET, TC "Packet corrupted; Network header offset is not relative to skb->data."),
 	DEFINE_STAT(JSTAT_SKB_TRUNCATED, TC "Packet corrupted; Data stopped in the middle of a header."),
 	DEFINE_STAT(JSTAT_FRAGMENTED_PING, TC "Packet was a fragmented ping, so its checksum was impossible to translate."),
+	DEFINE_STAT(JSTAT_FRAG_NO_FIRST, TC "Packet was a subsequent fragment, and its first fragment was not seen (or was seen too long ago). (NAT64 without defrag only.)"),
 	DEFINE_STAT(JSTAT_HDR6, TC "Some IPv6 header field was bogus. (Eg. version was not 6.)"),
 	DEFINE_STAT(JSTAT_HDR4, TC "Some IPv4 header field was bogus. (Eg. version was not 4.)"),
 	DEFINE_STAT(JSTAT_UNKNOWN_L4_PROTO, TC "Packet carried an unknown transport protocol. (Untranslatable by NAT64.)"),
@@ -82,10 +84,31 @@ static struct joolnl_stat_metadata const jstat_metadatas[] = {
 	DEFINE_STAT(JSTAT_FAILED_ROUTES, TC "The translated packet could not be routed; the kernel's routing function errored. Cause is unknown. (It usually happens because the packet's destination address could not be found in the routing table.)"),
 	DEFINE_STAT(JSTAT_PKT_TOO_BIG, TC "Translated IPv4 packet did not fit in the outgoing interface's MTU. A Packet Too Big or Fragmentation Needed ICMP error was returned to the client."),
 	DEFINE_STAT(JSTAT_DST_OUTPUT, TC "Translation was successful but the kernel's packet dispatch function (dst_output()) returned nonzero."),
+	DEFINE_STAT(JSTAT_NEIGH_XMIT, TC "Translation was successful but the kernel's neighbour layer (neigh_xmit()) refused the packet. (direct-xmit only.)"),
+	DEFINE_STAT(JSTAT_NEIGH_XMIT_SENT, "Translated packets handed directly to the kernel's neighbour layer (neigh_xmit()). (direct-xmit only.)"),
+	DEFINE_STAT(JSTAT_NEIGH_XMIT_FALLBACK, "Translated packets that had to be sent through dst_output() even though direct-xmit was enabled. (xfrm or lightweight tunnel routes, packets bigger than the MTU, IPv6 gateways, no room for the link layer header, or a missing neighbour table.)"),
 	DEFINE_STAT(JSTAT_ICMP6ERR_SUCCESS, "ICMPv6 errors (created by Jool, not translated) sent successfully."),
 	DEFINE_STAT(JSTAT_ICMP6ERR_FAILURE, "ICMPv6 errors (created by Jool, not translated) that could not be sent."),
+	DEFINE_STAT(JSTAT_ICMP6ERR_RATELIMITED, "ICMPv6 errors (created by Jool, not translated) that were not sent because their destination exceeded icmp-error-rate."),
 	DEFINE_STAT(JSTAT_ICMP4ERR_SUCCESS, "ICMPv4 errors (created by Jool, not translated) sent successfully."),
 	DEFINE_STAT(JSTAT_ICMP4ERR_FAILURE, "ICMPv4 errors (created by Jool, not translated) that could not be sent."),
+	DEFINE_STAT(JSTAT_ICMP4ERR_RATELIMITED, "ICMPv4 errors (created by Jool, not translated) that were not sent because their destination exceeded icmp-error-rate."),
+	DEFINE_STAT(JSTAT_TCP_OFFLOADED, "TCP packets that skipped Filtering and Updating because their connection was offloaded. (See tcp-offload.)"),
+	DEFINE_STAT(JSTAT_JOOLD_IN_FLIGHT, "Session sync packets sent to joold whose ACK hasn't arrived yet. (Not a counter; see ss-window.)"),
+	DEFINE_STAT(JSTAT_JOOLD_QUEUED, "Sessions waiting to be sent to joold. (Not a counter; see ss-capacity.)"),
+	DEFINE_STAT(JSTAT_JOOLD_DROPPED, "Session updates that could not be synchronized because the joold queue was full. (See ss-capacity.)"),
+	DEFINE_STAT(JSTAT_JOOLD_ADV_SENT, "Sessions the latest advertisement has sent so far. (Not a counter; see ss-advertise-rate.)"),
+	DEFINE_STAT(JSTAT_JOOLD_ADV_TOTAL, "Sessions the table had when the latest advertisement started. (Not a counter.)"),
+	DEFINE_STAT(JSTAT_SLOG_DROPPED, "BIB and session log events that could not be streamed to userspace because the kernel ran out of memory or the consumer fell behind. (See logging-stream.)"),
+	DEFINE_STAT(JSTAT_POOL4_EXHAUSTED, TC "The packet needed a new BIB entry, but its mark's pool4 ran out of transport addresses, or max-iterations ran out before a free one was found."),
+	DEFINE_STAT(JSTAT_POOL4_ITER_1, "Pool4 port allocations that succeeded on the first try."),
+	DEFINE_STAT(JSTAT_POOL4_ITER_4, "Pool4 port allocations that needed 2 to 4 tries."),
+	DEFINE_STAT(JSTAT_POOL4_ITER_16, "Pool4 port allocations that needed 5 to 16 tries."),
+	DEFINE_STAT(JSTAT_POOL4_ITER_64, "Pool4 port allocations that needed 17 to 64 tries."),
+	DEFINE_STAT(JSTAT_POOL4_ITER_256, "Pool4 port allocations that needed 65 to 256 tries."),
+	DEFINE_STAT(JSTAT_POOL4_ITER_1024, "Pool4 port allocations that needed 257 to 1024 tries."),
+	DEFINE_STAT(JSTAT_POOL4_ITER_4096, "Pool4 port allocations that needed 1025 to 4096 tries."),
+	DEFINE_STAT(JSTAT_POOL4_ITER_MORE, "Pool4 port allocations that needed more than 4096 tries. (See max-iterations.)"),
 	DEFINE_STAT(JSTAT_UNKNOWN, TC "Programming error found. The module recovered, but the packet was dropped."),
 	DEFINE_STAT(JSTAT_PADDING, "Dummy; ignore this one."),
 };
@@ -113,6 +136,11 @@ failure:
 	);
 }
 
+struct joolnl_stat_metadata const *joolnl_stat_meta(enum jool_stat_id id)
+{
+	return &jstat_metadatas[id];
+}
+
 struct query_args {
 	joolnl_stats_foreach_cb cb;
 	void *args;
@@ -191,3 +219,273 @@ struct jool_result joolnl_stats_foreach(struct joolnl_socket *sk,
 
 	return result_success();
 }
+
+struct dump_args {
+	joolnl_stats_dump_cb cb;
+	void *args;
+	struct joolnl_instance_stats entry;
+};
+
+static struct jool_result parse_instance_stats(struct nlattr *root,
+		struct joolnl_instance_stats *out)
+{
+	struct nlattr *attrs[JNLASTE_COUNT];
+	struct nlattr *attr;
+	enum jool_stat_id id;
+	int rem;
+	struct jool_result result;
+
+	result = jnla_parse_nested(attrs, JNLASTE_MAX, root,
+			joolnl_stats_entry_policy);
+	if (result.error)
+		return result;
+	if (!attrs[JNLASTE_INSTANCE] || !attrs[JNLASTE_STATS])
+		goto bad_entry;
+
+	result = nla_get_instance(attrs[JNLASTE_INSTANCE], &out->instance);
+	if (result.error)
+		return result;
+
+	memset(out->stats, 0, sizeof(out->stats));
+	nla_for_each_nested(attr, attrs[JNLASTE_STATS], rem) {
+		id = nla_type(attr);
+		if (id == JSTAT_PADDING)
+			continue;
+		if (id < 1 || id > JSTAT_UNKNOWN)
+			goto bad_entry;
+		out->stats[id] = nla_get_u64(attr);
+	}
+
+	return result_success();
+
+bad_entry:
+	return result_from_error(
+		-EINVAL,
+		"The kernel module returned a malformed stats entry."
+	);
+}
+
+static struct jool_result dump_response(struct nl_msg *response, void *arg)
+{
+	struct dump_args *args = arg;
+	struct nlattr *attr;
+	int rem;
+	bool done; /* Unused; dumps end with NLMSG_DONE instead. */
+	struct jool_result result;
+
+	result = joolnl_init_foreach_list(response, "stats", &done);
+	if (result.error)
+		return result;
+
+	foreach_entry(attr, genlmsg_hdr(nlmsg_hdr(response)), rem) {
+		result = parse_instance_stats(attr, &args->entry);
+		if (result.error)
+			return result;
+
+		result = args->cb(&args->entry, args->args);
+		if (result.error)
+			return result;
+	}
+
+	return result_success();
+}
+
+/**
+ * Hands the stats of every instance of @sk's type to @cb, regardless of
+ * namespace. The whole thing is a single Netlink dump.
+ */
+struct jool_result joolnl_stats_dump(struct joolnl_socket *sk,
+		joolnl_stats_dump_cb cb, void *_args)
+{
+	struct nl_msg *msg;
+	struct dump_args args;
+	struct jool_result result;
+
+	result = validate_stats();
+	if (result.error)
+		return result;
+
+	args.cb = cb;
+	args.args = _args;
+
+	result = joolnl_alloc_msg(sk, NULL, JNLOP_STATS_DUMP, 0, &msg);
+	if (result.error)
+		return result;
+
+	return joolnl_dump(sk, msg, dump_response, &args);
+}
+
+#define DEFINE_STAGE(_id, _doc) \
+	[_id] = { \
+		.id = _id, \
+		.name = #_id, \
+		.doc = _doc, \
+	}
+
+static struct joolnl_stage_metadata const jstage_metadatas[] = {
+	DEFINE_STAGE(JSTAGE_IN_TUPLE, "Determine Incoming Tuple. (NAT64 only.)"),
+	DEFINE_STAGE(JSTAGE_FILTERING, "Filtering and Updating: BIB and session lookup and creation. (NAT64 only; skipped by tcp-offload hits.)"),
+	DEFINE_STAGE(JSTAGE_OUT_TUPLE, "Compute Outgoing Tuple. (NAT64 only.)"),
+	DEFINE_STAGE(JSTAGE_TRANSLATE, "Translating the Packet: header rewriting and routing."),
+	DEFINE_STAGE(JSTAGE_SEND, "Sending the translated packet (or hairpinning it)."),
+};
+
+struct joolnl_stage_metadata const *joolnl_stage_meta(enum jool_stage stage)
+{
+	return (stage < JSTAGE_COUNT) ? &jstage_metadatas[stage] : NULL;
+}
+
+static struct jool_result latency_response(struct nl_msg *response, void *args)
+{
+	struct genlmsghdr *ghdr;
+	struct nlattr *head, *stage, *bucket;
+	int len, rem1, rem2;
+	int s, b;
+	struct joolnl_latency *out = args;
+
+	ghdr = nlmsg_data(nlmsg_hdr(response));
+	head = genlmsg_attrdata(ghdr, sizeof(struct joolnlhdr));
+	len = genlmsg_attrlen(ghdr, sizeof(struct joolnlhdr));
+
+	nla_for_each_attr(stage, head, len, rem1) {
+		s = nla_type(stage) - 1;
+		if (s < 0 || s >= JSTAGE_COUNT)
+			goto bad_stage;
+
+		nla_for_each_nested(bucket, stage, rem2) {
+			b = nla_type(bucket) - 1;
+			if (b == JSTAGE_PADDING - 1)
+				continue;
+			if (b < 0 || b >= JSTAGE_BUCKETS)
+				goto bad_stage;
+			out->buckets[s][b] = nla_get_u64(bucket);
+		}
+	}
+
+	return result_success();
+
+bad_stage:
+	return result_from_error(
+		-EINVAL,
+		"The kernel module returned an unknown latency histogram."
+	);
+}
+
+struct jool_result joolnl_stats_latency(struct joolnl_socket *sk,
+		char const *iname, struct joolnl_latency *result)
+{
+	struct nl_msg *msg;
+	struct jool_result error;
+
+	if (ARRAY_SIZE(jstage_metadatas) != JSTAGE_COUNT) {
+		return result_from_error(
+			-EINVAL,
+			"Programming error: The jstage_metadatas array does not match the jool_stage enum."
+		);
+	}
+
+	memset(result, 0, sizeof(*result));
+
+	error = joolnl_alloc_msg(sk, iname, JNLOP_STATS_LATENCY, 0, &msg);
+	if (error.error)
+		return error;
+
+	return joolnl_request(sk, msg, latency_response, result);
+}
+
+struct follow_args {
+	joolnl_stats_follow_cb cb;
+	void *args;
+	char const *iname;
+	struct joolnl_stats_delta delta;
+	struct jool_result result;
+};
+
+static int parse_stream(struct nlattr *root, struct joolnl_stat *stats,
+		unsigned int *count)
+{
+	struct nlattr *attr;
+	enum jool_stat_id id;
+	int rem;
+
+	*count = 0;
+	if (!root)
+		return 0;
+
+	nla_for_each_nested(attr, root, rem) {
+		id = nla_type(attr);
+		if (id == JSTAT_PADDING)
+			continue;
+		if (id < 1 || id > JSTAT_UNKNOWN)
+			return -EINVAL;
+
+		stats[*count].meta = jstat_metadatas[id];
+		stats[*count].value = nla_get_u64(attr);
+		(*count)++;
+	}
+
+	return 0;
+}
+
+static int handle_follow_msg(struct nl_msg *msg, void *arg)
+{
+	struct follow_args *args = arg;
+	struct genlmsghdr *ghdr;
+	struct nlattr *attrs[JNLAR_COUNT];
+	int error;
+
+	ghdr = joolnl_follow_hdr(msg, args->iname);
+	if (!ghdr)
+		return NL_SKIP;
+
+	error = nla_parse(attrs, JNLAR_MAX,
+			genlmsg_attrdata(ghdr, sizeof(struct joolnlhdr)),
+			genlmsg_attrlen(ghdr, sizeof(struct joolnlhdr)),
+			NULL);
+	if (error || !attrs[JNLAR_STATS_DELTAS])
+		return NL_SKIP;
+
+	if (parse_stream(attrs[JNLAR_STATS_DELTAS], args->delta.deltas,
+			&args->delta.delta_count))
+		goto bad_id;
+	if (parse_stream(attrs[JNLAR_STATS_GAUGES], args->delta.gauges,
+			&args->delta.gauge_count))
+		goto bad_id;
+
+	args->result = args->cb(&args->delta, args->args);
+	return args->result.error ? NL_STOP : NL_OK;
+
+bad_id:
+	args->result = result_from_error(
+		-EINVAL,
+		"The kernel module streamed an unknown stat counter."
+	);
+	return NL_STOP;
+}
+
+/**
+ * Subscribes to @iname's stats stream (see stats-stream-interval), and hands
+ * every delta to @cb. Only returns on error.
+ */
+struct jool_result joolnl_stats_follow(struct joolnl_socket *sk,
+		char const *iname, joolnl_stats_follow_cb cb, void *_args)
+{
+	struct follow_args args;
+	struct jool_result result;
+	int error;
+
+	error = iname_validate(iname, true);
+	if (error)
+		return result_from_error(error, INAME_VALIDATE_ERRMSG);
+	result = validate_stats();
+	if (result.error)
+		return result;
+
+	args.cb = cb;
+	args.args = _args;
+	args.iname = iname ? iname : "default";
+
+	/* Deltas are small and infrequent; the default buffer is plenty. */
+	return joolnl_follow(sk, JOOLNL_STATS_GRP_NAME, "stats stream", 0,
+			handle_follow_msg, &args, &args.result);
+}
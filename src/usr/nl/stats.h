@@ -25,4 +25,60 @@ struct jool_result joolnl_stats_foreach(
 	void *args
 );
 
+/* One stats-stream-interval's worth of changes. */
+struct joolnl_stats_delta {
+	/* Counters that grew since the previous delta, and how much. */
+	struct joolnl_stat deltas[JSTAT_COUNT];
+	unsigned int delta_count;
+	/* Current values of the gauges. */
+	struct joolnl_stat gauges[JSTAT_COUNT];
+	unsigned int gauge_count;
+};
+
+typedef struct jool_result (*joolnl_stats_follow_cb)(
+	struct joolnl_stats_delta const *delta, void *args
+);
+struct jool_result joolnl_stats_follow(
+	struct joolnl_socket *sk,
+	char const *iname,
+	joolnl_stats_follow_cb cb,
+	void *args
+);
+
+/* Metadata for stat @id. (Only valid if 1 <= @id <= JSTAT_UNKNOWN.) */
+struct joolnl_stat_metadata const *joolnl_stat_meta(enum jool_stat_id id);
+
+struct joolnl_instance_stats {
+	struct instance_entry_usr instance;
+	/* Indexed by enum jool_stat_id. */
+	__u64 stats[JSTAT_COUNT];
+};
+
+typedef struct jool_result (*joolnl_stats_dump_cb)(
+	struct joolnl_instance_stats const *entry, void *args
+);
+struct jool_result joolnl_stats_dump(
+	struct joolnl_socket *sk,
+	joolnl_stats_dump_cb cb,
+	void *args
+);
+
+struct joolnl_stage_metadata {
+	enum jool_stage id;
+	char *name;
+	char *doc;
+};
+
+struct joolnl_latency {
+	/* See JSTAGE_BUCKETS. */
+	__u64 buckets[JSTAGE_COUNT][JSTAGE_BUCKETS];
+};
+
+struct joolnl_stage_metadata const *joolnl_stage_meta(enum jool_stage stage);
+struct jool_result joolnl_stats_latency(
+	struct joolnl_socket *sk,
+	char const *iname,
+	struct joolnl_latency *result
+);
+
 #endif /* SRC_USR_NL_STATS_H_ */
@@ -0,0 +1,467 @@
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/sched.h>
+#include "framework/unit_test.h"
+#include "mod/common/address.h"
+#include "mod/common/atomic_config.h"
+#include "mod/common/xlator.c"
+
+MODULE_LICENSE(JOOL_LICENSE);
+MODULE_AUTHOR("Alberto Leiva");
+MODULE_DESCRIPTION("Atomic configuration test.");
+
+/*
+ * The NAT64 databases are dummies. These tests only care about who holds them,
+ * and whether the joold queue was stopped.
+ */
+struct dummy {
+	struct kref refs;
+};
+
+struct bib { struct dummy dummy; };
+struct pool4 { struct dummy dummy; };
+struct session_log { struct dummy dummy; };
+struct joold_queue {
+	struct dummy dummy;
+	bool stopped;
+};
+
+/* Dummies that haven't been released yet. */
+static atomic_t dummies = ATOMIC_INIT(0);
+
+static void *dummy_alloc(size_t size)
+{
+	struct dummy *dummy;
+
+	dummy = kzalloc(size, GFP_KERNEL);
+	if (!dummy)
+		return NULL;
+
+	kref_init(&dummy->refs);
+	atomic_inc(&dummies);
+	return dummy;
+}
+
+static void dummy_release(struct kref *refs)
+{
+	kfree(container_of(refs, struct dummy, refs));
+	atomic_dec(&dummies);
+}
+
+#define DUMMY_REFCOUNTERS(type, prefix)					\
+	void prefix##_get(struct type *db)				\
+	{								\
+		kref_get(&db->dummy.refs);				\
+	}								\
+	void prefix##_put(struct type *db)				\
+	{								\
+		kref_put(&db->dummy.refs, dummy_release);		\
+	}
+
+DUMMY_REFCOUNTERS(bib, bib)
+DUMMY_REFCOUNTERS(pool4, pool4db)
+DUMMY_REFCOUNTERS(session_log, slog)
+DUMMY_REFCOUNTERS(joold_queue, joold)
+
+struct bib *bib_alloc(void)
+{
+	return dummy_alloc(sizeof(struct bib));
+}
+
+struct pool4 *pool4db_alloc(void)
+{
+	return dummy_alloc(sizeof(struct pool4));
+}
+
+struct session_log *slog_alloc(struct net *ns, char const *iname)
+{
+	return dummy_alloc(sizeof(struct session_log));
+}
+
+struct joold_queue *joold_alloc(struct net *ns)
+{
+	return dummy_alloc(sizeof(struct joold_queue));
+}
+
+void joold_stop(struct joold_queue *queue)
+{
+	queue->stopped = true;
+}
+
+void slog_stop(struct session_log *log)
+{
+	/* No code. */
+}
+
+static void defrag_dummy(struct net *ns)
+{
+	/* No code. */
+}
+
+/** The network namespace where the test is being run. */
+static struct net *ns;
+static struct ipv6_prefix pool6;
+static char LIVE[] = "live";
+static char OTHER[] = "other";
+
+#define NAT64 (XF_IPTABLES | XT_NAT64)
+
+/* Clones running instance @iname, the way delta transactions do. */
+static int delta(char *iname, struct xlator *result)
+{
+	return xlator_find(ns, NAT64, iname, result);
+}
+
+/*
+ * Asserts running instance @iname still holds @queue, and hasn't stopped it.
+ * (Stopped queues can no longer advertise.)
+ */
+static bool assert_live_queue(char *iname, struct joold_queue *queue)
+{
+	struct xlator jool;
+	bool success = true;
+
+	if (delta(iname, &jool)) {
+		log_err("Instance '%s' is gone.", iname);
+		return false;
+	}
+
+	success &= ASSERT_PTR(queue, jool.nat64.joold, "%s's queue", iname);
+	success &= ASSERT_BOOL(false, queue->stopped, "%s's queue stopped",
+			iname);
+
+	xlator_put(&jool);
+	return success;
+}
+
+/* A delta candidate that fails to commit must not stop the queue it borrows. */
+static bool test_rollback_duplicate(void)
+{
+	struct xlator live, candidate1, candidate2;
+	struct xlator *batch[] = { &candidate1, &candidate2 };
+	bool success = true;
+
+	if (xlator_add(NAT64, LIVE, &pool6, &live))
+		return false;
+	if (delta(LIVE, &candidate1))
+		goto fail1;
+	if (delta(LIVE, &candidate2))
+		goto fail2;
+
+	success &= ASSERT_INT(-EINVAL, xlator_replace_batch(batch, 2),
+			"Commit result");
+	xlator_put(&candidate2);
+	xlator_put(&candidate1);
+
+	success &= assert_live_queue(LIVE, live.nat64.joold);
+	/* The instance itself, plus @live. */
+	success &= ASSERT_UINT(2, kref_read(&live.nat64.joold->dummy.refs),
+			"Queue refcount");
+
+	xlator_put(&live);
+	success &= ASSERT_INT(0, xlator_rm(XT_NAT64, LIVE), "Removal");
+	wait_for_retirements();
+	success &= ASSERT_INT(0, atomic_read(&dummies), "Leftover dummies");
+	return success;
+
+fail2:
+	xlator_put(&candidate1);
+fail1:
+	xlator_put(&live);
+	xlator_rm(XT_NAT64, LIVE);
+	return false;
+}
+
+/*
+ * Same, but the delta candidate is validated successfully. Its batch fails
+ * later.
+ */
+static bool test_rollback_batch(void)
+{
+	struct xlator live, other, candidate, replacement;
+	struct xlator *batch[] = { &candidate, &replacement };
+	struct ipv6_prefix pool6b;
+	bool success = true;
+
+	pool6b = pool6;
+	pool6b.addr.s6_addr32[1] = cpu_to_be32(1);
+
+	if (xlator_add(NAT64, LIVE, &pool6, &live))
+		return false;
+	if (xlator_add(NAT64, OTHER, &pool6, &other))
+		goto fail1;
+	if (delta(LIVE, &candidate))
+		goto fail2;
+	/* Not allowed, because it changes the pool6. */
+	if (xlator_init(&replacement, ns, OTHER, NAT64, &pool6b))
+		goto fail3;
+
+	success &= ASSERT_INT(-EINVAL, xlator_replace_batch(batch, 2),
+			"Commit result");
+	xlator_put(&replacement);
+	xlator_put(&candidate);
+
+	success &= assert_live_queue(LIVE, live.nat64.joold);
+	success &= assert_live_queue(OTHER, other.nat64.joold);
+
+	xlator_put(&other);
+	xlator_put(&live);
+	success &= ASSERT_INT(0, xlator_rm(XT_NAT64, OTHER), "Removal 1");
+	success &= ASSERT_INT(0, xlator_rm(XT_NAT64, LIVE), "Removal 2");
+	wait_for_retirements();
+	success &= ASSERT_INT(0, atomic_read(&dummies), "Leftover dummies");
+	return success;
+
+fail3:
+	xlator_put(&candidate);
+fail2:
+	xlator_put(&other);
+	xlator_rm(XT_NAT64, OTHER);
+fail1:
+	xlator_put(&live);
+	xlator_rm(XT_NAT64, LIVE);
+	return false;
+}
+
+/*
+ * The queue survives the replacement of its instance. The replacement stops it
+ * once it's removed.
+ */
+static bool test_commit(void)
+{
+	struct xlator live, candidate;
+	struct xlator *batch[] = { &candidate };
+	struct joold_queue *queue;
+	bool success = true;
+
+	if (xlator_add(NAT64, LIVE, &pool6, &live))
+		return false;
+	queue = live.nat64.joold;
+	if (delta(LIVE, &candidate)) {
+		xlator_put(&live);
+		xlator_rm(XT_NAT64, LIVE);
+		return false;
+	}
+
+	success &= ASSERT_INT(0, xlator_replace_batch(batch, 1),
+			"Commit result");
+	xlator_put(&candidate);
+	wait_for_retirements(); /* The old instance is destroyed here. */
+	success &= assert_live_queue(LIVE, queue);
+
+	success &= ASSERT_INT(0, xlator_rm(XT_NAT64, LIVE), "Removal");
+	wait_for_retirements();
+	success &= ASSERT_BOOL(true, queue->stopped, "Stopped after removal");
+
+	xlator_put(&live);
+	success &= ASSERT_INT(0, atomic_read(&dummies), "Leftover dummies");
+	return success;
+}
+
+/* Attributes of an atomic configuration request. (See send().) */
+#define REQ_INIT	(1 << 0)
+#define REQ_DELTA	(1 << 1)
+#define REQ_BIB		(1 << 2)
+#define REQ_HOLD	(1 << 3)
+#define REQ_END		(1 << 4)
+
+static int put_attrs(struct sk_buff *skb, struct nlattr **attrs,
+		unsigned int flags)
+{
+	/* Indexed by REQ_* bit. */
+	static const int TYPES[] = {
+		JNLAR_ATOMIC_INIT,
+		JNLAR_ATOMIC_DELTA,
+		JNLAR_BIB_ENTRIES,
+		JNLAR_ATOMIC_HOLD,
+		JNLAR_ATOMIC_END,
+	};
+	unsigned int i;
+	int error;
+
+	for (i = 0; i < ARRAY_SIZE(TYPES); i++) {
+		if (!(flags & (1 << i)))
+			continue;
+
+		attrs[TYPES[i]] = (struct nlattr *)skb_tail_pointer(skb);
+		/* The BIB list is empty, so it looks just like the flags. */
+		error = (TYPES[i] == JNLAR_ATOMIC_INIT)
+				? nla_put_u8(skb, TYPES[i], XF_IPTABLES)
+				: nla_put(skb, TYPES[i], 0, NULL);
+		if (error)
+			return error;
+	}
+
+	return 0;
+}
+
+/*
+ * Sends an atomic configuration request (one "file," or a slice of it) on
+ * instance @iname, as the userspace client would.
+ */
+static int send(char *iname, unsigned int flags)
+{
+	struct nlattr *attrs[JNLAR_COUNT] = { NULL };
+	struct joolnlhdr hdr;
+	struct genl_info info;
+	struct sk_buff *skb;
+	int error;
+
+	skb = alloc_skb(NLMSG_GOODSIZE, GFP_KERNEL);
+	if (!skb)
+		return -ENOMEM;
+
+	error = put_attrs(skb, attrs, flags);
+	if (error) {
+		kfree_skb(skb);
+		return error;
+	}
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.xt = XT_NAT64;
+	strcpy(hdr.iname, iname);
+	memset(&info, 0, sizeof(info));
+	info.attrs = attrs;
+	info.userhdr = &hdr;
+
+	error = atomconfig_add(skb, &info);
+	kfree_skb(skb);
+	return error;
+}
+
+/* Asserts instance @iname still translates (can be configured), untouched. */
+static bool assert_running(char *iname, struct joold_queue *queue)
+{
+	bool success = true;
+
+	success &= assert_live_queue(iname, queue);
+	/* The instance itself, plus the test's reference. */
+	success &= ASSERT_UINT(2, kref_read(&queue->dummy.refs),
+			"%s's queue refcount", iname);
+	success &= ASSERT_INT(0, send(iname, REQ_INIT | REQ_DELTA | REQ_END),
+			"%s's next transaction", iname);
+	wait_for_retirements();
+	success &= assert_live_queue(iname, queue);
+	return success;
+}
+
+/* A delta transaction that dies halfway must leave the instance alone. */
+static bool test_abort(void)
+{
+	struct xlator live;
+	bool success = true;
+
+	if (xlator_add(NAT64, LIVE, &pool6, &live))
+		return false;
+
+	/* Static BIB entries can't be part of a delta. */
+	success &= ASSERT_INT(-EINVAL,
+			send(LIVE, REQ_INIT | REQ_DELTA | REQ_BIB | REQ_END),
+			"Aborted transaction");
+	/* The candidate went away along with the transaction. */
+	success &= ASSERT_INT(-ESRCH, send(LIVE, REQ_END), "Orphan commit");
+	success &= assert_running(LIVE, live.nat64.joold);
+
+	xlator_put(&live);
+	success &= ASSERT_INT(0, xlator_rm(XT_NAT64, LIVE), "Removal");
+	wait_for_retirements();
+	success &= ASSERT_INT(0, atomic_read(&dummies), "Leftover dummies");
+	return success;
+}
+
+/*
+ * Two files in one transaction. The first one (a delta) is held until the
+ * second one is committed, but the second one is illegal, so neither of them
+ * can reach the running instances.
+ */
+static bool test_abort_batch(void)
+{
+	struct xlator live, other;
+	bool success = true;
+
+	if (xlator_add(NAT64, LIVE, &pool6, &live))
+		return false;
+	if (xlator_add(NAT64, OTHER, &pool6, &other)) {
+		xlator_put(&live);
+		xlator_rm(XT_NAT64, LIVE);
+		return false;
+	}
+
+	success &= ASSERT_INT(0,
+			send(LIVE, REQ_INIT | REQ_DELTA | REQ_HOLD | REQ_END),
+			"Held file");
+	/* Not a delta, so its pool6 is unset, which changes it. */
+	success &= ASSERT_INT(-EINVAL, send(OTHER, REQ_INIT | REQ_END),
+			"Failed commit");
+	/* The held file was part of the failed transaction. */
+	success &= ASSERT_INT(-ESRCH, send(LIVE, REQ_END), "Orphan commit");
+
+	success &= assert_running(LIVE, live.nat64.joold);
+	success &= assert_running(OTHER, other.nat64.joold);
+
+	xlator_put(&other);
+	xlator_put(&live);
+	success &= ASSERT_INT(0, xlator_rm(XT_NAT64, OTHER), "Removal 1");
+	success &= ASSERT_INT(0, xlator_rm(XT_NAT64, LIVE), "Removal 2");
+	wait_for_retirements();
+	success &= ASSERT_INT(0, atomic_read(&dummies), "Leftover dummies");
+	return success;
+}
+
+static int setup(void)
+{
+	int error;
+
+	error = str_to_addr6("64:ff9b::", &pool6.addr);
+	if (error)
+		return error;
+	pool6.len = 96;
+
+	ns = get_net_ns_by_pid(task_pid_vnr(current));
+	if (IS_ERR(ns)) {
+		log_err("Could not retrieve the current namespace.");
+		return PTR_ERR(ns);
+	}
+
+	error = xlator_setup();
+	if (error) {
+		log_info("xlator_setup() threw %d", error);
+		put_net(ns);
+		return error;
+	}
+
+	xlator_set_defrag(defrag_dummy);
+	return 0;
+}
+
+static void teardown(void)
+{
+	atomconfig_teardown();
+	xlator_teardown();
+	put_net(ns);
+}
+
+int init_module(void)
+{
+	struct test_group test = {
+		.name = "Atomic configuration",
+		.setup_fn = setup,
+		.teardown_fn = teardown,
+	};
+
+	if (test_group_begin(&test))
+		return -EINVAL;
+
+	test_group_test(&test, test_rollback_duplicate, "Duplicate delta rollback");
+	test_group_test(&test, test_rollback_batch, "Batch delta rollback");
+	test_group_test(&test, test_commit, "Delta commit");
+	test_group_test(&test, test_abort, "Aborted transaction");
+	test_group_test(&test, test_abort_batch, "Aborted multi-file transaction");
+
+	return test_group_end(&test);
+}
+
+void cleanup_module(void)
+{
+	/* No code. */
+}
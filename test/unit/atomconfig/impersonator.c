@@ -0,0 +1,111 @@
+#include "framework/unit_test.h"
+#include "mod/common/timer.h"
+#include "mod/common/nl/attribute.h"
+#include "mod/common/nl/global.h"
+#include "mod/common/nl/nl_common.h"
+#include "mod/common/nl/stats.h"
+#include "mod/common/db/bib/db.h"
+#include "mod/common/db/pool4/db.h"
+#include "mod/common/steps/handling_hairpinning_nat64.h"
+
+int global_update(struct jool_globals *cfg, xlator_type xt, bool force,
+		struct nlattr *root)
+{
+	return -EINVAL;
+}
+
+struct joolnlhdr *get_jool_hdr(struct genl_info *info)
+{
+	return info->userhdr;
+}
+
+int jnla_get_prefix4(struct nlattr *attr, char const *name,
+		struct ipv4_prefix *out)
+{
+	broken_unit_call(__func__);
+	return -EINVAL;
+}
+
+int jnla_get_eam(struct nlattr *attr, char const *name,
+		struct eamt_entry *eam)
+{
+	broken_unit_call(__func__);
+	return -EINVAL;
+}
+
+int jnla_get_pool4(struct nlattr *attr, char const *name,
+		struct pool4_entry *entry)
+{
+	broken_unit_call(__func__);
+	return -EINVAL;
+}
+
+int jnla_get_bib(struct nlattr *attr, char const *name,
+		struct bib_entry *entry)
+{
+	broken_unit_call(__func__);
+	return -EINVAL;
+}
+
+struct pool4 *pool4db_clone(struct pool4 *pool)
+{
+	broken_unit_call(__func__);
+	return NULL;
+}
+
+int pool4db_add(struct pool4 *pool, const struct pool4_entry *entry)
+{
+	broken_unit_call(__func__);
+	return -EINVAL;
+}
+
+int pool4db_rm_usr(struct pool4 *pool, struct pool4_entry *entry)
+{
+	broken_unit_call(__func__);
+	return -EINVAL;
+}
+
+int bib_add_static_batch(struct xlator *jool, struct bib_entry *entries,
+		unsigned int count)
+{
+	broken_unit_call(__func__);
+	return -EINVAL;
+}
+
+verdict translating_the_packet(struct xlation *state)
+{
+	return VERDICT_DROP;
+}
+
+bool is_hairpin_nat64(struct xlation *state)
+{
+	broken_unit_call(__func__);
+	return false;
+}
+
+verdict handling_hairpinning_nat64(struct xlation *old)
+{
+	broken_unit_call(__func__);
+	return VERDICT_DROP;
+}
+
+void jtimer_init(struct delayed_work *work, work_func_t fn)
+{
+	INIT_DELAYED_WORK(work, fn);
+}
+
+unsigned long jtimer_clean(struct xlator *jool)
+{
+	broken_unit_call(__func__);
+	return 0;
+}
+
+void jtimer_schedule(struct delayed_work *work, unsigned long delay)
+{
+	/* The housekeeper is not under test. */
+}
+
+void jnl_stats_stream(struct xlator *jool)
+{
+	broken_unit_call(__func__);
+}
@@ -2,6 +2,7 @@
 #include <linux/printk.h>
 #include "framework/unit_test.h"
 #include "framework/bib.h"
+#include "common/constants.h"
 
 MODULE_LICENSE(JOOL_LICENSE);
 MODULE_AUTHOR("Alberto Leiva");
@@ -13,6 +14,24 @@ static struct bib_entry bibs[8];
 static struct bib_entry *bibs4[4][25];
 static struct bib_entry *bibs6[4][25];
 
+/*
+ * Live BIB entries, as counted by the wkmalloc hooks. (This module is compiled
+ * with JKMEMLEAK; see the Makefile.)
+ */
+static atomic_t bib_entries = ATOMIC_INIT(0);
+
+void wkmalloc_add(const char *name)
+{
+	if (strcmp(name, "bib entry") == 0)
+		atomic_inc(&bib_entries);
+}
+
+void wkmalloc_rm(const char *name, void *obj)
+{
+	if (strcmp(name, "bib entry") == 0)
+		atomic_dec(&bib_entries);
+}
+
 static bool assert4(unsigned int addr_id, unsigned int port)
 {
 	struct bib_entry bib;
@@ -205,6 +224,153 @@ static bool test_flow(void)
 	return success;
 }
 
+static int init_entry(struct bib_entry *entry, l4_protocol proto,
+		char *addr6, u16 port6, char *addr4, u16 port4)
+{
+	int error;
+
+	error = str_to_addr6(addr6, &entry->addr6.l3);
+	if (error)
+		return error;
+	error = str_to_addr4(addr4, &entry->addr4.l3);
+	if (error)
+		return error;
+	entry->addr6.l4 = port6;
+	entry->addr4.l4 = port4;
+	entry->l4_proto = proto;
+	entry->is_static = true;
+	return 0;
+}
+
+/* Asserts @expected's presence (or absence, if @found is false) in the BIB. */
+static bool assert_entry(struct bib_entry *expected, bool found,
+		char const *test_name)
+{
+	struct bib_entry bib;
+	int error;
+	bool success = true;
+
+	error = bib_find6(jool.nat64.bib, expected->l4_proto, &expected->addr6,
+			&bib);
+	if (!found)
+		return ASSERT_INT(-ESRCH, error, "%s - find6", test_name);
+
+	success &= ASSERT_INT(0, error, "%s - find6", test_name);
+	if (error)
+		return false;
+	success &= ASSERT_BIB(expected, &bib, test_name);
+	success &= ASSERT_BOOL(true, bib.is_static, "%s - static", test_name);
+
+	error = bib_find4(jool.nat64.bib, expected->l4_proto, &expected->addr4,
+			NULL);
+	success &= ASSERT_INT(0, error, "%s - find4", test_name);
+
+	return success;
+}
+
+static int count_session(struct session_entry const *session, void *arg)
+{
+	(*(unsigned int *)arg)++;
+	return 0;
+}
+
+static bool test_batch(void)
+{
+	struct session_entry session;
+	struct bib_entry batch[6];
+	unsigned int sessions;
+	int base;
+	int error;
+	bool success = true;
+
+	base = atomic_read(&bib_entries);
+
+	/* A dynamic entry, which the batch will upgrade. */
+	memset(&session, 0, sizeof(session));
+	if (init_entry(&batch[0], L4PROTO_UDP, "2001:db8::2", 1,
+			"192.0.2.2", 1))
+		return false;
+	session.src6 = batch[0].addr6;
+	session.src4 = batch[0].addr4;
+	if (str_to_addr6("64:ff9b::203.0.113.1", &session.dst6.l3))
+		return false;
+	session.dst6.l4 = 80;
+	if (str_to_addr4("203.0.113.1", &session.dst4.l3))
+		return false;
+	session.dst4.l4 = 80;
+	session.proto = L4PROTO_UDP;
+	session.state = ESTABLISHED;
+	session.timer_type = SESSION_TIMER_EST;
+	session.update_time = jiffies;
+	session.timeout = UDP_DEFAULT;
+	error = bib_add_session(&jool, &session, NULL);
+	success &= ASSERT_INT(0, error, "Dynamic entry");
+	if (error)
+		return false;
+	success &= ASSERT_INT(base + 1, atomic_read(&bib_entries),
+			"Dynamic entry count");
+
+	/* Runs of several protocols; all of them succeed. */
+	if (init_entry(&batch[0], L4PROTO_TCP, "2001:db8::1", 1, "192.0.2.1", 1)
+	    || init_entry(&batch[1], L4PROTO_TCP, "2001:db8::1", 2, "192.0.2.1", 2)
+	    || init_entry(&batch[2], L4PROTO_UDP, "2001:db8::2", 1, "192.0.2.2", 1)
+	    || init_entry(&batch[3], L4PROTO_UDP, "2001:db8::2", 2, "192.0.2.2", 2)
+	    || init_entry(&batch[4], L4PROTO_TCP, "2001:db8::3", 1, "192.0.2.3", 1)
+	    || init_entry(&batch[5], L4PROTO_ICMP, "2001:db8::4", 1, "192.0.2.4", 1))
+		return false;
+
+	success &= ASSERT_INT(0, bib_add_static_batch(&jool, batch, 6),
+			"Mixed batch");
+	success &= assert_entry(&batch[0], true, "Mixed TCP 1");
+	success &= assert_entry(&batch[1], true, "Mixed TCP 2");
+	success &= assert_entry(&batch[2], true, "Upgraded UDP");
+	success &= assert_entry(&batch[3], true, "Mixed UDP");
+	success &= assert_entry(&batch[4], true, "Mixed TCP 3");
+	success &= assert_entry(&batch[5], true, "Mixed ICMP");
+	/* The upgrade keeps the original entry, and frees the new one. */
+	sessions = 0;
+	bib_foreach_session(&jool, L4PROTO_UDP, count_session, &sessions, NULL);
+	success &= ASSERT_UINT(1, sessions, "Upgraded entry kept its session");
+	success &= ASSERT_INT(base + 6, atomic_read(&bib_entries),
+			"Mixed batch count");
+
+	/* A collision halfway. */
+	if (init_entry(&batch[0], L4PROTO_UDP, "2001:db8::5", 1, "192.0.2.5", 1)
+	    || init_entry(&batch[1], L4PROTO_TCP, "2001:db8::5", 1, "192.0.2.5", 1)
+	    || init_entry(&batch[2], L4PROTO_TCP, "2001:db8::6", 1, "192.0.2.1", 1)
+	    || init_entry(&batch[3], L4PROTO_TCP, "2001:db8::7", 1, "192.0.2.7", 1)
+	    || init_entry(&batch[4], L4PROTO_ICMP, "2001:db8::7", 1, "192.0.2.7", 1))
+		return false;
+
+	success &= ASSERT_INT(-EEXIST, bib_add_static_batch(&jool, batch, 5),
+			"Colliding batch");
+	success &= assert_entry(&batch[0], true, "Before collision 1");
+	success &= assert_entry(&batch[1], true, "Before collision 2");
+	success &= assert_entry(&batch[2], false, "Collision");
+	success &= assert_entry(&batch[3], false, "After collision, same run");
+	success &= assert_entry(&batch[4], false, "After collision, next run");
+	if (init_entry(&batch[2], L4PROTO_TCP, "2001:db8::1", 1, "192.0.2.1", 1))
+		return false;
+	success &= assert_entry(&batch[2], true, "Collision victim");
+	success &= ASSERT_INT(base + 8, atomic_read(&bib_entries),
+			"Colliding batch count");
+
+	/* A collision on the IPv6 side, first thing. */
+	if (init_entry(&batch[0], L4PROTO_UDP, "2001:db8::2", 2, "192.0.2.9", 9)
+	    || init_entry(&batch[1], L4PROTO_UDP, "2001:db8::9", 9, "192.0.2.9", 9))
+		return false;
+	success &= ASSERT_INT(-EEXIST, bib_add_static_batch(&jool, batch, 2),
+			"IPv6 collision");
+	success &= assert_entry(&batch[1], false, "After IPv6 collision");
+	success &= ASSERT_INT(base + 8, atomic_read(&bib_entries),
+			"IPv6 collision count");
+
+	bib_flush(&jool);
+	success &= ASSERT_INT(base, atomic_read(&bib_entries), "Flush count");
+
+	return success;
+}
+
 enum session_fate tcp_est_expire_cb(struct session_entry *session, void *arg)
 {
 	return FATE_RM;
@@ -234,6 +400,7 @@ int init_module(void)
 		return -EINVAL;
 
 	test_group_test(&test, test_flow, "Flow");
+	test_group_test(&test, test_batch, "Static batch");
 
 	return test_group_end(&test);
 }
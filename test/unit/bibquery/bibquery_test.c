@@ -0,0 +1,482 @@
+#include <linux/module.h>
+#include <linux/printk.h>
+
+#include "framework/unit_test.h"
+#include "common/constants.h"
+#include "mod/common/db/bib/db.h"
+#include "mod/common/db/bib/query.h"
+
+MODULE_LICENSE(JOOL_LICENSE);
+MODULE_AUTHOR("Alberto Leiva Popper");
+MODULE_DESCRIPTION("BIB/session query module test.");
+
+static struct xlator jool;
+static const l4_protocol PROTO = L4PROTO_TCP;
+
+/*
+ * Three subscribers (2001:db8:0:1::/64, 2001:db8:0:2::/64, 2001:db8:0:3::/64)
+ * holding five BIB entries and six sessions between them.
+ */
+static const struct {
+	char const *src6;
+	__u16 src6_port;
+	char const *src4;
+	__u16 src4_port;
+	char const *dst4;
+	__u16 dst4_port;
+	tcp_state state;
+	unsigned int idle; /* msecs */
+} SESSIONS[] = {
+	{ "2001:db8:0:1::1", 1000, "192.0.2.1", 1000, "203.0.113.1", 80, ESTABLISHED, 0 },
+	{ "2001:db8:0:1::1", 1001, "192.0.2.1", 1001, "203.0.113.2", 80, ESTABLISHED, 0 },
+	{ "2001:db8:0:1::2", 1000, "192.0.2.1", 1002, "203.0.113.1", 443, V4_FIN_RCV, 10000 },
+	{ "2001:db8:0:2::1", 1000, "192.0.2.2", 2000, "203.0.113.1", 80, ESTABLISHED, 10000 },
+	{ "2001:db8:0:2::1", 1000, "192.0.2.2", 2000, "198.51.100.1", 80, TRANS, 0 },
+	{ "2001:db8:0:3::1", 1000, "192.0.2.3", 2001, "198.51.100.1", 80, ESTABLISHED, 0 },
+};
+
+static bool inject_sessions(void)
+{
+	struct session_entry entry;
+	unsigned int i;
+	int error;
+
+	memset(&entry, 0, sizeof(entry));
+	entry.proto = PROTO;
+	entry.timer_type = SESSION_TIMER_EST;
+	entry.timeout = TCP_EST;
+
+	for (i = 0; i < ARRAY_SIZE(SESSIONS); i++) {
+		if (str_to_addr6(SESSIONS[i].src6, &entry.src6.l3))
+			return false;
+		entry.src6.l4 = SESSIONS[i].src6_port;
+		if (str_to_addr4(SESSIONS[i].src4, &entry.src4.l3))
+			return false;
+		entry.src4.l4 = SESSIONS[i].src4_port;
+		if (str_to_addr4(SESSIONS[i].dst4, &entry.dst4.l3))
+			return false;
+		entry.dst4.l4 = SESSIONS[i].dst4_port;
+		if (str_to_addr6("64:ff9b::", &entry.dst6.l3))
+			return false;
+		entry.dst6.l3.s6_addr32[3] = entry.dst4.l3.s_addr;
+		entry.dst6.l4 = entry.dst4.l4;
+		entry.state = SESSIONS[i].state;
+		entry.update_time = jiffies - msecs_to_jiffies(SESSIONS[i].idle);
+
+		error = bib_add_session(&jool, &entry, NULL);
+		if (error) {
+			log_err("Errcode %d on bib_add_session().", error);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static void init_query(struct bib_query *query, __u8 mode)
+{
+	memset(query, 0, sizeof(*query));
+	query->mode = mode;
+}
+
+static void init_top(struct bib_query *query, __u32 top, __u8 subscriber_len)
+{
+	init_query(query, BQM_TOP);
+	query->top = top;
+	query->subscriber_len = subscriber_len;
+}
+
+static int set_src6(struct bib_query *query, char const *addr, __u8 len)
+{
+	query->src6.set = true;
+	query->src6.prefix.len = len;
+	return str_to_addr6(addr, &query->src6.prefix.addr);
+}
+
+static int set_src4(struct bib_query *query, char const *addr, __u8 len,
+		__u16 min, __u16 max)
+{
+	query->src4_set = true;
+	query->src4.prefix.len = len;
+	query->src4.ports.min = min;
+	query->src4.ports.max = max;
+	return str_to_addr4(addr, &query->src4.prefix.addr);
+}
+
+static int set_dst4(struct bib_query *query, char const *addr, __u8 len)
+{
+	query->dst4.set = true;
+	query->dst4.prefix.len = len;
+	return str_to_addr4(addr, &query->dst4.prefix.addr);
+}
+
+static void set_state(struct bib_query *query, tcp_state state)
+{
+	query->state_set = true;
+	query->state = state;
+}
+
+static bool assert_matches(struct bib_query const *query, bool session,
+		unsigned int expected, char const *test_name)
+{
+	struct bib_query_result result;
+	int error;
+	bool success = true;
+
+	success &= ASSERT_INT(0, bibq_validate(query), "%s - validation",
+			test_name);
+	error = session
+			? bibq_query_sessions(&jool, PROTO, query, &result)
+			: bibq_query_bib(jool.nat64.bib, PROTO, query, &result);
+	success &= ASSERT_INT(0, error, "%s - result", test_name);
+	if (!error)
+		success &= ASSERT_UINT(expected, result.matches,
+				"%s - matches", test_name);
+
+	return success;
+}
+
+static bool assert_top(struct bib_query_result const *result,
+		unsigned int index, char const *prefix, __u8 len,
+		__u32 matches, char const *test_name)
+{
+	bool success = true;
+
+	success &= ASSERT_ADDR6(prefix, &result->top[index].subscriber.addr,
+			test_name);
+	success &= ASSERT_UINT(len, result->top[index].subscriber.len,
+			"%s - length", test_name);
+	success &= ASSERT_UINT(matches, result->top[index].matches,
+			"%s - matches", test_name);
+
+	return success;
+}
+
+static bool test_validate(void)
+{
+	struct bib_query query;
+	bool success = true;
+
+	init_query(&query, BQM_COUNT);
+	success &= ASSERT_INT(0, bibq_validate(&query), "Empty");
+	init_query(&query, BQM_LIST);
+	success &= ASSERT_INT(0, bibq_validate(&query), "Empty list");
+	init_query(&query, 3);
+	success &= ASSERT_INT(-EINVAL, bibq_validate(&query), "Unknown mode");
+
+	init_query(&query, BQM_COUNT);
+	if (set_src6(&query, "2001:db8::1", 64))
+		return false;
+	success &= ASSERT_INT(-EINVAL, bibq_validate(&query), "src6 suffix");
+
+	init_query(&query, BQM_COUNT);
+	if (set_src4(&query, "192.0.2.1", 24, 0, 65535))
+		return false;
+	success &= ASSERT_INT(-EINVAL, bibq_validate(&query), "src4 suffix");
+	if (set_src4(&query, "192.0.2.0", 24, 2000, 1000))
+		return false;
+	success &= ASSERT_INT(-EINVAL, bibq_validate(&query), "Inverted ports");
+	if (set_src4(&query, "192.0.2.0", 24, 1000, 1000))
+		return false;
+	success &= ASSERT_INT(0, bibq_validate(&query), "Single port");
+
+	init_query(&query, BQM_COUNT);
+	if (set_dst4(&query, "192.0.2.1", 24))
+		return false;
+	success &= ASSERT_INT(-EINVAL, bibq_validate(&query), "dst4 suffix");
+
+	/* top and subscriber_len only matter to BQM_TOP. */
+	init_query(&query, BQM_COUNT);
+	query.subscriber_len = 200;
+	success &= ASSERT_INT(0, bibq_validate(&query), "Count ignores top");
+
+	init_top(&query, 0, 64);
+	success &= ASSERT_INT(-EINVAL, bibq_validate(&query), "Top 0");
+	init_top(&query, 1, 64);
+	success &= ASSERT_INT(0, bibq_validate(&query), "Top 1");
+	init_top(&query, BIB_QUERY_MAX_TOP, 64);
+	success &= ASSERT_INT(0, bibq_validate(&query), "Top max");
+	init_top(&query, BIB_QUERY_MAX_TOP + 1, 64);
+	success &= ASSERT_INT(-EINVAL, bibq_validate(&query), "Top max + 1");
+	init_top(&query, 10, 128);
+	success &= ASSERT_INT(0, bibq_validate(&query), "Length 128");
+	init_top(&query, 10, 129);
+	success &= ASSERT_INT(-EINVAL, bibq_validate(&query), "Length 129");
+
+	return success;
+}
+
+static bool test_session_filters(void)
+{
+	struct bib_query query;
+	bool success = true;
+
+	init_query(&query, BQM_COUNT);
+	success &= assert_matches(&query, true, 6, "No filters");
+
+	if (set_src6(&query, "2001:db8:0:1::", 64))
+		return false;
+	success &= assert_matches(&query, true, 3, "src6 /64");
+	if (set_src6(&query, "2001:db8:0:2::1", 128))
+		return false;
+	success &= assert_matches(&query, true, 2, "src6 /128");
+	if (set_src6(&query, "2001:db8:0:4::", 64))
+		return false;
+	success &= assert_matches(&query, true, 0, "src6 miss");
+
+	init_query(&query, BQM_COUNT);
+	if (set_src4(&query, "192.0.2.1", 32, 1000, 1001))
+		return false;
+	success &= assert_matches(&query, true, 2, "src4 /32, ports");
+	if (set_src4(&query, "192.0.2.2", 31, 0, 65535))
+		return false;
+	success &= assert_matches(&query, true, 3, "src4 /31, all ports");
+	if (set_src4(&query, "192.0.2.0", 24, 1002, 2000))
+		return false;
+	success &= assert_matches(&query, true, 3, "src4 /24, port range");
+
+	init_query(&query, BQM_COUNT);
+	if (set_dst4(&query, "203.0.113.0", 24))
+		return false;
+	success &= assert_matches(&query, true, 4, "dst4 /24");
+	if (set_dst4(&query, "198.51.100.1", 32))
+		return false;
+	success &= assert_matches(&query, true, 2, "dst4 /32");
+
+	init_query(&query, BQM_COUNT);
+	set_state(&query, ESTABLISHED);
+	success &= assert_matches(&query, true, 4, "ESTABLISHED");
+	set_state(&query, V4_FIN_RCV);
+	success &= assert_matches(&query, true, 1, "V4_FIN_RCV");
+	set_state(&query, TRANS);
+	success &= assert_matches(&query, true, 1, "TRANS");
+	set_state(&query, V6_INIT);
+	success &= assert_matches(&query, true, 0, "V6_INIT");
+
+	init_query(&query, BQM_COUNT);
+	query.min_idle = 5000;
+	success &= assert_matches(&query, true, 2, "Idle");
+
+	/* Filters are ANDed. */
+	init_query(&query, BQM_COUNT);
+	if (set_src6(&query, "2001:db8:0:2::", 64))
+		return false;
+	if (set_dst4(&query, "203.0.113.0", 24))
+		return false;
+	success &= assert_matches(&query, true, 1, "src6 + dst4");
+	set_state(&query, TRANS);
+	success &= assert_matches(&query, true, 0, "src6 + dst4 + state");
+
+	return success;
+}
+
+static bool test_bib_filters(void)
+{
+	struct bib_query query;
+	bool success = true;
+
+	init_query(&query, BQM_COUNT);
+	success &= assert_matches(&query, false, 5, "No filters");
+
+	if (set_src6(&query, "2001:db8:0:1::", 64))
+		return false;
+	success &= assert_matches(&query, false, 3, "src6");
+
+	init_query(&query, BQM_COUNT);
+	if (set_src4(&query, "192.0.2.2", 32, 2000, 2000))
+		return false;
+	success &= assert_matches(&query, false, 1, "src4");
+
+	init_query(&query, BQM_COUNT);
+	if (set_src6(&query, "2001:db8:0:1::", 64))
+		return false;
+	if (set_src4(&query, "192.0.2.1", 32, 1001, 1002))
+		return false;
+	success &= assert_matches(&query, false, 2, "src6 + src4");
+
+	/* BIB entries have no dst4, state nor idle time. */
+	init_query(&query, BQM_COUNT);
+	if (set_dst4(&query, "198.51.100.1", 32))
+		return false;
+	set_state(&query, TRANS);
+	query.min_idle = 5000;
+	success &= assert_matches(&query, false, 5, "Session-only filters");
+
+	return success;
+}
+
+static bool test_top(void)
+{
+	struct bib_query query;
+	struct bib_query_result result;
+	int error;
+	bool success = true;
+
+	/* Sessions per /64: 3, 2, 1. */
+	init_top(&query, 2, 64);
+	error = bibq_query_sessions(&jool, PROTO, &query, &result);
+	success &= ASSERT_INT(0, error, "Top 2 result");
+	success &= ASSERT_UINT(6, result.matches, "Top 2 matches");
+	success &= ASSERT_UINT(3, result.subscribers, "Top 2 subscribers");
+	success &= ASSERT_UINT(2, result.top_count, "Top 2 count");
+	success &= assert_top(&result, 0, "2001:db8:0:1::", 64, 3, "Top 2 #0");
+	success &= assert_top(&result, 1, "2001:db8:0:2::", 64, 2, "Top 2 #1");
+
+	/* Filters apply before ranking. */
+	if (set_dst4(&query, "198.51.100.0", 24))
+		return false;
+	query.top = 1;
+	error = bibq_query_sessions(&jool, PROTO, &query, &result);
+	success &= ASSERT_INT(0, error, "Filtered top result");
+	success &= ASSERT_UINT(2, result.matches, "Filtered top matches");
+	success &= ASSERT_UINT(2, result.subscribers, "Filtered top subscribers");
+	success &= ASSERT_UINT(1, result.top_count, "Filtered top count");
+	success &= assert_top(&result, 0, "2001:db8:0:2::", 64, 1,
+			"Filtered top #0");
+
+	/* A single subscriber that owns everything. */
+	init_top(&query, 5, 0);
+	error = bibq_query_sessions(&jool, PROTO, &query, &result);
+	success &= ASSERT_INT(0, error, "/0 result");
+	success &= ASSERT_UINT(1, result.subscribers, "/0 subscribers");
+	success &= ASSERT_UINT(1, result.top_count, "/0 count");
+	success &= assert_top(&result, 0, "::", 0, 6, "/0 #0");
+
+	return success;
+}
+
+static bool test_top_ties(void)
+{
+	struct bib_query query;
+	struct bib_query_result result;
+	int error;
+	bool success = true;
+
+	/* Sessions per /128: 2, 1, 2, 1. The smaller address wins ties. */
+	init_top(&query, BIB_QUERY_MAX_TOP, 128);
+	error = bibq_query_sessions(&jool, PROTO, &query, &result);
+	success &= ASSERT_INT(0, error, "All result");
+	success &= ASSERT_UINT(4, result.subscribers, "All subscribers");
+	success &= ASSERT_UINT(4, result.top_count, "All count");
+	success &= assert_top(&result, 0, "2001:db8:0:1::1", 128, 2, "All #0");
+	success &= assert_top(&result, 1, "2001:db8:0:2::1", 128, 2, "All #1");
+	success &= assert_top(&result, 2, "2001:db8:0:1::2", 128, 1, "All #2");
+	success &= assert_top(&result, 3, "2001:db8:0:3::1", 128, 1, "All #3");
+
+	/* Ties on the cutoff. */
+	query.top = 1;
+	error = bibq_query_sessions(&jool, PROTO, &query, &result);
+	success &= ASSERT_INT(0, error, "Top 1 result");
+	success &= ASSERT_UINT(4, result.subscribers, "Top 1 subscribers");
+	success &= ASSERT_UINT(1, result.top_count, "Top 1 count");
+	success &= assert_top(&result, 0, "2001:db8:0:1::1", 128, 2, "Top 1 #0");
+
+	query.top = 3;
+	error = bibq_query_sessions(&jool, PROTO, &query, &result);
+	success &= ASSERT_INT(0, error, "Top 3 result");
+	success &= ASSERT_UINT(3, result.top_count, "Top 3 count");
+	success &= assert_top(&result, 0, "2001:db8:0:1::1", 128, 2, "Top 3 #0");
+	success &= assert_top(&result, 1, "2001:db8:0:2::1", 128, 2, "Top 3 #1");
+	success &= assert_top(&result, 2, "2001:db8:0:1::2", 128, 1, "Top 3 #2");
+
+	/* BIB entries per /64: 3, 1, 1. */
+	init_top(&query, 2, 64);
+	error = bibq_query_bib(jool.nat64.bib, PROTO, &query, &result);
+	success &= ASSERT_INT(0, error, "BIB result");
+	success &= ASSERT_UINT(5, result.matches, "BIB matches");
+	success &= ASSERT_UINT(3, result.subscribers, "BIB subscribers");
+	success &= ASSERT_UINT(2, result.top_count, "BIB count");
+	success &= assert_top(&result, 0, "2001:db8:0:1::", 64, 3, "BIB #0");
+	success &= assert_top(&result, 1, "2001:db8:0:2::", 64, 1, "BIB #1");
+
+	return success;
+}
+
+static bool test_top_overflow(void)
+{
+	struct bib_query query;
+	struct bib_query_result result;
+	int error;
+	bool success = true;
+
+	/* N larger than the table. */
+	init_top(&query, 10, 64);
+	error = bibq_query_sessions(&jool, PROTO, &query, &result);
+	success &= ASSERT_INT(0, error, "Sessions result");
+	success &= ASSERT_UINT(3, result.subscribers, "Sessions subscribers");
+	success &= ASSERT_UINT(3, result.top_count, "Sessions count");
+	success &= assert_top(&result, 0, "2001:db8:0:1::", 64, 3, "Sessions #0");
+	success &= assert_top(&result, 1, "2001:db8:0:2::", 64, 2, "Sessions #1");
+	success &= assert_top(&result, 2, "2001:db8:0:3::", 64, 1, "Sessions #2");
+
+	error = bibq_query_bib(jool.nat64.bib, PROTO, &query, &result);
+	success &= ASSERT_INT(0, error, "BIB result");
+	success &= ASSERT_UINT(3, result.top_count, "BIB count");
+	success &= assert_top(&result, 2, "2001:db8:0:3::", 64, 1, "BIB #2");
+
+	/* Nothing matches. */
+	if (set_src6(&query, "2001:db8:0:4::", 64))
+		return false;
+	error = bibq_query_sessions(&jool, PROTO, &query, &result);
+	success &= ASSERT_INT(0, error, "No matches result");
+	success &= ASSERT_UINT(0, result.matches, "No matches matches");
+	success &= ASSERT_UINT(0, result.subscribers, "No matches subscribers");
+	success &= ASSERT_UINT(0, result.top_count, "No matches count");
+
+	/* Empty table. */
+	init_top(&query, 10, 64);
+	error = bibq_query_sessions(&jool, L4PROTO_UDP, &query, &result);
+	success &= ASSERT_INT(0, error, "Empty result");
+	success &= ASSERT_UINT(0, result.matches, "Empty matches");
+	success &= ASSERT_UINT(0, result.top_count, "Empty count");
+
+	return success;
+}
+
+static int init(void)
+{
+	int error;
+
+	error = xlator_init(&jool, NULL, INAME_DEFAULT, XF_NETFILTER | XT_NAT64,
+			NULL);
+	if (error)
+		return error;
+
+	if (!inject_sessions()) {
+		xlator_put(&jool);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static void clean(void)
+{
+	xlator_put(&jool);
+}
+
+int init_module(void)
+{
+	struct test_group test = {
+		.name = "BIB/Session query",
+		.init_fn = init,
+		.clean_fn = clean,
+	};
+
+	if (test_group_begin(&test))
+		return -EINVAL;
+
+	test_group_test(&test, test_validate, "Validation");
+	test_group_test(&test, test_session_filters, "Session filters");
+	test_group_test(&test, test_bib_filters, "BIB filters");
+	test_group_test(&test, test_top, "Top N");
+	test_group_test(&test, test_top_ties, "Top N ties");
+	test_group_test(&test, test_top_overflow, "N larger than the table");
+
+	return test_group_end(&test);
+}
+
+void cleanup_module(void)
+{
+	/* No code. */
+}
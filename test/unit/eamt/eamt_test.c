@@ -463,6 +463,36 @@ static bool remove_test(void)
 	return success;
 }
 
+static bool clone_test(void)
+{
+	struct eam_table *original;
+	struct eam_table *clone;
+	bool success = true;
+
+	success &= create_four_story_trie();
+
+	original = eamt;
+	clone = eamt_clone(original);
+	if (!ASSERT_BOOL(true, clone != NULL, "clone"))
+		return false;
+
+	/* The clone starts out identical... */
+	eamt = clone;
+	success &= test("1.0.0.0", "1::");
+	success &= test("7.0.0.0", "1:2:1:1::");
+
+	/* ...but modifying it doesn't affect the original. */
+	success &= remove_entry(NULL, 0, "1:2:1:1::", 64, 0);
+	success &= test_6to4("1:2:1:1::", "6.0.0.0");
+
+	eamt = original;
+	success &= test("7.0.0.0", "1:2:1:1::");
+
+	eamt_put(clone);
+	eamt_flush(eamt);
+	return success;
+}
+
 static int address_mapping_test_init(void)
 {
 	struct test_group test = {
@@ -480,6 +510,7 @@ static int address_mapping_test_init(void)
 	test_group_test(&test, rfc7757_overlapping_test, "RFC 7757 Section 5, 1st half");
 	test_group_test(&test, rfc7757_identical_test, "RFC 7757 Section 5, 2nd half");
 	test_group_test(&test, remove_test, "remove function");
+	test_group_test(&test, clone_test, "clone function");
 
 	return test_group_end(&test);
 }
@@ -1,4 +1,5 @@
 #include "mod/common/joold.h"
+#include "mod/common/session_log.h"
 #include "framework/unit_test.h"
 
 static struct fake {
@@ -24,3 +25,33 @@ void joold_put(struct joold_queue *queue)
 {
 	/* No code. */
 }
+
+void joold_stop(struct joold_queue *queue)
+{
+	/* No code. */
+}
+
+struct session_log *slog_alloc(struct net *ns, char const *iname)
+{
+	return (struct session_log *)&dummy;
+}
+
+void slog_get(struct session_log *log)
+{
+	/* No code. */
+}
+
+void slog_put(struct session_log *log)
+{
+	/* No code. */
+}
+
+void slog_stop(struct session_log *log)
+{
+	/* No code. */
+}
+
+void slog_add(struct xlator *jool, struct slog_event *event)
+{
+	/* No code. */
+}
@@ -0,0 +1,141 @@
+#include <linux/kernel.h>
+#include <linux/module.h>
+
+#include "framework/types.h"
+#include "framework/unit_test.h"
+#include "mod/common/db/bib/frag.c"
+
+MODULE_LICENSE(JOOL_LICENSE);
+MODULE_AUTHOR("Alberto Leiva");
+MODULE_DESCRIPTION("Fragment tuple table test");
+
+static struct frag_table *table;
+
+/* Only the fields the table cares about. */
+static int init_fragment(struct packet *pkt, char *src, char *dst, __u16 id,
+		__u16 offset, bool mf)
+{
+	struct sk_buff *skb;
+	struct iphdr *hdr;
+	struct in_addr tmp;
+	int error;
+
+	skb = alloc_skb(sizeof(*hdr), GFP_KERNEL);
+	if (!skb)
+		return -ENOMEM;
+	skb_reset_network_header(skb);
+	hdr = skb_put(skb, sizeof(*hdr));
+	memset(hdr, 0, sizeof(*hdr));
+
+	error = str_to_addr4(src, &tmp);
+	if (error)
+		goto fail;
+	hdr->saddr = tmp.s_addr;
+	error = str_to_addr4(dst, &tmp);
+	if (error)
+		goto fail;
+	hdr->daddr = tmp.s_addr;
+	hdr->id = cpu_to_be16(id);
+	hdr->frag_off = build_ipv4_frag_off_field(false, mf, offset);
+
+	memset(pkt, 0, sizeof(*pkt));
+	pkt->skb = skb;
+	pkt->l3_proto = L3PROTO_IPV4;
+	pkt->l4_proto = L4PROTO_UDP;
+	return 0;
+
+fail:
+	kfree_skb(skb);
+	return error;
+}
+
+static bool test_flow(void)
+{
+	struct packet first, subsequent, stranger;
+	struct tuple tuple, result;
+	struct frag_key key;
+	bool success;
+
+	if (init_fragment(&first, "192.0.2.1", "198.51.100.1", 1234, 0, true))
+		return false;
+	success = false;
+	if (init_fragment(&subsequent, "192.0.2.1", "198.51.100.1", 1234, 1480,
+			false))
+		goto end1;
+	if (init_fragment(&stranger, "192.0.2.1", "198.51.100.1", 4321, 1480,
+			false))
+		goto end2;
+	if (init_tuple4(&tuple, "192.0.2.1", 5000, "198.51.100.1", 53,
+			L4PROTO_UDP))
+		goto end3;
+	success = true;
+	first.tuple = tuple;
+
+	success &= ASSERT_INT(-ESRCH, frag_find(table, &subsequent, &result),
+			"empty");
+
+	success &= ASSERT_INT(0, frag_add(table, &first), "add");
+	success &= ASSERT_INT(0, frag_add(table, &first), "re-add");
+	success &= ASSERT_UINT(1, table->count, "count");
+
+	success &= ASSERT_INT(0, frag_find(table, &subsequent, &result),
+			"find");
+	success &= ASSERT_TUPLE(&tuple, &result, "found tuple");
+	success &= ASSERT_INT(-ESRCH, frag_find(table, &stranger, &result),
+			"different ID");
+
+	frag_clean(table);
+	success &= ASSERT_UINT(1, table->count, "fresh survives clean");
+
+	/* Expire it without waiting. */
+	init_key(&first, &key);
+	__find(get_bucket(table, &key), &key)->expires = jiffies - 1;
+	success &= ASSERT_INT(-ESRCH, frag_find(table, &subsequent, &result),
+			"expired");
+	frag_clean(table);
+	success &= ASSERT_UINT(0, table->count, "count after clean");
+
+	success &= ASSERT_INT(0, frag_add(table, &first), "add again");
+	frag_flush(table);
+	success &= ASSERT_UINT(0, table->count, "count after flush");
+
+end3:
+	kfree_skb(stranger.skb);
+end2:
+	kfree_skb(subsequent.skb);
+end1:
+	kfree_skb(first.skb);
+	return success;
+}
+
+static int init(void)
+{
+	table = frag_alloc();
+	return table ? 0 : -ENOMEM;
+}
+
+static void clean(void)
+{
+	frag_release(table);
+}
+
+int init_module(void)
+{
+	struct test_group test = {
+		.name = "Fragment table",
+		.init_fn = init,
+		.clean_fn = clean,
+	};
+
+	if (test_group_begin(&test))
+		return -EINVAL;
+
+	test_group_test(&test, test_flow, "Flow");
+
+	return test_group_end(&test);
+}
+
+void cleanup_module(void)
+{
+	/* No code. */
+}
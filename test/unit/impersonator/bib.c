@@ -1,5 +1,6 @@
 #include "mod/common/db/pool4/db.h"
 #include "mod/common/db/bib/pkt_queue.h"
+#include "mod/common/session_log.h"
 #include "framework/unit_test.h"
 
 static struct fake_pktqueue {
@@ -25,6 +26,11 @@ bool mask_domain_matches(struct mask_domain *masks,
 	return false;
 }
 
+unsigned int mask_domain_get_iterations(struct mask_domain *masks)
+{
+	return 0;
+}
+
 bool mask_domain_is_dynamic(struct mask_domain *masks)
 {
 	return false;
@@ -79,3 +85,8 @@ void pktqueue_clean(struct list_head *probes)
 {
 	broken_unit_call(__func__);
 }
+
+void slog_add(struct xlator *jool, struct slog_event *event)
+{
+	broken_unit_call(__func__);
+}
@@ -22,6 +22,11 @@ bool icmp64_send(struct sk_buff *skb, icmp_error_code error, __u32 info)
 	return true;
 }
 
+bool icmp64_allow(struct xlator const *jool, struct sk_buff *skb)
+{
+	return true;
+}
+
 int icmp64_pop(void)
 {
 	int result = sent;
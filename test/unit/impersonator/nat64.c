@@ -1,4 +1,5 @@
 #include "mod/common/joold.h"
+#include "mod/common/session_log.h"
 #include "mod/common/db/pool4/db.h"
 #include "mod/common/db/bib/db.h"
 #include "mod/common/steps/compute_outgoing_tuple.h"
@@ -31,6 +32,12 @@ verdict filtering_and_updating(struct xlation *state)
 	return VERDICT_DROP;
 }
 
+bool filtering_offloaded(struct xlation *state)
+{
+	fail(__func__);
+	return false;
+}
+
 verdict compute_out_tuple(struct xlation *state)
 {
 	fail(__func__);
@@ -53,6 +60,32 @@ void joold_put(struct joold_queue *queue)
 	fail(__func__);
 }
 
+void joold_stop(struct joold_queue *queue)
+{
+	fail(__func__);
+}
+
+struct session_log *slog_alloc(struct net *ns, char const *iname)
+{
+	fail(__func__);
+	return NULL;
+}
+
+void slog_get(struct session_log *log)
+{
+	fail(__func__);
+}
+
+void slog_put(struct session_log *log)
+{
+	fail(__func__);
+}
+
+void slog_stop(struct session_log *log)
+{
+	fail(__func__);
+}
+
 struct pool4 *pool4db_alloc(void)
 {
 	fail(__func__);
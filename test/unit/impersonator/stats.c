@@ -33,3 +33,8 @@ void jstat_add(struct jool_stats *stats, enum jool_stat_id stat, int addend)
 {
 	/* No code. */
 }
+
+void jstat_pool4_iterations(struct jool_stats *stats, unsigned int iterations)
+{
+	/* No code. */
+}
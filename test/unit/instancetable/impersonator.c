@@ -0,0 +1,36 @@
+#include "framework/unit_test.h"
+#include "mod/common/timer.h"
+#include "mod/common/nl/global.h"
+#include "mod/common/nl/stats.h"
+
+int global_update(struct jool_globals *cfg, xlator_type xt, bool force,
+		struct global_value *request, size_t request_size)
+{
+	return -EINVAL;
+}
+
+verdict translating_the_packet(struct xlation *state)
+{
+	return VERDICT_DROP;
+}
+
+void jtimer_init(struct delayed_work *work, work_func_t fn)
+{
+	INIT_DELAYED_WORK(work, fn);
+}
+
+unsigned long jtimer_clean(struct xlator *jool)
+{
+	broken_unit_call(__func__);
+	return 0;
+}
+
+void jtimer_schedule(struct delayed_work *work, unsigned long delay)
+{
+	broken_unit_call(__func__);
+}
+
+void jnl_stats_stream(struct xlator *jool)
+{
+	broken_unit_call(__func__);
+}
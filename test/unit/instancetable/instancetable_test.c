@@ -0,0 +1,350 @@
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/sched.h>
+#include "framework/unit_test.h"
+#include "mod/common/xlator.c"
+
+MODULE_LICENSE(JOOL_LICENSE);
+MODULE_AUTHOR("Alberto Leiva");
+MODULE_DESCRIPTION("Instance table test.");
+
+/* Enough to need 2^8 buckets. */
+#define INSTANCES 130
+
+/** The network namespace where the test is being run. */
+static struct net *ns;
+static char inames[INSTANCES][INAME_MAX_SIZE];
+static bool listed[INSTANCES];
+
+static bool add(unsigned int i)
+{
+	int error;
+
+	error = xlator_add(XF_IPTABLES | XT_SIIT, inames[i], NULL, NULL);
+	if (error) {
+		log_info("xlator_add() threw %d", error);
+		return false;
+	}
+
+	listed[i] = true;
+	return true;
+}
+
+static bool rm(unsigned int i)
+{
+	int error;
+
+	error = xlator_rm(XT_SIIT, inames[i]);
+	if (error) {
+		log_info("xlator_rm() threw %d", error);
+		return false;
+	}
+
+	listed[i] = false;
+	return true;
+}
+
+/*
+ * Waits until the replaced tables are freed, so the next (un)listing is not
+ * forced to postpone its resize.
+ */
+static void forget_old_tables(void)
+{
+	rcu_barrier_bh();
+}
+
+/* Checks the table has 2^@bits buckets, and every instance can be found. */
+static bool assert_table(unsigned int count, unsigned int bits)
+{
+	struct instance_table *table;
+	struct jool_instance *instance;
+	unsigned int errors;
+	unsigned int i;
+	bool success = true;
+
+	rcu_read_lock_bh();
+
+	table = get_table();
+	success &= ASSERT_UINT(bits, table->bits, "%u instances - bits", count);
+
+	errors = 0;
+	for (i = 0; i < INSTANCES; i++) {
+		instance = find_instance(ns, XT_SIIT, inames[i]);
+		if (listed[i] != !!instance) {
+			log_err("Instance %s: expected %s, found %p.", inames[i],
+					listed[i] ? "listed" : "unlisted",
+					instance);
+			errors++;
+		}
+	}
+	success &= ASSERT_UINT(0, errors, "%u instances - lookups", count);
+
+	rcu_read_unlock_bh();
+
+	success &= ASSERT_UINT(count, instance_count, "%u instances - count",
+			count);
+	return success;
+}
+
+/* Grows at 65 (> 2^6) and 129 (> 2^7) instances. */
+static bool test_grow(void)
+{
+	unsigned int i;
+	bool success = true;
+
+	success &= assert_table(0, TABLE_MIN_BITS);
+
+	for (i = 0; i < INSTANCES; i++) {
+		forget_old_tables();
+		if (!add(i))
+			return false;
+		success &= assert_table(i + 1, (i + 1 > 128) ? 8
+				: ((i + 1 > 64) ? 7 : 6));
+	}
+
+	return success;
+}
+
+/* Shrinks at 63 (< 2^8 / 4) and 31 (< 2^7 / 4) instances. */
+static bool test_shrink(void)
+{
+	unsigned int i;
+	bool success = true;
+
+	for (i = INSTANCES; i > 0; i--) {
+		forget_old_tables();
+		if (!rm(i - 1))
+			return false;
+		success &= assert_table(i - 1, (i - 1 >= 64) ? 8
+				: ((i - 1 >= 32) ? 7 : 6));
+	}
+
+	return success;
+}
+
+/*
+ * If the table before the current one might still have readers, resizes have
+ * to wait for the next (un)listing.
+ */
+static bool test_postponed(void)
+{
+	unsigned int i;
+	bool success = true;
+
+	for (i = 0; i < 65; i++) {
+		forget_old_tables();
+		if (!add(i))
+			return false;
+	}
+	success &= assert_table(65, 7);
+
+	forget_old_tables();
+	atomic_inc(&old_tables); /* Pretend there's a pending old table. */
+	for (i = 65; i > 31; i--) {
+		if (!rm(i - 1)) {
+			atomic_dec(&old_tables);
+			return false;
+		}
+		success &= assert_table(i - 1, 7);
+	}
+	atomic_dec(&old_tables);
+
+	if (!rm(30))
+		return false;
+	success &= assert_table(30, 6);
+
+	for (i = 30; i > 0; i--) {
+		forget_old_tables();
+		if (!rm(i - 1))
+			return false;
+	}
+	success &= assert_table(0, 6);
+
+	return success;
+}
+
+/* One dump page, as seen by xlator_foreach()'s callback. */
+struct page {
+	/* Instances that still fit. */
+	unsigned int room;
+	/* Last instance visited, by the current page or the previous ones. */
+	struct instance_entry_usr offset;
+	bool offset_set;
+	/* Times every test instance was visited, during the whole dump. */
+	unsigned int visits[INSTANCES];
+	/* Instances visited out of order. */
+	unsigned int disorders;
+};
+
+static int visit(struct xlator *jool, void *arg)
+{
+	struct page *page = arg;
+	unsigned int i;
+
+	if (!page->room)
+		return 1;
+	page->room--;
+
+	if (page->offset_set && strcmp(page->offset.iname, jool->iname) >= 0)
+		page->disorders++;
+	if (strncmp(jool->iname, "test", 4) == 0
+			&& !kstrtouint(jool->iname + 4, 10, &i) && i < INSTANCES)
+		page->visits[i]++;
+
+	page->offset.ns = ((__u64)jool->ns) & 0xFFFFFFFF;
+	page->offset.xf = xlator_flags2xf(jool->flags);
+	strcpy(page->offset.iname, jool->iname);
+	page->offset_set = true;
+	return 0;
+}
+
+static int dump_page(struct page *page, unsigned int room)
+{
+	page->room = room;
+	return xlator_foreach(XT_SIIT, visit, page,
+			page->offset_set ? &page->offset : NULL);
+}
+
+/*
+ * The instances added and removed here sort before the test ones, so they are
+ * never part of the rest of the dump.
+ */
+static bool add_aux(unsigned int i)
+{
+	char iname[INAME_MAX_SIZE];
+	int error;
+
+	snprintf(iname, INAME_MAX_SIZE, "aux%u", i);
+	error = xlator_add(XF_IPTABLES | XT_SIIT, iname, NULL, NULL);
+	if (error)
+		log_info("xlator_add(%s) threw %d", iname, error);
+	return !error;
+}
+
+static void rm_aux(unsigned int i)
+{
+	char iname[INAME_MAX_SIZE];
+
+	snprintf(iname, INAME_MAX_SIZE, "aux%u", i);
+	xlator_rm(XT_SIIT, iname);
+}
+
+/*
+ * Dumps resume by name, so resizes and removals between pages don't make them
+ * skip or repeat instances.
+ */
+static bool test_foreach(void)
+{
+	static struct page page;
+	unsigned int removed;
+	unsigned int aux;
+	unsigned int i;
+	bool success = true;
+
+	memset(&page, 0, sizeof(page));
+
+	for (i = 0; i < 60; i++) {
+		forget_old_tables();
+		if (!add(i))
+			return false;
+	}
+	success &= assert_table(60, 6);
+
+	success &= ASSERT_INT(1, dump_page(&page, 20), "Page 1");
+
+	/* Grow the table (60 + 10 > 2^6), so every instance moves. */
+	for (aux = 0; aux < 10; aux++) {
+		forget_old_tables();
+		if (!add_aux(aux))
+			goto revert;
+	}
+	forget_old_tables();
+	success &= assert_table(70, 7);
+
+	success &= ASSERT_INT(1, dump_page(&page, 20), "Page 2");
+
+	/* Remove the instance the next page resumes from. */
+	if (kstrtouint(page.offset.iname + 4, 10, &removed) || !rm(removed))
+		goto revert;
+
+	success &= ASSERT_INT(1, dump_page(&page, 10), "Page 3");
+	success &= ASSERT_INT(0, dump_page(&page, 20), "Page 4");
+
+	success &= ASSERT_UINT(0, page.disorders, "Disorders");
+	for (i = 0; i < 60; i++)
+		success &= ASSERT_UINT(1, page.visits[i], "Visits to test%u", i);
+
+	for (; aux > 0; aux--)
+		rm_aux(aux - 1);
+	for (i = 0; i < 60; i++) {
+		forget_old_tables();
+		if (listed[i] && !rm(i))
+			return false;
+	}
+	return success;
+
+revert:
+	for (; aux > 0; aux--)
+		rm_aux(aux - 1);
+	return false;
+}
+
+static int setup(void)
+{
+	unsigned int i;
+	int error;
+
+	for (i = 0; i < INSTANCES; i++)
+		snprintf(inames[i], INAME_MAX_SIZE, "test%u", i);
+	memset(listed, 0, sizeof(listed));
+
+	ns = get_net_ns_by_pid(task_pid_vnr(current));
+	if (IS_ERR(ns)) {
+		log_err("Could not retrieve the current namespace.");
+		return PTR_ERR(ns);
+	}
+
+	error = xlator_setup();
+	if (error) {
+		log_info("xlator_setup() threw %d", error);
+		put_net(ns);
+	}
+
+	return error;
+}
+
+static void teardown(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < INSTANCES; i++)
+		if (listed[i])
+			rm(i);
+
+	xlator_teardown();
+	put_net(ns);
+}
+
+int init_module(void)
+{
+	struct test_group test = {
+		.name = "Instance table",
+		.setup_fn = setup,
+		.teardown_fn = teardown,
+	};
+
+	if (test_group_begin(&test))
+		return -EINVAL;
+
+	test_group_test(&test, test_grow, "Growth");
+	test_group_test(&test, test_shrink, "Shrinkage");
+	test_group_test(&test, test_postponed, "Postponed resize");
+	test_group_test(&test, test_foreach, "Paged iteration");
+
+	return test_group_end(&test);
+}
+
+void cleanup_module(void)
+{
+	/* No code. */
+}
@@ -0,0 +1,693 @@
+#include <linux/module.h>
+#include <linux/printk.h>
+#include <net/genetlink.h>
+
+#include "framework/unit_test.h"
+#include "mod/common/linux_version.h"
+
+/* Hands joold's multicasts over to capture(), instead of to nobody. */
+static int capture(struct sk_buff *skb);
+#if LINUX_VERSION_LOWER_THAN(3, 13, 0, 7, 1)
+#define genlmsg_multicast_netns(ns, skb, portid, group, flags) capture(skb)
+#else
+#define genlmsg_multicast_netns(family, ns, skb, portid, group, flags) \
+	capture(skb)
+#endif
+
+#include "mod/common/joold.c"
+#include "mod/common/db/global.h"
+
+MODULE_LICENSE(JOOL_LICENSE);
+MODULE_AUTHOR("Alberto Leiva");
+MODULE_DESCRIPTION("joold module test.");
+
+static struct xlator jool;
+/* The stats the code under test has touched. */
+static long stats[JSTAT_COUNT];
+
+void jstat_inc(struct jool_stats *s, enum jool_stat_id stat)
+{
+	stats[stat]++;
+}
+
+void jstat_dec(struct jool_stats *s, enum jool_stat_id stat)
+{
+	stats[stat]--;
+}
+
+void jstat_add(struct jool_stats *s, enum jool_stat_id stat, int addend)
+{
+	stats[stat] += addend;
+}
+
+/* The instance xlator_find() returns, or NULL if there's none. */
+static struct xlator *owner;
+
+int xlator_find(struct net *ns, xlator_flags flags, const char *iname,
+		struct xlator *result)
+{
+	if (!owner)
+		return -ESRCH;
+	*result = *owner;
+	return 0;
+}
+
+void xlator_put(struct xlator *jool)
+{
+	/* No code. */
+}
+
+/* A session table, as the advertiser sees it. */
+struct fake_table {
+	struct session_entry sessions[16];
+	unsigned int count;
+	/* Times each session reached the multicast. */
+	unsigned int sent[16];
+};
+
+/* Indexed by l4_protocol. */
+static struct fake_table tables[ADVERTISE_PROTO_COUNT];
+#define FIRST_PORT 1000
+
+/* The sessions are sorted by src4 port; nothing else changes between them. */
+int bib_foreach_session(struct xlator *jool, l4_protocol proto,
+		session_foreach_entry_cb cb, void *cb_arg,
+		struct session_foreach_offset *offset)
+{
+	struct fake_table *table = &tables[proto];
+	unsigned int i;
+	int error;
+
+	i = offset ? (offset->offset.src.l4 - FIRST_PORT + 1) : 0;
+	for (; i < table->count; i++) {
+		error = cb(&table->sessions[i], cb_arg);
+		if (error)
+			return error;
+	}
+
+	return 0;
+}
+
+__u64 *jstat_query(struct jool_stats *s)
+{
+	__u64 *result;
+	unsigned int i;
+
+	result = kcalloc(JSTAT_COUNT, sizeof(__u64), GFP_KERNEL);
+	if (!result)
+		return NULL;
+	for (i = 0; i < ADVERTISE_PROTO_COUNT; i++)
+		result[JSTAT_SESSIONS] += tables[i].count;
+
+	return result;
+}
+
+/* Multicasts capture() will still accept. The rest "nobody receives." */
+static unsigned int mc_budget;
+static unsigned int multicasts;
+
+static void count_sent(struct session_entry *session)
+{
+	unsigned int i = session->src4.l4 - FIRST_PORT;
+
+	if (session->proto < ADVERTISE_PROTO_COUNT
+			&& i < tables[session->proto].count)
+		tables[session->proto].sent[i]++;
+	else
+		log_err("Multicasted a session that doesn't exist.");
+}
+
+static int capture(struct sk_buff *skb)
+{
+	struct nlattr *attr;
+	struct joold_records_hdr *hdr;
+	struct session_entry session;
+	void *cursor;
+	size_t len;
+	unsigned int count;
+	int size;
+	int error = 0;
+
+	if (!mc_budget) {
+		error = -ESRCH;
+		goto end;
+	}
+	mc_budget--;
+	multicasts++;
+
+	attr = nlmsg_find_attr(nlmsg_hdr(skb),
+			GENL_HDRLEN + jnl_family()->hdrsize,
+			JNLAR_SESSION_RECORDS);
+	if (!attr) {
+		log_err("The multicast has no records.");
+		error = -EINVAL;
+		goto end;
+	}
+
+	hdr = nla_data(attr);
+	cursor = hdr + 1;
+	len = nla_len(attr) - sizeof(*hdr);
+	for (count = be16_to_cpu(hdr->count); count > 0; count--) {
+		size = get_record(&jool, cursor, len, &session);
+		if (size < 0) {
+			error = size;
+			goto end;
+		}
+		count_sent(&session);
+		cursor += size;
+		len -= size;
+	}
+
+end:
+	kfree_skb(skb);
+	return error;
+}
+
+static void init_session(struct session_entry *session, l4_protocol proto,
+		tcp_state state, session_timer_type timer, __u16 port)
+{
+	memset(session, 0, sizeof(*session));
+	session->src6.l3.s6_addr32[0] = cpu_to_be32(0x20010db8u);
+	session->src6.l3.s6_addr32[3] = cpu_to_be32(1);
+	session->src6.l4 = port;
+	/* 64:ff9b::192.0.2.1; pool6 + dst4, so it's implied. */
+	session->dst6.l3.s6_addr32[0] = cpu_to_be32(0x0064ff9bu);
+	session->dst6.l3.s6_addr32[3] = cpu_to_be32(0xc0000201u);
+	session->dst6.l4 = port;
+	session->src4.l3.s_addr = cpu_to_be32(0xcb007101u);
+	session->src4.l4 = port;
+	session->dst4.l3.s_addr = cpu_to_be32(0xc0000201u);
+	session->dst4.l4 = port;
+	session->proto = proto;
+	session->state = state;
+	session->timer_type = timer;
+	session->update_time = jiffies;
+	session->timeout = msecs_to_jiffies(123456);
+}
+
+/* Are @a and @b the same expiration, give or take the jiffy roundings? */
+static bool close_enough(__u32 a, __u32 b)
+{
+	return ((a > b) ? (a - b) : (b - a)) <= jiffies_to_msecs(2);
+}
+
+static bool round_trip(struct session_entry *expected, char *test_name)
+{
+	unsigned char buffer[sizeof(struct joold_record) + sizeof(struct in6_addr)];
+	struct joold_record *record = (struct joold_record *)buffer;
+	struct session_entry actual;
+	__u32 expiration;
+	size_t size;
+	bool success = true;
+
+	memset(buffer, 0xff, sizeof(buffer));
+
+	size = put_record(&jool, buffer, expected);
+	success &= ASSERT_UINT(record_size(&jool, expected), size,
+			"%s - put size", test_name);
+	expiration = be32_to_cpu(record->expiration);
+	success &= ASSERT_BOOL(true, close_enough(expiration,
+			jnla_get_session_dying_time(expected)),
+			"%s - wire expiration", test_name);
+
+	success &= ASSERT_INT((int)size, get_record(&jool, buffer, size, &actual),
+			"%s - get size", test_name);
+	success &= ASSERT_SESSION(expected, &actual, test_name);
+	success &= ASSERT_UINT(expected->state, actual.state,
+			"%s - state", test_name);
+	success &= ASSERT_UINT(expected->timer_type, actual.timer_type,
+			"%s - timer", test_name);
+	success &= ASSERT_BOOL(true, close_enough(expiration,
+			jnla_get_session_dying_time(&actual)),
+			"%s - expiration", test_name);
+
+	return success;
+}
+
+static bool test_protocols(void)
+{
+	struct session_entry session;
+	tcp_state state;
+	session_timer_type timer;
+	bool success = true;
+
+	for (state = ESTABLISHED; state <= TRANS; state++) {
+		for (timer = SESSION_TIMER_EST; timer <= SESSION_TIMER_SYN4; timer++) {
+			init_session(&session, L4PROTO_TCP, state, timer, 1000);
+			success &= round_trip(&session, "TCP");
+		}
+	}
+
+	init_session(&session, L4PROTO_UDP, ESTABLISHED, SESSION_TIMER_EST, 1000);
+	success &= round_trip(&session, "UDP");
+	init_session(&session, L4PROTO_ICMP, ESTABLISHED, SESSION_TIMER_EST, 1000);
+	success &= round_trip(&session, "ICMP");
+
+	return success;
+}
+
+static bool test_extremes(void)
+{
+	struct session_entry session;
+	unsigned char buffer[sizeof(struct joold_record) + sizeof(struct in6_addr)];
+	struct joold_record *record = (struct joold_record *)buffer;
+	bool success = true;
+
+	init_session(&session, L4PROTO_TCP, TRANS, SESSION_TIMER_TRANS, 0);
+	success &= round_trip(&session, "Port 0");
+	init_session(&session, L4PROTO_UDP, ESTABLISHED, SESSION_TIMER_EST, 65535);
+	success &= round_trip(&session, "Port 65535");
+
+	/* Already expired; the wire says zero. */
+	init_session(&session, L4PROTO_UDP, ESTABLISHED, SESSION_TIMER_EST, 1);
+	session.update_time = jiffies - msecs_to_jiffies(10000);
+	session.timeout = msecs_to_jiffies(1000);
+	success &= round_trip(&session, "Expired");
+	put_record(&jool, buffer, &session);
+	success &= ASSERT_BE32(0, record->expiration, "Expired - wire");
+
+	/* Too far in the future to fit; the wire saturates. */
+	init_session(&session, L4PROTO_TCP, ESTABLISHED, SESSION_TIMER_EST, 1);
+	session.timeout = MAX_JIFFY_OFFSET / 2;
+	success &= round_trip(&session, "Saturated");
+	put_record(&jool, buffer, &session);
+	if (BITS_PER_LONG > 32)
+		success &= ASSERT_BE32(MAX_U32, record->expiration,
+				"Saturated - wire");
+
+	/* Not implied by pool6, so it travels along. */
+	init_session(&session, L4PROTO_ICMP, ESTABLISHED, SESSION_TIMER_EST, 1);
+	session.dst6.l3.s6_addr32[1] = cpu_to_be32(1);
+	success &= ASSERT_UINT(sizeof(buffer), record_size(&jool, &session),
+			"Explicit dst6 size");
+	success &= round_trip(&session, "Explicit dst6");
+	put_record(&jool, buffer, &session);
+	success &= ASSERT_UINT(JOOLD_RECORD_DST6, record->flags & JOOLD_RECORD_DST6,
+			"Explicit dst6 flag");
+
+	return success;
+}
+
+static bool reject(void *buffer, size_t len, char *test_name)
+{
+	struct session_entry session;
+	return ASSERT_BOOL(true, get_record(&jool, buffer, len, &session) < 0,
+			"%s", test_name);
+}
+
+static bool test_garbage(void)
+{
+	unsigned char buffer[sizeof(struct joold_record) + sizeof(struct in6_addr)];
+	struct joold_record *record = (struct joold_record *)buffer;
+	struct session_entry session;
+	size_t size;
+	bool success = true;
+
+	init_session(&session, L4PROTO_TCP, ESTABLISHED, SESSION_TIMER_EST, 1);
+	size = put_record(&jool, buffer, &session);
+	success &= reject(buffer, 0, "Empty");
+	success &= reject(buffer, size - 1, "Truncated");
+
+	/* The flag promises a dst6 that isn't there. */
+	record->flags = JOOLD_RECORD_DST6;
+	success &= reject(buffer, size, "Truncated dst6");
+
+	put_record(&jool, buffer, &session);
+	record->flags = 0x80;
+	success &= reject(buffer, size, "Unknown flag");
+
+	put_record(&jool, buffer, &session);
+	record->proto = 200;
+	success &= reject(buffer, size, "Unknown protocol");
+
+	put_record(&jool, buffer, &session);
+	record->state = TRANS + 1;
+	success &= reject(buffer, size, "Unknown state");
+
+	put_record(&jool, buffer, &session);
+	record->timer = SESSION_TIMER_SYN4 + 1;
+	success &= reject(buffer, size, "Unknown TCP timer");
+
+	init_session(&session, L4PROTO_UDP, ESTABLISHED, SESSION_TIMER_EST, 1);
+	put_record(&jool, buffer, &session);
+	record->timer = 0xff;
+	success &= reject(buffer, size, "Unknown UDP timer");
+
+	memset(buffer, 0xff, sizeof(buffer));
+	success &= reject(buffer, sizeof(buffer), "All ones");
+
+	return success;
+}
+
+/* Builds and seals @count (empty) joold packets, as if they had been sent. */
+static bool send_packets(unsigned int count, char *test_name)
+{
+	struct joold_queue *queue = jool.nat64.joold;
+	struct sk_buff *skb;
+	void *msg_head;
+	void *records;
+	u32 seq;
+	bool success = true;
+
+	for (; count > 0; count--) {
+		skb = alloc_packet(&jool, sizeof(struct joold_records_hdr), 0,
+				&msg_head, &records);
+		if (!ASSERT_BOOL(true, skb != NULL, "%s - alloc", test_name))
+			return false;
+
+		spin_lock_bh(&queue->lock);
+		seq = queue->next_seq;
+		success &= ASSERT_INT(0, seal_packet(&jool, skb, msg_head),
+				"%s - seal", test_name);
+		success &= ASSERT_UINT(seq + 1, queue->next_seq,
+				"%s - next seq", test_name);
+		spin_unlock_bh(&queue->lock);
+
+		kfree_skb(skb);
+	}
+
+	return success;
+}
+
+static bool assert_in_flight(unsigned int expected, char *test_name)
+{
+	static __u64 gauges[JSTAT_COUNT];
+	bool success = true;
+
+	success &= ASSERT_UINT(expected, jool.nat64.joold->in_flight,
+			"%s - in flight", test_name);
+	joold_gauges(&jool, gauges);
+	success &= ASSERT_U64(expected, gauges[JSTAT_JOOLD_IN_FLIGHT],
+			"%s - in flight gauge", test_name);
+
+	return success;
+}
+
+static bool ack(u32 seq, unsigned int expected, char *test_name)
+{
+	joold_ack(&jool, &seq);
+	return assert_in_flight(expected, test_name);
+}
+
+static bool test_window(void)
+{
+	struct joold_queue *queue = jool.nat64.joold;
+	bool success = true;
+
+	success &= send_packets(3, "Send");
+	success &= assert_in_flight(3, "Send");
+
+	/* Acks the first two. */
+	success &= ack(1, 1, "Cumulative ACK");
+	success &= ack(1, 1, "Duplicate ACK");
+	success &= ack(0, 1, "Stale ACK");
+	/* Packet 3 was never sent. */
+	success &= ack(3, 1, "Future ACK");
+	success &= ack(queue->next_seq + 1000, 1, "Far future ACK");
+	success &= ack(2, 0, "Last ACK");
+	success &= ack(2, 0, "Duplicate of the last ACK");
+
+	/* Unknown sequence: The oldest one, but never below zero. */
+	success &= send_packets(2, "Resend");
+	joold_ack(&jool, NULL);
+	success &= assert_in_flight(1, "Anonymous ACK");
+	joold_ack(&jool, NULL);
+	success &= assert_in_flight(0, "Anonymous ACK 2");
+	joold_ack(&jool, NULL);
+	success &= assert_in_flight(0, "Anonymous ACK, empty window");
+
+	return success;
+}
+
+static bool test_wraparound(void)
+{
+	struct joold_queue *queue = jool.nat64.joold;
+	bool success = true;
+
+	queue->next_seq = 0xfffffffeu;
+	/* 0xfffffffe, 0xffffffff, 0 and 1. */
+	success &= send_packets(4, "Send");
+	success &= ASSERT_UINT(2, queue->next_seq, "Next seq");
+	success &= assert_in_flight(4, "Send");
+
+	success &= ack(0xfffffffdu, 4, "Stale ACK before the wrap");
+	success &= ack(0xffffffffu, 2, "ACK before the wrap");
+	success &= ack(0xfffffffeu, 2, "Stale ACK across the wrap");
+	success &= ack(2, 2, "Future ACK after the wrap");
+	success &= ack(0, 1, "ACK after the wrap");
+	success &= ack(1, 0, "Last ACK");
+
+	return success;
+}
+
+static bool test_lost_acks(void)
+{
+	struct joold_queue *queue = jool.nat64.joold;
+	unsigned long deadline;
+	bool success = true;
+
+	deadline = msecs_to_jiffies(GLOBALS(&jool).flush_deadline);
+
+	success &= send_packets(3, "Send");
+	success &= assert_in_flight(3, "Send");
+
+	/* Deadline hasn't passed; the ACKs might still come. */
+	spin_lock_bh(&queue->lock);
+	forget_lost_acks(&jool);
+	spin_unlock_bh(&queue->lock);
+	success &= assert_in_flight(3, "Before the deadline");
+
+	spin_lock_bh(&queue->lock);
+	queue->last_flush_time = jiffies - deadline - 1;
+	forget_lost_acks(&jool);
+	spin_unlock_bh(&queue->lock);
+	success &= assert_in_flight(0, "After the deadline");
+
+	/* The ACKs finally arrive; they must not drive the gauge negative. */
+	success &= ack(2, 0, "Late ACK");
+	joold_ack(&jool, NULL);
+	success &= assert_in_flight(0, "Late anonymous ACK");
+
+	/* And the window is usable again. */
+	success &= send_packets(1, "Send again");
+	success &= assert_in_flight(1, "Send again");
+	success &= ack(3, 0, "ACK again");
+
+	return success;
+}
+
+static void init_tables(void)
+{
+	static const unsigned int COUNTS[] = { 10, 5, 3 };
+	struct fake_table *table;
+	l4_protocol proto;
+	unsigned int i;
+
+	memset(tables, 0, sizeof(tables));
+	for (proto = 0; proto < ADVERTISE_PROTO_COUNT; proto++) {
+		table = &tables[proto];
+		table->count = COUNTS[proto];
+		for (i = 0; i < table->count; i++)
+			init_session(&table->sessions[i], proto, ESTABLISHED,
+					SESSION_TIMER_EST, FIRST_PORT + i);
+	}
+
+	/* 4 sessions per packet; the tables need 6 of them. */
+	GLOBALS(&jool).max_payload = jnl_family()->hdrsize
+			+ nla_total_size(sizeof(struct joold_records_hdr)
+					+ 4 * sizeof(struct joold_record))
+			+ nla_total_size(sizeof(u32));
+	GLOBALS(&jool).window = 8;
+	GLOBALS(&jool).advertise_rate = 0; /* Rate limiting needs a clock. */
+	owner = &jool;
+}
+
+/* Waits for the advertiser's pending round. */
+static void wait_round(void)
+{
+	flush_delayed_work(&jool.nat64.joold->advertiser.work);
+}
+
+/*
+ * Asserts the first @sent sessions (in advertisement order) were multicasted
+ * once, and the rest never were.
+ */
+static bool assert_advertised(unsigned int sent, unsigned int total,
+		char *test_name)
+{
+	l4_protocol proto;
+	unsigned int i;
+	unsigned int n;
+	bool success = true;
+
+	n = 0;
+	for (proto = 0; proto < ADVERTISE_PROTO_COUNT; proto++) {
+		for (i = 0; i < tables[proto].count; i++, n++) {
+			success &= ASSERT_UINT(n < sent ? 1 : 0,
+					tables[proto].sent[i],
+					"%s - session %u/%u", test_name,
+					proto, i);
+		}
+	}
+
+	success &= ASSERT_UINT(sent, jool.nat64.joold->advertiser.sent,
+			"%s - sent", test_name);
+	success &= ASSERT_UINT(sent, stats[JSTAT_JOOLD_ADV_SENT],
+			"%s - sent stat", test_name);
+	success &= ASSERT_UINT(total, stats[JSTAT_JOOLD_ADV_TOTAL],
+			"%s - total stat", test_name);
+	return success;
+}
+
+static bool test_advertise(void)
+{
+	bool success = true;
+
+	init_tables();
+	mc_budget = UINT_MAX;
+
+	success &= ASSERT_INT(0, joold_advertise(&jool), "Start");
+	wait_round();
+	success &= ASSERT_BOOL(false, jool.nat64.joold->advertiser.active,
+			"Done");
+	success &= ASSERT_UINT(6, multicasts, "Multicasts");
+	success &= assert_advertised(18, 18, "Done");
+
+	return success;
+}
+
+/* Nobody heard the third packet; the next advertisement starts from it. */
+static bool test_resume(void)
+{
+	struct joold_advertiser *adv = &jool.nat64.joold->advertiser;
+	bool success = true;
+
+	init_tables();
+	mc_budget = 2;
+
+	success &= ASSERT_INT(0, joold_advertise(&jool), "Start");
+	wait_round();
+	success &= ASSERT_BOOL(false, adv->active, "Paused");
+	success &= ASSERT_UINT(0, adv->proto, "Paused on TCP");
+	success &= assert_advertised(8, 18, "Paused");
+
+	mc_budget = UINT_MAX;
+	success &= ASSERT_INT(0, joold_advertise(&jool), "Resume");
+	wait_round();
+	success &= ASSERT_BOOL(false, adv->active, "Done");
+	success &= ASSERT_UINT(6, multicasts, "Multicasts");
+	success &= assert_advertised(18, 18, "Done");
+
+	return success;
+}
+
+/* An instance that replaced the owner brought its own queue. */
+static bool test_replaced(void)
+{
+	struct xlator replacement;
+	bool success = true;
+
+	init_tables();
+	mc_budget = UINT_MAX;
+	replacement = jool;
+	replacement.nat64.joold = NULL;
+	owner = &replacement;
+
+	success &= ASSERT_INT(0, joold_advertise(&jool), "Start");
+	wait_round();
+	success &= ASSERT_BOOL(false, jool.nat64.joold->advertiser.active,
+			"Abandoned");
+	success &= ASSERT_UINT(0, multicasts, "Multicasts");
+	success &= assert_advertised(0, 18, "Abandoned");
+
+	return success;
+}
+
+/* Once the owner is gone, nothing can kick the advertiser again. */
+static bool test_stop(void)
+{
+	bool success = true;
+
+	init_tables();
+	mc_budget = UINT_MAX;
+
+	joold_stop(jool.nat64.joold);
+	success &= ASSERT_INT(0, joold_advertise(&jool), "Start");
+	success &= ASSERT_BOOL(false,
+			delayed_work_pending(&jool.nat64.joold->advertiser.work),
+			"Scheduled");
+	wait_round();
+	success &= ASSERT_UINT(0, multicasts, "Multicasts");
+	success &= assert_advertised(0, 18, "Stopped");
+
+	/* Nor can the ACKs. */
+	joold_ack(&jool, NULL);
+	success &= ASSERT_BOOL(false,
+			delayed_work_pending(&jool.nat64.joold->advertiser.work),
+			"Scheduled by ACK");
+
+	return success;
+}
+
+static int init(void)
+{
+	struct ipv6_prefix pool6;
+	int error;
+
+	memset(&jool, 0, sizeof(jool));
+	memset(stats, 0, sizeof(stats));
+	multicasts = 0;
+	owner = NULL;
+	jool.flags = XF_NETFILTER | XT_NAT64;
+	strcpy(jool.iname, INAME_DEFAULT);
+
+	pool6.addr.s6_addr32[0] = cpu_to_be32(0x0064ff9bu);
+	pool6.addr.s6_addr32[1] = 0;
+	pool6.addr.s6_addr32[2] = 0;
+	pool6.addr.s6_addr32[3] = 0;
+	pool6.len = 96;
+	error = globals_init(&jool.globals, XT_NAT64, &pool6);
+	if (error)
+		return error;
+	GLOBALS(&jool).enabled = true;
+
+	jool.nat64.joold = joold_alloc(NULL);
+	return jool.nat64.joold ? 0 : -ENOMEM;
+}
+
+static void clean(void)
+{
+	joold_stop(jool.nat64.joold);
+	joold_put(jool.nat64.joold);
+}
+
+int init_module(void)
+{
+	struct test_group test = {
+		.name = "joold",
+		.teardown_fn = joold_teardown,
+		.init_fn = init,
+		.clean_fn = clean,
+	};
+
+	if (test_group_begin(&test))
+		return -EINVAL;
+
+	test_group_test(&test, test_protocols, "Record round trip, every protocol and state");
+	test_group_test(&test, test_extremes, "Record round trip, extreme values");
+	test_group_test(&test, test_garbage, "Garbage records");
+	test_group_test(&test, test_window, "ACK window");
+	test_group_test(&test, test_wraparound, "Sequence number wraparound");
+	test_group_test(&test, test_lost_acks, "Lost ACKs");
+	test_group_test(&test, test_advertise, "Advertisement");
+	test_group_test(&test, test_resume, "Resumed advertisement");
+	test_group_test(&test, test_replaced, "Advertisement of a replaced instance");
+	test_group_test(&test, test_stop, "Advertisement after joold_stop()");
+
+	return test_group_end(&test);
+}
+
+void cleanup_module(void)
+{
+	/* No code. */
+}
@@ -0,0 +1,159 @@
+#include <linux/kernel.h>
+#include <linux/module.h>
+
+#include "framework/types.h"
+#include "framework/unit_test.h"
+#include "mod/common/db/bib/offload.c"
+
+MODULE_LICENSE(JOOL_LICENSE);
+MODULE_AUTHOR("Alberto Leiva");
+MODULE_DESCRIPTION("TCP offload table test");
+
+static struct offload_table *table;
+
+static int init_session(struct session_entry *session, char *src6, u16 port6,
+		char *dst6, char *src4, u16 port4, char *dst4, u16 dport)
+{
+	int error;
+
+	error = str_to_addr6(src6, &session->src6.l3);
+	if (error)
+		return error;
+	session->src6.l4 = port6;
+	error = str_to_addr6(dst6, &session->dst6.l3);
+	if (error)
+		return error;
+	session->dst6.l4 = dport;
+	error = str_to_addr4(src4, &session->src4.l3);
+	if (error)
+		return error;
+	session->src4.l4 = port4;
+	error = str_to_addr4(dst4, &session->dst4.l3);
+	if (error)
+		return error;
+	session->dst4.l4 = dport;
+
+	session->proto = L4PROTO_TCP;
+	session->state = ESTABLISHED;
+	session->timer_type = SESSION_TIMER_EST;
+	session->update_time = jiffies;
+	session->timeout = 0;
+	session->has_stored = false;
+	return 0;
+}
+
+static bool assert_found(struct session_entry *expected, struct tuple *tuple,
+		char *test_name)
+{
+	struct bib_session result;
+	bool success = true;
+
+	memset(&result, 0, sizeof(result));
+	success &= ASSERT_INT(0, offload_find(table, tuple, &result),
+			"%s - find", test_name);
+	if (!success)
+		return false;
+
+	success &= ASSERT_BOOL(true, result.session_set, "%s - set", test_name);
+	success &= ASSERT_SESSION(expected, &result.session, test_name);
+	return success;
+}
+
+static bool assert_not_found(struct tuple *tuple, char *test_name)
+{
+	struct bib_session result;
+	return ASSERT_INT(-ESRCH, offload_find(table, tuple, &result),
+			"%s - find", test_name);
+}
+
+static bool test_flow(void)
+{
+	struct session_entry s1, s2;
+	struct tuple t61, t41, t62, t42;
+	bool success = true;
+
+	if (init_session(&s1, "2001:db8::1", 1000, "64:ff9b::c633:6401",
+			"192.0.2.1", 2000, "198.51.100.1", 80))
+		return false;
+	if (init_session(&s2, "2001:db8::2", 1000, "64:ff9b::c633:6401",
+			"192.0.2.1", 2001, "198.51.100.1", 80))
+		return false;
+	if (init_tuple6(&t61, "2001:db8::1", 1000, "64:ff9b::c633:6401", 80,
+			L4PROTO_TCP))
+		return false;
+	if (init_tuple4(&t41, "198.51.100.1", 80, "192.0.2.1", 2000,
+			L4PROTO_TCP))
+		return false;
+	if (init_tuple6(&t62, "2001:db8::2", 1000, "64:ff9b::c633:6401", 80,
+			L4PROTO_TCP))
+		return false;
+	if (init_tuple4(&t42, "198.51.100.1", 80, "192.0.2.1", 2001,
+			L4PROTO_TCP))
+		return false;
+
+	success &= assert_not_found(&t61, "empty 6");
+	success &= assert_not_found(&t41, "empty 4");
+
+	success &= ASSERT_INT(0, offload_add(table, &s1), "add 1");
+	success &= ASSERT_INT(0, offload_add(table, &s2), "add 2");
+	success &= ASSERT_INT(0, offload_add(table, &s1), "renew 1");
+	success &= ASSERT_UINT(2, table->count, "count");
+	success &= assert_found(&s1, &t61, "s1 by 6");
+	success &= assert_found(&s1, &t41, "s1 by 4");
+	success &= assert_found(&s2, &t62, "s2 by 6");
+	success &= assert_found(&s2, &t42, "s2 by 4");
+
+	offload_rm(table, &s1.src6, &s1.dst6);
+	success &= assert_not_found(&t61, "rm'd s1 by 6");
+	success &= assert_not_found(&t41, "rm'd s1 by 4");
+	success &= assert_found(&s2, &t62, "survivor by 6");
+
+	/* Expire s2 without waiting. */
+	__find6(table, &s2.src6, &s2.dst6)->expires = jiffies - 1;
+	success &= assert_not_found(&t62, "expired s2 by 6");
+	success &= assert_not_found(&t42, "expired s2 by 4");
+	success &= ASSERT_INT(0, offload_add(table, &s1), "re-add 1");
+	offload_clean(table);
+	success &= ASSERT_UINT(1, table->count, "count after clean");
+	success &= assert_found(&s1, &t61, "clean survivor");
+
+	offload_flush(table);
+	success &= ASSERT_UINT(0, table->count, "count after flush");
+	success &= assert_not_found(&t61, "flushed s1 by 6");
+	success &= assert_not_found(&t41, "flushed s1 by 4");
+
+	return success;
+}
+
+static int init(void)
+{
+	table = offload_alloc();
+	return table ? 0 : -ENOMEM;
+}
+
+static void clean(void)
+{
+	offload_release(table);
+	rcu_barrier();
+}
+
+int init_module(void)
+{
+	struct test_group test = {
+		.name = "TCP Offload",
+		.init_fn = init,
+		.clean_fn = clean,
+	};
+
+	if (test_group_begin(&test))
+		return -EINVAL;
+
+	test_group_test(&test, test_flow, "Flow");
+
+	return test_group_end(&test);
+}
+
+void cleanup_module(void)
+{
+	/* No code. */
+}
@@ -518,6 +518,50 @@ static bool test_flush(void)
 	return success;
 }
 
+static bool test_clone(void)
+{
+	struct pool4 *original;
+	struct pool4 *clone;
+	struct pool4_entry expected[9];
+	unsigned int i = 0;
+	bool success = true;
+
+	if (!add_common_samples())
+		return false;
+
+	init_sample(&expected[i++], 0xc0000200U, 6, 7);
+	init_sample(&expected[i++], 0xc0000201U, 6, 7);
+	init_sample(&expected[i++], 0xc0000210U, 15, 19);
+	init_sample(&expected[i++], 0xc0000210U, 22, 23);
+	init_sample(&expected[i++], 0xc0000211U, 19, 19);
+	init_sample(&expected[i++], 0xc0000220U, 1, 1);
+	init_sample(&expected[i++], 0xc0000221U, 1, 1);
+	init_sample(&expected[i++], 0xc0000222U, 1, 1);
+	init_sample(&expected[i++], 0xc0000223U, 1, 1);
+
+	original = pool;
+	clone = pool4db_clone(original);
+	if (!ASSERT_BOOL(true, clone != NULL, "clone"))
+		return false;
+
+	/* The clone starts out identical... */
+	pool = clone;
+	success &= __foreach(expected, 9, 16);
+	success &= assert_contains_range(0, 1, 6, 7, true);
+
+	/* ...but modifying it doesn't affect the original. */
+	success &= rm(0xc0000220U, 30, 1, 1);
+	success &= __foreach(expected, 5, 12);
+	success &= assert_contains_range(32, 35, 1, 1, false);
+
+	pool = original;
+	success &= __foreach(expected, 9, 16);
+	success &= assert_contains_range(32, 35, 1, 1, true);
+
+	pool4db_put(clone);
+	return success;
+}
+
 static int init(void)
 {
 	pool = pool4db_alloc();
@@ -559,6 +603,7 @@ int init_module(void)
 	test_group_test(&test, test_add, "Add");
 	test_group_test(&test, test_rm, "Rm");
 	test_group_test(&test, test_flush, "Flush");
+	test_group_test(&test, test_clone, "Clone");
 
 	return test_group_end(&test);
 }
@@ -0,0 +1,265 @@
+#include <linux/module.h>
+#include <linux/printk.h>
+
+#include "framework/unit_test.h"
+#include "framework/skb_generator.h"
+#include "mod/common/icmp_wrapper.c"
+
+MODULE_LICENSE(JOOL_LICENSE);
+MODULE_AUTHOR("Alberto Leiva");
+MODULE_DESCRIPTION("ICMP error rate limit module test.");
+
+/*
+ * icmp64_allow() reads the clock by itself, so these tests travel in time by
+ * moving the buckets' timestamps backwards instead.
+ * The rates are low enough for the few jiffies the tests might take to never
+ * be worth an entire token.
+ */
+
+static struct xlator jool;
+static struct sk_buff *skb4;
+static struct sk_buff *skb6;
+
+static bool allow(struct sk_buff *skb, unsigned int rate)
+{
+	jool.globals.icmp_error_rate = rate;
+	return icmp64_allow(&jool, skb);
+}
+
+static u32 credit(struct sk_buff *skb)
+{
+	return (u32)atomic64_read(get_bucket(&jool, skb));
+}
+
+/* Leaves @skb's bucket with @tokens tokens, last updated @ago jiffies ago. */
+static void set_bucket(struct sk_buff *skb, unsigned long ago, u32 tokens)
+{
+	atomic64_set(get_bucket(&jool, skb),
+			((u64)(u32)(jiffies - ago) << 32) | (tokens * RL_COST));
+}
+
+/* Rewinds the last update of @skb's bucket by @ticks jiffies. */
+static void rewind(struct sk_buff *skb, unsigned long ticks)
+{
+	atomic64_t *bucket = get_bucket(&jool, skb);
+	u64 old = atomic64_read(bucket);
+
+	atomic64_set(bucket, ((u64)((u32)(old >> 32) - (u32)ticks) << 32)
+			| (u32)old);
+}
+
+/* Returns how many of @attempts errors @skb's source was allowed. */
+static unsigned int spend(struct sk_buff *skb, unsigned int rate,
+		unsigned int attempts)
+{
+	unsigned int allowed = 0;
+
+	for (; attempts > 0; attempts--)
+		if (allow(skb, rate))
+			allowed++;
+
+	return allowed;
+}
+
+static bool test_burst(void)
+{
+	bool success = true;
+
+	set_bucket(skb4, 0, 5);
+	success &= ASSERT_UINT(5, spend(skb4, 5, 8), "IPv4 burst");
+	success &= ASSERT_UINT(0, spend(skb4, 5, 3), "IPv4 exhausted");
+
+	set_bucket(skb6, 0, 5);
+	success &= ASSERT_UINT(5, spend(skb6, 5, 8), "IPv6 burst");
+	success &= ASSERT_UINT(0, spend(skb6, 5, 3), "IPv6 exhausted");
+
+	/* A second of silence is a whole new burst. */
+	set_bucket(skb4, HZ, 0);
+	success &= ASSERT_UINT(5, spend(skb4, 5, 8), "Idle bucket");
+
+	return success;
+}
+
+static bool test_refill(void)
+{
+	bool success = true;
+
+	set_bucket(skb4, 0, 0);
+	success &= ASSERT_UINT(0, spend(skb4, 5, 1), "Empty");
+
+	/* 5 per second; a fifth of a second is worth one. */
+	rewind(skb4, HZ / 5);
+	success &= ASSERT_UINT(1, spend(skb4, 5, 3), "A fifth of a second");
+
+	/* Half a second is worth two and a half. */
+	set_bucket(skb4, HZ / 2, 0);
+	success &= ASSERT_UINT(2, spend(skb4, 5, 5), "Half a second");
+	success &= ASSERT_BOOL(true, credit(skb4) >= RL_COST / 2,
+			"The half is kept");
+
+	/* The refill saturates at one second's worth... */
+	set_bucket(skb4, 10 * HZ, 0);
+	success &= ASSERT_UINT(5, spend(skb4, 5, 8), "Ten seconds");
+	/* ...even if the credit was not empty to begin with. */
+	set_bucket(skb4, HZ, 4);
+	success &= ASSERT_UINT(5, spend(skb4, 5, 8), "Full bucket plus a second");
+
+	return success;
+}
+
+static bool test_disabled(void)
+{
+	s64 before;
+	bool success = true;
+
+	set_bucket(skb4, 0, 0);
+	before = atomic64_read(get_bucket(&jool, skb4));
+	success &= ASSERT_UINT(100, spend(skb4, 0, 100), "Rate zero");
+	success &= ASSERT_U64((u64)before,
+			(u64)atomic64_read(get_bucket(&jool, skb4)),
+			"Rate zero doesn't touch the bucket");
+
+	success &= ASSERT_BOOL(true, allow(NULL, 5), "NULL packet");
+
+	return success;
+}
+
+static bool test_max_rate(void)
+{
+	bool success = true;
+
+	/* Unclamped, RL_COST * UINT_MAX would overflow the credit. */
+	set_bucket(skb4, HZ, 0);
+	success &= ASSERT_BOOL(true, allow(skb4, UINT_MAX), "UINT_MAX");
+	success &= ASSERT_UINT((RL_MAX_RATE - 1) * RL_COST, credit(skb4),
+			"UINT_MAX credit");
+
+	set_bucket(skb4, HZ, 0);
+	success &= ASSERT_BOOL(true, allow(skb4, RL_MAX_RATE + 1),
+			"Max + 1");
+	success &= ASSERT_UINT((RL_MAX_RATE - 1) * RL_COST, credit(skb4),
+			"Max + 1 credit");
+
+	set_bucket(skb4, HZ, 0);
+	success &= ASSERT_BOOL(true, allow(skb4, RL_MAX_RATE), "Max");
+	success &= ASSERT_UINT((RL_MAX_RATE - 1) * RL_COST, credit(skb4),
+			"Max credit");
+
+	return success;
+}
+
+static bool test_ipv6_aggregation(void)
+{
+	struct sk_buff *same64, *other64;
+	bool success = true;
+
+	if (create_skb6_udp("2001:db8::ffff:ffff:ffff:1", 1234,
+			"64:ff9b::192.0.2.1", 80, 100, 32, &same64))
+		return false;
+	if (create_skb6_udp("2001:db8:0:1::1", 1234,
+			"64:ff9b::192.0.2.1", 80, 100, 32, &other64)) {
+		kfree_skb(same64);
+		return false;
+	}
+
+	success &= ASSERT_PTR(get_bucket(&jool, skb6),
+			get_bucket(&jool, same64), "Same /64, same bucket");
+
+	set_bucket(skb6, 0, 3);
+	success &= ASSERT_UINT(2, spend(skb6, 3, 2), "First address");
+	success &= ASSERT_UINT(1, spend(same64, 3, 3), "Same /64");
+	success &= ASSERT_UINT(0, spend(skb6, 3, 1), "First address, again");
+
+	/* Different /64s can still collide, but not by design. */
+	if (get_bucket(&jool, skb6) != get_bucket(&jool, other64)) {
+		set_bucket(other64, 0, 3);
+		success &= ASSERT_UINT(3, spend(other64, 3, 4), "Other /64");
+	} else {
+		log_debug("The /64s collided; skipping that part.");
+	}
+
+	kfree_skb(same64);
+	kfree_skb(other64);
+	return success;
+}
+
+/* Every instance meters its sources separately. */
+static bool test_instances(void)
+{
+	struct xlator other;
+	atomic64_t *bucket;
+	bool success = true;
+
+	memcpy(&other, &jool, sizeof(other));
+	strcpy(other.iname, "other");
+	other.globals.icmp_error_rate = 3;
+
+	bucket = get_bucket(&other, skb4);
+	if (bucket == get_bucket(&jool, skb4)) {
+		log_debug("The instances collided; skipping test.");
+		return true;
+	}
+
+	set_bucket(skb4, 0, 0);
+	atomic64_set(bucket, ((u64)(u32)jiffies << 32) | (3 * RL_COST));
+
+	success &= ASSERT_UINT(0, spend(skb4, 3, 1), "Drained instance");
+	success &= ASSERT_BOOL(true, icmp64_allow(&other, skb4),
+			"Same source, other instance");
+	success &= ASSERT_UINT(0, credit(skb4), "Drained instance untouched");
+
+	return success;
+}
+
+static int init(void)
+{
+	int error;
+
+	memset(&jool, 0, sizeof(jool));
+	strcpy(jool.iname, "test");
+
+	error = create_skb4_udp("192.0.2.1", 1234, "203.0.113.1", 80, 100, 32,
+			&skb4);
+	if (error)
+		return error;
+	error = create_skb6_udp("2001:db8::1", 1234, "64:ff9b::192.0.2.1", 80,
+			100, 32, &skb6);
+	if (error) {
+		kfree_skb(skb4);
+		return error;
+	}
+
+	return 0;
+}
+
+static void clean(void)
+{
+	kfree_skb(skb4);
+	kfree_skb(skb6);
+}
+
+int init_module(void)
+{
+	struct test_group test = {
+		.name = "ICMP error rate limit",
+		.init_fn = init,
+		.clean_fn = clean,
+	};
+
+	if (test_group_begin(&test))
+		return -EINVAL;
+
+	test_group_test(&test, test_burst, "Burst exhaustion");
+	test_group_test(&test, test_refill, "Refill");
+	test_group_test(&test, test_disabled, "Rate zero");
+	test_group_test(&test, test_max_rate, "Rate clamping");
+	test_group_test(&test, test_ipv6_aggregation, "IPv6 /64 aggregation");
+	test_group_test(&test, test_instances, "Per-instance buckets");
+
+	return test_group_end(&test);
+}
+
+void cleanup_module(void)
+{
+	/* No code. */
+}
@@ -0,0 +1,158 @@
+#include <linux/kernel.h>
+#include <linux/module.h>
+
+#include "framework/skb_generator.h"
+#include "framework/unit_test.h"
+#include "mod/common/steps/send_packet.c"
+
+MODULE_LICENSE(JOOL_LICENSE);
+MODULE_AUTHOR("Alberto Leiva");
+MODULE_DESCRIPTION("Send packet test.");
+
+/* See get_nexthop_mtu(). */
+#define MTU 1500
+/* Big enough to need segmentation, small enough for a linear skb. */
+#define PAYLOAD_LEN 4000
+
+struct dst_entry *route(struct net *ns, struct packet *pkt)
+{
+	broken_unit_call(__func__);
+	return NULL;
+}
+
+static struct xlation state;
+
+/*
+ * Prepares an IPv4 -> IPv6 translation whose outgoing packet is a TCP (or UDP,
+ * if @udp) GSO super-packet, segmented into @gso_size payload chunks.
+ * The incoming packet has DF set.
+ */
+static bool init_state(bool udp, unsigned short gso_size)
+{
+	struct sk_buff *skb;
+	struct skb_shared_info *shinfo;
+
+	xlation_init(&state, NULL);
+
+	if (create_skb4_tcp("192.0.2.1", 1234, "203.0.113.1", 80, 100, 64,
+			&skb))
+		return false;
+	state.in.skb = skb;
+	state.in.l3_proto = L3PROTO_IPV4;
+
+	if (udp
+			? create_skb6_udp("2001:db8::1", 1234, "64:ff9b::cb00:7101",
+					80, PAYLOAD_LEN, 64, &skb)
+			: create_skb6_tcp("2001:db8::1", 1234, "64:ff9b::cb00:7101",
+					80, PAYLOAD_LEN, 64, &skb)) {
+		kfree_skb(state.in.skb);
+		return false;
+	}
+	state.out.skb = skb;
+	state.out.l3_proto = L3PROTO_IPV6;
+	state.out.payload = skb_transport_header(skb) + (udp
+			? sizeof(struct udphdr)
+			: sizeof(struct tcphdr));
+
+	shinfo = skb_shinfo(skb);
+	shinfo->gso_size = gso_size;
+	shinfo->gso_type = udp ? SKB_GSO_UDP_L4 : SKB_GSO_TCPV6;
+	shinfo->gso_segs = DIV_ROUND_UP(PAYLOAD_LEN, gso_size);
+	return true;
+}
+
+static void clean_state(void)
+{
+	kfree_skb(state.in.skb);
+	kfree_skb(state.out.skb);
+}
+
+static bool assert_gso(unsigned short size, unsigned short segs, bool dodgy,
+		char *test)
+{
+	struct skb_shared_info *shinfo = skb_shinfo(state.out.skb);
+	bool success = true;
+
+	success &= ASSERT_UINT(size, shinfo->gso_size, "%s - gso_size", test);
+	success &= ASSERT_UINT(segs, shinfo->gso_segs, "%s - gso_segs", test);
+	success &= ASSERT_BOOL(dodgy, !!(shinfo->gso_type & SKB_GSO_DODGY),
+			"%s - dodgy", test);
+	return success;
+}
+
+static bool test_tcp(void)
+{
+	bool success = true;
+
+	/* Segments that still fit are left alone; gso_size is never grown. */
+	if (!init_state(false, 1400))
+		return false;
+	success &= ASSERT_VERDICT(CONTINUE, whine_if_too_big(&state),
+			"Fits - verdict");
+	success &= assert_gso(1400, 3, false, "Fits");
+	clean_state();
+
+	/* 1460 bytes of IPv4 payload no longer fit after the IPv6 header. */
+	if (!init_state(false, 1460))
+		return false;
+	success &= ASSERT_VERDICT(CONTINUE, whine_if_too_big(&state),
+			"Shrunk - verdict");
+	success &= assert_gso(MTU - sizeof(struct ipv6hdr)
+			- sizeof(struct tcphdr), 0, true, "Shrunk");
+	success &= ASSERT_UINT(SKB_GSO_TCPV6,
+			skb_shinfo(state.out.skb)->gso_type & SKB_GSO_TCPV6,
+			"Shrunk - gso_type");
+	clean_state();
+
+	return success;
+}
+
+#if LINUX_VERSION_AT_LEAST(4, 18, 0, 8, 0)
+static bool test_udp(void)
+{
+	bool success = true;
+
+	if (!init_state(true, 1400))
+		return false;
+	success &= ASSERT_VERDICT(CONTINUE, whine_if_too_big(&state),
+			"Fits - verdict");
+	success &= assert_gso(1400, 3, false, "Fits");
+	clean_state();
+
+	/* UDP segments are datagrams; they can't be cut. Packet Too Big. */
+	if (!init_state(true, 1460))
+		return false;
+	success &= ASSERT_VERDICT(DROP, whine_if_too_big(&state),
+			"Too big - verdict");
+	success &= ASSERT_UINT(ICMPERR_FRAG_NEEDED, state.result.icmp,
+			"Too big - ICMP error");
+	success &= ASSERT_UINT(MTU - 20, state.result.info,
+			"Too big - ICMP MTU");
+	success &= assert_gso(1460, 3, false, "Too big");
+	clean_state();
+
+	return success;
+}
+#endif
+
+int init_module(void)
+{
+	struct test_group test = {
+		.name = "Send packet",
+	};
+
+	if (test_group_begin(&test))
+		return -EINVAL;
+
+	test_group_test(&test, test_tcp, "TCP GSO");
+#if LINUX_VERSION_AT_LEAST(4, 18, 0, 8, 0)
+	test_group_test(&test, test_udp, "UDP GSO");
+#endif
+
+	return test_group_end(&test);
+}
+
+void cleanup_module(void)
+{
+	/* No code. */
+}
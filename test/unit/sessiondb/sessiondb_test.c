@@ -250,6 +250,204 @@ static bool simple_session(void)
 	return success;
 }
 
+static bool assert_summary(struct bib_add_summary *summary,
+		unsigned int added, unsigned int updated,
+		unsigned int collisions, char *test_name)
+{
+	bool success = true;
+
+	success &= ASSERT_UINT(added, summary->added, "%s - added",
+			test_name);
+	success &= ASSERT_UINT(updated, summary->updated, "%s - updated",
+			test_name);
+	success &= ASSERT_UINT(collisions, summary->collisions,
+			"%s - collisions", test_name);
+	success &= ASSERT_UINT(0, summary->failed, "%s - failed", test_name);
+	return success;
+}
+
+static bool bulk_session(void)
+{
+	struct session_entry batch[16];
+	struct bib_add_summary summary;
+	bool success = true;
+
+	/* Borrow the fixtures; the single version already proved them. */
+	if (!insert_test_sessions())
+		return false;
+	memcpy(batch, session_instances, sizeof(batch));
+	bib_flush(&jool);
+
+	memset(&summary, 0, sizeof(summary));
+	bib_add_sessions(&jool, batch, ARRAY_SIZE(batch), &summary);
+	success &= assert_summary(&summary, 16, 0, 0, "first");
+	success &= test_db();
+
+	/* Peers re-sending the same sessions is the normal case. */
+	memset(&summary, 0, sizeof(summary));
+	bib_add_sessions(&jool, batch, ARRAY_SIZE(batch), &summary);
+	success &= assert_summary(&summary, 0, 16, 0, "again");
+	success &= test_db();
+
+	/* Same IPv6 side, different mask: We're out of sync with the peer. */
+	batch[0].src4.l4 = 3;
+	memset(&summary, 0, sizeof(summary));
+	bib_add_sessions(&jool, batch, 1, &summary);
+	success &= assert_summary(&summary, 0, 0, 1, "collision");
+	success &= test_db();
+
+	success &= flush();
+	return success;
+}
+
+/*
+ * The foreaches copy the tables in chunks of 64 (FOREACH_CHUNK), so the walk
+ * tests need more than that. The "page" is how many entries fit in one
+ * simulated dump skb; it's deliberately not a divisor of the chunk size.
+ */
+#define WALK_BIBS 100
+#define WALK_SESSIONS_PER_BIB 3
+#define WALK_SESSIONS (WALK_BIBS * WALK_SESSIONS_PER_BIB)
+#define WALK_PAGE 50
+
+/* Mimics the state handle_bib_dump() and handle_session_dump() keep. */
+struct walk_state {
+	unsigned int seen[WALK_SESSIONS];
+	unsigned int room; /* Entries left in the current "skb" */
+	bool offset_set;
+	struct ipv4_transport_addr src4;
+	struct ipv4_transport_addr dst4;
+};
+
+static struct walk_state walk;
+
+static bool inject_walk_sessions(void)
+{
+	struct session_entry entry;
+	unsigned int b, s;
+	int error;
+
+	memset(&entry, 0, sizeof(entry));
+	entry.proto = PROTO;
+	entry.state = ESTABLISHED;
+	entry.timer_type = SESSION_TIMER_EST;
+	entry.timeout = UDP_DEFAULT;
+
+	for (b = 0; b < WALK_BIBS; b++) {
+		for (s = 0; s < WALK_SESSIONS_PER_BIB; s++) {
+			init_src6(&entry.src6, 1, b + 1);
+			init_dst6(&entry.dst6, 1, s + 1);
+			init_src4(&entry.src4, 1, b + 1);
+			init_dst4(&entry.dst4, 1, s + 1);
+			entry.update_time = jiffies;
+
+			error = bib_add_session(&jool, &entry, NULL);
+			if (error) {
+				log_err("Errcode %d on bib_add_session().", error);
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+static int walk_bib_cb(struct bib_entry const *bib, void *arg)
+{
+	if (walk.room == 0)
+		return 1; /* "skb" full; the entry is not consumed. */
+
+	walk.room--;
+	walk.seen[bib->addr4.l4 - 1]++;
+	walk.src4 = bib->addr4;
+	walk.offset_set = true;
+	return 0;
+}
+
+static int walk_session_cb(struct session_entry const *session, void *arg)
+{
+	if (walk.room == 0)
+		return 1;
+
+	walk.room--;
+	walk.seen[(session->src4.l4 - 1) * WALK_SESSIONS_PER_BIB
+			+ session->dst4.l4 - 1]++;
+	walk.src4 = session->src4;
+	walk.dst4 = session->dst4;
+	walk.offset_set = true;
+	return 0;
+}
+
+static bool assert_walk(unsigned int total, unsigned int calls,
+		unsigned int expected_calls, char *test_name)
+{
+	unsigned int i;
+	bool success = true;
+
+	for (i = 0; i < total; i++)
+		success &= ASSERT_UINT(1, walk.seen[i], "%s - entry %u",
+				test_name, i);
+	for (; i < WALK_SESSIONS; i++)
+		success &= ASSERT_UINT(0, walk.seen[i], "%s - entry %u",
+				test_name, i);
+	success &= ASSERT_UINT(expected_calls, calls, "%s - dump calls",
+			test_name);
+
+	return success;
+}
+
+/*
+ * Walks the tables the way the dumpits do: One foreach per "skb", each one
+ * resuming from the last entry the previous one managed to serialize.
+ */
+static bool chunked_foreach(void)
+{
+	struct session_foreach_offset offset;
+	unsigned int calls;
+	int error;
+	bool success = true;
+
+	if (!inject_walk_sessions())
+		return false;
+
+	memset(&walk, 0, sizeof(walk));
+	calls = 0;
+	do {
+		walk.room = WALK_PAGE;
+		error = bib_foreach(jool.nat64.bib, PROTO, walk_bib_cb, NULL,
+				walk.offset_set ? &walk.src4 : NULL);
+		calls++;
+	} while (error > 0 && calls <= WALK_BIBS);
+	success &= ASSERT_INT(0, error, "BIB walk result");
+	success &= assert_walk(WALK_BIBS, calls,
+			DIV_ROUND_UP(WALK_BIBS, WALK_PAGE), "BIB walk");
+
+	memset(&walk, 0, sizeof(walk));
+	calls = 0;
+	do {
+		walk.room = WALK_PAGE;
+		offset.offset.src = walk.src4;
+		offset.offset.dst = walk.dst4;
+		offset.include_offset = false;
+		error = bib_foreach_session(&jool, PROTO, walk_session_cb, NULL,
+				walk.offset_set ? &offset : NULL);
+		calls++;
+	} while (error > 0 && calls <= WALK_SESSIONS);
+	success &= ASSERT_INT(0, error, "Session walk result");
+	success &= assert_walk(WALK_SESSIONS, calls,
+			DIV_ROUND_UP(WALK_SESSIONS, WALK_PAGE), "Session walk");
+
+	/* One pass, no "skb" limits: The chunks must still line up. */
+	memset(&walk, 0, sizeof(walk));
+	walk.room = UINT_MAX;
+	error = bib_foreach_session(&jool, PROTO, walk_session_cb, NULL, NULL);
+	success &= ASSERT_INT(0, error, "Single session walk result");
+	success &= assert_walk(WALK_SESSIONS, 1, 1, "Single session walk");
+
+	success &= flush();
+	return success;
+}
+
 enum session_fate tcp_est_expire_cb(struct session_entry *session, void *arg)
 {
 	return FATE_RM;
@@ -279,6 +477,8 @@ int init_module(void)
 		return -EINVAL;
 
 	test_group_test(&test, simple_session, "Single Session");
+	test_group_test(&test, bulk_session, "Bulk Session");
+	test_group_test(&test, chunked_foreach, "Chunked foreach");
 
 	return test_group_end(&test);
 }
@@ -0,0 +1,101 @@
+#include <linux/kernel.h>
+#include <linux/module.h>
+
+#include "framework/unit_test.h"
+#include "mod/common/stats.c"
+
+MODULE_LICENSE(JOOL_LICENSE);
+MODULE_AUTHOR("Alberto Leiva");
+MODULE_DESCRIPTION("Stats test.");
+
+static struct jool_stats *stats;
+static __u64 result[JSTAT_COUNT];
+
+/*
+ * Asserts the next jstat_delta() reports @changed stats, @received6 new
+ * JSTAT_RECEIVED6s, and @sessions JSTAT_SESSIONS (a gauge).
+ */
+static bool assert_delta(int changed, __u64 received6, __u64 sessions,
+		char *test_name)
+{
+	bool success = true;
+
+	success &= ASSERT_INT(changed, jstat_delta(stats, result),
+			"%s - changed", test_name);
+	success &= ASSERT_U64(received6, result[JSTAT_RECEIVED6],
+			"%s - counter", test_name);
+	success &= ASSERT_U64(sessions, result[JSTAT_SESSIONS],
+			"%s - gauge", test_name);
+	return success;
+}
+
+static bool test_delta(void)
+{
+	bool success = true;
+
+	/* The first delta counts from the creation of the stats. */
+	jstat_add(stats, JSTAT_RECEIVED6, 5);
+	jstat_add(stats, JSTAT_SESSIONS, 3);
+	success &= assert_delta(2, 5, 3, "First");
+
+	/* Idle: the counters didn't grow, but the gauges are still there. */
+	success &= assert_delta(0, 0, 3, "Idle");
+
+	jstat_inc(stats, JSTAT_RECEIVED6);
+	jstat_dec(stats, JSTAT_SESSIONS);
+	success &= assert_delta(2, 1, 2, "Second");
+
+	/* A gauge going back to its old value still counts as a change. */
+	jstat_inc(stats, JSTAT_SESSIONS);
+	success &= assert_delta(1, 0, 3, "Gauge only");
+
+	return success;
+}
+
+static bool test_wraparound(void)
+{
+	bool success = true;
+
+	jstat_add(stats, JSTAT_RECEIVED6, 2);
+	success &= assert_delta(1, 2, 0, "Before the wrap");
+
+	/* Pretend the counter was about to wrap during the previous delta. */
+	stats->last[JSTAT_RECEIVED6] = ~0ULL;
+	jstat_inc(stats, JSTAT_RECEIVED6);
+	success &= assert_delta(1, 4, 0, "After the wrap");
+
+	return success;
+}
+
+static int init(void)
+{
+	stats = jstat_alloc();
+	return stats ? 0 : -ENOMEM;
+}
+
+static void clean(void)
+{
+	jstat_put(stats);
+}
+
+int init_module(void)
+{
+	struct test_group test = {
+		.name = "Stats",
+		.init_fn = init,
+		.clean_fn = clean,
+	};
+
+	if (test_group_begin(&test))
+		return -EINVAL;
+
+	test_group_test(&test, test_delta, "Stream deltas");
+	test_group_test(&test, test_wraparound, "Counter wraparound");
+
+	return test_group_end(&test);
+}
+
+void cleanup_module(void)
+{
+	/* No code. */
+}
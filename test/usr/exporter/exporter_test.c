@@ -0,0 +1,238 @@
+#include "usr/argp/exporter.c"
+
+#include <stdarg.h>
+
+/*
+ * OpenMetrics exporter test.
+ *
+ * The Netlink layer is faked: joolnl_stats_dump() reports the instances in
+ * @instances (unless @dump_error), and the stat metadata is the made-up table
+ * below.
+ */
+
+static unsigned int failures;
+
+#define CHECK(cond, ...) do {						\
+		if (!(cond)) {						\
+			fprintf(stderr, "Test failed: " __VA_ARGS__);	\
+			fprintf(stderr, "\n");				\
+			failures++;					\
+		}							\
+	} while (0)
+
+static struct joolnl_instance_stats instances[2];
+static size_t instance_count;
+static int dump_error;
+
+struct jool_result joolnl_stats_dump(struct joolnl_socket *sk,
+		joolnl_stats_dump_cb cb, void *args)
+{
+	struct jool_result result;
+	size_t i;
+
+	if (dump_error)
+		return result_from_error(dump_error, "Fake dump failure.");
+
+	for (i = 0; i < instance_count; i++) {
+		result = cb(&instances[i], args);
+		if (result.error)
+			return result;
+	}
+
+	return result_success();
+}
+
+struct joolnl_stat_metadata const *joolnl_stat_meta(enum jool_stat_id id)
+{
+	static char names[JSTAT_COUNT][32];
+	static struct joolnl_stat_metadata metas[JSTAT_COUNT];
+
+	metas[id].id = id;
+	metas[id].name = names[id];
+	switch (id) {
+	case JSTAT_RECEIVED6:
+		strcpy(names[id], "JSTAT_RECEIVED6");
+		metas[id].doc = "Packets \"received\"\\over IPv6.\nSo far.";
+		break;
+	case JSTAT_SESSIONS:
+		strcpy(names[id], "JSTAT_SESSIONS");
+		metas[id].doc = "Sessions.";
+		break;
+	default:
+		sprintf(names[id], "JSTAT_OTHER%u", id);
+		metas[id].doc = "Untested.";
+	}
+
+	return &metas[id];
+}
+
+int pr_result(struct jool_result *result)
+{
+	result_cleanup(result);
+	return 0;
+}
+
+void pr_err(const char *fmt, ...)
+{
+	/* No code. */
+}
+
+static void init_instance(size_t i, __u32 ns, char const *iname,
+		__u64 received6, __u64 sessions)
+{
+	memset(&instances[i], 0, sizeof(instances[i]));
+	instances[i].instance.ns = ns;
+	instances[i].instance.xf = XF_NETFILTER;
+	strcpy(instances[i].instance.iname, iname);
+	instances[i].stats[JSTAT_RECEIVED6] = received6;
+	instances[i].stats[JSTAT_SESSIONS] = sessions;
+}
+
+static void check_contains(struct page const *page, char const *expected,
+		char const *test)
+{
+	CHECK(strstr(page->text, expected) != NULL,
+			"%s: Missing:\n%s\nPage:\n%s", test, expected,
+			page->text);
+}
+
+static void test_metric_name(void)
+{
+	char name[64];
+
+	metric_name("JSTAT_RECEIVED6", name, sizeof(name));
+	CHECK(strcmp(name, "jool_received6") == 0, "Name 1: %s", name);
+	metric_name("JSTAT64_TTL", name, sizeof(name));
+	CHECK(strcmp(name, "jool_64_ttl") == 0, "Name 2: %s", name);
+	metric_name("JSTAT_BIB_ENTRIES", name, sizeof(name));
+	CHECK(strcmp(name, "jool_bib_entries") == 0, "Name 3: %s", name);
+}
+
+static void test_render(void)
+{
+	struct snapshot snapshot = { 0 };
+	struct snapshot scratch = { 0 };
+	struct page page = { 0 };
+
+	page.capacity = 16; /* Forces page_printf() to grow it. */
+	page.text = malloc(page.capacity);
+	if (!page.text) {
+		CHECK(false, "Out of memory.");
+		return;
+	}
+
+	init_instance(0, 0x2a, "default", 100, 7);
+	init_instance(1, 0x2b, "we\"ird\\", 5, 0);
+	instance_count = 2;
+	dump_error = 0;
+
+	CHECK(refresh(NULL, &snapshot, &scratch, &page, "NAT64") == 0,
+			"Refresh 1");
+	CHECK(strlen(page.text) == page.len, "Length");
+	check_contains(&page, "# TYPE jool_up gauge\n", "Up type");
+	check_contains(&page, "\njool_up 1\n", "Up");
+
+	/* Counters get _total; the samples of each family are together. */
+	check_contains(&page, "# TYPE jool_received6 counter\n"
+			"# HELP jool_received6 Packets \\\"received\\\"\\\\over IPv6.\\nSo far.\n"
+			"jool_received6_total{namespace=\"0000002a\",xlator=\"NAT64\",jool_instance=\"default\"} 100\n"
+			"jool_received6_total{namespace=\"0000002b\",xlator=\"NAT64\",jool_instance=\"we\\\"ird\\\\\"} 5\n"
+			"# TYPE ", "Counter");
+	check_contains(&page, "# TYPE jool_sessions gauge\n"
+			"# HELP jool_sessions Sessions.\n"
+			"jool_sessions{namespace=\"0000002a\",xlator=\"NAT64\",jool_instance=\"default\"} 7\n"
+			"jool_sessions{namespace=\"0000002b\",xlator=\"NAT64\",jool_instance=\"we\\\"ird\\\\\"} 0\n"
+			"# TYPE ", "Gauge");
+	CHECK(page.len >= 6 && strcmp(page.text + page.len - 6, "# EOF\n") == 0,
+			"EOF");
+
+	/* A failed poll serves the previous one, flagged as stale. */
+	dump_error = -EIO;
+	instances[0].stats[JSTAT_RECEIVED6] = 200;
+	CHECK(refresh(NULL, &snapshot, &scratch, &page, "NAT64") == 0,
+			"Refresh 2");
+	check_contains(&page, "\njool_up 0\n", "Stale up");
+	check_contains(&page, "jool_instance=\"default\"} 100\n", "Stale");
+
+	/* And the next successful one replaces it. */
+	dump_error = 0;
+	instance_count = 1;
+	CHECK(refresh(NULL, &snapshot, &scratch, &page, "NAT64") == 0,
+			"Refresh 3");
+	check_contains(&page, "\njool_up 1\n", "Recovered up");
+	check_contains(&page, "jool_instance=\"default\"} 200\n", "Recovered");
+	CHECK(strstr(page.text, "we\\\"ird") == NULL, "Removed instance");
+
+	free(snapshot.instances);
+	free(scratch.instances);
+	free(page.text);
+}
+
+/* Sends @request to serve(), and returns the response. */
+static char *scrape(struct page const *page, char const *request)
+{
+	static char response[4096];
+	ssize_t len;
+	int fds[2];
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds)) {
+		CHECK(false, "socketpair(): %s", strerror(errno));
+		return NULL;
+	}
+
+	send_all(fds[1], request, strlen(request));
+	serve(fds[0], page);
+	close(fds[0]);
+
+	len = recv(fds[1], response, sizeof(response) - 1, MSG_WAITALL);
+	close(fds[1]);
+	response[len > 0 ? len : 0] = '\0';
+	return response;
+}
+
+static void test_serve(void)
+{
+	struct page page;
+	char *response;
+
+	page.text = "jool_up 1\n# EOF\n";
+	page.len = strlen(page.text);
+	page.capacity = page.len + 1;
+
+	response = scrape(&page, "GET /metrics HTTP/1.1\r\nHost: x\r\n\r\n");
+	if (response) {
+		CHECK(strncmp(response, "HTTP/1.1 200 OK\r\n", 17) == 0,
+				"Metrics status: %s", response);
+		CHECK(strstr(response, "Content-Type: " CONTENT_TYPE "\r\n")
+				!= NULL, "Metrics type: %s", response);
+		CHECK(strstr(response, "Content-Length: 16\r\n") != NULL,
+				"Metrics length: %s", response);
+		CHECK(strstr(response, "\r\n\r\njool_up 1\n# EOF\n") != NULL,
+				"Metrics body: %s", response);
+	}
+
+	response = scrape(&page, "GET /other HTTP/1.1\r\n\r\n");
+	if (response)
+		CHECK(strncmp(response, "HTTP/1.1 404 ", 13) == 0,
+				"Not found: %s", response);
+
+	response = scrape(&page, "POST /metrics HTTP/1.1\r\n\r\n");
+	if (response)
+		CHECK(strncmp(response, "HTTP/1.1 405 ", 13) == 0,
+				"Not allowed: %s", response);
+}
+
+int main(void)
+{
+	test_metric_name();
+	test_render();
+	test_serve();
+
+	if (failures) {
+		fprintf(stderr, "%u test(s) failed.\n", failures);
+		return 1;
+	}
+
+	printf("Exporter test: OK.\n");
+	return 0;
+}